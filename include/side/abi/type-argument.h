@@ -68,6 +68,8 @@ struct side_arg_vla_visitor {
 } SIDE_PACKED;
 side_check_size(struct side_arg_vla_visitor, 32);
 
+struct side_arg_lazy;
+
 union side_arg_static {
 	/* Stack-copy basic types */
 	union side_bool_value bool_value;
@@ -84,6 +86,7 @@ union side_arg_static {
 	side_ptr_t(const struct side_arg_vec) side_vla;
 	/* Pointer to non-const structure. Content modified by libside. */
 	side_ptr_t(struct side_arg_vla_visitor) side_vla_visitor;
+	side_ptr_t(struct side_arg_lazy) side_lazy;
 
 	/* Gather basic types */
 	side_ptr_t(const void) side_bool_gather_ptr;
@@ -195,6 +198,26 @@ struct side_arg_optional {
 } SIDE_PACKED;
 side_check_size(struct side_arg_optional, 65);
 
+enum side_arg_lazy_state {
+	SIDE_ARG_LAZY_UNEVALUATED = 0,
+	SIDE_ARG_LAZY_EVALUATED,
+	SIDE_ARG_LAZY_ERROR,
+};
+
+/*
+ * Lazily evaluated argument. The value is computed by the lazy
+ * function of the type description the first time a tracer reads it
+ * (see side_arg_lazy_value()), and cached for the other callbacks of
+ * the same event.
+ */
+struct side_arg_lazy {
+	side_ptr_t(void) app_ctx;
+	/* libside argument cache, initialize to SIDE_ARG_LAZY_UNEVALUATED. */
+	struct side_arg value;
+	side_enum_t(enum side_arg_lazy_state, uint8_t) state;
+} SIDE_PACKED;
+side_check_size(struct side_arg_lazy, 81);
+
 struct side_arg_vec {
 	side_ptr_t(const struct side_arg) sav;
 	uint32_t len;
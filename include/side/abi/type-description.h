@@ -152,6 +152,9 @@ enum side_type_label {
 	SIDE_TYPE_DYNAMIC_VLA,
 	SIDE_TYPE_DYNAMIC_VLA_VISITOR,
 
+	/* Stack-copy lazily evaluated type */
+	SIDE_TYPE_LAZY,
+
 	_NR_SIDE_TYPE_LABEL,	/* Last entry. */
 };
 
@@ -257,6 +260,13 @@ struct side_type_vla_visitor {
 } SIDE_PACKED;
 side_check_size(struct side_type_vla_visitor, 68);
 
+struct side_type_lazy {
+	side_ptr_t(const struct side_type) value_type;
+	side_func_ptr_t(side_lazy_func) func;
+	side_array_t(const struct side_attr) attributes;
+} SIDE_PACKED;
+side_check_size(struct side_type_lazy, 52);
+
 struct side_type_enum {
 	side_ptr_t(const struct side_enum_mappings) mappings;
 	side_ptr_t(const struct side_type) elem_type;
@@ -369,6 +379,7 @@ struct side_type {
 		side_ptr_t(const struct side_type_struct) side_struct;
 		side_ptr_t(const struct side_type_variant) side_variant;
 		side_ptr_t(const struct side_type_optional) side_optional;
+		side_ptr_t(const struct side_type_lazy) side_lazy;
 
 		/* Stack-copy enumeration types */
 		struct side_type_enum side_enum;
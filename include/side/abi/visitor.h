@@ -36,13 +36,37 @@ enum side_visitor_status {
 typedef enum side_visitor_status (*side_write_elem_func)(
 		const struct side_tracer_visitor_ctx *tracer_ctx,
 		const struct side_arg *elem);
+typedef enum side_visitor_status (*side_write_elems_func)(
+		const struct side_tracer_visitor_ctx *tracer_ctx,
+		const struct side_arg *elems, uint32_t nr_elems);
+/*
+ * Write nr_elems bool, byte, integer, pointer or float elements of the
+ * type of the proto argument, whose value is ignored. The first value
+ * is at base and each following one stride bytes further, in the
+ * representation of the type (e.g. a uint32_t for side_arg_u32()).
+ */
+typedef enum side_visitor_status (*side_write_scalars_func)(
+		const struct side_tracer_visitor_ctx *tracer_ctx,
+		const struct side_arg *proto, const void *base, size_t stride,
+		uint32_t nr_elems);
 typedef enum side_visitor_status (*side_visitor_func)(
 		const struct side_tracer_visitor_ctx *tracer_ctx,
 		void *app_ctx);
 
+/*
+ * Compute the value of a lazily evaluated argument into value. The
+ * value, and the storage it points to, must stay valid until the end
+ * of the event call.
+ */
+typedef enum side_visitor_status (*side_lazy_func)(void *app_ctx,
+		struct side_arg *value);
+
 struct side_tracer_visitor_ctx {
 	side_write_elem_func write_elem;
 	void *priv;		/* Private tracer context. */
+	/* Batched forms of write_elem. */
+	side_write_elems_func write_elems;
+	side_write_scalars_func write_scalars;
 };
 
 typedef enum side_visitor_status (*side_write_field_func)(
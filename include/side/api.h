@@ -566,13 +566,32 @@
 #define side_field_vla_visitor _side_field_vla_visitor
 #define side_arg_vla_visitor(...) _side_arg_vla_visitor(__VA_ARGS__)
 
+/* Lazily evaluated field. */
+#define side_define_static_lazy(_identifier, _value_type, _func, _type, _attr...) \
+	static enum side_visitor_status _side_lazy_func_##_identifier(void *_side_ctx, \
+					     struct side_arg *_side_value) \
+	{								\
+		return _func((_type *)_side_ctx, _side_value);		\
+	}								\
+	static const struct side_type_lazy _identifier =		\
+		_side_type_lazy_define(SIDE_PARAM(_value_type),		\
+				       _side_lazy_func_##_identifier,	\
+				       SIDE_DEFAULT_ATTR(_, ##_attr, side_attr_list()));
+
+#define side_arg_define_lazy _side_arg_define_lazy
+
+#define side_type_lazy(...) _side_type_lazy(__VA_ARGS__)
+
+#define side_field_lazy _side_field_lazy
+#define side_arg_lazy(...) _side_arg_lazy(__VA_ARGS__)
+
 
 /* Event. */
 #define side_event_call(_identifier, _sav)		\
-	_side_event_call(side_call, _identifier, SIDE_PARAM(_sav))
+	_side_event_call(side_call_v0, _identifier, SIDE_PARAM(_sav))
 
 #define side_event_call_variadic(_identifier, _sav, _var_fields, _attr...) \
-	_side_event_call_variadic(side_call_variadic, _identifier,	\
+	_side_event_call_variadic(side_call_variadic_v0, _identifier,	\
 				  SIDE_PARAM(_sav), SIDE_PARAM(_var_fields), \
 				  SIDE_DEFAULT_ATTR(_, ##_attr, side_dynamic_attr_list()))
 
@@ -716,6 +716,23 @@ enum {
 #define _side_field_vla_visitor(_name, _vla_visitor) \
 	_side_field(_name, _side_type_vla_visitor(SIDE_PARAM(_vla_visitor)))
 
+#define _side_type_lazy_define(_value_type, _func, _attr...) \
+	{ \
+		.value_type = SIDE_PTR_INIT(_value_type), \
+		.func = SIDE_PTR_INIT(_func), \
+		.attributes = SIDE_DEFAULT_ATTR(_, ##_attr, side_attr_list()), \
+	}
+
+#define _side_type_lazy(_lazy) \
+	{ \
+		.type = SIDE_ENUM_INIT(SIDE_TYPE_LAZY), \
+		.u = { \
+			.side_lazy = SIDE_PTR_INIT(&_lazy), \
+		}, \
+	}
+#define _side_field_lazy(_name, _lazy) \
+	_side_field(_name, _side_type_lazy(SIDE_PARAM(_lazy)))
+
 /* Gather field and type definitions */
 
 #define _side_type_gather_byte(_offset, _access_mode, _attr...) \
@@ -1106,6 +1123,24 @@ enum {
 		.cached_arg = SIDE_PTR_INIT(NULL), \
 	}
 
+#define _side_arg_lazy(_side_lazy) \
+	{ \
+		.type = SIDE_ENUM_INIT(SIDE_TYPE_LAZY), \
+		.flags = 0, \
+		.u = { \
+			.side_static = { \
+				.side_lazy = SIDE_PTR_INIT(&_side_lazy), \
+			 } \
+		 } \
+	}
+
+#define _side_arg_define_lazy(_identifier, _ctx) \
+	struct side_arg_lazy _identifier = { \
+		.app_ctx = SIDE_PTR_INIT(_ctx), \
+		.value = _side_arg_null(), \
+		.state = SIDE_ENUM_INIT(SIDE_ARG_LAZY_UNEVALUATED), \
+	}
+
 /* Gather field arguments */
 
 #define _side_arg_gather_bool(_ptr)		{ .type = SIDE_ENUM_INIT(SIDE_TYPE_GATHER_BOOL), .flags = 0, .u = { .side_static = { .side_bool_gather_ptr = SIDE_PTR_INIT(_ptr) } } }
@@ -1422,17 +1457,133 @@ enum {
 
 #define _side_arg_list(...)	__VA_ARGS__
 
-#define side_event_enabled(_identifier) \
-	side_unlikely(__atomic_load_n(&side_event_state__##_identifier.enabled, \
-					__ATOMIC_RELAXED))
+/*
+ * Events with a sampling policy are only kept if side_event_sample()
+ * agrees, before their arguments are built.
+ */
+#define _side_event_enabled_load(_identifier) \
+	__extension__ ({						\
+		uintptr_t side_enabled_state =				\
+			__atomic_load_n(&side_event_state__##_identifier.enabled, \
+					__ATOMIC_RELAXED);		\
+		side_unlikely(side_enabled_state) &&			\
+			(side_likely(!(side_enabled_state & SIDE_EVENT_ENABLED_SAMPLING_MASK)) || \
+			 side_event_sample(&side_event_state__##_identifier.parent)); \
+	})
+
+/*
+ * Static keys: when SIDE_STATIC_KEYS is defined before including the
+ * side headers, each side_event_enabled() site starts with a 5-byte
+ * jump to the portable enabled state load, recorded in the
+ * "side_jump_entry" section. libside patches the jump into a NOP
+ * while the event is disabled, and back into a jump when a tracer
+ * enables it. If libside cannot patch the code, the jump stays in
+ * place and the site behaves as the portable load.
+ *
+ * The jump is aligned on 8 bytes so it never crosses a cache line
+ * while it is patched. The entry refers to the event state through a
+ * local pointer, because the address of an event state exported from
+ * a shared object cannot be used as an immediate asm operand. Only
+ * supported on x86-64, other architectures use the portable load.
+ */
+#if defined(SIDE_STATIC_KEYS) && defined(__x86_64__) && defined(__GNUC__)
+# define SIDE_JUMP_ENTRY_SECTION	"side_jump_entry"
+# define side_event_enabled(_identifier) \
+	__extension__ ({						\
+		__label__ side_l_check, side_l_out;			\
+		static struct side_event_state * const side_key_ref =	\
+			&side_event_state__##_identifier.parent;	\
+		bool side_enabled = false;				\
+		__asm__ goto (						\
+			".balign 8\n\t"					\
+			"1:\n\t"						\
+			".byte 0xe9\n\t"				\
+			".long %l[side_l_check] - 2f\n\t"		\
+			"2:\n\t"						\
+			".pushsection " SIDE_JUMP_ENTRY_SECTION ", \"aw\"\n\t" \
+			".balign 8\n\t"					\
+			".quad 1b, %l[side_l_check], %c0\n\t"		\
+			".popsection\n\t"				\
+			: : "i" (&side_key_ref) : : side_l_check);	\
+		goto side_l_out;					\
+	side_l_check:							\
+		side_enabled = _side_event_enabled_load(_identifier);	\
+	side_l_out:							\
+		side_enabled;						\
+	})
+#else
+# define side_event_enabled(_identifier) \
+	_side_event_enabled_load(_identifier)
+#endif
+
+/*
+ * USDT probes: when SIDE_USDT is defined before including the side
+ * headers, each event instrumentation site emits a stapsdt note in the
+ * ".note.stapsdt" section, which bpftrace, perf and SystemTap list as
+ * probe "side:<identifier>". The probe arguments are the event
+ * description, the struct side_arg_vec and the variadic struct
+ * side_arg_dynamic_struct (NULL for non-variadic events).
+ *
+ * The probe semaphore is SIDE_EVENT_ENABLED_USDT_MASK within the event
+ * enabled state, so attaching a uprobe to the probe enables the event
+ * site, and a detached probe leaves the disabled event check as it is.
+ * The semaphore refers to the event state by symbol name, so the
+ * probe site must be linked in the same executable or shared object as
+ * the event definition. Sites patched into NOPs by SIDE_STATIC_KEYS do
+ * not observe the semaphore. Only supported on 64-bit x86 and ARM ELF
+ * targets.
+ */
+#if defined(SIDE_USDT) && SIDE_BITS_PER_LONG == 64 && defined(__GNUC__) && \
+	defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+# define _side_usdt_state_label(_identifier) \
+	__asm__("side_event_state__" #_identifier)
+# define _side_usdt_probe(_identifier, _sav, _var) \
+	__asm__ __volatile__ (						\
+		"990:\n\t"						\
+		"nop\n\t"						\
+		".pushsection .note.stapsdt, \"?\", \"note\"\n\t"	\
+		".balign 4\n\t"						\
+		".4byte 992f-991f, 994f-993f, 3\n\t"			\
+		"991:\n\t"						\
+		".asciz \"stapsdt\"\n\t"				\
+		"992:\n\t"						\
+		".balign 4\n\t"						\
+		"993:\n\t"						\
+		".8byte 990b\n\t"					\
+		".8byte _.stapsdt.base\n\t"				\
+		".8byte side_event_state__" #_identifier "+%c[off]\n\t"	\
+		".asciz \"side\"\n\t"					\
+		".asciz \"" #_identifier "\"\n\t"			\
+		".asciz \"8@%[desc] 8@%[sav] 8@%[var]\"\n\t"		\
+		"994:\n\t"						\
+		".balign 4\n\t"						\
+		".popsection\n\t"					\
+		".ifndef _.stapsdt.base\n\t"				\
+		".pushsection .stapsdt.base, \"aG\", \"progbits\", .stapsdt.base, comdat\n\t" \
+		".weak _.stapsdt.base\n\t"				\
+		".hidden _.stapsdt.base\n\t"				\
+		"_.stapsdt.base:\n\t"					\
+		".space 1\n\t"						\
+		".size _.stapsdt.base, 1\n\t"				\
+		".popsection\n\t"					\
+		".endif\n\t"						\
+		: : [off] "i" (offsetof(struct side_event_state_0, enabled) + \
+				SIDE_EVENT_ENABLED_USDT_OFFSET),	\
+			[desc] "r" (&(_identifier)),			\
+			[sav] "r" (_sav),				\
+			[var] "r" (_var))
+#else
+# define _side_usdt_state_label(_identifier)
+# define _side_usdt_probe(_identifier, _sav, _var)
+#endif
 
 #define _side_event(_identifier, _sav)					\
 	if (side_event_enabled(_identifier))				\
-		_side_event_call(side_call, _identifier, SIDE_PARAM(_sav))
+		_side_event_call(side_call_v0, _identifier, SIDE_PARAM(_sav))
 
 #define _side_event_variadic(_identifier, _sav, _var, _attr...) \
 	if (side_event_enabled(_identifier))				\
-		_side_event_call_variadic(side_call_variadic, _identifier, \
+		_side_event_call_variadic(side_call_variadic_v0, _identifier, \
 					SIDE_PARAM(_sav), SIDE_PARAM(_var), \
 					SIDE_DEFAULT_ATTR(_, ##_attr, side_dynamic_attr_list()))
 
@@ -1443,6 +1594,7 @@ enum {
 			.sav = SIDE_PTR_INIT(side_sav), \
 			.len = SIDE_ARRAY_SIZE(side_sav), \
 		}; \
+		_side_usdt_probe(_identifier, &side_arg_vec, (const void *) 0); \
 		_call(&(side_event_state__##_identifier).parent, &side_arg_vec); \
 	}
 
@@ -1459,6 +1611,7 @@ enum {
 			.len = SIDE_ARRAY_SIZE(side_fields), \
 			.attributes = SIDE_DEFAULT_ATTR(_, ##_attr, side_dynamic_attr_list()), \
 		}; \
+		_side_usdt_probe(_identifier, &side_arg_vec, &var_struct); \
 		_call(&(side_event_state__##_identifier.parent), &side_arg_vec, &var_struct); \
 	}
 
@@ -1510,9 +1663,9 @@ enum {
 	_forward_decl_linkage struct side_event_description __attribute__((section("side_event_description"))) \
 		_identifier;							\
 	_forward_decl_linkage struct side_event_state_0 __attribute__((section("side_event_state"))) \
-		side_event_state__##_identifier;				\
+		side_event_state__##_identifier _side_usdt_state_label(_identifier); \
 	_linkage struct side_event_state_0 __attribute__((section("side_event_state"))) \
-		side_event_state__##_identifier = {			\
+		side_event_state__##_identifier _side_usdt_state_label(_identifier) = { \
 		.parent = {						\
 			.version = SIDE_EVENT_STATE_ABI_VERSION,	\
 		},							\
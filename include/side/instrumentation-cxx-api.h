@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2022 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef SIDE_INSTRUMENTATION_CXX_API_H
+#define SIDE_INSTRUMENTATION_CXX_API_H
+
+#include <side/trace.h>
+
+#if !defined(__cplusplus) || (__cplusplus < 201703L)
+# error "side/instrumentation-cxx-api.h requires C++17"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/*
+ * C++ instrumentation API
+ *
+ * Event fields are described by the C++ types of their arguments. The
+ * field descriptions are built at compile time into read-only storage,
+ * and each argument is stored into the argument vector with its label
+ * and value only:
+ *
+ * side_cxx_static_event(my_event, "myprovider", "myevent", SIDE_LOGLEVEL_INFO,
+ * 	libside::field<uint32_t>("id"),
+ * 	libside::field<const char *>("name"),
+ * 	libside::field<double>("ratio"));
+ *
+ * side_cxx_event(my_event, id, name, 0.5);
+ *
+ * The arguments are converted to the field types, so a call site with
+ * the wrong number of arguments or with arguments not convertible to
+ * the field types does not compile.
+ *
+ * Supported field types are bool, integers, enumerations (described
+ * as their underlying integer type), float, double, C strings
+ * (const char *, described as UTF-8 strings) and other pointers.
+ * Other types can be described by specializing libside::type_traits,
+ * with a constexpr type() member returning their struct side_type and
+ * an arg() member returning their struct side_arg.
+ *
+ * Events are static to the translation unit and have no attributes.
+ * Variadic events and compound types are described with the C API.
+ */
+
+namespace libside {
+
+	template <typename T, typename Enable = void>
+	struct type_traits;
+
+	namespace detail {
+
+		template <typename T>
+		struct dependent_false : std::false_type {};
+
+		template <typename T>
+		constexpr enum side_type_label integer_label()
+		{
+			constexpr bool s = std::is_signed<T>::value;
+
+			if constexpr (sizeof(T) == 1)
+				return s ? SIDE_TYPE_S8 : SIDE_TYPE_U8;
+			else if constexpr (sizeof(T) == 2)
+				return s ? SIDE_TYPE_S16 : SIDE_TYPE_U16;
+			else if constexpr (sizeof(T) == 4)
+				return s ? SIDE_TYPE_S32 : SIDE_TYPE_U32;
+			else if constexpr (sizeof(T) == 8)
+				return s ? SIDE_TYPE_S64 : SIDE_TYPE_U64;
+#ifdef __SIZEOF_INT128__
+			else if constexpr (sizeof(T) == 16)
+				return s ? SIDE_TYPE_S128 : SIDE_TYPE_U128;
+#endif
+			else
+				static_assert(dependent_false<T>::value, "Unsupported integer size");
+		}
+
+		constexpr struct side_type integer_type(enum side_type_label label,
+				uint16_t size, bool is_signed)
+		{
+			return {
+				.type = SIDE_ENUM_INIT(label),
+				.u = {
+					.side_integer = {
+						.attributes = { SIDE_PTR_INIT(nullptr), 0 },
+						.integer_size = size,
+						.len_bits = 0,
+						.signedness = is_signed,
+						.byte_order = SIDE_ENUM_INIT(SIDE_TYPE_BYTE_ORDER_HOST),
+					},
+				},
+			};
+		}
+
+		/* Only the label and the value are stored. */
+		template <typename T>
+		inline struct side_arg integer_arg(T v)
+		{
+			struct side_arg arg;
+
+			arg.type.v = integer_label<T>();
+			arg.flags = 0;
+			if constexpr (sizeof(T) == 1) {
+				if constexpr (std::is_signed<T>::value)
+					arg.u.side_static.integer_value.side_s8 = v;
+				else
+					arg.u.side_static.integer_value.side_u8 = v;
+			} else if constexpr (sizeof(T) == 2) {
+				if constexpr (std::is_signed<T>::value)
+					arg.u.side_static.integer_value.side_s16 = v;
+				else
+					arg.u.side_static.integer_value.side_u16 = v;
+			} else if constexpr (sizeof(T) == 4) {
+				if constexpr (std::is_signed<T>::value)
+					arg.u.side_static.integer_value.side_s32 = v;
+				else
+					arg.u.side_static.integer_value.side_u32 = v;
+			} else if constexpr (sizeof(T) == 8) {
+				if constexpr (std::is_signed<T>::value)
+					arg.u.side_static.integer_value.side_s64 = v;
+				else
+					arg.u.side_static.integer_value.side_u64 = v;
+#ifdef __SIZEOF_INT128__
+			} else {
+				if constexpr (std::is_signed<T>::value)
+					arg.u.side_static.integer_value.side_s128 = v;
+				else
+					arg.u.side_static.integer_value.side_u128 = v;
+#endif
+			}
+			return arg;
+		}
+	};
+
+	template <typename T>
+	struct type_traits<T, typename std::enable_if<std::is_integral<T>::value &&
+			!std::is_same<T, bool>::value>::type> {
+		static constexpr struct side_type type()
+		{
+			return detail::integer_type(detail::integer_label<T>(),
+					sizeof(T), std::is_signed<T>::value);
+		}
+
+		static inline struct side_arg arg(T v)
+		{
+			return detail::integer_arg<T>(v);
+		}
+	};
+
+	template <typename T>
+	struct type_traits<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+		using underlying = typename std::underlying_type<T>::type;
+
+		static constexpr struct side_type type()
+		{
+			return type_traits<underlying>::type();
+		}
+
+		static inline struct side_arg arg(T v)
+		{
+			return type_traits<underlying>::arg(static_cast<underlying>(v));
+		}
+	};
+
+	template <>
+	struct type_traits<bool> {
+		static constexpr struct side_type type()
+		{
+			return {
+				.type = SIDE_ENUM_INIT(SIDE_TYPE_BOOL),
+				.u = {
+					.side_bool = {
+						.attributes = { SIDE_PTR_INIT(nullptr), 0 },
+						.bool_size = sizeof(uint8_t),
+						.len_bits = 0,
+						.byte_order = SIDE_ENUM_INIT(SIDE_TYPE_BYTE_ORDER_HOST),
+					},
+				},
+			};
+		}
+
+		static inline struct side_arg arg(bool v)
+		{
+			struct side_arg arg;
+
+			arg.type.v = SIDE_TYPE_BOOL;
+			arg.flags = 0;
+			arg.u.side_static.bool_value.side_bool8 = v;
+			return arg;
+		}
+	};
+
+	template <typename T>
+	struct type_traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+		static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Unsupported floating point size");
+
+		static constexpr enum side_type_label label =
+			sizeof(T) == 4 ? SIDE_TYPE_FLOAT_BINARY32 : SIDE_TYPE_FLOAT_BINARY64;
+
+		static constexpr struct side_type type()
+		{
+			return {
+				.type = SIDE_ENUM_INIT(label),
+				.u = {
+					.side_float = {
+						.attributes = { SIDE_PTR_INIT(nullptr), 0 },
+						.float_size = sizeof(T),
+						.byte_order = SIDE_ENUM_INIT(SIDE_TYPE_FLOAT_WORD_ORDER_HOST),
+					},
+				},
+			};
+		}
+
+		static inline struct side_arg arg(T v)
+		{
+			struct side_arg arg;
+
+			arg.type.v = label;
+			arg.flags = 0;
+			if constexpr (sizeof(T) == 4)
+				arg.u.side_static.float_value.side_float_binary32 = v;
+			else
+				arg.u.side_static.float_value.side_float_binary64 = v;
+			return arg;
+		}
+	};
+
+	template <>
+	struct type_traits<const char *> {
+		static constexpr struct side_type type()
+		{
+			return {
+				.type = SIDE_ENUM_INIT(SIDE_TYPE_STRING_UTF8),
+				.u = {
+					.side_string = {
+						.attributes = { SIDE_PTR_INIT(nullptr), 0 },
+						.unit_size = sizeof(uint8_t),
+						.byte_order = SIDE_ENUM_INIT(SIDE_TYPE_BYTE_ORDER_HOST),
+					},
+				},
+			};
+		}
+
+		static inline struct side_arg arg(const char *v)
+		{
+			struct side_arg arg;
+
+			arg.type.v = SIDE_TYPE_STRING_UTF8;
+			arg.flags = 0;
+			side_ptr_set(arg.u.side_static.string_value, v);
+			return arg;
+		}
+	};
+
+	template <typename T>
+	struct type_traits<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+		static constexpr struct side_type type()
+		{
+			return detail::integer_type(SIDE_TYPE_POINTER, sizeof(uintptr_t), false);
+		}
+
+		static inline struct side_arg arg(T *v)
+		{
+			struct side_arg arg;
+
+			arg.type.v = SIDE_TYPE_POINTER;
+			arg.flags = 0;
+			arg.u.side_static.integer_value.side_uptr = reinterpret_cast<uintptr_t>(v);
+			return arg;
+		}
+	};
+
+	/* Field of type T, named by a string literal. */
+	template <typename T>
+	struct field {
+		const char *name;
+
+		constexpr explicit field(const char *_name) : name(_name) {}
+	};
+
+	template <typename... T>
+	struct event_fields {
+		static constexpr uint32_t nr_fields = sizeof...(T);
+
+		/* Arrays cannot be empty: an event without fields keeps one unused element. */
+		struct side_event_field fields[sizeof...(T) ? sizeof...(T) : 1];
+	};
+
+	template <typename T>
+	constexpr struct side_event_field describe_field(field<T> f)
+	{
+		return {
+			.field_name = SIDE_PTR_INIT(f.name),
+			.side_type = type_traits<T>::type(),
+		};
+	}
+
+	template <typename... T>
+	constexpr event_fields<T...> make_fields(field<T>... f)
+	{
+		if constexpr (sizeof...(T) == 0)
+			return { { } };
+		else
+			return { { describe_field(f)... } };
+	}
+
+	template <typename... T, typename... Args>
+	inline void event_call(const event_fields<T...> &, const struct side_event_state *state,
+			Args&&... args)
+	{
+		static_assert(sizeof...(Args) == sizeof...(T),
+			"Number of arguments does not match the event fields");
+
+		if constexpr (sizeof...(T) == 0) {
+			const struct side_arg_vec side_arg_vec = {
+				.sav = SIDE_PTR_INIT(nullptr),
+				.len = 0,
+			};
+
+			side_call_v0(state, &side_arg_vec);
+		} else {
+			const struct side_arg side_sav[] = {
+				type_traits<T>::arg(std::forward<Args>(args))...
+			};
+			const struct side_arg_vec side_arg_vec = {
+				.sav = SIDE_PTR_INIT(side_sav),
+				.len = sizeof...(T),
+			};
+
+			side_call_v0(state, &side_arg_vec);
+		}
+	}
+};
+
+/*
+ * Define a static event whose fields are described by a list of
+ * libside::field<T>("name").
+ */
+#define side_cxx_static_event(_identifier, _provider, _event, _loglevel, ...) \
+	namespace {							\
+		constexpr auto side_cxx_fields__##_identifier =		\
+			libside::make_fields(__VA_ARGS__);		\
+	}								\
+	_side_static_event(_identifier, _provider, _event, _loglevel,	\
+			SIDE_PARAM({ SIDE_PTR_INIT(side_cxx_fields__##_identifier.fields), \
+				side_cxx_fields__##_identifier.nr_fields }))
+
+#define side_cxx_event_call(_identifier, ...)				\
+	libside::event_call(side_cxx_fields__##_identifier,		\
+			&(side_event_state__##_identifier).parent, ##__VA_ARGS__)
+
+#define side_cxx_event(_identifier, ...)				\
+	if (side_event_enabled(_identifier))				\
+		side_cxx_event_call(_identifier, ##__VA_ARGS__)
+
+#endif /* SIDE_INSTRUMENTATION_CXX_API_H */
@@ -1811,6 +1811,15 @@ SIDE_SC_DEFINE_TYPE(optional);
 #define SIDE_SC_CHECK_side_arg_vla_visitor(_identifier) ,SIDE_SC_TYPE(user_arg_define_vla_visitor__##_identifier)
 #define SIDE_SC_EMIT_side_arg_vla_visitor _side_arg_vla_visitor
 
+/* Dispatch: lazy */
+#undef side_field_lazy
+#define SIDE_SC_CHECK_side_field_lazy(_name, _identifier) ,SIDE_SC_TYPE(user_define_lazy__##_identifier) *
+#define SIDE_SC_EMIT_side_field_lazy _side_field_lazy
+
+#undef side_arg_lazy
+#define SIDE_SC_CHECK_side_arg_lazy(_identifier) ,SIDE_SC_TYPE(user_arg_define_lazy__##_identifier)
+#define SIDE_SC_EMIT_side_arg_lazy _side_arg_lazy
+
 /* Dispatch: enum */
 #undef side_field_enum
 #define SIDE_SC_CHECK_side_field_enum(_name, _mappings, _elem) SIDE_SC_CHECK_##_elem
@@ -2120,6 +2129,10 @@ SIDE_SC_DEFINE_TYPE(dynamic);
 #undef side_type_vla_visitor
 #define SIDE_SC_EMIT_side_type_vla_visitor _side_type_vla_visitor
 
+/* Dispatch: type_lazy */
+#undef side_type_lazy
+#define SIDE_SC_EMIT_side_type_lazy _side_type_lazy
+
 /* Dispatch: type_pointer */
 #undef side_type_pointer
 #define SIDE_SC_CHECK_side_type_pointer(...) ,SIDE_SC_TYPE(pointer)
@@ -2705,16 +2718,40 @@ SIDE_SC_DEFINE_TYPE(dynamic);
 	typedef __typeof__(_ctx) SIDE_SC_TYPE(user_arg_define_vla_visitor__##_identifier); \
 				 SIDE_SC_END_DIAGNOSTIC()
 
+/* Dispatch: define_static_lazy */
+#undef side_define_static_lazy
+#define side_define_static_lazy(_identifier, _value_type, _func, _type, _attr...) \
+	static enum side_visitor_status _side_lazy_func_##_identifier(void *_side_ctx, \
+									struct side_arg *_side_value) \
+	{								\
+		return _func((_type *)_side_ctx, _side_value);		\
+	}								\
+	static const struct side_type_lazy _identifier =		\
+		_side_type_lazy_define(SIDE_SC_EMIT_##_value_type,	\
+				_side_lazy_func_##_identifier,		\
+				SIDE_DEFAULT_ATTR(_, ##_attr, side_attr_list())); \
+	SIDE_SC_BEGIN_DIAGNOSTIC();					\
+	typedef _type SIDE_SC_TYPE(user_define_lazy__##_identifier);	\
+	SIDE_SC_END_DIAGNOSTIC()
+
+/* Dispatch: arg_define_lazy */
+#undef side_arg_define_lazy
+#define side_arg_define_lazy(_identifier, _ctx)				\
+	_side_arg_define_lazy(_identifier, _ctx);			\
+	SIDE_SC_BEGIN_DIAGNOSTIC();					\
+	typedef __typeof__(_ctx) SIDE_SC_TYPE(user_arg_define_lazy__##_identifier); \
+	SIDE_SC_END_DIAGNOSTIC()
+
 /* Dispatch: event_call */
 #undef side_event_call
 #define side_event_call(_identifier, _sav)				\
-	_side_event_call(side_call, _identifier, SIDE_SC_EMIT_##_sav);	\
+	_side_event_call(side_call_v0, _identifier, SIDE_SC_EMIT_##_sav);	\
 	SIDE_SC_CHECK_EVENT_CALL(_identifier, _sav)
 
 /* Dispatch: event_call_variadic */
 #undef side_event_call_variadic
 #define side_event_call_variadic(_identifier, _sav, _var_fields, _attr...) \
-	_side_event_call_variadic(side_call_variadic, _identifier, SIDE_SC_EMIT_##_sav, SIDE_SC_EMIT_##_var_fields, \
+	_side_event_call_variadic(side_call_variadic_v0, _identifier, SIDE_SC_EMIT_##_sav, SIDE_SC_EMIT_##_var_fields, \
 				SIDE_DEFAULT_ATTR(_, ##_attr, side_dynamic_attr_list())); \
 	SIDE_SC_CHECK_EVENT_CALL_VARIADIC(_identifier, _sav)
 
@@ -2736,7 +2773,7 @@ SIDE_SC_DEFINE_TYPE(dynamic);
 #define side_event(_identifier, _sav)					\
 	do {								\
 		if (side_event_enabled(_identifier)) {			\
-			_side_event_call(side_call, _identifier, SIDE_SC_EMIT_##_sav); \
+			_side_event_call(side_call_v0, _identifier, SIDE_SC_EMIT_##_sav); \
 			SIDE_SC_CHECK_EVENT_CALL(_identifier, _sav);	\
 		}							\
 	} while(0)
@@ -2746,7 +2783,7 @@ SIDE_SC_DEFINE_TYPE(dynamic);
 #define side_event_variadic(_identifier, _sav, _var, _attr...)		\
 	do {								\
 		if (side_event_enabled(_identifier)) {			\
-			_side_event_call_variadic(side_call_variadic, _identifier, SIDE_SC_EMIT_##_sav, SIDE_SC_EMIT_##_var, \
+			_side_event_call_variadic(side_call_variadic_v0, _identifier, SIDE_SC_EMIT_##_sav, SIDE_SC_EMIT_##_var, \
 						SIDE_DEFAULT_ATTR(_, ##_attr, side_dynamic_attr_list())); \
 			SIDE_SC_CHECK_EVENT_CALL_VARIADIC(_identifier, _sav); \
 		}							\
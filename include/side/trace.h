@@ -68,6 +68,44 @@ struct side_event_state_0 {
 	struct side_event_description *desc;
 };
 
+/*
+ * Set in the enabled state of events with a sampling policy and
+ * enabled callbacks. The instrumentation then calls side_event_sample()
+ * before building the event arguments.
+ */
+#if SIDE_BITS_PER_LONG == 64
+# define SIDE_EVENT_ENABLED_SAMPLING_MASK	0x0080000000000000ULL
+#else
+# define SIDE_EVENT_ENABLED_SAMPLING_MASK	0x00800000UL
+#endif
+
+/*
+ * On 64-bit architectures, bits 32 to 47 of the enabled state count the
+ * external tracers attached to the USDT probes of an event (see
+ * SIDE_USDT). They are the 16-bit semaphore of the probes, located
+ * SIDE_EVENT_ENABLED_USDT_OFFSET bytes into the enabled state, which
+ * the kernel increments when a uprobe is attached to a probe.
+ */
+#if SIDE_BITS_PER_LONG == 64
+# define SIDE_EVENT_ENABLED_USDT_MASK		0x0000FFFF00000000ULL
+# if SIDE_BYTE_ORDER == SIDE_LITTLE_ENDIAN
+#  define SIDE_EVENT_ENABLED_USDT_OFFSET	4
+# else
+#  define SIDE_EVENT_ENABLED_USDT_OFFSET	2
+# endif
+#endif
+
+/*
+ * Static key patch site, emitted in the "side_jump_entry" section by
+ * side_event_enabled() when SIDE_STATIC_KEYS is defined. The entries
+ * are sorted in place by libside on registration.
+ */
+struct side_jump_entry {
+	uint64_t code;		/* Address of the patchable jump instruction. */
+	uint64_t target;	/* Address of the jump target. */
+	uint64_t key_ref;	/* Address of a pointer to the event state. */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -75,6 +113,8 @@ extern "C" {
 struct side_callback;
 struct side_tracer_handle;
 struct side_statedump_request_handle;
+struct side_tracer_enable_rule_handle;
+struct side_jump_entries_handle;
 
 extern const char side_empty_callback[];
 
@@ -84,10 +124,85 @@ void side_call_variadic(const struct side_event_state *state,
 	const struct side_arg_vec *side_arg_vec,
 	const struct side_arg_dynamic_struct *var_struct);
 
+/*
+ * Fast entry points used by the instrumentation macros. The event
+ * state must be of version 0, and the event variadic flag must match
+ * the entry point.
+ */
+void side_call_v0(const struct side_event_state *state,
+	const struct side_arg_vec *side_arg_vec);
+void side_call_variadic_v0(const struct side_event_state *state,
+	const struct side_arg_vec *side_arg_vec,
+	const struct side_arg_dynamic_struct *var_struct);
+
+/*
+ * Returns true if the current occurrence of the event is kept by its
+ * sampling policy.
+ */
+bool side_event_sample(const struct side_event_state *state);
+
 struct side_events_register_handle *side_events_register(struct side_event_description **events,
 		uint32_t nr_events);
 void side_events_unregister(struct side_events_register_handle *handle);
 
+/*
+ * Registered event index. Each registered event has a dense ID, reused
+ * after the event is unregistered, so tracers can keep per-event state
+ * in arrays indexed by event ID. Descriptions and IDs are valid until
+ * their events are unregistered, which tracers are notified of with
+ * SIDE_TRACER_NOTIFICATION_REMOVE_EVENTS.
+ */
+#define SIDE_EVENT_ID_INVALID		UINT32_MAX
+
+/* Returns the first registered event matching the names, or NULL. */
+struct side_event_description *side_event_lookup(const char *provider_name,
+		const char *event_name);
+/* Returns SIDE_EVENT_ID_INVALID if the event is not registered. */
+uint32_t side_event_get_id(const struct side_event_description *desc);
+/* Returns NULL if no event is registered with this ID. */
+struct side_event_description *side_event_from_id(uint32_t id);
+/* All event IDs are below the returned limit. */
+uint32_t side_event_id_limit(void);
+/*
+ * Invoke cb for each registered event with provider and event names
+ * matching the fnmatch(3) patterns, in ID order.
+ */
+int side_event_glob(const char *provider_pattern, const char *event_pattern,
+		void (*cb)(struct side_event_description *desc, uint32_t id, void *priv),
+		void *priv);
+
+/*
+ * Type description content hashes. The hash of a type covers its
+ * labels, sizes, byte orders, gather offsets, field names, enumeration
+ * mappings and attributes, including nested types, but not the
+ * addresses of the descriptions nor their visitor and lazy functions.
+ * Structurally identical types therefore have the same hash across
+ * events, shared objects, processes and restarts, so tracers can cache
+ * compiled plans and metadata by hash. The hash of the fields of an
+ * event also covers its flags. Descriptions with different hashes
+ * differ; equal hashes should be confirmed by comparing descriptions.
+ */
+uint64_t side_type_hash(const struct side_type *type);
+uint64_t side_event_fields_hash(const struct side_event_description *desc);
+/*
+ * Compound types (structures, variants, optionals, arrays, enumerations
+ * and their gather counterparts) of registered events are interned.
+ * Returns the canonical registered instance of a type structurally
+ * identical to type (including visitor and lazy functions), or NULL if
+ * no registered event has such type. The instance is valid until the
+ * events using it are unregistered.
+ */
+const struct side_type *side_type_interned(const struct side_type *type);
+
+/*
+ * Register static key patch sites. Sites of disabled events are
+ * patched into NOPs, and follow the enabled state of their event until
+ * unregistered. Returns NULL if there are no sites to patch.
+ */
+struct side_jump_entries_handle *side_jump_entries_register(struct side_jump_entry *start,
+		struct side_jump_entry *stop);
+void side_jump_entries_unregister(struct side_jump_entries_handle *handle);
+
 /*
  * Userspace tracer registration API. This allows userspace tracers to
  * register event notification callbacks to be notified of the currently
@@ -122,6 +237,245 @@ int side_tracer_callback_variadic_unregister(struct side_event_description *desc
 		side_tracer_callback_variadic_func call_variadic,
 		void *priv, uint64_t key);
 
+/*
+ * Callback filters. A filter is a predicate over the fields of an
+ * event, e.g. "fd == 3 && len > 4096", compiled once against the event
+ * description, and evaluated against the event arguments before
+ * invoking the callback. The callback is not invoked for events
+ * rejected by the filter.
+ *
+ * Operands are field names, integer literals, true, false and string
+ * literals. Operators are ==, !=, <, <=, >, >=, !, && and ||, with
+ * parentheses. Each comparison has a field and a literal operand, and
+ * a field alone is true when non-zero. Bool, byte, integer, pointer and
+ * enumeration fields of up to 64 bits are compared as integers, and
+ * UTF-8 string fields are compared with == and != to string literals,
+ * for both stack-copy and gather fields. The variadic fields of
+ * variadic events cannot be filtered on.
+ *
+ * Compilation returns SIDE_ERROR_INVAL for syntax errors, unknown
+ * fields and unsupported comparisons. Filters belong to the tracer,
+ * which destroys them after unregistering the callbacks using them.
+ * Unregistering a filtered callback is done with
+ * side_tracer_callback_unregister() or
+ * side_tracer_callback_variadic_unregister().
+ */
+struct side_filter;
+
+int side_filter_compile(const struct side_event_description *desc,
+		const char *expr, struct side_filter **filter);
+void side_filter_destroy(struct side_filter *filter);
+
+int side_tracer_callback_filter_register(struct side_event_description *desc,
+		side_tracer_callback_func call,
+		void *priv, uint64_t key,
+		const struct side_filter *filter);
+int side_tracer_callback_variadic_filter_register(struct side_event_description *desc,
+		side_tracer_callback_variadic_func call_variadic,
+		void *priv, uint64_t key,
+		const struct side_filter *filter);
+
+/*
+ * Payload callbacks receive the event arguments serialized into a
+ * binary payload rather than the arguments themselves. The payload of
+ * an event occurrence is serialized once, by the first payload
+ * callback invoked, and shared by all the payload callbacks of the
+ * occurrence, whichever tracer registered them. It is valid until the
+ * callback returns.
+ *
+ * The payload encodes the fields in the order of the event
+ * description, followed by the variadic fields of variadic events:
+ * each value is written in its declared size and byte order, strings
+ * up to and including their null terminator, variable-length arrays
+ * and visitors prefixed by a u32 length, optionals by a u8 selector,
+ * and dynamic values by their u16 type label and type parameters.
+ * This is the payload of the records of the ring buffer tracer.
+ *
+ * The callback is invoked with a NULL payload for occurrences which
+ * cannot be serialized (e.g. larger than 4096 bytes), so the tracer
+ * can account for them. Payload callbacks can be registered on both
+ * variadic and non-variadic events.
+ */
+enum side_tracer_callback_flag {
+	SIDE_TRACER_CALLBACK_FLAG_PAYLOAD = (1U << 0),
+	SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP = (1U << 1),
+};
+
+typedef void (*side_tracer_callback_payload_func)(const struct side_event_description *desc,
+			const void *payload, size_t len,
+			void *priv, void *caller_addr);
+
+int side_tracer_callback_payload_register(struct side_event_description *desc,
+		side_tracer_callback_payload_func call_payload,
+		void *priv, uint64_t key);
+int side_tracer_callback_payload_unregister(struct side_event_description *desc,
+		side_tracer_callback_payload_func call_payload,
+		void *priv, uint64_t key);
+
+/*
+ * Timestamp callbacks receive the timestamp of the event occurrence
+ * after the arguments of the corresponding callbacks. The timestamp is
+ * read once per event occurrence, by the first timestamp callback
+ * invoked, and passed to all the timestamp callbacks of the
+ * occurrence, so tracers attached to the same event record the same
+ * time without reading the clock each. Timestamps are in nanoseconds
+ * of the CLOCK_MONOTONIC time base, as returned by side_timestamp().
+ *
+ * They are registered with SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP,
+ * combined with SIDE_TRACER_CALLBACK_FLAG_PAYLOAD for payload
+ * callbacks.
+ */
+typedef void (*side_tracer_callback_timestamp_func)(const struct side_event_description *desc,
+			const struct side_arg_vec *side_arg_vec,
+			void *priv, void *caller_addr, uint64_t timestamp);
+typedef void (*side_tracer_callback_variadic_timestamp_func)(const struct side_event_description *desc,
+			const struct side_arg_vec *side_arg_vec,
+			const struct side_arg_dynamic_struct *var_struct,
+			void *priv, void *caller_addr, uint64_t timestamp);
+typedef void (*side_tracer_callback_payload_timestamp_func)(const struct side_event_description *desc,
+			const void *payload, size_t len,
+			void *priv, void *caller_addr, uint64_t timestamp);
+
+int side_tracer_callback_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_timestamp_func call,
+		void *priv, uint64_t key);
+int side_tracer_callback_variadic_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_variadic_timestamp_func call_variadic,
+		void *priv, uint64_t key);
+int side_tracer_callback_payload_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_payload_timestamp_func call_payload,
+		void *priv, uint64_t key);
+int side_tracer_callback_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_timestamp_func call,
+		void *priv, uint64_t key);
+int side_tracer_callback_variadic_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_variadic_timestamp_func call_variadic,
+		void *priv, uint64_t key);
+int side_tracer_callback_payload_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_payload_timestamp_func call_payload,
+		void *priv, uint64_t key);
+
+/*
+ * Returns the current time in the time base of event timestamps. The
+ * clock source is selected when libside initializes: clock_gettime()
+ * by default, or the CPU cycle counter scaled to nanoseconds with
+ * LIBSIDE_CLOCK=cycles.
+ */
+uint64_t side_timestamp(void);
+
+/*
+ * Returns the value of a lazily evaluated argument (SIDE_TYPE_LAZY),
+ * of the value type of its type description. The lazy function is
+ * invoked by the first tracer callback reading the value during the
+ * event call, and its result is returned to the following ones.
+ * Returns NULL if the lazy function fails.
+ */
+const struct side_arg *side_arg_lazy_value(const struct side_type *type_desc,
+		const struct side_arg *arg);
+
+/*
+ * Batched callback registration. The callback union member used is
+ * selected by the SIDE_TRACER_CALLBACK_FLAG_PAYLOAD and
+ * SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP flags of the entry, and
+ * otherwise by the SIDE_EVENT_FLAG_VARIADIC flag of the event
+ * description. Registration does not wait for RCU readers, and
+ * unregistration waits for a single grace period for the whole batch,
+ * which makes it well-suited for tracers enabling a large number of
+ * events at once. Processing stops at the first entry which fails,
+ * and its error is returned. Entries preceding the failing entry stay
+ * applied.
+ */
+struct side_tracer_callback_batch_entry {
+	struct side_event_description *desc;
+	union {
+		side_tracer_callback_func call;
+		side_tracer_callback_variadic_func call_variadic;
+		side_tracer_callback_payload_func payload;
+		side_tracer_callback_timestamp_func call_timestamp;
+		side_tracer_callback_variadic_timestamp_func call_variadic_timestamp;
+		side_tracer_callback_payload_timestamp_func payload_timestamp;
+	} u;
+	void *priv;
+	uint64_t key;
+	uint32_t flags;		/* enum side_tracer_callback_flag */
+};
+
+int side_tracer_callback_register_batch(const struct side_tracer_callback_batch_entry *entries,
+		uint32_t nr_entries);
+int side_tracer_callback_unregister_batch(const struct side_tracer_callback_batch_entry *entries,
+		uint32_t nr_entries);
+
+/*
+ * Enablement rules register a callback on the events matching provider
+ * and event name fnmatch(3) patterns, at or above the loglevel
+ * severity (at or below its value). The rule is applied to the events
+ * already registered, and by side_events_register() to new events
+ * while it builds their callback arrays, before they are published to
+ * tracers, which avoids registering the callback on each event from
+ * the event notification callback.
+ *
+ * The callback is the payload callback if flags has
+ * SIDE_TRACER_CALLBACK_FLAG_PAYLOAD, and otherwise call or
+ * call_variadic depending on the SIDE_EVENT_FLAG_VARIADIC flag of the
+ * event description. With SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP, the
+ * corresponding *_timestamp member is used instead. A NULL callback
+ * does not match the events of its kind. Events on which the
+ * (callback, priv, key) tuple of a rule is already registered keep that
+ * registration, which the rule does not own. Unregistering the rule
+ * removes its callback from the events it registered it on, with a
+ * single grace period.
+ */
+struct side_tracer_enable_rule {
+	const char *provider_pattern;
+	const char *event_pattern;
+	uint32_t loglevel;		/* enum side_loglevel */
+	uint32_t flags;			/* enum side_tracer_callback_flag */
+	side_tracer_callback_func call;
+	side_tracer_callback_variadic_func call_variadic;
+	side_tracer_callback_payload_func payload;
+	void *priv;
+	uint64_t key;
+	side_tracer_callback_timestamp_func call_timestamp;
+	side_tracer_callback_variadic_timestamp_func call_variadic_timestamp;
+	side_tracer_callback_payload_timestamp_func payload_timestamp;
+};
+
+/* The rule is copied, including its patterns. Returns NULL on error. */
+struct side_tracer_enable_rule_handle *side_tracer_enable_rule_register(
+		const struct side_tracer_enable_rule *rule);
+void side_tracer_enable_rule_unregister(struct side_tracer_enable_rule_handle *handle);
+
+/*
+ * Loglevel thresholds. Callbacks are only invoked for events with a
+ * loglevel at or below (more severe than) the threshold of their key.
+ * Keys without a threshold of their own, including callbacks registered
+ * to match all keys, use the process-wide threshold, which defaults to
+ * SIDE_LOGLEVEL_DEBUG. Events without callbacks enabled by the
+ * thresholds are disabled.
+ */
+int side_loglevel_threshold_set(enum side_loglevel loglevel);
+int side_tracer_key_loglevel_threshold_set(uint64_t key, enum side_loglevel loglevel);
+/* Key falls back to the process-wide threshold. */
+int side_tracer_key_loglevel_threshold_unset(uint64_t key);
+
+/*
+ * Event sampling policy, evaluated by side_event_enabled() before the
+ * event arguments are built. Only one occurrence out of "period" is
+ * kept (0 or 1 keeps all occurrences), and at most "max_per_second"
+ * occurrences are kept per second on each CPU (0 is unlimited). Once a
+ * thread reaches the period, it counts the next one on its own, so it
+ * skips occurrences without accessing shared state.
+ */
+struct side_event_sampling {
+	uint32_t period;
+	uint32_t max_per_second;
+};
+
+/* Replace the sampling policy of an event, resetting its counters. */
+int side_event_sampling_set(struct side_event_description *desc,
+		const struct side_event_sampling *sampling);
+int side_event_sampling_unset(struct side_event_description *desc);
+
 enum side_tracer_notification {
 	SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
 	SIDE_TRACER_NOTIFICATION_REMOVE_EVENTS,
@@ -134,6 +488,33 @@ struct side_tracer_handle *side_tracer_event_notification_register(
 		void *priv);
 void side_tracer_event_notification_unregister(struct side_tracer_handle *handle);
 
+/*
+ * Deferred event notifications. With SIDE_TRACER_NOTIFICATION_MODE_SYNC,
+ * the callback is invoked by side_events_register() for each events
+ * registration handle, as with side_tracer_event_notification_register().
+ * With the deferred modes, inserted events are accumulated and
+ * delivered with a single SIDE_TRACER_NOTIFICATION_INSERT_EVENTS
+ * notification (without NULL event pointers), either by the
+ * notification thread shortly after a burst of registrations (e.g.
+ * libraries loaded at startup), or by
+ * side_tracer_event_notification_flush() only. Pending inserted events
+ * are always delivered before the removal of events is notified. The
+ * callback receives the events already registered within a single
+ * notification on registration.
+ */
+enum side_tracer_notification_mode {
+	SIDE_TRACER_NOTIFICATION_MODE_SYNC = 0,
+	SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_THREAD = 1,
+	SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_FLUSH = 2,
+};
+
+struct side_tracer_handle *side_tracer_event_notification_register_mode(
+		void (*cb)(enum side_tracer_notification notif,
+			struct side_event_description **events, uint32_t nr_events, void *priv),
+		void *priv, enum side_tracer_notification_mode mode);
+/* Deliver the pending inserted events of a deferred mode tracer. */
+int side_tracer_event_notification_flush(struct side_tracer_handle *handle);
+
 /*
  * The side_statedump_call APIs should be used for application/library
  * state dump.
@@ -179,7 +560,10 @@ void side_statedump_call_variadic(const struct side_event_state *state,
  * agent thread quiescence.
  *
  * The statedump_request_key received by the statedump_cb is only
- * valid until the statedump_cb returns.
+ * valid until the statedump_cb returns. Requests from several tracers
+ * pending on a handle are coalesced: the statedump_cb is invoked once,
+ * and the side_statedump_call APIs emit each event for all the tracer
+ * keys of the request.
  */
 enum side_statedump_mode {
 	SIDE_STATEDUMP_MODE_POLLING,
@@ -194,9 +578,56 @@ struct side_statedump_request_handle *
 void side_statedump_request_notification_unregister(
 		struct side_statedump_request_handle *handle);
 
-/* Returns true if the handle has pending statedump requests. */
+/*
+ * Resumable state dump. The statedump_cb dumps part of the state,
+ * starting from the cursor position, and returns
+ * SIDE_STATEDUMP_STATUS_MORE with the cursor position updated if the
+ * state is not completely dumped. It is invoked again with the same
+ * statedump_request_key and cursor position until it returns
+ * SIDE_STATEDUMP_STATUS_DONE. The position is 0 when a state dump
+ * begins.
+ *
+ * The statedump_cb should return once
+ * side_statedump_cursor_budget_exhausted() is true. The time and
+ * event budgets are provided to side_statedump_run_pending_requests_budget()
+ * by polling mode applications, which can spread state dumps across
+ * event loop iterations. Agent threads run state dumps without budget.
+ */
+enum side_statedump_status {
+	SIDE_STATEDUMP_STATUS_DONE = 0,
+	SIDE_STATEDUMP_STATUS_MORE = 1,
+};
+
+struct side_statedump_cursor {
+	uint64_t position;	/* Application-defined, 0 when a state dump begins. */
+	uint64_t deadline;	/* CLOCK_MONOTONIC time in ns, 0 if unbounded. */
+	uint64_t event_budget;	/* Events per invocation, 0 if unbounded. */
+	uint64_t nr_events;	/* Events emitted by the current invocation. */
+};
+
+struct side_statedump_request_handle *
+	side_statedump_request_resumable_notification_register(
+		const char *state_name,
+		enum side_statedump_status (*statedump_cb)(void *statedump_request_key,
+			struct side_statedump_cursor *cursor),
+		enum side_statedump_mode mode);
+
+/* Returns true if the budget of the current invocation is exhausted. */
+bool side_statedump_cursor_budget_exhausted(const struct side_statedump_cursor *cursor);
+
+/*
+ * Returns true if the handle has pending statedump requests, including
+ * a resumable state dump in progress.
+ */
 bool side_statedump_poll_pending_requests(struct side_statedump_request_handle *handle);
 int side_statedump_run_pending_requests(struct side_statedump_request_handle *handle);
+/*
+ * Run pending requests within a time budget (in ns) and an event
+ * budget, 0 meaning unbounded. A resumable state dump which does not
+ * complete within the budget stays pending.
+ */
+int side_statedump_run_pending_requests_budget(struct side_statedump_request_handle *handle,
+		uint64_t time_budget_ns, uint64_t event_budget);
 
 /*
  * Request a state dump for tracer callbacks identified with "key".
@@ -207,6 +638,71 @@ int side_tracer_statedump_request(uint64_t key);
  */
 int side_tracer_statedump_request_cancel(uint64_t key);
 
+/*
+ * RCU read-side synchronization mode used by the side library for
+ * callback dispatch, for diagnostic purposes.
+ */
+enum side_rcu_read_mode {
+	/* rseq per-cpu counters, membarrier on grace period. */
+	SIDE_RCU_READ_MODE_RSEQ_MEMBARRIER = 0,
+	/* Relaxed atomic counters, membarrier on grace period. */
+	SIDE_RCU_READ_MODE_MEMBARRIER = 1,
+	/* Sequentially consistent atomic counters. */
+	SIDE_RCU_READ_MODE_ATOMIC = 2,
+};
+
+enum side_rcu_read_mode side_rcu_get_read_mode(void);
+
+/*
+ * Performance counters. Grace periods and state dumps are always
+ * accounted for. Event and callback counters are only kept with
+ * LIBSIDE_STATS=1: events count the occurrences which reach their
+ * callbacks, per CPU, and one occurrence out of 64 on each CPU times
+ * each callback invoked. The counters of a callback are those of its
+ * (call, priv, key) tuple on the event, kept until the event is
+ * unregistered.
+ *
+ * With LIBSIDE_STATS_PERIOD_MS=<ms>, the counters are also emitted
+ * every period by the "side_stats" state dump, with the "side"
+ * provider events "stats_grace_periods", "stats_statedump",
+ * "stats_event" and "stats_callback". Tracers requesting a state dump
+ * receive it at the next period.
+ *
+ * The query functions return SIDE_ERROR_NOENT for unknown events,
+ * callbacks and handles, and for event and callback counters when they
+ * are disabled.
+ */
+struct side_stats {
+	uint64_t nr_grace_periods;	/* Grace period waits. */
+	uint64_t grace_period_ns;	/* Total wait time. */
+	uint64_t grace_period_max_ns;
+};
+
+struct side_event_stats {
+	uint64_t nr_hits;
+};
+
+struct side_callback_stats {
+	uint64_t nr_samples;		/* Timed invocations. */
+	uint64_t sampled_ns;		/* Total time of timed invocations. */
+};
+
+struct side_statedump_stats {
+	uint64_t nr_statedumps;		/* Completed state dumps. */
+	uint64_t statedump_ns;		/* Total time, summed over the runs. */
+	uint64_t statedump_max_ns;
+};
+
+int side_stats_get(struct side_stats *stats);
+int side_event_stats_get(const struct side_event_description *desc,
+		struct side_event_stats *stats);
+/* call is the registered callback, of any kind. */
+int side_tracer_callback_stats_get(const struct side_event_description *desc,
+		void *call, void *priv, uint64_t key,
+		struct side_callback_stats *stats);
+int side_statedump_stats_get(struct side_statedump_request_handle *handle,
+		struct side_statedump_stats *stats);
+
 /*
  * Explicit hooks to initialize/finalize the side instrumentation
  * library. Those are also library constructor/destructor.
@@ -233,6 +729,12 @@ int side_event_description_ptr_registered
         __attribute__((weak, visibility("hidden")));
 struct side_events_register_handle *side_events_handle
 	__attribute__((weak, visibility("hidden")));
+extern struct side_jump_entry __start_side_jump_entry[]
+	__attribute__((weak, visibility("hidden")));
+extern struct side_jump_entry __stop_side_jump_entry[]
+	__attribute__((weak, visibility("hidden")));
+struct side_jump_entries_handle *side_jump_entries_handle
+	__attribute__((weak, visibility("hidden")));
 
 static void
 side_event_description_ptr_init(void)
@@ -245,6 +747,8 @@ side_event_description_ptr_init(void)
 		return;
 	side_events_handle = side_events_register(__start_side_event_description_ptr,
 		__stop_side_event_description_ptr - __start_side_event_description_ptr);
+	side_jump_entries_handle = side_jump_entries_register(__start_side_jump_entry,
+		__stop_side_jump_entry);
 }
 
 static void
@@ -256,6 +760,8 @@ side_event_description_ptr_exit(void)
 {
 	if (--side_event_description_ptr_registered)
 		return;
+	side_jump_entries_unregister(side_jump_entries_handle);
+	side_jump_entries_handle = NULL;
 	side_events_unregister(side_events_handle);
 	side_events_handle = NULL;
 }
@@ -0,0 +1,618 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Each queue is a ring of records written by its owner thread and read
+ * by the consumer, indexed by free-running byte positions. A record is
+ * a header followed by the copy of the argument vector, with the
+ * pointers of the copy relocated within the record. Records do not wrap
+ * around: a padding record fills the end of the ring when the next
+ * record does not fit.
+ *
+ * The consumer sleeps on a futex when the queues are empty. Producers
+ * order the publication of a record before reading the sleeping flag,
+ * and the consumer orders setting the flag before checking the queues
+ * one last time, so either the producer wakes it or the consumer sees
+ * the record.
+ *
+ * Lock order: async_pipelines_lock, then the pipeline lock, which
+ * protects the queue list and serializes consumers.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "async-pipeline.h"
+#include "list.h"
+#include "rcu.h"
+#include "utf.h"
+
+#define ASYNC_ALIGN	8
+#define async_align(_len)	(((_len) + ASYNC_ALIGN - 1) & ~((size_t) ASYNC_ALIGN - 1))
+
+struct async_record {
+	uint32_t size;			/* Bytes, including the header. */
+	uint32_t padding;		/* Skip to the start of the ring. */
+	const struct side_event_description *desc;
+	void *priv;
+	void *caller_addr;
+	struct side_arg_vec side_arg_vec;
+};
+
+struct async_queue {
+	struct side_list_node node;	/* Pipeline queues. */
+	struct async_queue *thread_next;	/* Queues of the owner thread. */
+	struct side_async_pipeline *pipeline;	/* NULL once destroyed. */
+	char *data;
+	uint64_t size;
+	bool orphan;			/* Owner thread exited. */
+
+	/* Written by the producer. */
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t nr_events;
+	uint64_t nr_dropped;
+	uint64_t max_depth;
+
+	/* Written by the consumer. */
+	uint64_t tail __attribute__((aligned(64)));
+};
+
+struct side_async_pipeline {
+	struct side_list_node node;	/* async_pipelines. */
+	struct side_async_pipeline_ops ops;
+	size_t queue_size;
+	pthread_mutex_t lock;
+	struct side_list_head queues;
+	pthread_t consumer;
+	bool consumer_created;
+	bool exit;
+	int32_t sleeping;		/* Consumer futex. */
+
+	/* Counters of the freed queues. */
+	uint64_t nr_events;
+	uint64_t nr_dropped;
+	uint64_t max_depth;
+};
+
+static pthread_mutex_t async_pipelines_lock = PTHREAD_MUTEX_INITIALIZER;
+static DEFINE_SIDE_LIST_HEAD(async_pipelines);
+static pthread_once_t async_once = PTHREAD_ONCE_INIT;
+static pthread_key_t async_thread_key;
+
+static __thread struct async_queue *async_thread_queues;
+
+/* Bytes copied after the header, false if the arguments cannot be copied. */
+static
+bool vec_size(const struct side_arg_vec *vec, size_t *size, size_t max_size);
+
+static
+bool arg_size(const struct side_arg *arg, size_t *size, size_t max_size)
+{
+	switch (side_enum_get(arg->type)) {
+	case SIDE_TYPE_NULL:
+	case SIDE_TYPE_BOOL:
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_U128:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_S128:
+	case SIDE_TYPE_BYTE:
+	case SIDE_TYPE_POINTER:
+	case SIDE_TYPE_FLOAT_BINARY16:
+	case SIDE_TYPE_FLOAT_BINARY32:
+	case SIDE_TYPE_FLOAT_BINARY64:
+	case SIDE_TYPE_FLOAT_BINARY128:
+		break;
+	case SIDE_TYPE_STRING_UTF8:
+	case SIDE_TYPE_STRING_UTF16:
+	case SIDE_TYPE_STRING_UTF32:
+	{
+		uint8_t unit_size = side_enum_get(arg->type) == SIDE_TYPE_STRING_UTF8 ? 1 :
+			side_enum_get(arg->type) == SIDE_TYPE_STRING_UTF16 ? 2 : 4;
+
+		*size += async_align((side_utf_strlen(side_ptr_get(arg->u.side_static.string_value),
+				unit_size) + 1) * unit_size);
+		break;
+	}
+	case SIDE_TYPE_STRUCT:
+		*size += async_align(sizeof(struct side_arg_vec));
+		return vec_size(side_ptr_get(arg->u.side_static.side_struct), size, max_size);
+	case SIDE_TYPE_ARRAY:
+		*size += async_align(sizeof(struct side_arg_vec));
+		return vec_size(side_ptr_get(arg->u.side_static.side_array), size, max_size);
+	case SIDE_TYPE_VLA:
+		*size += async_align(sizeof(struct side_arg_vec));
+		return vec_size(side_ptr_get(arg->u.side_static.side_vla), size, max_size);
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_arg_variant *variant = side_ptr_get(arg->u.side_static.side_variant);
+
+		*size += async_align(sizeof(struct side_arg_variant));
+		return arg_size(&variant->selector, size, max_size) &&
+			arg_size(&variant->option, size, max_size);
+	}
+	case SIDE_TYPE_OPTIONAL:
+	{
+		const struct side_arg_optional *optional = side_ptr_get(arg->u.side_static.side_optional);
+
+		*size += async_align(sizeof(struct side_arg_optional));
+		if (optional->selector == SIDE_OPTIONAL_DISABLED)
+			break;
+		return arg_size(&optional->side_static, size, max_size);
+	}
+	default:
+		/* Refers to application state. */
+		return false;
+	}
+	return *size <= max_size;
+}
+
+static
+bool vec_size(const struct side_arg_vec *vec, size_t *size, size_t max_size)
+{
+	const struct side_arg *sav = side_ptr_get(vec->sav);
+	uint32_t i;
+
+	*size += async_align((size_t) vec->len * sizeof(struct side_arg));
+	if (*size > max_size)
+		return false;
+	for (i = 0; i < vec->len; i++) {
+		if (!arg_size(&sav[i], size, max_size))
+			return false;
+	}
+	return true;
+}
+
+static
+char *copy_reserve(char **p, size_t len)
+{
+	char *dst = *p;
+
+	*p += async_align(len);
+	return dst;
+}
+
+static
+void vec_copy(struct side_arg_vec *dst, const struct side_arg_vec *src, char **p);
+
+static
+const struct side_arg_vec *vec_copy_new(const struct side_arg_vec *src, char **p)
+{
+	struct side_arg_vec *dst = (struct side_arg_vec *) copy_reserve(p, sizeof(struct side_arg_vec));
+
+	vec_copy(dst, src, p);
+	return dst;
+}
+
+static
+void arg_copy(struct side_arg *dst, const struct side_arg *src, char **p)
+{
+	memcpy(dst, src, sizeof(struct side_arg));
+	switch (side_enum_get(src->type)) {
+	case SIDE_TYPE_STRING_UTF8:
+	case SIDE_TYPE_STRING_UTF16:
+	case SIDE_TYPE_STRING_UTF32:
+	{
+		uint8_t unit_size = side_enum_get(src->type) == SIDE_TYPE_STRING_UTF8 ? 1 :
+			side_enum_get(src->type) == SIDE_TYPE_STRING_UTF16 ? 2 : 4;
+		const void *s = side_ptr_get(src->u.side_static.string_value);
+		size_t len = (side_utf_strlen(s, unit_size) + 1) * unit_size;
+		char *str = copy_reserve(p, len);
+
+		memcpy(str, s, len);
+		side_ptr_set(dst->u.side_static.string_value, str);
+		break;
+	}
+	case SIDE_TYPE_STRUCT:
+		side_ptr_set(dst->u.side_static.side_struct,
+			vec_copy_new(side_ptr_get(src->u.side_static.side_struct), p));
+		break;
+	case SIDE_TYPE_ARRAY:
+		side_ptr_set(dst->u.side_static.side_array,
+			vec_copy_new(side_ptr_get(src->u.side_static.side_array), p));
+		break;
+	case SIDE_TYPE_VLA:
+		side_ptr_set(dst->u.side_static.side_vla,
+			vec_copy_new(side_ptr_get(src->u.side_static.side_vla), p));
+		break;
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_arg_variant *src_variant = side_ptr_get(src->u.side_static.side_variant);
+		struct side_arg_variant *variant = (struct side_arg_variant *)
+			copy_reserve(p, sizeof(struct side_arg_variant));
+
+		arg_copy(&variant->selector, &src_variant->selector, p);
+		arg_copy(&variant->option, &src_variant->option, p);
+		side_ptr_set(dst->u.side_static.side_variant, variant);
+		break;
+	}
+	case SIDE_TYPE_OPTIONAL:
+	{
+		const struct side_arg_optional *src_optional = side_ptr_get(src->u.side_static.side_optional);
+		struct side_arg_optional *optional = (struct side_arg_optional *)
+			copy_reserve(p, sizeof(struct side_arg_optional));
+
+		memcpy(optional, src_optional, sizeof(struct side_arg_optional));
+		if (src_optional->selector != SIDE_OPTIONAL_DISABLED)
+			arg_copy(&optional->side_static, &src_optional->side_static, p);
+		side_ptr_set(dst->u.side_static.side_optional, optional);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static
+void vec_copy(struct side_arg_vec *dst, const struct side_arg_vec *src, char **p)
+{
+	const struct side_arg *src_sav = side_ptr_get(src->sav);
+	struct side_arg *sav = (struct side_arg *) copy_reserve(p, (size_t) src->len * sizeof(struct side_arg));
+	uint32_t i;
+
+	for (i = 0; i < src->len; i++)
+		arg_copy(&sav[i], &src_sav[i], p);
+	side_ptr_set(dst->sav, sav);
+	dst->len = src->len;
+}
+
+static
+void async_queue_free(struct async_queue *queue)
+{
+	free(queue->data);
+	free(queue);
+}
+
+/* Detach the queues of the exiting thread, drained by the consumer. */
+static
+void async_thread_exit(void *arg __attribute__((unused)))
+{
+	struct async_queue *queue, *next;
+
+	pthread_mutex_lock(&async_pipelines_lock);
+	for (queue = async_thread_queues; queue; queue = next) {
+		struct side_async_pipeline *pipeline = queue->pipeline;
+
+		next = queue->thread_next;
+		if (!pipeline) {
+			async_queue_free(queue);
+			continue;
+		}
+		pthread_mutex_lock(&pipeline->lock);
+		queue->orphan = true;
+		pthread_mutex_unlock(&pipeline->lock);
+		if (__atomic_exchange_n(&pipeline->sleeping, 0, __ATOMIC_RELAXED))
+			(void) futex(&pipeline->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+	async_thread_queues = NULL;
+	pthread_mutex_unlock(&async_pipelines_lock);
+}
+
+static
+void async_before_fork(void)
+{
+	struct side_async_pipeline *pipeline;
+
+	pthread_mutex_lock(&async_pipelines_lock);
+	side_list_for_each_entry(pipeline, &async_pipelines, node)
+		pthread_mutex_lock(&pipeline->lock);
+}
+
+static
+void async_after_fork_parent(void)
+{
+	struct side_async_pipeline *pipeline;
+
+	side_list_for_each_entry(pipeline, &async_pipelines, node)
+		pthread_mutex_unlock(&pipeline->lock);
+	pthread_mutex_unlock(&async_pipelines_lock);
+}
+
+/*
+ * The parent consumes the pending events, and only the forking thread
+ * exists in the child: the queues of the other threads are orphaned.
+ */
+static
+void async_after_fork_child(void)
+{
+	struct side_async_pipeline *pipeline;
+	struct async_queue *queue;
+
+	side_list_for_each_entry(pipeline, &async_pipelines, node) {
+		side_list_for_each_entry(queue, &pipeline->queues, node) {
+			queue->tail = queue->head;
+			queue->orphan = true;
+		}
+		pipeline->consumer_created = false;
+		pipeline->sleeping = 0;
+	}
+	for (queue = async_thread_queues; queue; queue = queue->thread_next)
+		queue->orphan = false;
+	side_list_for_each_entry(pipeline, &async_pipelines, node)
+		pthread_mutex_unlock(&pipeline->lock);
+	pthread_mutex_unlock(&async_pipelines_lock);
+}
+
+static
+void async_init(void)
+{
+	if (pthread_key_create(&async_thread_key, async_thread_exit))
+		abort();
+	if (pthread_atfork(async_before_fork, async_after_fork_parent, async_after_fork_child))
+		abort();
+}
+
+/*
+ * Consume the events queued up to now, and free the drained orphan
+ * queues. Returns the number of events consumed. Called with the
+ * pipeline lock held.
+ */
+static
+uint64_t async_consume(struct side_async_pipeline *pipeline)
+{
+	struct async_queue *queue, *next;
+	uint64_t nr = 0;
+
+	side_list_for_each_entry_safe(queue, next, &pipeline->queues, node) {
+		uint64_t tail = queue->tail, head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+		while (tail != head) {
+			const struct async_record *record =
+				(const struct async_record *) (queue->data + (tail & (queue->size - 1)));
+
+			if (!record->padding) {
+				pipeline->ops.consume(record->desc, &record->side_arg_vec,
+					record->priv, record->caller_addr);
+				nr++;
+			}
+			tail += record->size;
+			__atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+		}
+		if (queue->orphan) {
+			side_list_remove_node(&queue->node);
+			pipeline->nr_events += queue->nr_events;
+			pipeline->nr_dropped += queue->nr_dropped;
+			if (queue->max_depth > pipeline->max_depth)
+				pipeline->max_depth = queue->max_depth;
+			async_queue_free(queue);
+		}
+	}
+	if (nr && pipeline->ops.batch_end)
+		pipeline->ops.batch_end();
+	return nr;
+}
+
+/* Called with the pipeline lock held. */
+static
+bool async_pending(struct side_async_pipeline *pipeline)
+{
+	struct async_queue *queue;
+
+	side_list_for_each_entry(queue, &pipeline->queues, node) {
+		if (queue->orphan || __atomic_load_n(&queue->head, __ATOMIC_RELAXED) != queue->tail)
+			return true;
+	}
+	return false;
+}
+
+static
+void *async_consumer_func(void *arg)
+{
+	struct side_async_pipeline *pipeline = (struct side_async_pipeline *) arg;
+
+	for (;;) {
+		bool pending;
+
+		pthread_mutex_lock(&pipeline->lock);
+		if (async_consume(pipeline)) {
+			pthread_mutex_unlock(&pipeline->lock);
+			continue;
+		}
+		if (__atomic_load_n(&pipeline->exit, __ATOMIC_RELAXED)) {
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+		__atomic_store_n(&pipeline->sleeping, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pending = async_pending(pipeline) || __atomic_load_n(&pipeline->exit, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&pipeline->lock);
+		if (!pending)
+			(void) futex(&pipeline->sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+		__atomic_store_n(&pipeline->sleeping, 0, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static
+void async_consumer_wake(struct side_async_pipeline *pipeline)
+{
+	if (__atomic_load_n(&pipeline->sleeping, __ATOMIC_RELAXED) &&
+			__atomic_exchange_n(&pipeline->sleeping, 0, __ATOMIC_RELAXED))
+		(void) futex(&pipeline->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* Queue of the calling thread, created if needed. */
+static
+struct async_queue *async_thread_queue(struct side_async_pipeline *pipeline)
+{
+	struct async_queue *queue;
+
+	for (queue = async_thread_queues; queue; queue = queue->thread_next) {
+		if (queue->pipeline == pipeline)
+			return queue;
+	}
+	/* The producer and consumer fields are on their own cache line. */
+	if (posix_memalign((void **) &queue, __alignof__(struct async_queue), sizeof(struct async_queue)))
+		return NULL;
+	memset(queue, 0, sizeof(struct async_queue));
+	queue->data = (char *) malloc(pipeline->queue_size);
+	if (!queue->data) {
+		free(queue);
+		return NULL;
+	}
+	queue->size = pipeline->queue_size;
+	queue->pipeline = pipeline;
+	(void) pthread_setspecific(async_thread_key, queue);
+	pthread_mutex_lock(&pipeline->lock);
+	side_list_insert_node_tail(&pipeline->queues, &queue->node);
+	pthread_mutex_unlock(&pipeline->lock);
+	queue->thread_next = async_thread_queues;
+	async_thread_queues = queue;
+	return queue;
+}
+
+/*
+ * Without a consumer thread, the events are consumed when the pipeline
+ * is drained or destroyed.
+ */
+static
+void async_consumer_create(struct side_async_pipeline *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	if (!pipeline->consumer_created &&
+			!pthread_create(&pipeline->consumer, NULL, async_consumer_func, pipeline))
+		__atomic_store_n(&pipeline->consumer_created, true, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+struct side_async_pipeline *side_async_pipeline_create(size_t queue_size,
+		const struct side_async_pipeline_ops *ops)
+{
+	struct side_async_pipeline *pipeline;
+
+	if (!queue_size || (queue_size & (queue_size - 1)))
+		return NULL;
+	if (pthread_once(&async_once, async_init))
+		abort();
+	pipeline = (struct side_async_pipeline *) calloc(1, sizeof(struct side_async_pipeline));
+	if (!pipeline)
+		return NULL;
+	pipeline->ops = *ops;
+	pipeline->queue_size = queue_size;
+	pthread_mutex_init(&pipeline->lock, NULL);
+	side_list_head_init(&pipeline->queues);
+	pthread_mutex_lock(&async_pipelines_lock);
+	side_list_insert_node_tail(&async_pipelines, &pipeline->node);
+	pthread_mutex_unlock(&async_pipelines_lock);
+	return pipeline;
+}
+
+void side_async_pipeline_destroy(struct side_async_pipeline *pipeline)
+{
+	struct async_queue *queue, *next;
+	bool created;
+
+	if (!pipeline)
+		return;
+	pthread_mutex_lock(&pipeline->lock);
+	__atomic_store_n(&pipeline->exit, true, __ATOMIC_RELAXED);
+	created = pipeline->consumer_created;
+	pthread_mutex_unlock(&pipeline->lock);
+	if (created) {
+		__atomic_store_n(&pipeline->sleeping, 0, __ATOMIC_RELAXED);
+		(void) futex(&pipeline->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+		if (pthread_join(pipeline->consumer, NULL))
+			abort();
+	}
+	pthread_mutex_lock(&async_pipelines_lock);
+	pthread_mutex_lock(&pipeline->lock);
+	(void) async_consume(pipeline);
+	/* Queues of live threads are freed when their owner exits. */
+	side_list_for_each_entry_safe(queue, next, &pipeline->queues, node) {
+		side_list_remove_node(&queue->node);
+		queue->pipeline = NULL;
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+	side_list_remove_node(&pipeline->node);
+	pthread_mutex_unlock(&async_pipelines_lock);
+	pthread_mutex_destroy(&pipeline->lock);
+	free(pipeline);
+}
+
+bool side_async_pipeline_push(struct side_async_pipeline *pipeline,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		void *priv, void *caller_addr)
+{
+	size_t size = async_align(sizeof(struct async_record));
+	uint64_t head, tail, offset, pad = 0;
+	struct async_queue *queue;
+	struct async_record *record;
+	char *p;
+
+	if (!vec_size(side_arg_vec, &size, pipeline->queue_size / 2))
+		return false;
+	queue = async_thread_queue(pipeline);
+	if (!queue)
+		return false;
+	if (side_unlikely(!__atomic_load_n(&pipeline->consumer_created, __ATOMIC_RELAXED)))
+		async_consumer_create(pipeline);
+	head = queue->head;
+	tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	offset = head & (queue->size - 1);
+	if (offset + size > queue->size)
+		pad = queue->size - offset;
+	if (head + pad + size - tail > queue->size) {
+		__atomic_store_n(&queue->nr_dropped, queue->nr_dropped + 1, __ATOMIC_RELAXED);
+		return true;
+	}
+	if (pad) {
+		record = (struct async_record *) (queue->data + offset);
+		record->size = pad;
+		record->padding = 1;
+		head += pad;
+	}
+	record = (struct async_record *) (queue->data + (head & (queue->size - 1)));
+	record->size = size;
+	record->padding = 0;
+	record->desc = desc;
+	record->priv = priv;
+	record->caller_addr = caller_addr;
+	p = (char *) record + async_align(sizeof(struct async_record));
+	vec_copy(&record->side_arg_vec, side_arg_vec, &p);
+	__atomic_store_n(&queue->head, head + size, __ATOMIC_RELEASE);
+	__atomic_store_n(&queue->nr_events, queue->nr_events + 1, __ATOMIC_RELAXED);
+	if (head + size - tail > queue->max_depth)
+		__atomic_store_n(&queue->max_depth, head + size - tail, __ATOMIC_RELAXED);
+	/* Order the record publication before the sleeping flag load. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	async_consumer_wake(pipeline);
+	return true;
+}
+
+void side_async_pipeline_drain(struct side_async_pipeline *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	(void) async_consume(pipeline);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+void side_async_pipeline_get_stats(struct side_async_pipeline *pipeline,
+		struct side_async_pipeline_stats *stats)
+{
+	struct async_queue *queue;
+
+	pthread_mutex_lock(&pipeline->lock);
+	stats->nr_events = pipeline->nr_events;
+	stats->nr_dropped = pipeline->nr_dropped;
+	stats->max_depth = pipeline->max_depth;
+	stats->nr_queues = 0;
+	side_list_for_each_entry(queue, &pipeline->queues, node) {
+		uint64_t max_depth = __atomic_load_n(&queue->max_depth, __ATOMIC_RELAXED);
+
+		stats->nr_events += __atomic_load_n(&queue->nr_events, __ATOMIC_RELAXED);
+		stats->nr_dropped += __atomic_load_n(&queue->nr_dropped, __ATOMIC_RELAXED);
+		if (max_depth > stats->max_depth)
+			stats->max_depth = max_depth;
+		stats->nr_queues++;
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_ASYNC_PIPELINE_H
+#define _SIDE_ASYNC_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * Asynchronous consumer pipeline. A tracer callback pushes the
+ * arguments of an event into a single-producer single-consumer queue
+ * owned by the calling thread: the argument vector is copied with the
+ * strings and the compound arguments it refers to, and nothing else is
+ * done on the instrumented thread. A consumer thread, created by the
+ * first event pushed, drains the queues in batches and hands each event to
+ * the consume callback with the copied arguments, which can be visited
+ * against the event description as the original ones.
+ *
+ * Arguments which refer to application state (gather, lazy, visitor
+ * and dynamic types) cannot be copied, nor variadic fields: the caller
+ * handles those events synchronously, as well as events larger than
+ * half a queue. Events pushed to a full queue are dropped and counted.
+ *
+ * The events of a queue are consumed in order, and the consume
+ * callbacks are serialized. The queues of threads which exit are
+ * drained and freed by the consumer. In a child process, the pending
+ * events of the parent are discarded and the consumer thread is created
+ * again by the first event pushed.
+ */
+
+struct side_async_pipeline;
+
+struct side_async_pipeline_ops {
+	void (*consume)(const struct side_event_description *desc,
+			const struct side_arg_vec *side_arg_vec,
+			void *priv, void *caller_addr);
+	/* After the events of a batch are consumed. May be NULL. */
+	void (*batch_end)(void);
+};
+
+struct side_async_pipeline_stats {
+	uint64_t nr_events;		/* Pushed and queued. */
+	uint64_t nr_dropped;		/* Pushed to a full queue. */
+	uint64_t max_depth;		/* Largest number of bytes queued by a thread. */
+	uint32_t nr_queues;		/* Queues currently allocated. */
+};
+
+/*
+ * queue_size is the size of the queue of each thread in bytes, a power
+ * of two. Returns NULL on allocation failure.
+ */
+struct side_async_pipeline *side_async_pipeline_create(size_t queue_size,
+		const struct side_async_pipeline_ops *ops)
+	__attribute__((visibility("hidden")));
+/* Consume the queued events, stop the consumer and free the queues. */
+void side_async_pipeline_destroy(struct side_async_pipeline *pipeline)
+	__attribute__((visibility("hidden")));
+/*
+ * Returns false if the arguments cannot be copied, in which case the
+ * event is neither queued nor counted.
+ */
+bool side_async_pipeline_push(struct side_async_pipeline *pipeline,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		void *priv, void *caller_addr)
+	__attribute__((visibility("hidden")));
+/*
+ * Consume the events queued so far from the calling thread, for
+ * instance before the descriptions or the private data they refer to
+ * are freed.
+ */
+void side_async_pipeline_drain(struct side_async_pipeline *pipeline)
+	__attribute__((visibility("hidden")));
+void side_async_pipeline_get_stats(struct side_async_pipeline *pipeline,
+		struct side_async_pipeline_stats *stats)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_ASYNC_PIPELINE_H */
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "clock.h"
+
+/* Interval between the two calibration samples of the x86-64 TSC. */
+#define SIDE_CLOCK_CALIBRATION_NS	10000000L
+#define SIDE_CLOCK_NR_SAMPLES		8
+
+struct side_clock side_clock;
+
+/*
+ * Sample CLOCK_MONOTONIC with the cycle counter read at the middle of
+ * the shortest of a few clock_gettime() calls, so preemption or a slow
+ * vDSO read do not skew the pair.
+ */
+static
+void side_clock_sample(uint64_t *cycles, uint64_t *ns)
+{
+	uint64_t best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < SIDE_CLOCK_NR_SAMPLES; i++) {
+		uint64_t c0, c1, t;
+
+		c0 = side_clock_cycles();
+		t = side_clock_monotonic();
+		c1 = side_clock_cycles();
+		if (c1 - c0 < best) {
+			best = c1 - c0;
+			*cycles = c0 + (c1 - c0) / 2;
+			*ns = t;
+		}
+	}
+}
+
+/* Returns the cycle counter frequency in Hz, or 0 if it is unusable. */
+static
+uint64_t side_clock_cycles_frequency(void)
+{
+#if defined(__x86_64__)
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = SIDE_CLOCK_CALIBRATION_NS };
+	unsigned int eax, ebx, ecx, edx;
+	uint64_t c0, t0, c1, t1;
+
+	/* The TSC must tick at a constant rate across P- and C-states. */
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1U << 8)))
+		return 0;
+	side_clock_sample(&c0, &t0);
+	while (nanosleep(&delay, &delay) && errno == EINTR)
+		;
+	side_clock_sample(&c1, &t1);
+	if (t1 <= t0 || c1 <= c0)
+		return 0;
+	return (uint64_t) ((unsigned __int128) (c1 - c0) * 1000000000ULL / (t1 - t0));
+#elif defined(__aarch64__)
+	uint64_t freq;
+
+	__asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r" (freq));
+	return freq;
+#else
+	return 0;
+#endif
+}
+
+void side_clock_init(void)
+{
+	const char *env = getenv("LIBSIDE_CLOCK");
+	uint64_t freq;
+
+	if (!env || strcmp(env, "cycles"))
+		return;
+	freq = side_clock_cycles_frequency();
+	/* Below 1 MHz, the counter is too coarse for event timestamps. */
+	if (freq < 1000000)
+		return;
+	side_clock.mult = (uint64_t) (((unsigned __int128) 1000000000ULL << 32) / freq);
+	side_clock_sample(&side_clock.cycles_base, &side_clock.ns_base);
+	__atomic_store_n(&side_clock.source, SIDE_CLOCK_SOURCE_CYCLES, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_CLOCK_H
+#define _SIDE_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include <side/macros.h>
+
+/*
+ * Event timestamps, in nanoseconds of the CLOCK_MONOTONIC time base.
+ * The clock source is selected once per process by side_clock_init():
+ * clock_gettime() (through the vDSO) by default, or the CPU cycle
+ * counter (x86-64 invariant TSC, aarch64 CNTVCT_EL0) scaled to
+ * nanoseconds from CLOCK_MONOTONIC when LIBSIDE_CLOCK=cycles. The
+ * cycle counter is not slewed by NTP, so it drifts slowly from
+ * CLOCK_MONOTONIC over the life of the process.
+ */
+
+enum side_clock_source {
+	SIDE_CLOCK_SOURCE_MONOTONIC = 0,
+	SIDE_CLOCK_SOURCE_CYCLES,
+};
+
+struct side_clock {
+	enum side_clock_source source;
+	/* Cycle counter scaling: ns = ns_base + ((cycles - cycles_base) * mult) >> 32. */
+	uint64_t cycles_base;
+	uint64_t ns_base;
+	uint64_t mult;
+};
+
+extern struct side_clock side_clock __attribute__((visibility("hidden")));
+
+/* Select the clock source. Called once, by side_init(). */
+void side_clock_init(void) __attribute__((visibility("hidden")));
+
+static inline
+uint64_t side_clock_monotonic(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static inline
+uint64_t side_clock_cycles(void)
+{
+#if defined(__x86_64__)
+	uint32_t low, high;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+#elif defined(__aarch64__)
+	uint64_t v;
+
+	/* Prevent the counter read from being speculated before earlier loads. */
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (v) :: "memory");
+	return v;
+#else
+	return 0;
+#endif
+}
+
+static inline
+uint64_t side_clock_read(void)
+{
+	uint64_t delta;
+
+	if (side_likely(side_clock.source == SIDE_CLOCK_SOURCE_MONOTONIC))
+		return side_clock_monotonic();
+	delta = side_clock_cycles() - side_clock.cycles_base;
+	/* Counters of other CPUs may lag slightly behind the base. */
+	if (side_unlikely((int64_t) delta < 0))
+		delta = 0;
+	return side_clock.ns_base + (uint64_t) (((unsigned __int128) delta * side_clock.mult) >> 32);
+}
+
+#endif /* _SIDE_CLOCK_H */
@@ -0,0 +1,754 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctf2-metadata.h"
+#include "ring-buffer.h"
+#include "visit-description.h"
+
+#define CTF2_RECORD_SEPARATOR	"\x1e"
+#define CTF2_MAX_DEPTH		64
+
+struct ctf2_ctx {
+	char *buf;
+	size_t len;
+	size_t alloc;
+	bool error;		/* Allocation failure. */
+	bool unsupported;	/* Type without CTF 2 representation. */
+
+	/* Items emitted within each open list, for separators. */
+	uint32_t nr_items[CTF2_MAX_DEPTH];
+	unsigned int depth;
+
+	/* Structure member names from the payload root. */
+	const char *path[CTF2_MAX_DEPTH];
+	unsigned int path_len;
+
+	/* Skip the declared length type of variable-length arrays. */
+	unsigned int suppress;
+
+	/* Mappings of the enumeration or bitmap being visited. */
+	const struct side_enum_mappings *enum_mappings;
+	const struct side_enum_bitmap_mappings *bitmap_mappings;
+};
+
+static
+void ctf2_printf(struct ctf2_ctx *ctx, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+static
+void ctf2_printf(struct ctf2_ctx *ctx, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (ctx->error)
+		return;
+	for (;;) {
+		size_t avail = ctx->alloc - ctx->len;
+
+		va_start(ap, fmt);
+		ret = vsnprintf(ctx->buf + ctx->len, avail, fmt, ap);
+		va_end(ap);
+		if (ret < 0) {
+			ctx->error = true;
+			return;
+		}
+		if ((size_t) ret < avail) {
+			ctx->len += ret;
+			return;
+		} else {
+			size_t new_alloc = ctx->alloc ? ctx->alloc : 4096;
+			char *new_buf;
+
+			while (new_alloc - ctx->len <= (size_t) ret)
+				new_alloc <<= 1;
+			new_buf = (char *) realloc(ctx->buf, new_alloc);
+			if (!new_buf) {
+				ctx->error = true;
+				return;
+			}
+			ctx->buf = new_buf;
+			ctx->alloc = new_alloc;
+		}
+	}
+}
+
+static
+void ctf2_json_string(struct ctf2_ctx *ctx, const char *str)
+{
+	const unsigned char *p;
+
+	ctf2_printf(ctx, "\"");
+	for (p = (const unsigned char *) str; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			ctf2_printf(ctx, "\\%c", *p);
+		else if (*p < 0x20)
+			ctf2_printf(ctx, "\\u%04x", *p);
+		else
+			ctf2_printf(ctx, "%c", *p);
+	}
+	ctf2_printf(ctx, "\"");
+}
+
+static
+void ctf2_begin_list(struct ctf2_ctx *ctx)
+{
+	if (ctx->depth == CTF2_MAX_DEPTH) {
+		ctx->unsupported = true;
+		return;
+	}
+	ctx->nr_items[ctx->depth++] = 0;
+}
+
+static
+void ctf2_list_item(struct ctf2_ctx *ctx)
+{
+	if (!ctx->depth)
+		return;
+	if (ctx->nr_items[ctx->depth - 1]++)
+		ctf2_printf(ctx, ",");
+}
+
+static
+void ctf2_end_list(struct ctf2_ctx *ctx)
+{
+	if (ctx->depth)
+		ctx->depth--;
+}
+
+static
+void ctf2_push_path(struct ctf2_ctx *ctx, const char *name)
+{
+	if (ctx->path_len == CTF2_MAX_DEPTH) {
+		ctx->unsupported = true;
+		return;
+	}
+	ctx->path[ctx->path_len++] = name;
+}
+
+static
+void ctf2_pop_path(struct ctf2_ctx *ctx)
+{
+	if (ctx->path_len)
+		ctx->path_len--;
+}
+
+/* Location of the member name following the current path. */
+static
+void ctf2_field_location(struct ctf2_ctx *ctx, const char *name)
+{
+	unsigned int i;
+
+	ctf2_printf(ctx, "{\"origin\":\"event-record-payload\",\"path\":[");
+	for (i = 0; i < ctx->path_len; i++) {
+		ctf2_json_string(ctx, ctx->path[i]);
+		ctf2_printf(ctx, ",");
+	}
+	ctf2_json_string(ctx, name);
+	ctf2_printf(ctx, "]}");
+}
+
+static
+const char *ctf2_byte_order(enum side_type_label_byte_order byte_order)
+{
+	return byte_order == SIDE_TYPE_BYTE_ORDER_LE ? "little-endian" : "big-endian";
+}
+
+static
+bool ctf2_utf8_label(struct ctf2_ctx *ctx, const struct side_type_raw_string *label)
+{
+	if (label->unit_size != 1) {
+		ctx->unsupported = true;
+		return false;
+	}
+	return true;
+}
+
+static
+void ctf2_enum_mappings(struct ctf2_ctx *ctx, const struct side_enum_mappings *mappings, bool is_signed)
+{
+	const struct side_enum_mapping *m = side_ptr_get(mappings->mappings.elements);
+	uint32_t i, j, nr = side_array_length(&mappings->mappings);
+	bool first = true;
+
+	if (!nr)
+		return;
+	ctf2_printf(ctx, ",\"mappings\":{");
+	/* Group the ranges of each label. */
+	for (i = 0; i < nr; i++) {
+		const char *label = (const char *) side_ptr_get(m[i].label.p);
+		bool first_range = true;
+
+		if (!ctf2_utf8_label(ctx, &m[i].label))
+			return;
+		for (j = 0; j < i; j++) {
+			if (!strcmp(label, (const char *) side_ptr_get(m[j].label.p)))
+				break;
+		}
+		if (j < i)
+			continue;
+		if (!first)
+			ctf2_printf(ctx, ",");
+		first = false;
+		ctf2_json_string(ctx, label);
+		ctf2_printf(ctx, ":[");
+		for (j = i; j < nr; j++) {
+			if (strcmp(label, (const char *) side_ptr_get(m[j].label.p)))
+				continue;
+			if (!first_range)
+				ctf2_printf(ctx, ",");
+			first_range = false;
+			if (is_signed)
+				ctf2_printf(ctx, "[%" PRId64 ",%" PRId64 "]", m[j].range_begin, m[j].range_end);
+			else
+				ctf2_printf(ctx, "[%" PRIu64 ",%" PRIu64 "]",
+					(uint64_t) m[j].range_begin, (uint64_t) m[j].range_end);
+		}
+		ctf2_printf(ctx, "]");
+	}
+	ctf2_printf(ctx, "}");
+}
+
+/* Returns false if no flag fits within the bitmap length. */
+static
+bool ctf2_bitmap_flags(struct ctf2_ctx *ctx, const struct side_enum_bitmap_mappings *mappings,
+		unsigned int bits)
+{
+	const struct side_enum_bitmap_mapping *m = side_ptr_get(mappings->mappings.elements);
+	uint32_t i, nr = side_array_length(&mappings->mappings);
+	bool first = true;
+
+	for (i = 0; i < nr; i++) {
+		if (!ctf2_utf8_label(ctx, &m[i].label))
+			return false;
+		if (m[i].range_begin >= bits || m[i].range_begin > m[i].range_end)
+			continue;
+		ctf2_printf(ctx, first ? ",\"flags\":{" : ",");
+		first = false;
+		ctf2_json_string(ctx, (const char *) side_ptr_get(m[i].label.p));
+		ctf2_printf(ctx, ":[[%" PRIu64 ",%" PRIu64 "]]", m[i].range_begin,
+			m[i].range_end < bits ? m[i].range_end : bits - 1);
+	}
+	if (first)
+		return false;
+	ctf2_printf(ctx, "}");
+	return true;
+}
+
+static
+void ctf2_integer(struct ctf2_ctx *ctx, bool is_signed, unsigned int bits,
+		enum side_type_label_byte_order byte_order, unsigned int display_base)
+{
+	const struct side_enum_bitmap_mappings *bitmap_mappings = ctx->bitmap_mappings;
+	const struct side_enum_mappings *enum_mappings = ctx->enum_mappings;
+
+	if (ctx->suppress)
+		return;
+	ctx->bitmap_mappings = NULL;
+	ctx->enum_mappings = NULL;
+	if (bitmap_mappings) {
+		size_t len = ctx->len;
+
+		ctf2_printf(ctx, "{\"type\":\"fixed-length-bit-map\",\"length\":%u,\"byte-order\":\"%s\"",
+			bits, ctf2_byte_order(byte_order));
+		if (ctf2_bitmap_flags(ctx, bitmap_mappings, bits)) {
+			ctf2_printf(ctx, "}");
+			return;
+		}
+		/* No flag: describe the underlying integer. */
+		ctx->len = len;
+	}
+	ctf2_printf(ctx, "{\"type\":\"fixed-length-%s-integer\",\"length\":%u,\"byte-order\":\"%s\"",
+		is_signed ? "signed" : "unsigned", bits, ctf2_byte_order(byte_order));
+	if (display_base != 10)
+		ctf2_printf(ctx, ",\"preferred-display-base\":%u", display_base);
+	if (enum_mappings)
+		ctf2_enum_mappings(ctx, enum_mappings, is_signed);
+	ctf2_printf(ctx, "}");
+}
+
+static
+void ctf2_bool(struct ctf2_ctx *ctx, const struct side_type_bool *type)
+{
+	if (ctx->suppress)
+		return;
+	ctf2_printf(ctx, "{\"type\":\"fixed-length-boolean\",\"length\":%u,\"byte-order\":\"%s\"}",
+		type->bool_size * 8, ctf2_byte_order(side_enum_get(type->byte_order)));
+}
+
+static
+void ctf2_float(struct ctf2_ctx *ctx, const struct side_type_float *type)
+{
+	if (ctx->suppress)
+		return;
+	ctf2_printf(ctx, "{\"type\":\"fixed-length-floating-point-number\",\"length\":%u,\"byte-order\":\"%s\"}",
+		type->float_size * 8, ctf2_byte_order(side_enum_get(type->byte_order)));
+}
+
+static
+void ctf2_string(struct ctf2_ctx *ctx, const struct side_type_string *type)
+{
+	const char *bo = side_enum_get(type->byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be";
+
+	if (ctx->suppress)
+		return;
+	switch (type->unit_size) {
+	case 1:
+		ctf2_printf(ctx, "{\"type\":\"null-terminated-string\",\"encoding\":\"utf-8\"}");
+		break;
+	case 2:
+	case 4:
+		ctf2_printf(ctx, "{\"type\":\"null-terminated-string\",\"encoding\":\"utf-%u%s\"}",
+			type->unit_size * 8, bo);
+		break;
+	default:
+		ctx->unsupported = true;
+		break;
+	}
+}
+
+/* Length of variable-length arrays, as encoded by the tracer. */
+static
+void ctf2_length(struct ctf2_ctx *ctx)
+{
+	ctf2_printf(ctx, "{\"type\":\"fixed-length-unsigned-integer\",\"length\":32,\"byte-order\":\"%s\"}",
+		ctf2_byte_order(SIDE_TYPE_BYTE_ORDER_HOST));
+}
+
+/* Description visitor callbacks. */
+
+static
+void ctf2_before_field(const struct side_event_field *item_desc, void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_list_item(ctx);
+	ctf2_printf(ctx, "{\"name\":");
+	ctf2_json_string(ctx, side_ptr_get(item_desc->field_name));
+	ctf2_printf(ctx, ",\"field-class\":");
+	ctf2_push_path(ctx, side_ptr_get(item_desc->field_name));
+}
+
+static
+void ctf2_after_field(const struct side_event_field *item_desc __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_pop_path(ctx);
+	ctf2_printf(ctx, "}");
+}
+
+static
+void ctf2_before_option(const struct side_variant_option *option_desc, void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_list_item(ctx);
+	ctf2_printf(ctx, "{\"selector-field-ranges\":[[%" PRId64 ",%" PRId64 "]],\"field-class\":",
+		option_desc->range_begin, option_desc->range_end);
+}
+
+static
+void ctf2_after_option(const struct side_variant_option *option_desc __attribute__((unused)), void *priv)
+{
+	ctf2_printf((struct ctf2_ctx *) priv, "}");
+}
+
+static
+void ctf2_null_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	if (ctx->suppress)
+		return;
+	ctf2_printf(ctx, "{\"type\":\"structure\"}");
+}
+
+static
+void ctf2_bool_type(const struct side_type *type_desc, void *priv)
+{
+	ctf2_bool((struct ctf2_ctx *) priv, &type_desc->u.side_bool);
+}
+
+static
+void ctf2_integer_type(const struct side_type *type_desc, void *priv)
+{
+	const struct side_type_integer *type = &type_desc->u.side_integer;
+
+	ctf2_integer((struct ctf2_ctx *) priv, type->signedness, type->integer_size * 8,
+		side_enum_get(type->byte_order), 10);
+}
+
+static
+void ctf2_byte_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	ctf2_integer((struct ctf2_ctx *) priv, false, 8, SIDE_TYPE_BYTE_ORDER_HOST, 16);
+}
+
+static
+void ctf2_pointer_type(const struct side_type *type_desc, void *priv)
+{
+	const struct side_type_integer *type = &type_desc->u.side_integer;
+
+	ctf2_integer((struct ctf2_ctx *) priv, false, type->integer_size * 8,
+		side_enum_get(type->byte_order), 16);
+}
+
+static
+void ctf2_float_type(const struct side_type *type_desc, void *priv)
+{
+	ctf2_float((struct ctf2_ctx *) priv, &type_desc->u.side_float);
+}
+
+static
+void ctf2_string_type(const struct side_type *type_desc, void *priv)
+{
+	ctf2_string((struct ctf2_ctx *) priv, &type_desc->u.side_string);
+}
+
+static
+void ctf2_before_struct_type(const struct side_type_struct *side_struct __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_printf(ctx, "{\"type\":\"structure\",\"member-classes\":[");
+	ctf2_begin_list(ctx);
+}
+
+static
+void ctf2_after_struct_type(const struct side_type_struct *side_struct __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_end_list(ctx);
+	ctf2_printf(ctx, "]}");
+}
+
+static
+void ctf2_before_variant_type(const struct side_type_variant *side_variant, void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+	const struct side_type_integer *selector = &side_variant->selector.u.side_integer;
+
+	ctf2_printf(ctx, "{\"type\":\"structure\",\"member-classes\":[{\"name\":\"selector\",\"field-class\":");
+	ctf2_integer(ctx, selector->signedness, selector->integer_size * 8,
+		side_enum_get(selector->byte_order), 10);
+	ctf2_printf(ctx, "},{\"name\":\"option\",\"field-class\":{\"type\":\"variant\",\"selector-field-location\":");
+	ctf2_field_location(ctx, "selector");
+	ctf2_printf(ctx, ",\"options\":[");
+	ctf2_push_path(ctx, "option");
+	ctf2_begin_list(ctx);
+}
+
+static
+void ctf2_after_variant_type(const struct side_type_variant *side_variant __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_end_list(ctx);
+	ctf2_pop_path(ctx);
+	ctf2_printf(ctx, "]}}]}");
+}
+
+static
+void ctf2_before_array_type(const struct side_type_array *side_array, void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctx->bitmap_mappings = NULL;
+	ctf2_printf(ctx, "{\"type\":\"static-length-array\",\"length\":%" PRIu32 ",\"element-field-class\":",
+		side_array->length);
+}
+
+static
+void ctf2_after_array_type(const struct side_type_array *side_array __attribute__((unused)), void *priv)
+{
+	ctf2_printf((struct ctf2_ctx *) priv, "}");
+}
+
+static
+void ctf2_begin_vla(struct ctf2_ctx *ctx)
+{
+	ctx->bitmap_mappings = NULL;
+	ctf2_printf(ctx, "{\"type\":\"structure\",\"member-classes\":[{\"name\":\"length\",\"field-class\":");
+	ctf2_length(ctx);
+	ctf2_printf(ctx, "},{\"name\":\"elements\",\"field-class\":{\"type\":\"dynamic-length-array\",\"length-field-location\":");
+	ctf2_field_location(ctx, "length");
+	ctf2_printf(ctx, ",\"element-field-class\":");
+	ctf2_push_path(ctx, "elements");
+	ctx->suppress++;
+}
+
+static
+void ctf2_end_vla(struct ctf2_ctx *ctx)
+{
+	ctf2_pop_path(ctx);
+	ctf2_printf(ctx, "}}]}");
+}
+
+static
+void ctf2_before_vla_type(const struct side_type_vla *side_vla __attribute__((unused)), void *priv)
+{
+	ctf2_begin_vla((struct ctf2_ctx *) priv);
+}
+
+static
+void ctf2_after_length_vla_type(const struct side_type_vla *side_vla __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->suppress--;
+}
+
+static
+void ctf2_after_element_vla_type(const struct side_type_vla *side_vla __attribute__((unused)), void *priv)
+{
+	ctf2_end_vla((struct ctf2_ctx *) priv);
+}
+
+static
+void ctf2_before_vla_visitor_type(const struct side_type_vla_visitor *side_vla_visitor __attribute__((unused)), void *priv)
+{
+	ctf2_begin_vla((struct ctf2_ctx *) priv);
+}
+
+static
+void ctf2_after_length_vla_visitor_type(const struct side_type_vla_visitor *side_vla_visitor __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->suppress--;
+}
+
+static
+void ctf2_after_element_vla_visitor_type(const struct side_type_vla_visitor *side_vla_visitor __attribute__((unused)), void *priv)
+{
+	ctf2_end_vla((struct ctf2_ctx *) priv);
+}
+
+static
+void ctf2_before_optional_type(const struct side_type *optional __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_printf(ctx, "{\"type\":\"structure\",\"member-classes\":[{\"name\":\"selector\",\"field-class\":"
+		"{\"type\":\"fixed-length-boolean\",\"length\":8,\"byte-order\":\"%s\"}},"
+		"{\"name\":\"value\",\"field-class\":{\"type\":\"optional\",\"selector-field-location\":",
+		ctf2_byte_order(SIDE_TYPE_BYTE_ORDER_HOST));
+	ctf2_field_location(ctx, "selector");
+	ctf2_printf(ctx, ",\"field-class\":");
+	ctf2_push_path(ctx, "value");
+}
+
+static
+void ctf2_after_optional_type(const struct side_type *optional __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctf2_pop_path(ctx);
+	ctf2_printf(ctx, "}}]}");
+}
+
+static
+void ctf2_before_enum_type(const struct side_type *type_desc, void *priv)
+{
+	((struct ctf2_ctx *) priv)->enum_mappings = side_ptr_get(type_desc->u.side_enum.mappings);
+}
+
+static
+void ctf2_before_enum_bitmap_type(const struct side_type *type_desc, void *priv)
+{
+	((struct ctf2_ctx *) priv)->bitmap_mappings = side_ptr_get(type_desc->u.side_enum_bitmap.mappings);
+}
+
+static
+void ctf2_after_enum_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	struct ctf2_ctx *ctx = (struct ctf2_ctx *) priv;
+
+	ctx->enum_mappings = NULL;
+	ctx->bitmap_mappings = NULL;
+}
+
+static
+void ctf2_gather_bool_type(const struct side_type_gather_bool *type, void *priv)
+{
+	ctf2_bool((struct ctf2_ctx *) priv, &type->type);
+}
+
+static
+void ctf2_gather_byte_type(const struct side_type_gather_byte *type __attribute__((unused)), void *priv)
+{
+	ctf2_integer((struct ctf2_ctx *) priv, false, 8, SIDE_TYPE_BYTE_ORDER_HOST, 16);
+}
+
+static
+void ctf2_gather_integer_type(const struct side_type_gather_integer *type, void *priv)
+{
+	ctf2_integer((struct ctf2_ctx *) priv, type->type.signedness, type->type.integer_size * 8,
+		side_enum_get(type->type.byte_order), 10);
+}
+
+static
+void ctf2_gather_pointer_type(const struct side_type_gather_integer *type, void *priv)
+{
+	ctf2_integer((struct ctf2_ctx *) priv, false, type->type.integer_size * 8,
+		side_enum_get(type->type.byte_order), 16);
+}
+
+static
+void ctf2_gather_float_type(const struct side_type_gather_float *type, void *priv)
+{
+	ctf2_float((struct ctf2_ctx *) priv, &type->type);
+}
+
+static
+void ctf2_gather_string_type(const struct side_type_gather_string *type, void *priv)
+{
+	ctf2_string((struct ctf2_ctx *) priv, &type->type);
+}
+
+static
+void ctf2_before_gather_enum_type(const struct side_type_gather_enum *type, void *priv)
+{
+	((struct ctf2_ctx *) priv)->enum_mappings = side_ptr_get(type->mappings);
+}
+
+static
+void ctf2_after_gather_enum_type(const struct side_type_gather_enum *type __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->enum_mappings = NULL;
+}
+
+static
+void ctf2_before_gather_struct_type(const struct side_type_gather_struct *type __attribute__((unused)), void *priv)
+{
+	ctf2_before_struct_type(NULL, priv);
+}
+
+static
+void ctf2_after_gather_struct_type(const struct side_type_gather_struct *type __attribute__((unused)), void *priv)
+{
+	ctf2_after_struct_type(NULL, priv);
+}
+
+/* Not traced by the ring buffer tracer. */
+
+static
+void ctf2_before_gather_array_type(const struct side_type_gather_array *type __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->unsupported = true;
+}
+
+static
+void ctf2_before_gather_vla_type(const struct side_type_gather_vla *type __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->unsupported = true;
+}
+
+/* Dynamic values carry their own type, which is not described statically. */
+static
+void ctf2_dynamic_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	((struct ctf2_ctx *) priv)->unsupported = true;
+}
+
+static const struct side_description_visitor ctf2_visitor = {
+	.before_field_func = ctf2_before_field,
+	.after_field_func = ctf2_after_field,
+	.before_option_func = ctf2_before_option,
+	.after_option_func = ctf2_after_option,
+	.null_type_func = ctf2_null_type,
+	.bool_type_func = ctf2_bool_type,
+	.integer_type_func = ctf2_integer_type,
+	.byte_type_func = ctf2_byte_type,
+	.pointer_type_func = ctf2_pointer_type,
+	.float_type_func = ctf2_float_type,
+	.string_type_func = ctf2_string_type,
+	.before_struct_type_func = ctf2_before_struct_type,
+	.after_struct_type_func = ctf2_after_struct_type,
+	.before_variant_type_func = ctf2_before_variant_type,
+	.after_variant_type_func = ctf2_after_variant_type,
+	.before_array_type_func = ctf2_before_array_type,
+	.after_array_type_func = ctf2_after_array_type,
+	.before_vla_type_func = ctf2_before_vla_type,
+	.after_length_vla_type_func = ctf2_after_length_vla_type,
+	.after_element_vla_type_func = ctf2_after_element_vla_type,
+	.before_vla_visitor_type_func = ctf2_before_vla_visitor_type,
+	.after_length_vla_visitor_type_func = ctf2_after_length_vla_visitor_type,
+	.after_element_vla_visitor_type_func = ctf2_after_element_vla_visitor_type,
+	.before_optional_type_func = ctf2_before_optional_type,
+	.after_optional_type_func = ctf2_after_optional_type,
+	.before_enum_type_func = ctf2_before_enum_type,
+	.after_enum_type_func = ctf2_after_enum_type,
+	.before_enum_bitmap_type_func = ctf2_before_enum_bitmap_type,
+	.after_enum_bitmap_type_func = ctf2_after_enum_type,
+	.gather_bool_type_func = ctf2_gather_bool_type,
+	.gather_byte_type_func = ctf2_gather_byte_type,
+	.gather_integer_type_func = ctf2_gather_integer_type,
+	.gather_pointer_type_func = ctf2_gather_pointer_type,
+	.gather_float_type_func = ctf2_gather_float_type,
+	.gather_string_type_func = ctf2_gather_string_type,
+	.before_gather_struct_type_func = ctf2_before_gather_struct_type,
+	.after_gather_struct_type_func = ctf2_after_gather_struct_type,
+	.before_gather_array_type_func = ctf2_before_gather_array_type,
+	.before_gather_vla_type_func = ctf2_before_gather_vla_type,
+	.before_gather_enum_type_func = ctf2_before_gather_enum_type,
+	.after_gather_enum_type_func = ctf2_after_gather_enum_type,
+	.dynamic_type_func = ctf2_dynamic_type,
+};
+
+char *side_ctf2_trace_metadata(void)
+{
+	struct ctf2_ctx ctx;
+	const char *bo = ctf2_byte_order(SIDE_TYPE_BYTE_ORDER_HOST);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctf2_printf(&ctx, CTF2_RECORD_SEPARATOR "{\"type\":\"preamble\",\"version\":2}\n");
+	ctf2_printf(&ctx, CTF2_RECORD_SEPARATOR "{\"type\":\"trace-class\"}\n");
+	ctf2_printf(&ctx, CTF2_RECORD_SEPARATOR "{\"type\":\"clock-class\",\"id\":\"monotonic\","
+		"\"name\":\"monotonic\",\"frequency\":1000000000}\n");
+	ctf2_printf(&ctx, CTF2_RECORD_SEPARATOR "{\"type\":\"data-stream-class\","
+		"\"default-clock-class-id\":\"monotonic\","
+		"\"event-record-header-field-class\":{\"type\":\"structure\",\"minimum-alignment\":%d,\"member-classes\":["
+		"{\"name\":\"size\",\"field-class\":{\"type\":\"fixed-length-unsigned-integer\","
+			"\"length\":32,\"byte-order\":\"%s\"}},"
+		"{\"name\":\"id\",\"field-class\":{\"type\":\"fixed-length-unsigned-integer\","
+			"\"length\":32,\"byte-order\":\"%s\",\"roles\":[\"event-record-class-id\"]}},"
+		"{\"name\":\"timestamp\",\"field-class\":{\"type\":\"fixed-length-unsigned-integer\","
+			"\"length\":64,\"byte-order\":\"%s\",\"roles\":[\"default-clock-timestamp\"]}}"
+		"]}}\n", SIDE_RING_BUFFER_ALIGN * 8, bo, bo, bo);
+	if (ctx.error) {
+		free(ctx.buf);
+		return NULL;
+	}
+	return ctx.buf;
+}
+
+char *side_ctf2_event_metadata(const struct side_event_description *desc, uint32_t id)
+{
+	struct ctf2_ctx ctx;
+
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return NULL;
+	memset(&ctx, 0, sizeof(ctx));
+	ctf2_printf(&ctx, CTF2_RECORD_SEPARATOR "{\"type\":\"event-record-class\",\"id\":%" PRIu32 ",\"namespace\":", id);
+	ctf2_json_string(&ctx, side_ptr_get(desc->provider_name));
+	ctf2_printf(&ctx, ",\"name\":");
+	ctf2_json_string(&ctx, side_ptr_get(desc->event_name));
+	ctf2_printf(&ctx, ",\"attributes\":{\"libside\":{\"loglevel\":%d}}", (int) side_enum_get(desc->loglevel));
+	ctf2_printf(&ctx, ",\"payload-field-class\":{\"type\":\"structure\",\"member-classes\":[");
+	ctf2_begin_list(&ctx);
+	description_visitor_event(&ctf2_visitor, desc, &ctx);
+	ctf2_end_list(&ctx);
+	ctf2_printf(&ctx, "]}}\n");
+	if (ctx.error || ctx.unsupported) {
+		free(ctx.buf);
+		return NULL;
+	}
+	return ctx.buf;
+}
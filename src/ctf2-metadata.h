@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_CTF2_METADATA_H
+#define _SIDE_CTF2_METADATA_H
+
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * CTF 2 metadata describing records encoded by the ring buffer tracer,
+ * as JSON text sequence fragments (RFC 7464).
+ *
+ * Each record is a data stream event record: its event record header
+ * holds the u32 record size, the u32 event ID (mapped to the event
+ * record class ID) and the u64 timestamp of the "monotonic" clock
+ * class, in nanoseconds. Payload field classes follow the ring buffer
+ * tracer encoding: variable-length arrays, optionals and variants are
+ * structures holding their length or selector member, followed by their
+ * elements or value.
+ *
+ * Returned strings are allocated with malloc().
+ */
+
+/*
+ * Preamble, trace class, clock class and data stream class fragments.
+ * Returns NULL on allocation failure.
+ */
+char *side_ctf2_trace_metadata(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Event record class fragment of an event. Returns NULL if the event
+ * uses types without a CTF 2 representation (dynamic types, variadic
+ * fields, gather compound types, non UTF-8 enumeration labels), or on
+ * allocation failure.
+ */
+char *side_ctf2_event_metadata(const struct side_event_description *desc, uint32_t id)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_CTF2_METADATA_H */
@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "event-registry.h"
+
+#define SIDE_EVENT_REGISTRY_MIN_BUCKETS	64
+
+struct side_event_hash_table {
+	struct side_event_registry_entry **buckets;
+	size_t nr_buckets;	/* Power of two. */
+};
+
+static struct side_event_hash_table name_table, desc_table;
+static size_t nr_entries;
+
+/* Entries indexed by event ID. */
+static struct side_event_registry_entry **id_table;
+static uint32_t id_table_len, id_limit;
+
+/* Stack of IDs released by unregistered events. */
+static uint32_t *free_ids;
+static uint32_t nr_free_ids, free_ids_len;
+
+/* FNV-1a hash of the provider and event names. */
+static
+uint64_t name_hash(const char *provider_name, const char *event_name)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const char *p;
+
+	for (p = provider_name; *p; p++)
+		hash = (hash ^ (uint8_t) *p) * 0x100000001b3ULL;
+	hash = (hash ^ (uint8_t) ':') * 0x100000001b3ULL;
+	for (p = event_name; *p; p++)
+		hash = (hash ^ (uint8_t) *p) * 0x100000001b3ULL;
+	return hash;
+}
+
+static
+uint64_t desc_hash(const struct side_event_description *desc)
+{
+	uint64_t hash = (uint64_t) (uintptr_t) desc;
+
+	/* Mix pointer bits (splitmix64 finalizer). */
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+	return hash ^ (hash >> 31);
+}
+
+static
+uint64_t entry_name_hash(const struct side_event_registry_entry *entry)
+{
+	return name_hash(side_ptr_get(entry->desc->provider_name),
+			side_ptr_get(entry->desc->event_name));
+}
+
+/* Grow both hash tables to hold at least nr entries. */
+static
+int hash_tables_reserve(size_t nr)
+{
+	struct side_event_registry_entry **name_buckets, **desc_buckets;
+	size_t nr_buckets = name_table.nr_buckets, i;
+
+	if (nr_buckets >= nr && nr_buckets)
+		return SIDE_ERROR_OK;
+	if (!nr_buckets)
+		nr_buckets = SIDE_EVENT_REGISTRY_MIN_BUCKETS;
+	while (nr_buckets < nr)
+		nr_buckets <<= 1;
+	name_buckets = (struct side_event_registry_entry **)
+			calloc(nr_buckets, sizeof(struct side_event_registry_entry *));
+	if (!name_buckets)
+		return SIDE_ERROR_NOMEM;
+	desc_buckets = (struct side_event_registry_entry **)
+			calloc(nr_buckets, sizeof(struct side_event_registry_entry *));
+	if (!desc_buckets) {
+		free(name_buckets);
+		return SIDE_ERROR_NOMEM;
+	}
+	/* Rehash, preserving the registration order within chains. */
+	for (i = 0; i < name_table.nr_buckets; i++) {
+		struct side_event_registry_entry *entry, *next;
+
+		for (entry = name_table.buckets[i]; entry; entry = next) {
+			struct side_event_registry_entry **pos;
+
+			next = entry->name_next;
+			pos = &name_buckets[entry_name_hash(entry) & (nr_buckets - 1)];
+			while (*pos)
+				pos = &(*pos)->name_next;
+			entry->name_next = NULL;
+			*pos = entry;
+		}
+		for (entry = desc_table.buckets[i]; entry; entry = next) {
+			size_t bucket = desc_hash(entry->desc) & (nr_buckets - 1);
+
+			next = entry->desc_next;
+			entry->desc_next = desc_buckets[bucket];
+			desc_buckets[bucket] = entry;
+		}
+	}
+	free(name_table.buckets);
+	free(desc_table.buckets);
+	name_table.buckets = name_buckets;
+	name_table.nr_buckets = nr_buckets;
+	desc_table.buckets = desc_buckets;
+	desc_table.nr_buckets = nr_buckets;
+	return SIDE_ERROR_OK;
+}
+
+/* Reserve IDs for nr new entries. */
+static
+int ids_reserve(uint32_t nr)
+{
+	uint32_t nr_new_ids = nr > nr_free_ids ? nr - nr_free_ids : 0;
+	uint64_t len;
+
+	if (!nr_new_ids)
+		return SIDE_ERROR_OK;
+	len = (uint64_t) id_limit + nr_new_ids;
+	/* SIDE_EVENT_ID_INVALID is not a valid ID. */
+	if (len >= SIDE_EVENT_ID_INVALID)
+		return SIDE_ERROR_NOMEM;
+	if (len > id_table_len) {
+		struct side_event_registry_entry **new_table;
+		uint64_t new_len = id_table_len ? id_table_len : SIDE_EVENT_REGISTRY_MIN_BUCKETS;
+
+		while (new_len < len)
+			new_len <<= 1;
+		if (new_len >= SIDE_EVENT_ID_INVALID)
+			new_len = SIDE_EVENT_ID_INVALID - 1;
+		new_table = (struct side_event_registry_entry **)
+			realloc(id_table, new_len * sizeof(struct side_event_registry_entry *));
+		if (!new_table)
+			return SIDE_ERROR_NOMEM;
+		memset(&new_table[id_table_len], 0,
+			(new_len - id_table_len) * sizeof(struct side_event_registry_entry *));
+		id_table = new_table;
+		id_table_len = (uint32_t) new_len;
+	}
+	return SIDE_ERROR_OK;
+}
+
+static
+uint32_t id_alloc(void)
+{
+	if (nr_free_ids)
+		return free_ids[--nr_free_ids];
+	return id_limit++;
+}
+
+int side_event_registry_insert(struct side_event_registry_entry *entries,
+		struct side_event_description **events, uint32_t nr_events)
+{
+	uint32_t i, nr_new = 0;
+	int ret;
+
+	for (i = 0; i < nr_events; i++) {
+		if (events[i])
+			nr_new++;
+	}
+	ret = hash_tables_reserve(nr_entries + nr_new);
+	if (ret)
+		return ret;
+	ret = ids_reserve(nr_new);
+	if (ret)
+		return ret;
+	for (i = 0; i < nr_events; i++) {
+		struct side_event_registry_entry *entry = &entries[i], **pos;
+		struct side_event_description *desc = events[i];
+		size_t bucket;
+
+		entry->desc = desc;
+		entry->name_next = NULL;
+		entry->desc_next = NULL;
+		entry->id = SIDE_EVENT_ID_INVALID;
+		/* Skip NULL pointers */
+		if (!desc)
+			continue;
+		/* Append to keep the first registered event first. */
+		pos = &name_table.buckets[entry_name_hash(entry) & (name_table.nr_buckets - 1)];
+		while (*pos)
+			pos = &(*pos)->name_next;
+		*pos = entry;
+		bucket = desc_hash(desc) & (desc_table.nr_buckets - 1);
+		entry->desc_next = desc_table.buckets[bucket];
+		desc_table.buckets[bucket] = entry;
+		entry->id = id_alloc();
+		id_table[entry->id] = entry;
+		nr_entries++;
+	}
+	return SIDE_ERROR_OK;
+}
+
+void side_event_registry_remove(struct side_event_registry_entry *entries, uint32_t nr_events)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_events; i++) {
+		struct side_event_registry_entry *entry = &entries[i], **pos;
+
+		if (entry->id == SIDE_EVENT_ID_INVALID)
+			continue;
+		for (pos = &name_table.buckets[entry_name_hash(entry) & (name_table.nr_buckets - 1)];
+				*pos != entry; pos = &(*pos)->name_next) { }
+		*pos = entry->name_next;
+		for (pos = &desc_table.buckets[desc_hash(entry->desc) & (desc_table.nr_buckets - 1)];
+				*pos != entry; pos = &(*pos)->desc_next) { }
+		*pos = entry->desc_next;
+		id_table[entry->id] = NULL;
+		if (nr_free_ids == free_ids_len) {
+			uint32_t new_len = free_ids_len ? free_ids_len << 1 : SIDE_EVENT_REGISTRY_MIN_BUCKETS;
+			uint32_t *new_free_ids;
+
+			new_free_ids = (uint32_t *) realloc(free_ids, new_len * sizeof(uint32_t));
+			if (!new_free_ids) {
+				/* Leak the ID rather than failing. */
+				goto next;
+			}
+			free_ids = new_free_ids;
+			free_ids_len = new_len;
+		}
+		free_ids[nr_free_ids++] = entry->id;
+	next:
+		entry->id = SIDE_EVENT_ID_INVALID;
+		nr_entries--;
+	}
+}
+
+struct side_event_registry_entry *side_event_registry_lookup_name(const char *provider_name,
+		const char *event_name)
+{
+	struct side_event_registry_entry *entry;
+
+	if (!name_table.nr_buckets)
+		return NULL;
+	entry = name_table.buckets[name_hash(provider_name, event_name) & (name_table.nr_buckets - 1)];
+	for (; entry; entry = entry->name_next) {
+		if (!strcmp(side_ptr_get(entry->desc->event_name), event_name) &&
+		    !strcmp(side_ptr_get(entry->desc->provider_name), provider_name))
+			return entry;
+	}
+	return NULL;
+}
+
+struct side_event_registry_entry *side_event_registry_lookup_desc(const struct side_event_description *desc)
+{
+	struct side_event_registry_entry *entry;
+
+	if (!desc_table.nr_buckets)
+		return NULL;
+	entry = desc_table.buckets[desc_hash(desc) & (desc_table.nr_buckets - 1)];
+	for (; entry; entry = entry->desc_next) {
+		if (entry->desc == desc)
+			return entry;
+	}
+	return NULL;
+}
+
+struct side_event_registry_entry *side_event_registry_lookup_id(uint32_t id)
+{
+	if (id >= id_limit)
+		return NULL;
+	return id_table[id];
+}
+
+uint32_t side_event_registry_id_limit(void)
+{
+	return id_limit;
+}
+
+void side_event_registry_exit(void)
+{
+	free(name_table.buckets);
+	free(desc_table.buckets);
+	memset(&name_table, 0, sizeof(name_table));
+	memset(&desc_table, 0, sizeof(desc_table));
+	free(id_table);
+	id_table = NULL;
+	id_table_len = 0;
+	id_limit = 0;
+	free(free_ids);
+	free_ids = NULL;
+	nr_free_ids = 0;
+	free_ids_len = 0;
+	nr_entries = 0;
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_EVENT_REGISTRY_H
+#define _SIDE_EVENT_REGISTRY_H
+
+#include <stdint.h>
+#include <side/trace.h>
+
+#include "serialize-plan.h"
+#include "stats.h"
+#include "type-intern.h"
+
+/*
+ * Index of registered events by name and by description, with a dense
+ * event ID allocated to each registered event. IDs are reused after
+ * their event is unregistered.
+ *
+ * All functions must be called with the event lock held.
+ */
+
+struct side_event_registry_entry {
+	struct side_event_registry_entry *name_next;	/* Name hash chain. */
+	struct side_event_registry_entry *desc_next;	/* Description hash chain. */
+	struct side_event_description *desc;
+	/* Interned fields of the event, NULL on allocation failure. */
+	struct side_type_intern_layout *layout;
+	/* NULL unless the event layout is fixed. Shared by the layout. */
+	const struct side_serialize_plan *plan;
+	/* Performance counters, NULL until the event gets callbacks. */
+	struct side_event_stats_state *stats;
+	uint32_t id;
+};
+
+/*
+ * Index nr_events events into the caller-allocated entries array. NULL
+ * events are skipped. Returns SIDE_ERROR_OK or SIDE_ERROR_NOMEM, in
+ * which case no event is indexed.
+ */
+int side_event_registry_insert(struct side_event_registry_entry *entries,
+		struct side_event_description **events, uint32_t nr_events)
+	__attribute__((visibility("hidden")));
+void side_event_registry_remove(struct side_event_registry_entry *entries, uint32_t nr_events)
+	__attribute__((visibility("hidden")));
+/* Returns the first registered event matching the names, or NULL. */
+struct side_event_registry_entry *side_event_registry_lookup_name(const char *provider_name,
+		const char *event_name)
+	__attribute__((visibility("hidden")));
+struct side_event_registry_entry *side_event_registry_lookup_desc(const struct side_event_description *desc)
+	__attribute__((visibility("hidden")));
+struct side_event_registry_entry *side_event_registry_lookup_id(uint32_t id)
+	__attribute__((visibility("hidden")));
+/* One past the largest event ID in use. */
+uint32_t side_event_registry_id_limit(void)
+	__attribute__((visibility("hidden")));
+void side_event_registry_exit(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Take the event lock, for tracer threads using the registry outside of
+ * event notifications. The lock is recursive, so the side_tracer_*()
+ * functions can be called while holding it. Implemented by side.c.
+ */
+void side_event_registry_lock(void)
+	__attribute__((visibility("hidden")));
+void side_event_registry_unlock(void)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_EVENT_REGISTRY_H */
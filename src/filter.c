@@ -0,0 +1,695 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+/* Parenthesis and negation nesting limit. */
+#define FILTER_MAX_NESTING	32
+
+struct filter_parser {
+	const struct side_event_description *desc;
+	const char *p;
+	struct side_filter *filter;
+	uint32_t max_ops;
+	int nesting;
+	int error;
+};
+
+/* Operand of a comparison: a field or a literal. */
+struct filter_operand {
+	const struct side_event_field *field;	/* NULL for literals. */
+	uint32_t arg_index;
+	enum {
+		FILTER_LITERAL_INTEGER,
+		FILTER_LITERAL_STRING,
+	} kind;
+	bool negative;
+	uint64_t value;				/* Absolute value. */
+	char *string;
+};
+
+static
+void filter_skip_space(struct filter_parser *parser)
+{
+	while (isspace((unsigned char) *parser->p))
+		parser->p++;
+}
+
+static
+bool filter_match_token(struct filter_parser *parser, const char *token)
+{
+	size_t len = strlen(token);
+
+	filter_skip_space(parser);
+	if (strncmp(parser->p, token, len))
+		return false;
+	parser->p += len;
+	return true;
+}
+
+static
+struct side_filter_op *filter_append(struct filter_parser *parser, enum side_filter_opcode opcode)
+{
+	struct side_filter *filter = parser->filter;
+	struct side_filter_op *op;
+
+	if (parser->error)
+		return NULL;
+	if (filter->nr_ops == parser->max_ops) {
+		uint32_t max_ops = parser->max_ops ? 2 * parser->max_ops : 8;
+
+		filter = (struct side_filter *) realloc(filter, sizeof(struct side_filter)
+				+ max_ops * sizeof(struct side_filter_op));
+		if (!filter) {
+			parser->error = SIDE_ERROR_NOMEM;
+			return NULL;
+		}
+		parser->filter = filter;
+		parser->max_ops = max_ops;
+	}
+	op = &filter->ops[filter->nr_ops++];
+	memset(op, 0, sizeof(*op));
+	op->opcode = opcode;
+	return op;
+}
+
+static
+void filter_set_integer(struct side_filter_op *op, const struct side_type_integer *type_integer)
+{
+	op->size = type_integer->integer_size;
+	op->len_bits = type_integer->len_bits ? type_integer->len_bits : op->size * CHAR_BIT;
+	op->signedness = type_integer->signedness;
+	op->reverse_bo = side_enum_get(type_integer->byte_order) != SIDE_TYPE_BYTE_ORDER_HOST;
+}
+
+static
+void filter_set_bool(struct side_filter_op *op, const struct side_type_bool *type_bool)
+{
+	op->size = type_bool->bool_size;
+	op->len_bits = type_bool->len_bits ? type_bool->len_bits : op->size * CHAR_BIT;
+	op->reverse_bo = side_enum_get(type_bool->byte_order) != SIDE_TYPE_BYTE_ORDER_HOST;
+	op->boolean = true;
+}
+
+/*
+ * Set the field loaded by a comparison. Only fields with a value which
+ * fits in 64 bits and UTF-8 strings can be compared.
+ */
+static
+int filter_set_field(struct side_filter_op *op, const struct side_type *type_desc)
+{
+	enum side_type_label label = side_enum_get(type_desc->type);
+
+	op->label = label;
+	switch (label) {
+	case SIDE_TYPE_BOOL:
+		op->load = SIDE_FILTER_LOAD_INTEGER;
+		filter_set_bool(op, &type_desc->u.side_bool);
+		break;
+	case SIDE_TYPE_BYTE:
+		op->load = SIDE_FILTER_LOAD_INTEGER;
+		op->size = 1;
+		op->len_bits = CHAR_BIT;
+		break;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_POINTER:
+		op->load = SIDE_FILTER_LOAD_INTEGER;
+		filter_set_integer(op, &type_desc->u.side_integer);
+		break;
+	case SIDE_TYPE_ENUM:
+	{
+		const struct side_type *elem_type = side_ptr_get(type_desc->u.side_enum.elem_type);
+
+		switch (side_enum_get(elem_type->type)) {
+		case SIDE_TYPE_U8:
+		case SIDE_TYPE_U16:
+		case SIDE_TYPE_U32:
+		case SIDE_TYPE_U64:
+		case SIDE_TYPE_S8:
+		case SIDE_TYPE_S16:
+		case SIDE_TYPE_S32:
+		case SIDE_TYPE_S64:
+			return filter_set_field(op, elem_type);
+		default:
+			return SIDE_ERROR_INVAL;
+		}
+	}
+	case SIDE_TYPE_STRING_UTF8:
+		if (type_desc->u.side_string.unit_size != 1)
+			return SIDE_ERROR_INVAL;
+		op->load = SIDE_FILTER_LOAD_STRING;
+		break;
+	case SIDE_TYPE_LAZY:
+	{
+		const struct side_type *value_type = side_ptr_get(side_ptr_get(type_desc->u.side_lazy)->value_type);
+
+		if (op->lazy)
+			return SIDE_ERROR_INVAL;
+		op->lazy = type_desc;
+		return filter_set_field(op, value_type);
+	}
+	case SIDE_TYPE_GATHER_BOOL:
+	{
+		const struct side_type_gather_bool *side_bool = &type_desc->u.side_gather.u.side_bool;
+
+		op->load = SIDE_FILTER_LOAD_GATHER_INTEGER;
+		op->access = side_enum_get(side_bool->access_mode);
+		op->offset = side_bool->offset;
+		op->offset_bits = side_bool->offset_bits;
+		filter_set_bool(op, &side_bool->type);
+		break;
+	}
+	case SIDE_TYPE_GATHER_BYTE:
+	{
+		const struct side_type_gather_byte *side_byte = &type_desc->u.side_gather.u.side_byte;
+
+		op->load = SIDE_FILTER_LOAD_GATHER_INTEGER;
+		op->access = side_enum_get(side_byte->access_mode);
+		op->offset = side_byte->offset;
+		op->size = 1;
+		op->len_bits = CHAR_BIT;
+		break;
+	}
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+	{
+		const struct side_type_gather_integer *side_integer = &type_desc->u.side_gather.u.side_integer;
+
+		if (side_integer->type.integer_size > sizeof(uint64_t))
+			return SIDE_ERROR_INVAL;
+		op->load = SIDE_FILTER_LOAD_GATHER_INTEGER;
+		op->access = side_enum_get(side_integer->access_mode);
+		op->offset = side_integer->offset;
+		op->offset_bits = side_integer->offset_bits;
+		filter_set_integer(op, &side_integer->type);
+		break;
+	}
+	case SIDE_TYPE_GATHER_ENUM:
+	{
+		const struct side_type *elem_type = side_ptr_get(type_desc->u.side_gather.u.side_enum.elem_type);
+
+		if (side_enum_get(elem_type->type) != SIDE_TYPE_GATHER_INTEGER)
+			return SIDE_ERROR_INVAL;
+		return filter_set_field(op, elem_type);
+	}
+	case SIDE_TYPE_GATHER_STRING:
+	{
+		const struct side_type_gather_string *side_string = &type_desc->u.side_gather.u.side_string;
+
+		if (side_string->type.unit_size != 1)
+			return SIDE_ERROR_INVAL;
+		op->load = SIDE_FILTER_LOAD_GATHER_STRING;
+		op->access = side_enum_get(side_string->access_mode);
+		op->offset = side_string->offset;
+		break;
+	}
+	default:
+		return SIDE_ERROR_INVAL;
+	}
+	if (op->size > sizeof(uint64_t) || op->offset_bits + op->len_bits > op->size * CHAR_BIT)
+		return SIDE_ERROR_INVAL;
+	switch (op->access) {
+	case SIDE_TYPE_GATHER_ACCESS_DIRECT:
+	case SIDE_TYPE_GATHER_ACCESS_POINTER:
+		break;
+	default:
+		return SIDE_ERROR_INVAL;
+	}
+	return SIDE_ERROR_OK;
+}
+
+static
+char *filter_parse_string(struct filter_parser *parser)
+{
+	const char *p = parser->p + 1;	/* Skip opening quote. */
+	char *string, *q;
+
+	string = (char *) malloc(strlen(p) + 1);
+	if (!string) {
+		parser->error = SIDE_ERROR_NOMEM;
+		return NULL;
+	}
+	for (q = string; *p != '"'; p++) {
+		if (*p == '\\')
+			p++;
+		if (*p == '\0') {
+			free(string);
+			parser->error = SIDE_ERROR_INVAL;
+			return NULL;
+		}
+		*q++ = *p;
+	}
+	*q = '\0';
+	parser->p = p + 1;
+	return string;
+}
+
+static
+void filter_parse_operand(struct filter_parser *parser, struct filter_operand *operand)
+{
+	const char *p;
+
+	memset(operand, 0, sizeof(*operand));
+	filter_skip_space(parser);
+	p = parser->p;
+	if (*p == '"') {
+		operand->kind = FILTER_LITERAL_STRING;
+		operand->string = filter_parse_string(parser);
+	} else if (*p == '-' || isdigit((unsigned char) *p)) {
+		char *end;
+
+		if (*p == '-') {
+			operand->negative = true;
+			p++;
+		}
+		if (!isdigit((unsigned char) *p))
+			goto error;
+		errno = 0;
+		operand->value = strtoull(p, &end, 0);
+		if (errno || isalnum((unsigned char) *end) || *end == '_')
+			goto error;
+		if (operand->negative && operand->value > (uint64_t) INT64_MAX + 1)
+			goto error;
+		operand->kind = FILTER_LITERAL_INTEGER;
+		parser->p = end;
+	} else if (isalpha((unsigned char) *p) || *p == '_') {
+		const struct side_event_field *fields = side_ptr_get(parser->desc->fields.elements);
+		size_t len;
+		uint32_t i;
+
+		while (isalnum((unsigned char) *p) || *p == '_')
+			p++;
+		len = p - parser->p;
+		for (i = 0; i < side_array_length(&parser->desc->fields); i++) {
+			const char *field_name = side_ptr_get(fields[i].field_name);
+
+			if (!strncmp(field_name, parser->p, len) && field_name[len] == '\0') {
+				operand->field = &fields[i];
+				operand->arg_index = i;
+				break;
+			}
+		}
+		if (!operand->field) {
+			/* Field names take precedence over keywords. */
+			operand->kind = FILTER_LITERAL_INTEGER;
+			if (len == 4 && !strncmp(parser->p, "true", len))
+				operand->value = 1;
+			else if (!(len == 5 && !strncmp(parser->p, "false", len)))
+				goto error;
+		}
+		parser->p = p;
+	} else {
+		goto error;
+	}
+	return;
+error:
+	parser->error = SIDE_ERROR_INVAL;
+}
+
+static
+bool filter_parse_cmp(struct filter_parser *parser, enum side_filter_cmp *cmp)
+{
+	if (filter_match_token(parser, "=="))
+		*cmp = SIDE_FILTER_CMP_EQ;
+	else if (filter_match_token(parser, "!="))
+		*cmp = SIDE_FILTER_CMP_NE;
+	else if (filter_match_token(parser, "<="))
+		*cmp = SIDE_FILTER_CMP_LE;
+	else if (filter_match_token(parser, ">="))
+		*cmp = SIDE_FILTER_CMP_GE;
+	else if (filter_match_token(parser, "<"))
+		*cmp = SIDE_FILTER_CMP_LT;
+	else if (filter_match_token(parser, ">"))
+		*cmp = SIDE_FILTER_CMP_GT;
+	else
+		return false;
+	return true;
+}
+
+/* Comparison with swapped operands. */
+static
+enum side_filter_cmp filter_cmp_swap(enum side_filter_cmp cmp)
+{
+	switch (cmp) {
+	case SIDE_FILTER_CMP_LT:
+		return SIDE_FILTER_CMP_GT;
+	case SIDE_FILTER_CMP_LE:
+		return SIDE_FILTER_CMP_GE;
+	case SIDE_FILTER_CMP_GT:
+		return SIDE_FILTER_CMP_LT;
+	case SIDE_FILTER_CMP_GE:
+		return SIDE_FILTER_CMP_LE;
+	default:
+		return cmp;
+	}
+}
+
+/*
+ * comparison := field [cmp literal] | literal cmp field
+ * A field alone is true when its value is non-zero.
+ */
+static
+void filter_parse_comparison(struct filter_parser *parser)
+{
+	struct filter_operand lhs, rhs = {
+		.kind = FILTER_LITERAL_INTEGER,
+	};
+	struct filter_operand *field, *literal;
+	enum side_filter_cmp cmp = SIDE_FILTER_CMP_NE;
+	struct side_filter_op *op;
+
+	filter_parse_operand(parser, &lhs);
+	if (parser->error)
+		goto end;
+	if (filter_parse_cmp(parser, &cmp))
+		filter_parse_operand(parser, &rhs);
+	if (parser->error)
+		goto end;
+	if (lhs.field && !rhs.field) {
+		field = &lhs;
+		literal = &rhs;
+	} else if (!lhs.field && rhs.field) {
+		field = &rhs;
+		literal = &lhs;
+		cmp = filter_cmp_swap(cmp);
+	} else {
+		parser->error = SIDE_ERROR_INVAL;
+		goto end;
+	}
+	op = filter_append(parser, SIDE_FILTER_OP_CMP);
+	if (!op)
+		goto end;
+	op->cmp = cmp;
+	op->arg_index = field->arg_index;
+	parser->error = filter_set_field(op, &field->field->side_type);
+	if (parser->error)
+		goto end;
+	switch (op->load) {
+	case SIDE_FILTER_LOAD_INTEGER:
+	case SIDE_FILTER_LOAD_GATHER_INTEGER:
+		if (literal->kind != FILTER_LITERAL_INTEGER)
+			goto inval;
+		if (op->signedness) {
+			if (!literal->negative && literal->value > INT64_MAX)
+				goto inval;
+			op->imm.s = literal->negative ? (int64_t) -literal->value : (int64_t) literal->value;
+		} else {
+			if (literal->negative && literal->value)
+				goto inval;
+			op->imm.u = literal->value;
+		}
+		break;
+	case SIDE_FILTER_LOAD_STRING:
+	case SIDE_FILTER_LOAD_GATHER_STRING:
+		if (literal->kind != FILTER_LITERAL_STRING)
+			goto inval;
+		if (cmp != SIDE_FILTER_CMP_EQ && cmp != SIDE_FILTER_CMP_NE)
+			goto inval;
+		/* Owned by the filter. */
+		op->imm.string = literal->string;
+		literal->string = NULL;
+		break;
+	}
+end:
+	free(lhs.string);
+	free(rhs.string);
+	return;
+inval:
+	parser->error = SIDE_ERROR_INVAL;
+	goto end;
+}
+
+static void filter_parse_or(struct filter_parser *parser);
+
+/* unary := '!' unary | '(' or ')' | comparison */
+static
+void filter_parse_unary(struct filter_parser *parser)
+{
+	if (++parser->nesting > FILTER_MAX_NESTING) {
+		parser->error = SIDE_ERROR_INVAL;
+		return;
+	}
+	filter_skip_space(parser);
+	if (parser->p[0] == '!' && parser->p[1] != '=') {
+		parser->p++;
+		filter_parse_unary(parser);
+		(void) filter_append(parser, SIDE_FILTER_OP_NOT);
+	} else if (filter_match_token(parser, "(")) {
+		filter_parse_or(parser);
+		if (!parser->error && !filter_match_token(parser, ")"))
+			parser->error = SIDE_ERROR_INVAL;
+	} else {
+		filter_parse_comparison(parser);
+	}
+	parser->nesting--;
+}
+
+/*
+ * Logical operators jump over their right operand when their left
+ * operand decides the result.
+ */
+static
+void filter_parse_logical(struct filter_parser *parser, const char *token,
+		enum side_filter_opcode jump, void (*parse_operand)(struct filter_parser *parser))
+{
+	parse_operand(parser);
+	while (!parser->error && filter_match_token(parser, token)) {
+		uint32_t jump_index = parser->filter->nr_ops;
+
+		if (!filter_append(parser, jump))
+			return;
+		parse_operand(parser);
+		if (parser->error)
+			return;
+		parser->filter->ops[jump_index].arg_index = parser->filter->nr_ops;
+	}
+}
+
+/* and := unary ('&&' unary)* */
+static
+void filter_parse_and(struct filter_parser *parser)
+{
+	filter_parse_logical(parser, "&&", SIDE_FILTER_OP_JUMP_FALSE, filter_parse_unary);
+}
+
+/* or := and ('||' and)* */
+static
+void filter_parse_or(struct filter_parser *parser)
+{
+	filter_parse_logical(parser, "||", SIDE_FILTER_OP_JUMP_TRUE, filter_parse_and);
+}
+
+int side_filter_compile(const struct side_event_description *desc,
+		const char *expr, struct side_filter **filter_p)
+{
+	struct filter_parser parser = {
+		.desc = desc,
+		.p = expr,
+	};
+
+	if (!desc || !expr || !filter_p)
+		return SIDE_ERROR_INVAL;
+	parser.filter = (struct side_filter *) calloc(1, sizeof(struct side_filter));
+	if (!parser.filter)
+		return SIDE_ERROR_NOMEM;
+	parser.filter->desc = desc;
+	parser.filter->nr_args = side_array_length(&desc->fields);
+	filter_parse_or(&parser);
+	filter_skip_space(&parser);
+	if (!parser.error && *parser.p != '\0')
+		parser.error = SIDE_ERROR_INVAL;
+	if (parser.error) {
+		side_filter_destroy(parser.filter);
+		return parser.error;
+	}
+	*filter_p = parser.filter;
+	return SIDE_ERROR_OK;
+}
+
+void side_filter_destroy(struct side_filter *filter)
+{
+	uint32_t i;
+
+	if (!filter)
+		return;
+	for (i = 0; i < filter->nr_ops; i++) {
+		const struct side_filter_op *op = &filter->ops[i];
+
+		if (op->opcode != SIDE_FILTER_OP_CMP)
+			continue;
+		if (op->load == SIDE_FILTER_LOAD_STRING || op->load == SIDE_FILTER_LOAD_GATHER_STRING)
+			free(op->imm.string);
+	}
+	free(filter);
+}
+
+static
+const char *filter_gather_access(const struct side_filter_op *op, const char *ptr)
+{
+	ptr += op->offset;
+	if (op->access == SIDE_TYPE_GATHER_ACCESS_POINTER)
+		memcpy(&ptr, ptr, sizeof(const char *));
+	return ptr;
+}
+
+static
+uint64_t filter_load_integer(const struct side_filter_op *op, const void *p)
+{
+	uint64_t v;
+
+	switch (op->size) {
+	case 1:
+	{
+		uint8_t v8;
+
+		memcpy(&v8, p, sizeof(v8));
+		v = v8;
+		break;
+	}
+	case 2:
+	{
+		uint16_t v16;
+
+		memcpy(&v16, p, sizeof(v16));
+		v = op->reverse_bo ? side_bswap_16(v16) : v16;
+		break;
+	}
+	case 4:
+	{
+		uint32_t v32;
+
+		memcpy(&v32, p, sizeof(v32));
+		v = op->reverse_bo ? side_bswap_32(v32) : v32;
+		break;
+	}
+	case 8:
+		memcpy(&v, p, sizeof(v));
+		if (op->reverse_bo)
+			v = side_bswap_64(v);
+		break;
+	default:
+		abort();
+	}
+	v >>= op->offset_bits;
+	if (op->len_bits < 64) {
+		uint64_t mask = (1ULL << op->len_bits) - 1;
+
+		v &= mask;
+		if (op->signedness && (v & (1ULL << (op->len_bits - 1))))
+			v |= ~mask;
+	}
+	if (op->boolean)
+		v = !!v;
+	return v;
+}
+
+static
+bool filter_cmp_integer(const struct side_filter_op *op, uint64_t v)
+{
+	if (op->signedness) {
+		int64_t s = (int64_t) v;
+
+		switch (op->cmp) {
+		case SIDE_FILTER_CMP_EQ: return s == op->imm.s;
+		case SIDE_FILTER_CMP_NE: return s != op->imm.s;
+		case SIDE_FILTER_CMP_LT: return s < op->imm.s;
+		case SIDE_FILTER_CMP_LE: return s <= op->imm.s;
+		case SIDE_FILTER_CMP_GT: return s > op->imm.s;
+		case SIDE_FILTER_CMP_GE: return s >= op->imm.s;
+		}
+	} else {
+		switch (op->cmp) {
+		case SIDE_FILTER_CMP_EQ: return v == op->imm.u;
+		case SIDE_FILTER_CMP_NE: return v != op->imm.u;
+		case SIDE_FILTER_CMP_LT: return v < op->imm.u;
+		case SIDE_FILTER_CMP_LE: return v <= op->imm.u;
+		case SIDE_FILTER_CMP_GT: return v > op->imm.u;
+		case SIDE_FILTER_CMP_GE: return v >= op->imm.u;
+		}
+	}
+	abort();
+}
+
+static
+bool filter_cmp_string(const struct side_filter_op *op, const char *s)
+{
+	bool equal = s && !strcmp(s, op->imm.string);
+
+	return op->cmp == SIDE_FILTER_CMP_EQ ? equal : !equal;
+}
+
+bool side_filter_match(const struct side_filter *filter,
+		const struct side_arg_vec *side_arg_vec)
+{
+	const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
+	uint32_t pc = 0;
+	bool r = true;
+
+	if (side_unlikely(side_arg_vec->len != filter->nr_args))
+		return true;
+	while (pc < filter->nr_ops) {
+		const struct side_filter_op *op = &filter->ops[pc++];
+		const struct side_arg *arg;
+
+		switch (op->opcode) {
+		case SIDE_FILTER_OP_CMP:
+			arg = &sav[op->arg_index];
+			if (op->lazy) {
+				/* Evaluated only when the comparison is reached. */
+				if (side_unlikely(side_enum_get(arg->type) != SIDE_TYPE_LAZY))
+					return true;
+				arg = side_arg_lazy_value(op->lazy, arg);
+				if (side_unlikely(!arg))
+					return true;
+			}
+			if (side_unlikely(side_enum_get(arg->type) != op->label))
+				return true;
+			switch (op->load) {
+			case SIDE_FILTER_LOAD_INTEGER:
+				r = filter_cmp_integer(op,
+					filter_load_integer(op, &arg->u.side_static.integer_value));
+				break;
+			case SIDE_FILTER_LOAD_GATHER_INTEGER:
+				r = filter_cmp_integer(op,
+					filter_load_integer(op, filter_gather_access(op,
+						side_ptr_get(arg->u.side_static.side_integer_gather_ptr))));
+				break;
+			case SIDE_FILTER_LOAD_STRING:
+				r = filter_cmp_string(op, side_ptr_get(arg->u.side_static.string_value));
+				break;
+			case SIDE_FILTER_LOAD_GATHER_STRING:
+				r = filter_cmp_string(op, filter_gather_access(op,
+						side_ptr_get(arg->u.side_static.side_string_gather_ptr)));
+				break;
+			}
+			break;
+		case SIDE_FILTER_OP_NOT:
+			r = !r;
+			break;
+		case SIDE_FILTER_OP_JUMP_FALSE:
+			if (!r)
+				pc = op->arg_index;
+			break;
+		case SIDE_FILTER_OP_JUMP_TRUE:
+			if (r)
+				pc = op->arg_index;
+			break;
+		}
+	}
+	return r;
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_FILTER_H
+#define _SIDE_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * Compiled callback filter. The expression is compiled into a sequence
+ * of operations on a single boolean result register: comparisons of a
+ * field value with an immediate value set the register, and logical
+ * operators are jumps over the remaining operations of their right
+ * operand (short-circuit evaluation).
+ */
+
+enum side_filter_opcode {
+	SIDE_FILTER_OP_CMP,		/* r = (field cmp immediate) */
+	SIDE_FILTER_OP_NOT,		/* r = !r */
+	SIDE_FILTER_OP_JUMP_FALSE,	/* if (!r) jump to target */
+	SIDE_FILTER_OP_JUMP_TRUE,	/* if (r) jump to target */
+};
+
+enum side_filter_cmp {
+	SIDE_FILTER_CMP_EQ,
+	SIDE_FILTER_CMP_NE,
+	SIDE_FILTER_CMP_LT,
+	SIDE_FILTER_CMP_LE,
+	SIDE_FILTER_CMP_GT,
+	SIDE_FILTER_CMP_GE,
+};
+
+enum side_filter_load {
+	SIDE_FILTER_LOAD_INTEGER,		/* Argument value storage. */
+	SIDE_FILTER_LOAD_GATHER_INTEGER,	/* Gather pointer + offset. */
+	SIDE_FILTER_LOAD_STRING,		/* Argument string pointer. */
+	SIDE_FILTER_LOAD_GATHER_STRING,		/* Gather pointer + offset. */
+};
+
+struct side_filter_op {
+	uint8_t opcode;			/* enum side_filter_opcode */
+	uint8_t cmp;			/* enum side_filter_cmp */
+	uint8_t load;			/* enum side_filter_load */
+	uint8_t access;			/* enum side_type_gather_access_mode */
+	uint16_t label;			/* Expected argument type label. */
+	uint16_t size;			/* Integer size, bytes. */
+	uint16_t offset_bits;
+	uint16_t len_bits;
+	bool signedness;
+	bool reverse_bo;
+	bool boolean;			/* Non-zero values are true. */
+	uint32_t arg_index;		/* Argument read, or jump target. */
+	uint64_t offset;		/* Gather offset, bytes. */
+	/* Lazy field type, or NULL. Its value is loaded. */
+	const struct side_type *lazy;
+	union {
+		uint64_t u;
+		int64_t s;
+		char *string;
+	} imm;
+};
+
+struct side_filter {
+	const struct side_event_description *desc;
+	uint32_t nr_args;		/* One per field. */
+	uint32_t nr_ops;
+	struct side_filter_op ops[];
+};
+
+/*
+ * Returns true if the event arguments match the filter. Arguments which
+ * do not match the event description are not filtered out, so the
+ * callback can report them.
+ */
+bool side_filter_match(const struct side_filter *filter,
+		const struct side_arg_vec *side_arg_vec)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_FILTER_H */
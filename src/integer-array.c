@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <side/trace.h>
+
+#include "integer-array.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Vector kernels process whole vectors and return the number of
+ * elements done. The scalar code handles the remaining elements.
+ */
+typedef size_t (*bswap_kernel)(char *dst, const char *src, size_t count, unsigned int size);
+typedef size_t (*extract_bits_kernel)(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign);
+
+static
+uint64_t bits_mask(unsigned int len_bits)
+{
+	return len_bits >= 64 ? ~0ULL : (1ULL << len_bits) - 1;
+}
+
+static
+void bswap_scalar(char *dst, const char *src, size_t count, unsigned int size)
+{
+	size_t i;
+
+	switch (size) {
+	case 1:
+		if (dst != src)
+			memcpy(dst, src, count);
+		break;
+	case 2:
+		for (i = 0; i < count; i++) {
+			uint16_t v;
+
+			memcpy(&v, src + i * 2, 2);
+			v = side_bswap_16(v);
+			memcpy(dst + i * 2, &v, 2);
+		}
+		break;
+	case 4:
+		for (i = 0; i < count; i++) {
+			uint32_t v;
+
+			memcpy(&v, src + i * 4, 4);
+			v = side_bswap_32(v);
+			memcpy(dst + i * 4, &v, 4);
+		}
+		break;
+	case 8:
+		for (i = 0; i < count; i++) {
+			uint64_t v;
+
+			memcpy(&v, src + i * 8, 8);
+			v = side_bswap_64(v);
+			memcpy(dst + i * 8, &v, 8);
+		}
+		break;
+	}
+}
+
+/* Sign extension is (v ^ sign) - sign, with sign the top bit of len_bits. */
+static
+void extract_bits_scalar(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		uint64_t v = 0;
+
+		switch (size) {
+		case 1:
+		{
+			uint8_t v8;
+
+			memcpy(&v8, src + i, 1);
+			v = v8;
+			break;
+		}
+		case 2:
+		{
+			uint16_t v16;
+
+			memcpy(&v16, src + i * 2, 2);
+			v = v16;
+			break;
+		}
+		case 4:
+		{
+			uint32_t v32;
+
+			memcpy(&v32, src + i * 4, 4);
+			v = v32;
+			break;
+		}
+		case 8:
+			memcpy(&v, src + i * 8, 8);
+			break;
+		}
+		v = (((v >> offset_bits) & mask) ^ sign) - sign;
+		switch (size) {
+		case 1:
+		{
+			uint8_t v8 = v;
+
+			memcpy(dst + i, &v8, 1);
+			break;
+		}
+		case 2:
+		{
+			uint16_t v16 = v;
+
+			memcpy(dst + i * 2, &v16, 2);
+			break;
+		}
+		case 4:
+		{
+			uint32_t v32 = v;
+
+			memcpy(dst + i * 4, &v32, 4);
+			break;
+		}
+		case 8:
+			memcpy(dst + i * 8, &v, 8);
+			break;
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+static const uint8_t bswap_shuffle[3][16] = {
+	{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+	{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+	{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 },
+};
+
+static
+const uint8_t *bswap_shuffle_mask(unsigned int size)
+{
+	switch (size) {
+	case 2:
+		return bswap_shuffle[0];
+	case 4:
+		return bswap_shuffle[1];
+	case 8:
+		return bswap_shuffle[2];
+	default:
+		return NULL;
+	}
+}
+
+static __attribute__((target("ssse3")))
+size_t bswap_ssse3(char *dst, const char *src, size_t count, unsigned int size);
+static
+size_t bswap_ssse3(char *dst, const char *src, size_t count, unsigned int size)
+{
+	const uint8_t *shuffle = bswap_shuffle_mask(size);
+	size_t i, len = count * size;
+	__m128i mask;
+
+	if (!shuffle)
+		return 0;
+	mask = _mm_loadu_si128((const __m128i *) shuffle);
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(v, mask));
+	}
+	return i / size;
+}
+
+static __attribute__((target("avx2")))
+size_t bswap_avx2(char *dst, const char *src, size_t count, unsigned int size);
+static
+size_t bswap_avx2(char *dst, const char *src, size_t count, unsigned int size)
+{
+	const uint8_t *shuffle = bswap_shuffle_mask(size);
+	size_t i, len = count * size;
+	__m256i mask;
+
+	if (!shuffle)
+		return 0;
+	mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) shuffle));
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(v, mask));
+	}
+	return i / size;
+}
+
+/* SSE2 is part of the x86-64 baseline. */
+static
+size_t extract_bits_sse2(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign)
+{
+	__m128i shift = _mm_cvtsi32_si128(offset_bits), vmask, vsign;
+	size_t i, len = count * size;
+
+	switch (size) {
+	case 2:
+		vmask = _mm_set1_epi16((int16_t) mask);
+		vsign = _mm_set1_epi16((int16_t) sign);
+		for (i = 0; i + 16 <= len; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+			v = _mm_and_si128(_mm_srl_epi16(v, shift), vmask);
+			v = _mm_sub_epi16(_mm_xor_si128(v, vsign), vsign);
+			_mm_storeu_si128((__m128i *) (dst + i), v);
+		}
+		break;
+	case 4:
+		vmask = _mm_set1_epi32((int32_t) mask);
+		vsign = _mm_set1_epi32((int32_t) sign);
+		for (i = 0; i + 16 <= len; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+			v = _mm_and_si128(_mm_srl_epi32(v, shift), vmask);
+			v = _mm_sub_epi32(_mm_xor_si128(v, vsign), vsign);
+			_mm_storeu_si128((__m128i *) (dst + i), v);
+		}
+		break;
+	case 8:
+		vmask = _mm_set1_epi64x((int64_t) mask);
+		vsign = _mm_set1_epi64x((int64_t) sign);
+		for (i = 0; i + 16 <= len; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+			v = _mm_and_si128(_mm_srl_epi64(v, shift), vmask);
+			v = _mm_sub_epi64(_mm_xor_si128(v, vsign), vsign);
+			_mm_storeu_si128((__m128i *) (dst + i), v);
+		}
+		break;
+	default:
+		return 0;
+	}
+	return i / size;
+}
+
+static __attribute__((target("avx2")))
+size_t extract_bits_avx2(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign);
+static
+size_t extract_bits_avx2(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign)
+{
+	__m128i shift = _mm_cvtsi32_si128(offset_bits);
+	size_t i, len = count * size;
+	__m256i vmask, vsign;
+
+	switch (size) {
+	case 2:
+		vmask = _mm256_set1_epi16((int16_t) mask);
+		vsign = _mm256_set1_epi16((int16_t) sign);
+		for (i = 0; i + 32 <= len; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+			v = _mm256_and_si256(_mm256_srl_epi16(v, shift), vmask);
+			v = _mm256_sub_epi16(_mm256_xor_si256(v, vsign), vsign);
+			_mm256_storeu_si256((__m256i *) (dst + i), v);
+		}
+		break;
+	case 4:
+		vmask = _mm256_set1_epi32((int32_t) mask);
+		vsign = _mm256_set1_epi32((int32_t) sign);
+		for (i = 0; i + 32 <= len; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+			v = _mm256_and_si256(_mm256_srl_epi32(v, shift), vmask);
+			v = _mm256_sub_epi32(_mm256_xor_si256(v, vsign), vsign);
+			_mm256_storeu_si256((__m256i *) (dst + i), v);
+		}
+		break;
+	case 8:
+		vmask = _mm256_set1_epi64x((int64_t) mask);
+		vsign = _mm256_set1_epi64x((int64_t) sign);
+		for (i = 0; i + 32 <= len; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+			v = _mm256_and_si256(_mm256_srl_epi64(v, shift), vmask);
+			v = _mm256_sub_epi64(_mm256_xor_si256(v, vsign), vsign);
+			_mm256_storeu_si256((__m256i *) (dst + i), v);
+		}
+		break;
+	default:
+		return 0;
+	}
+	return i / size;
+}
+
+#elif defined(__aarch64__)
+
+/* NEON is part of the aarch64 baseline. */
+static
+size_t bswap_neon(char *dst, const char *src, size_t count, unsigned int size)
+{
+	size_t i, len = count * size;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *) (src + i));
+
+		switch (size) {
+		case 2:
+			v = vrev16q_u8(v);
+			break;
+		case 4:
+			v = vrev32q_u8(v);
+			break;
+		case 8:
+			v = vrev64q_u8(v);
+			break;
+		default:
+			return 0;
+		}
+		vst1q_u8((uint8_t *) (dst + i), v);
+	}
+	return i / size;
+}
+
+static
+size_t extract_bits_neon(char *dst, const char *src, size_t count, unsigned int size,
+		unsigned int offset_bits, uint64_t mask, uint64_t sign)
+{
+	size_t i, len = count * size;
+
+	switch (size) {
+	case 2:
+	{
+		int16x8_t shift = vdupq_n_s16(-(int16_t) offset_bits);
+		uint16x8_t vmask = vdupq_n_u16((uint16_t) mask), vsign = vdupq_n_u16((uint16_t) sign);
+
+		for (i = 0; i + 16 <= len; i += 16) {
+			uint16x8_t v = vld1q_u16((const uint16_t *) (src + i));
+
+			v = vandq_u16(vshlq_u16(v, shift), vmask);
+			v = vsubq_u16(veorq_u16(v, vsign), vsign);
+			vst1q_u16((uint16_t *) (dst + i), v);
+		}
+		break;
+	}
+	case 4:
+	{
+		int32x4_t shift = vdupq_n_s32(-(int32_t) offset_bits);
+		uint32x4_t vmask = vdupq_n_u32((uint32_t) mask), vsign = vdupq_n_u32((uint32_t) sign);
+
+		for (i = 0; i + 16 <= len; i += 16) {
+			uint32x4_t v = vld1q_u32((const uint32_t *) (src + i));
+
+			v = vandq_u32(vshlq_u32(v, shift), vmask);
+			v = vsubq_u32(veorq_u32(v, vsign), vsign);
+			vst1q_u32((uint32_t *) (dst + i), v);
+		}
+		break;
+	}
+	case 8:
+	{
+		int64x2_t shift = vdupq_n_s64(-(int64_t) offset_bits);
+		uint64x2_t vmask = vdupq_n_u64(mask), vsign = vdupq_n_u64(sign);
+
+		for (i = 0; i + 16 <= len; i += 16) {
+			uint64x2_t v = vld1q_u64((const uint64_t *) (src + i));
+
+			v = vandq_u64(vshlq_u64(v, shift), vmask);
+			v = vsubq_u64(veorq_u64(v, vsign), vsign);
+			vst1q_u64((uint64_t *) (dst + i), v);
+		}
+		break;
+	}
+	default:
+		return 0;
+	}
+	return i / size;
+}
+
+#endif
+
+static bswap_kernel bswap_vector;
+static extract_bits_kernel extract_bits_vector;
+static bool kernels_selected;
+
+/* Selection is idempotent: concurrent first calls select the same kernels. */
+static
+void select_kernels(void)
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		__atomic_store_n(&bswap_vector, bswap_avx2, __ATOMIC_RELAXED);
+		__atomic_store_n(&extract_bits_vector, extract_bits_avx2, __ATOMIC_RELAXED);
+	} else {
+		if (__builtin_cpu_supports("ssse3"))
+			__atomic_store_n(&bswap_vector, bswap_ssse3, __ATOMIC_RELAXED);
+		__atomic_store_n(&extract_bits_vector, extract_bits_sse2, __ATOMIC_RELAXED);
+	}
+#elif defined(__aarch64__)
+	__atomic_store_n(&bswap_vector, bswap_neon, __ATOMIC_RELAXED);
+	__atomic_store_n(&extract_bits_vector, extract_bits_neon, __ATOMIC_RELAXED);
+#endif
+	__atomic_store_n(&kernels_selected, true, __ATOMIC_RELEASE);
+}
+
+void side_integer_array_bswap(void *_dst, const void *_src, size_t count, unsigned int size)
+{
+	const char *src = (const char *) _src;
+	char *dst = (char *) _dst;
+	bswap_kernel kernel;
+	size_t done = 0;
+
+	if (side_unlikely(!__atomic_load_n(&kernels_selected, __ATOMIC_ACQUIRE)))
+		select_kernels();
+	kernel = __atomic_load_n(&bswap_vector, __ATOMIC_RELAXED);
+	if (kernel)
+		done = kernel(dst, src, count, size);
+	bswap_scalar(dst + done * size, src + done * size, count - done, size);
+}
+
+void side_integer_array_extract_bits(void *_dst, const void *_src, size_t count, unsigned int size,
+		unsigned int offset_bits, unsigned int len_bits, bool is_signed)
+{
+	const char *src = (const char *) _src;
+	char *dst = (char *) _dst;
+	uint64_t mask = bits_mask(len_bits), sign = 0;
+	extract_bits_kernel kernel;
+	size_t done = 0;
+
+	if (is_signed && len_bits)
+		sign = 1ULL << (len_bits - 1);
+	if (side_unlikely(!__atomic_load_n(&kernels_selected, __ATOMIC_ACQUIRE)))
+		select_kernels();
+	kernel = __atomic_load_n(&extract_bits_vector, __ATOMIC_RELAXED);
+	if (kernel)
+		done = kernel(dst, src, count, size, offset_bits, mask, sign);
+	extract_bits_scalar(dst + done * size, src + done * size, count - done, size,
+		offset_bits, mask, sign);
+}
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_INTEGER_ARRAY_H
+#define _SIDE_INTEGER_ARRAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Batch kernels over arrays of integers stored back to back. They use
+ * SSSE3 or AVX2 on x86-64 and NEON on aarch64, selected at runtime
+ * from the CPU features, and fall back to scalar code otherwise.
+ *
+ * dst and src may be the same array, but must not otherwise overlap.
+ */
+
+/* Reverse the byte order of count elements of size 1, 2, 4 or 8 bytes. */
+void side_integer_array_bswap(void *dst, const void *src, size_t count, unsigned int size)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Keep the len_bits bits at offset_bits of each host byte order element
+ * of size 1, 2, 4 or 8 bytes, sign-extended to the element size if
+ * is_signed. offset_bits + len_bits must not exceed the element size.
+ */
+void side_integer_array_extract_bits(void *dst, const void *src, size_t count, unsigned int size,
+		unsigned int offset_bits, unsigned int len_bits, bool is_signed)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_INTEGER_ARRAY_H */
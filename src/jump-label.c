@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include "jump-label.h"
+
+#if defined(__x86_64__)
+
+#define JUMP_LABEL_INSN_LEN	5
+#define JUMP_LABEL_INT3		0xcc
+#define JUMP_LABEL_POKE_HISTORY	64
+
+static const uint8_t jump_label_nop[JUMP_LABEL_INSN_LEN] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+/*
+ * Sites are patched while other threads may execute them, with the
+ * breakpoint protocol for cross-modifying code:
+ *
+ *   1. write an int3 over the first byte, and sync all cores,
+ *   2. write the last four bytes of the new instruction, and sync,
+ *   3. write the first byte of the new instruction.
+ *
+ * The final sync is side_jump_label_sync(), done once for all the sites
+ * patched by an operation. A thread hitting the int3 while its site is
+ * patched is resumed by the SIGTRAP handler at the destination of the
+ * replaced instruction. A thread trapping on a stale int3 of one of the
+ * last JUMP_LABEL_POKE_HISTORY patched sites re-executes the site. Other
+ * traps are delivered again with the previous SIGTRAP action, and the
+ * handler is installed back before the next patch.
+ *
+ * The handler is installed by the first patch, so processes without
+ * static key sites keep their SIGTRAP action. The patched sites are
+ * only updated with side_event_lock held.
+ */
+static uint64_t jump_label_poke_addr;		/* Site being patched, or 0. */
+static uint64_t jump_label_poke_resume;		/* Destination of the replaced instruction. */
+static uint64_t jump_label_poked[JUMP_LABEL_POKE_HISTORY];
+static unsigned int jump_label_nr_poked;
+static struct sigaction jump_label_prev_sigtrap;
+
+static
+int membarrier(int cmd, unsigned int flags, int cpu_id)
+{
+	return syscall(__NR_membarrier, cmd, flags, cpu_id);
+}
+
+/* Returns true if addr is one of the last patched sites. */
+static
+bool jump_label_recently_poked(uint64_t addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < JUMP_LABEL_POKE_HISTORY; i++) {
+		if (__atomic_load_n(&jump_label_poked[i], __ATOMIC_RELAXED) == addr)
+			return true;
+	}
+	return false;
+}
+
+static
+void jump_label_sigtrap(int sig __attribute__((unused)), siginfo_t *info, void *context)
+{
+	ucontext_t *uc = (ucontext_t *) context;
+	uint64_t addr = (uint64_t) uc->uc_mcontext.gregs[REG_RIP] - 1;
+	uint64_t poke = __atomic_load_n(&jump_label_poke_addr, __ATOMIC_ACQUIRE);
+
+	/* Only int3 traps report SI_KERNEL, signals sent by processes do not. */
+	if (info->si_code != SI_KERNEL)
+		goto chain;
+	if (poke && addr == poke) {
+		uint64_t resume = __atomic_load_n(&jump_label_poke_resume, __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&jump_label_poke_addr, __ATOMIC_RELAXED) == poke) {
+			uc->uc_mcontext.gregs[REG_RIP] = (greg_t) resume;
+			return;
+		}
+	}
+	/* The int3 of a patched site was replaced since it trapped. */
+	if (jump_label_recently_poked(addr) &&
+	    __atomic_load_n((uint8_t *) (uintptr_t) addr, __ATOMIC_RELAXED) != JUMP_LABEL_INT3) {
+		uc->uc_mcontext.gregs[REG_RIP] = (greg_t) addr;
+		return;
+	}
+chain:
+	/*
+	 * SIGTRAP is blocked while the handler runs: the signal raised
+	 * again is delivered with the previous action once it returns.
+	 */
+	(void) sigaction(SIGTRAP, &jump_label_prev_sigtrap, NULL);
+	(void) raise(SIGTRAP);
+}
+
+/*
+ * Install the SIGTRAP handler if it is not installed, saving the
+ * current action to deliver the traps which are not caused by patching.
+ */
+static
+bool jump_label_sigtrap_install(void)
+{
+	struct sigaction sa;
+
+	if (sigaction(SIGTRAP, NULL, &sa))
+		return false;
+	if ((sa.sa_flags & SA_SIGINFO) && sa.sa_sigaction == jump_label_sigtrap)
+		return true;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = jump_label_sigtrap;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	return !sigaction(SIGTRAP, &sa, &jump_label_prev_sigtrap);
+}
+
+/*
+ * Registration fails on kernels without SYNC_CORE membarrier support,
+ * in which case sites are left unpatched.
+ */
+bool side_jump_label_init(void)
+{
+	return !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0, 0);
+}
+
+static
+void jump_label_make_jump(const struct side_jump_entry *entry, uint8_t *insn)
+{
+	int32_t rel = (int32_t) (entry->target - (entry->code + JUMP_LABEL_INSN_LEN));
+
+	insn[0] = 0xe9;
+	memcpy(&insn[1], &rel, sizeof(rel));
+}
+
+/* Look up the protection of the mapping containing addr. */
+static
+bool jump_label_get_prot(uintptr_t addr, int *prot)
+{
+	bool line_start = true, found = false;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/self/maps", "re");
+	if (!f)
+		return false;
+	while (!found && fgets(line, sizeof(line), f)) {
+		unsigned long start, end;
+		char perms[5];
+		bool match;
+
+		/* Skip the end of lines longer than the buffer. */
+		match = line_start && sscanf(line, "%lx-%lx %4s", &start, &end, perms) == 3 &&
+			addr >= start && addr < end;
+		line_start = strchr(line, '\n') != NULL;
+		if (!match)
+			continue;
+		*prot = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0) |
+			(perms[2] == 'x' ? PROT_EXEC : 0);
+		found = true;
+	}
+	fclose(f);
+	return found;
+}
+
+/*
+ * The page protection is restored after patching. Sites are 8-byte
+ * aligned, so they never cross a page boundary.
+ */
+bool side_jump_label_patch(const struct side_jump_entry *entry, bool enable)
+{
+	uint8_t jump[JUMP_LABEL_INSN_LEN];
+	uint8_t *code = (uint8_t *) (uintptr_t) entry->code;
+	long page_size = sysconf(_SC_PAGESIZE);
+	const uint8_t *insn;
+	uintptr_t page;
+	bool is_jump;
+	int prot, i;
+
+	if (entry->code & (sizeof(uint64_t) - 1))
+		return false;
+	jump_label_make_jump(entry, jump);
+	/* Only patch sites in a known state. */
+	if (!memcmp(code, jump, JUMP_LABEL_INSN_LEN))
+		is_jump = true;
+	else if (!memcmp(code, jump_label_nop, JUMP_LABEL_INSN_LEN))
+		is_jump = false;
+	else
+		return false;
+	if (is_jump == enable)
+		return true;
+	if (!jump_label_sigtrap_install())
+		return false;
+	page = (uintptr_t) code & ~((uintptr_t) page_size - 1);
+	if (!jump_label_get_prot(page, &prot))
+		return false;
+	if (mprotect((void *) page, page_size, prot | PROT_WRITE))
+		return false;
+	insn = enable ? jump : jump_label_nop;
+	__atomic_store_n(&jump_label_poke_resume,
+			is_jump ? entry->target : entry->code + JUMP_LABEL_INSN_LEN, __ATOMIC_RELAXED);
+	__atomic_store_n(&jump_label_poked[jump_label_nr_poked++ % JUMP_LABEL_POKE_HISTORY],
+			entry->code, __ATOMIC_RELAXED);
+	__atomic_store_n(&jump_label_poke_addr, entry->code, __ATOMIC_RELEASE);
+	__atomic_store_n(&code[0], JUMP_LABEL_INT3, __ATOMIC_RELAXED);
+	side_jump_label_sync();
+	for (i = 1; i < JUMP_LABEL_INSN_LEN; i++)
+		__atomic_store_n(&code[i], insn[i], __ATOMIC_RELAXED);
+	side_jump_label_sync();
+	__atomic_store_n(&code[0], insn[0], __ATOMIC_RELAXED);
+	__atomic_store_n(&jump_label_poke_addr, 0, __ATOMIC_RELEASE);
+	if (mprotect((void *) page, page_size, prot)) {
+		perror("mprotect");
+		abort();
+	}
+	return true;
+}
+
+void side_jump_label_sync(void)
+{
+	if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0, 0)) {
+		perror("membarrier");
+		abort();
+	}
+}
+
+#else
+
+bool side_jump_label_init(void)
+{
+	return false;
+}
+
+bool side_jump_label_patch(const struct side_jump_entry *entry __attribute__((unused)),
+		bool enable __attribute__((unused)))
+{
+	return false;
+}
+
+void side_jump_label_sync(void)
+{
+}
+
+#endif
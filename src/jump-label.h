@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_JUMP_LABEL_H
+#define _SIDE_JUMP_LABEL_H
+
+#include <stdbool.h>
+#include <side/trace.h>
+
+/* Returns true if code patching can be used. */
+bool side_jump_label_init(void) __attribute__((visibility("hidden")));
+/*
+ * Patch a site into a jump to its target if enable is true, else into
+ * a NOP, installing the SIGTRAP handler used while patching if needed.
+ * Returns false if the site could not be patched. Called with
+ * side_event_lock held, which serializes patching and the page
+ * protection changes. The new instruction is executed by all threads
+ * after the next side_jump_label_sync().
+ */
+bool side_jump_label_patch(const struct side_jump_entry *entry, bool enable)
+	__attribute__((visibility("hidden")));
+/* Serialize instruction fetch of all threads after patching. */
+void side_jump_label_sync(void) __attribute__((visibility("hidden")));
+
+#endif /* _SIDE_JUMP_LABEL_H */
@@ -0,0 +1,792 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Event payloads are encoded in the order of the event description,
+ * without type information:
+ *   - integers, booleans, bytes, pointers, floats: their declared size,
+ *     in their declared byte order,
+ *   - strings: code units up to and including the null terminator,
+ *   - structures and arrays: their fields or elements,
+ *   - variable-length arrays: u32 length, then elements,
+ *   - optionals: u8 selector, then the value if enabled,
+ *   - variants: selector value, then the selected option,
+ *   - enumerations: their underlying type,
+ *   - lazy values: their value type, evaluated when serialized,
+ *   - gather types: as their stack-copy counterpart,
+ *   - dynamic types and variadic fields: u16 type label and type
+ *     parameters (as in declarations), then the value. Dynamic
+ *     structures and variadic fields are u32 number of fields, then
+ *     null-terminated field names followed by their value.
+ *
+ * Declarations are u32 number of fields, then null-terminated field
+ * names each followed by their type: u16 type label and the type
+ * parameters (see payload_encode_type()), lazy types being declared as
+ * their value type. Gather arrays and gather variable-length arrays
+ * cannot be declared.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <side/trace.h>
+
+#include "payload.h"
+#include "utf.h"
+#include "visit-arg-vec.h"
+
+/* Scratch buffers of a thread, one per nesting level. */
+#define SIDE_PAYLOAD_NESTING	4
+
+struct side_payload_scratch {
+	unsigned int nesting;
+	char data[SIDE_PAYLOAD_NESTING][SIDE_PAYLOAD_MAX_SIZE];
+};
+
+static __thread struct side_payload_scratch payload_scratch;
+
+void side_payload_write(struct side_payload_writer *ctx, const void *src, size_t len)
+{
+	if (side_unlikely(len > (size_t) (ctx->end - ctx->p))) {
+		ctx->error = true;
+		ctx->p = ctx->end;
+		return;
+	}
+	memcpy(ctx->p, src, len);
+	ctx->p += len;
+}
+
+static
+void payload_write_u8(struct side_payload_writer *ctx, uint8_t v)
+{
+	side_payload_write(ctx, &v, sizeof(v));
+}
+
+static
+void payload_write_u16(struct side_payload_writer *ctx, uint16_t v)
+{
+	side_payload_write(ctx, &v, sizeof(v));
+}
+
+void side_payload_write_u32(struct side_payload_writer *ctx, uint32_t v)
+{
+	side_payload_write(ctx, &v, sizeof(v));
+}
+
+void side_payload_write_u64(struct side_payload_writer *ctx, uint64_t v)
+{
+	side_payload_write(ctx, &v, sizeof(v));
+}
+
+/* Reserve room for a u32 written once known. */
+static
+char *payload_reserve_u32(struct side_payload_writer *ctx)
+{
+	char *p = ctx->p;
+
+	side_payload_write_u32(ctx, 0);
+	return ctx->error ? NULL : p;
+}
+
+void side_payload_write_cstr(struct side_payload_writer *ctx, const char *str)
+{
+	side_payload_write(ctx, str, strlen(str) + 1);
+}
+
+static
+void payload_write_string(struct side_payload_writer *ctx, const void *p, uint8_t unit_size)
+{
+	if (unit_size != 1 && unit_size != 2 && unit_size != 4) {
+		ctx->error = true;
+		return;
+	}
+	side_payload_write(ctx, p, (side_utf_strlen(p, unit_size) + 1) * unit_size);
+}
+
+/* Type parameters, shared by declarations and dynamic types. */
+
+static
+void payload_encode_bool_params(struct side_payload_writer *ctx, const struct side_type_bool *type)
+{
+	payload_write_u16(ctx, type->bool_size);
+	payload_write_u16(ctx, type->len_bits);
+	payload_write_u8(ctx, side_enum_get(type->byte_order));
+}
+
+static
+void payload_encode_integer_params(struct side_payload_writer *ctx, const struct side_type_integer *type)
+{
+	payload_write_u16(ctx, type->integer_size);
+	payload_write_u16(ctx, type->len_bits);
+	payload_write_u8(ctx, type->signedness);
+	payload_write_u8(ctx, side_enum_get(type->byte_order));
+}
+
+static
+void payload_encode_float_params(struct side_payload_writer *ctx, const struct side_type_float *type)
+{
+	payload_write_u16(ctx, type->float_size);
+	payload_write_u8(ctx, side_enum_get(type->byte_order));
+}
+
+static
+void payload_encode_string_params(struct side_payload_writer *ctx, const struct side_type_string *type)
+{
+	payload_write_u8(ctx, type->unit_size);
+	payload_write_u8(ctx, side_enum_get(type->byte_order));
+}
+
+static
+void payload_encode_type(struct side_payload_writer *ctx, const struct side_type *type);
+
+void side_payload_encode_fields(struct side_payload_writer *ctx, const struct side_event_field *fields, uint32_t nr_fields)
+{
+	uint32_t i;
+
+	side_payload_write_u32(ctx, nr_fields);
+	for (i = 0; i < nr_fields; i++) {
+		side_payload_write_cstr(ctx, side_ptr_get(fields[i].field_name));
+		payload_encode_type(ctx, &fields[i].side_type);
+	}
+}
+
+static
+void payload_encode_type(struct side_payload_writer *ctx, const struct side_type *type)
+{
+	uint16_t label = side_enum_get(type->type);
+
+	/* Lazy values are encoded as their value type. */
+	if (label == SIDE_TYPE_LAZY) {
+		payload_encode_type(ctx, side_ptr_get(side_ptr_get(type->u.side_lazy)->value_type));
+		return;
+	}
+	payload_write_u16(ctx, label);
+	switch (label) {
+	case SIDE_TYPE_NULL:
+	case SIDE_TYPE_BYTE:
+	case SIDE_TYPE_DYNAMIC:
+		break;
+	case SIDE_TYPE_BOOL:
+		payload_encode_bool_params(ctx, &type->u.side_bool);
+		break;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_U128:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_S128:
+	case SIDE_TYPE_POINTER:
+		payload_encode_integer_params(ctx, &type->u.side_integer);
+		break;
+	case SIDE_TYPE_FLOAT_BINARY16:
+	case SIDE_TYPE_FLOAT_BINARY32:
+	case SIDE_TYPE_FLOAT_BINARY64:
+	case SIDE_TYPE_FLOAT_BINARY128:
+		payload_encode_float_params(ctx, &type->u.side_float);
+		break;
+	case SIDE_TYPE_STRING_UTF8:
+	case SIDE_TYPE_STRING_UTF16:
+	case SIDE_TYPE_STRING_UTF32:
+		payload_encode_string_params(ctx, &type->u.side_string);
+		break;
+	case SIDE_TYPE_STRUCT:
+	{
+		const struct side_type_struct *side_struct = side_ptr_get(type->u.side_struct);
+
+		side_payload_encode_fields(ctx, side_ptr_get(side_struct->fields.elements), side_struct->fields.length);
+		break;
+	}
+	case SIDE_TYPE_ARRAY:
+		side_payload_write_u32(ctx, side_ptr_get(type->u.side_array)->length);
+		payload_encode_type(ctx, side_ptr_get(side_ptr_get(type->u.side_array)->elem_type));
+		break;
+	case SIDE_TYPE_VLA:
+		payload_encode_type(ctx, side_ptr_get(side_ptr_get(type->u.side_vla)->elem_type));
+		break;
+	case SIDE_TYPE_VLA_VISITOR:
+		payload_encode_type(ctx, side_ptr_get(side_ptr_get(type->u.side_vla_visitor)->elem_type));
+		break;
+	case SIDE_TYPE_OPTIONAL:
+		payload_encode_type(ctx, side_ptr_get(side_ptr_get(type->u.side_optional)->elem_type));
+		break;
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_type_variant *variant = side_ptr_get(type->u.side_variant);
+		const struct side_variant_option *option;
+
+		payload_encode_type(ctx, &variant->selector);
+		side_payload_write_u32(ctx, variant->options.length);
+		side_for_each_element_in_array(option, &variant->options) {
+			side_payload_write_u64(ctx, (uint64_t) option->range_begin);
+			side_payload_write_u64(ctx, (uint64_t) option->range_end);
+			payload_encode_type(ctx, &option->side_type);
+		}
+		break;
+	}
+	case SIDE_TYPE_ENUM:
+		payload_encode_type(ctx, side_ptr_get(type->u.side_enum.elem_type));
+		break;
+	case SIDE_TYPE_ENUM_BITMAP:
+		payload_encode_type(ctx, side_ptr_get(type->u.side_enum_bitmap.elem_type));
+		break;
+	case SIDE_TYPE_GATHER_BOOL:
+		payload_write_u16(ctx, type->u.side_gather.u.side_bool.offset_bits);
+		payload_encode_bool_params(ctx, &type->u.side_gather.u.side_bool.type);
+		break;
+	case SIDE_TYPE_GATHER_BYTE:
+		break;
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+		payload_write_u16(ctx, type->u.side_gather.u.side_integer.offset_bits);
+		payload_encode_integer_params(ctx, &type->u.side_gather.u.side_integer.type);
+		break;
+	case SIDE_TYPE_GATHER_FLOAT:
+		payload_encode_float_params(ctx, &type->u.side_gather.u.side_float.type);
+		break;
+	case SIDE_TYPE_GATHER_STRING:
+		payload_encode_string_params(ctx, &type->u.side_gather.u.side_string.type);
+		break;
+	case SIDE_TYPE_GATHER_ENUM:
+		payload_encode_type(ctx, side_ptr_get(type->u.side_gather.u.side_enum.elem_type));
+		break;
+	case SIDE_TYPE_GATHER_STRUCT:
+	{
+		const struct side_type_struct *side_struct = side_ptr_get(type->u.side_gather.u.side_struct.type);
+
+		side_payload_encode_fields(ctx, side_ptr_get(side_struct->fields.elements), side_struct->fields.length);
+		break;
+	}
+	default:
+		/* Gather arrays and variable-length arrays. */
+		ctx->error = true;
+		break;
+	}
+}
+
+static
+void payload_serialize_arg(struct side_payload_writer *ctx, const struct side_type *type, const struct side_arg *arg);
+static
+void payload_serialize_dynamic(struct side_payload_writer *ctx, const struct side_arg *arg);
+
+static
+int64_t payload_load_selector(const struct side_type_integer *type, const union side_integer_value *value)
+{
+	bool reverse_bo = side_enum_get(type->byte_order) != SIDE_TYPE_BYTE_ORDER_HOST;
+
+	switch (type->integer_size) {
+	case 1:
+		return type->signedness ? (int64_t) value->side_s8 : (int64_t) value->side_u8;
+	case 2:
+	{
+		uint16_t v = reverse_bo ? side_bswap_16(value->side_u16) : value->side_u16;
+
+		return type->signedness ? (int64_t) (int16_t) v : (int64_t) v;
+	}
+	case 4:
+	{
+		uint32_t v = reverse_bo ? side_bswap_32(value->side_u32) : value->side_u32;
+
+		return type->signedness ? (int64_t) (int32_t) v : (int64_t) v;
+	}
+	case 8:
+		return (int64_t) (reverse_bo ? side_bswap_64(value->side_u64) : value->side_u64);
+	default:
+		return 0;
+	}
+}
+
+static
+const char *payload_gather_access(enum side_type_gather_access_mode access_mode, const char *ptr)
+{
+	if (access_mode == SIDE_TYPE_GATHER_ACCESS_POINTER)
+		memcpy(&ptr, ptr, sizeof(const char *));
+	return ptr;
+}
+
+static
+void payload_serialize_vec(struct side_payload_writer *ctx, const struct side_type *elem_type,
+		const struct side_arg_vec *side_arg_vec)
+{
+	const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
+	uint32_t i;
+
+	for (i = 0; i < side_arg_vec->len; i++)
+		payload_serialize_arg(ctx, elem_type, &sav[i]);
+}
+
+struct payload_visitor_priv {
+	struct side_payload_writer *ctx;
+	const struct side_type *elem_type;	/* NULL for dynamic elements. */
+	uint32_t count;
+};
+
+static
+enum side_visitor_status payload_write_elem(const struct side_tracer_visitor_ctx *tracer_ctx,
+		const struct side_arg *elem)
+{
+	struct payload_visitor_priv *priv = (struct payload_visitor_priv *) tracer_ctx->priv;
+
+	if (priv->elem_type)
+		payload_serialize_arg(priv->ctx, priv->elem_type, elem);
+	else
+		payload_serialize_dynamic(priv->ctx, elem);
+	priv->count++;
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status payload_write_elems(const struct side_tracer_visitor_ctx *tracer_ctx,
+		const struct side_arg *elems, uint32_t nr_elems)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_elems; i++)
+		(void) payload_write_elem(tracer_ctx, &elems[i]);
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status payload_write_scalars(const struct side_tracer_visitor_ctx *tracer_ctx,
+		const struct side_arg *proto, const void *base, size_t stride,
+		uint32_t nr_elems)
+{
+	struct payload_visitor_priv *priv = (struct payload_visitor_priv *) tracer_ctx->priv;
+	struct side_arg elem = *proto;
+	const char *p = base;
+	size_t size;
+	void *value;
+	uint32_t i;
+
+	size = side_arg_scalar_value(&elem, priv->elem_type, &value);
+	if (!size)
+		return SIDE_VISITOR_STATUS_ERROR;
+	for (i = 0; i < nr_elems; i++, p += stride) {
+		memcpy(value, p, size);
+		(void) payload_write_elem(tracer_ctx, &elem);
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status payload_write_field(const struct side_tracer_dynamic_struct_visitor_ctx *tracer_ctx,
+		const struct side_arg_dynamic_field *field)
+{
+	struct payload_visitor_priv *priv = (struct payload_visitor_priv *) tracer_ctx->priv;
+
+	side_payload_write_cstr(priv->ctx, side_ptr_get(field->field_name));
+	payload_serialize_dynamic(priv->ctx, &field->elem);
+	priv->count++;
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+void payload_serialize_vla_visitor(struct side_payload_writer *ctx, const struct side_type *elem_type,
+		side_visitor_func func, void *app_ctx)
+{
+	struct payload_visitor_priv priv = {
+		.ctx = ctx,
+		.elem_type = elem_type,
+		.count = 0,
+	};
+	const struct side_tracer_visitor_ctx tracer_ctx = {
+		.write_elem = payload_write_elem,
+		.priv = &priv,
+		.write_elems = payload_write_elems,
+		.write_scalars = payload_write_scalars,
+	};
+	char *length = payload_reserve_u32(ctx);
+
+	if (func(&tracer_ctx, app_ctx) != SIDE_VISITOR_STATUS_OK)
+		ctx->error = true;
+	if (length)
+		memcpy(length, &priv.count, sizeof(priv.count));
+}
+
+static
+void payload_serialize_dynamic_fields(struct side_payload_writer *ctx, const struct side_arg_dynamic_field *fields,
+		uint32_t nr_fields)
+{
+	uint32_t i;
+
+	side_payload_write_u32(ctx, nr_fields);
+	for (i = 0; i < nr_fields; i++) {
+		side_payload_write_cstr(ctx, side_ptr_get(fields[i].field_name));
+		payload_serialize_dynamic(ctx, &fields[i].elem);
+	}
+}
+
+static
+void payload_serialize_dynamic(struct side_payload_writer *ctx, const struct side_arg *arg)
+{
+	uint16_t label = side_enum_get(arg->type);
+
+	payload_write_u16(ctx, label);
+	switch (label) {
+	case SIDE_TYPE_DYNAMIC_NULL:
+		break;
+	case SIDE_TYPE_DYNAMIC_BOOL:
+		payload_encode_bool_params(ctx, &arg->u.side_dynamic.side_bool.type);
+		side_payload_write(ctx, &arg->u.side_dynamic.side_bool.value, arg->u.side_dynamic.side_bool.type.bool_size);
+		break;
+	case SIDE_TYPE_DYNAMIC_INTEGER:
+	case SIDE_TYPE_DYNAMIC_POINTER:
+		payload_encode_integer_params(ctx, &arg->u.side_dynamic.side_integer.type);
+		side_payload_write(ctx, &arg->u.side_dynamic.side_integer.value, arg->u.side_dynamic.side_integer.type.integer_size);
+		break;
+	case SIDE_TYPE_DYNAMIC_BYTE:
+		payload_write_u8(ctx, arg->u.side_dynamic.side_byte.value);
+		break;
+	case SIDE_TYPE_DYNAMIC_FLOAT:
+		payload_encode_float_params(ctx, &arg->u.side_dynamic.side_float.type);
+		side_payload_write(ctx, &arg->u.side_dynamic.side_float.value, arg->u.side_dynamic.side_float.type.float_size);
+		break;
+	case SIDE_TYPE_DYNAMIC_STRING:
+		payload_encode_string_params(ctx, &arg->u.side_dynamic.side_string.type);
+		payload_write_string(ctx, (const void *) (uintptr_t) arg->u.side_dynamic.side_string.value,
+				arg->u.side_dynamic.side_string.type.unit_size);
+		break;
+	case SIDE_TYPE_DYNAMIC_STRUCT:
+	{
+		const struct side_arg_dynamic_struct *side_struct = side_ptr_get(arg->u.side_dynamic.side_dynamic_struct);
+
+		payload_serialize_dynamic_fields(ctx, side_ptr_get(side_struct->fields), side_struct->len);
+		break;
+	}
+	case SIDE_TYPE_DYNAMIC_STRUCT_VISITOR:
+	{
+		struct side_arg_dynamic_struct_visitor *visitor = side_ptr_get(arg->u.side_dynamic.side_dynamic_struct_visitor);
+		struct payload_visitor_priv priv = {
+			.ctx = ctx,
+			.count = 0,
+		};
+		const struct side_tracer_dynamic_struct_visitor_ctx tracer_ctx = {
+			.write_field = payload_write_field,
+			.priv = &priv,
+		};
+		char *length = payload_reserve_u32(ctx);
+
+		if (side_ptr_get(visitor->visitor)(&tracer_ctx, side_ptr_get(visitor->app_ctx)) != SIDE_VISITOR_STATUS_OK)
+			ctx->error = true;
+		if (length)
+			memcpy(length, &priv.count, sizeof(priv.count));
+		break;
+	}
+	case SIDE_TYPE_DYNAMIC_VLA:
+	{
+		const struct side_arg_dynamic_vla *vla = side_ptr_get(arg->u.side_dynamic.side_dynamic_vla);
+		const struct side_arg *sav = side_ptr_get(vla->sav);
+		uint32_t i;
+
+		side_payload_write_u32(ctx, vla->len);
+		for (i = 0; i < vla->len; i++)
+			payload_serialize_dynamic(ctx, &sav[i]);
+		break;
+	}
+	case SIDE_TYPE_DYNAMIC_VLA_VISITOR:
+	{
+		struct side_arg_dynamic_vla_visitor *visitor = side_ptr_get(arg->u.side_dynamic.side_dynamic_vla_visitor);
+
+		payload_serialize_vla_visitor(ctx, NULL, side_ptr_get(visitor->visitor), side_ptr_get(visitor->app_ctx));
+		break;
+	}
+	default:
+		ctx->error = true;
+		break;
+	}
+}
+
+static
+void payload_serialize_arg(struct side_payload_writer *ctx, const struct side_type *type, const struct side_arg *arg)
+{
+	uint16_t label = side_enum_get(type->type);
+
+	switch (label) {
+	case SIDE_TYPE_ENUM:
+		payload_serialize_arg(ctx, side_ptr_get(type->u.side_enum.elem_type), arg);
+		return;
+	case SIDE_TYPE_ENUM_BITMAP:
+		payload_serialize_arg(ctx, side_ptr_get(type->u.side_enum_bitmap.elem_type), arg);
+		return;
+	case SIDE_TYPE_GATHER_ENUM:
+		payload_serialize_arg(ctx, side_ptr_get(type->u.side_gather.u.side_enum.elem_type), arg);
+		return;
+	case SIDE_TYPE_DYNAMIC:
+		payload_serialize_dynamic(ctx, arg);
+		return;
+	case SIDE_TYPE_LAZY:
+	{
+		const struct side_arg *value;
+
+		if (side_unlikely(side_enum_get(arg->type) != label)) {
+			ctx->error = true;
+			return;
+		}
+		value = side_arg_lazy_value(type, arg);
+		if (side_unlikely(!value)) {
+			ctx->error = true;
+			return;
+		}
+		payload_serialize_arg(ctx, side_ptr_get(side_ptr_get(type->u.side_lazy)->value_type), value);
+		return;
+	}
+	default:
+		break;
+	}
+	if (side_unlikely(side_enum_get(arg->type) != label)) {
+		ctx->error = true;
+		return;
+	}
+	switch (label) {
+	case SIDE_TYPE_NULL:
+		break;
+	case SIDE_TYPE_BOOL:
+		side_payload_write(ctx, &arg->u.side_static.bool_value, type->u.side_bool.bool_size);
+		break;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_U128:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_S128:
+	case SIDE_TYPE_POINTER:
+		side_payload_write(ctx, &arg->u.side_static.integer_value, type->u.side_integer.integer_size);
+		break;
+	case SIDE_TYPE_BYTE:
+		payload_write_u8(ctx, arg->u.side_static.byte_value);
+		break;
+	case SIDE_TYPE_FLOAT_BINARY16:
+	case SIDE_TYPE_FLOAT_BINARY32:
+	case SIDE_TYPE_FLOAT_BINARY64:
+	case SIDE_TYPE_FLOAT_BINARY128:
+		side_payload_write(ctx, &arg->u.side_static.float_value, type->u.side_float.float_size);
+		break;
+	case SIDE_TYPE_STRING_UTF8:
+	case SIDE_TYPE_STRING_UTF16:
+	case SIDE_TYPE_STRING_UTF32:
+		payload_write_string(ctx, side_ptr_get(arg->u.side_static.string_value), type->u.side_string.unit_size);
+		break;
+	case SIDE_TYPE_STRUCT:
+	{
+		const struct side_type_struct *side_struct = side_ptr_get(type->u.side_struct);
+		const struct side_arg_vec *side_arg_vec = side_ptr_get(arg->u.side_static.side_struct);
+		const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
+		uint32_t i;
+
+		if (side_unlikely(side_arg_vec->len != side_struct->fields.length)) {
+			ctx->error = true;
+			break;
+		}
+		for (i = 0; i < side_arg_vec->len; i++)
+			payload_serialize_arg(ctx, &(side_array_at(&side_struct->fields, i))->side_type, &sav[i]);
+		break;
+	}
+	case SIDE_TYPE_ARRAY:
+	{
+		const struct side_arg_vec *side_arg_vec = side_ptr_get(arg->u.side_static.side_array);
+
+		if (side_unlikely(side_arg_vec->len != side_ptr_get(type->u.side_array)->length)) {
+			ctx->error = true;
+			break;
+		}
+		payload_serialize_vec(ctx, side_ptr_get(side_ptr_get(type->u.side_array)->elem_type), side_arg_vec);
+		break;
+	}
+	case SIDE_TYPE_VLA:
+	{
+		const struct side_arg_vec *side_arg_vec = side_ptr_get(arg->u.side_static.side_vla);
+
+		side_payload_write_u32(ctx, side_arg_vec->len);
+		payload_serialize_vec(ctx, side_ptr_get(side_ptr_get(type->u.side_vla)->elem_type), side_arg_vec);
+		break;
+	}
+	case SIDE_TYPE_VLA_VISITOR:
+	{
+		const struct side_type_vla_visitor *side_vla_visitor = side_ptr_get(type->u.side_vla_visitor);
+		struct side_arg_vla_visitor *vla_visitor = side_ptr_get(arg->u.side_static.side_vla_visitor);
+
+		payload_serialize_vla_visitor(ctx, side_ptr_get(side_vla_visitor->elem_type),
+			side_ptr_get(side_vla_visitor->visitor), side_ptr_get(vla_visitor->app_ctx));
+		break;
+	}
+	case SIDE_TYPE_OPTIONAL:
+	{
+		const struct side_arg_optional *optional = side_ptr_get(arg->u.side_static.side_optional);
+
+		payload_write_u8(ctx, optional->selector);
+		if (optional->selector != SIDE_OPTIONAL_DISABLED)
+			payload_serialize_arg(ctx, side_ptr_get(side_ptr_get(type->u.side_optional)->elem_type),
+					&optional->side_static);
+		break;
+	}
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_type_variant *side_type_variant = side_ptr_get(type->u.side_variant);
+		const struct side_arg_variant *side_arg_variant = side_ptr_get(arg->u.side_static.side_variant);
+		const struct side_variant_option *option;
+		int64_t v;
+
+		payload_serialize_arg(ctx, &side_type_variant->selector, &side_arg_variant->selector);
+		v = payload_load_selector(&side_type_variant->selector.u.side_integer,
+				&side_arg_variant->selector.u.side_static.integer_value);
+		side_for_each_element_in_array(option, &side_type_variant->options) {
+			if (v >= option->range_begin && v <= option->range_end) {
+				payload_serialize_arg(ctx, &option->side_type, &side_arg_variant->option);
+				return;
+			}
+		}
+		ctx->error = true;
+		break;
+	}
+	case SIDE_TYPE_GATHER_BOOL:
+	{
+		const struct side_type_gather_bool *gather = &type->u.side_gather.u.side_bool;
+
+		side_payload_write(ctx, payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_bool_gather_ptr) + gather->offset),
+			gather->type.bool_size);
+		break;
+	}
+	case SIDE_TYPE_GATHER_BYTE:
+	{
+		const struct side_type_gather_byte *gather = &type->u.side_gather.u.side_byte;
+
+		side_payload_write(ctx, payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_byte_gather_ptr) + gather->offset), 1);
+		break;
+	}
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+	{
+		const struct side_type_gather_integer *gather = &type->u.side_gather.u.side_integer;
+
+		side_payload_write(ctx, payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_integer_gather_ptr) + gather->offset),
+			gather->type.integer_size);
+		break;
+	}
+	case SIDE_TYPE_GATHER_FLOAT:
+	{
+		const struct side_type_gather_float *gather = &type->u.side_gather.u.side_float;
+
+		side_payload_write(ctx, payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_float_gather_ptr) + gather->offset),
+			gather->type.float_size);
+		break;
+	}
+	case SIDE_TYPE_GATHER_STRING:
+	{
+		const struct side_type_gather_string *gather = &type->u.side_gather.u.side_string;
+
+		payload_write_string(ctx, payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_string_gather_ptr) + gather->offset),
+			gather->type.unit_size);
+		break;
+	}
+	case SIDE_TYPE_GATHER_STRUCT:
+	{
+		const struct side_type_gather_struct *gather = &type->u.side_gather.u.side_struct;
+		const struct side_type_struct *side_struct = side_ptr_get(gather->type);
+		struct side_arg field_arg = {};
+		uint32_t i;
+
+		/* The fields are gather types reading from the structure. */
+		side_ptr_set(field_arg.u.side_static.side_struct_gather_ptr,
+			payload_gather_access(side_enum_get(gather->access_mode),
+				(const char *) side_ptr_get(arg->u.side_static.side_struct_gather_ptr) + gather->offset));
+		for (i = 0; i < side_struct->fields.length; i++) {
+			const struct side_event_field *field = side_array_at(&side_struct->fields, i);
+
+			side_enum_set(field_arg.type, side_enum_get(field->side_type.type));
+			payload_serialize_arg(ctx, &field->side_type, &field_arg);
+		}
+		break;
+	}
+	default:
+		ctx->error = true;
+		break;
+	}
+}
+
+void side_payload_serialize(struct side_payload_writer *ctx,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct)
+{
+	const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
+	uint32_t i;
+
+	if (side_unlikely(side_arg_vec->len != desc->fields.length)) {
+		ctx->error = true;
+		return;
+	}
+	for (i = 0; i < side_arg_vec->len; i++)
+		payload_serialize_arg(ctx, &(side_array_at(&desc->fields, i))->side_type, &sav[i]);
+	if (var_struct)
+		payload_serialize_dynamic_fields(ctx, side_ptr_get(var_struct->fields), var_struct->len);
+}
+
+bool side_payload_get(struct side_payload *payload,
+		const struct side_event_description *desc,
+		const struct side_serialize_plan *plan,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct)
+{
+	struct side_payload_scratch *scratch = &payload_scratch;
+	char *buf;
+
+	if (payload->data)
+		return true;
+	if (payload->error)
+		return false;
+	if (side_unlikely(scratch->nesting >= SIDE_PAYLOAD_NESTING)) {
+		payload->error = true;
+		return false;
+	}
+	/*
+	 * Claim the buffer before serializing: visitors and lazy
+	 * functions may emit events.
+	 */
+	buf = scratch->data[scratch->nesting++];
+	if (plan && !var_struct) {
+		if (side_unlikely(plan->size > SIDE_PAYLOAD_MAX_SIZE ||
+				!side_serialize_plan_run(plan, side_arg_vec, buf)))
+			goto error;
+		payload->len = plan->size;
+	} else {
+		struct side_payload_writer ctx = {
+			.p = buf,
+			.end = buf + SIDE_PAYLOAD_MAX_SIZE,
+			.error = false,
+		};
+
+		side_payload_serialize(&ctx, desc, side_arg_vec, var_struct);
+		if (side_unlikely(ctx.error))
+			goto error;
+		payload->len = ctx.p - buf;
+	}
+	payload->data = buf;
+	return true;
+
+error:
+	scratch->nesting--;
+	payload->error = true;
+	return false;
+}
+
+void side_payload_put(struct side_payload *payload)
+{
+	if (payload->data)
+		payload_scratch.nesting--;
+}
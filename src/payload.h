@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_PAYLOAD_H
+#define _SIDE_PAYLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+#include "serialize-plan.h"
+
+/*
+ * Binary encoding of event payloads and declarations, shared by the
+ * ring buffer tracer and the payload callbacks (see payload.c for the
+ * encoding).
+ */
+
+/* Payloads with a larger encoding are not serialized. */
+#define SIDE_PAYLOAD_MAX_SIZE	4096
+
+struct side_payload_writer {
+	char *p;
+	char *end;
+	bool error;		/* Set when p reaches end or on bad input. */
+};
+
+void side_payload_write(struct side_payload_writer *ctx, const void *src, size_t len)
+	__attribute__((visibility("hidden")));
+void side_payload_write_u32(struct side_payload_writer *ctx, uint32_t v)
+	__attribute__((visibility("hidden")));
+void side_payload_write_u64(struct side_payload_writer *ctx, uint64_t v)
+	__attribute__((visibility("hidden")));
+void side_payload_write_cstr(struct side_payload_writer *ctx, const char *str)
+	__attribute__((visibility("hidden")));
+
+/* Declaration: u32 number of fields, then names and types. */
+void side_payload_encode_fields(struct side_payload_writer *ctx,
+		const struct side_event_field *fields, uint32_t nr_fields)
+	__attribute__((visibility("hidden")));
+
+/* Payload of the event arguments, and variadic fields if var_struct. */
+void side_payload_serialize(struct side_payload_writer *ctx,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Payload of an event occurrence shared by its payload callbacks. It
+ * is serialized into a per-thread scratch buffer by the first payload
+ * callback, and the buffer is released by side_payload_put() once the
+ * callbacks of the occurrence have been called.
+ */
+struct side_payload {
+	const char *data;	/* NULL until serialized. */
+	size_t len;
+	bool error;		/* Cannot be serialized. */
+};
+
+#define SIDE_PAYLOAD_INIT	{ .data = NULL, .len = 0, .error = false }
+
+/*
+ * Returns false if the payload cannot be serialized: larger than
+ * SIDE_PAYLOAD_MAX_SIZE, arguments not matching the description, or
+ * too deeply nested events (emitted by callbacks or signal handlers
+ * while the thread serializes a payload).
+ */
+bool side_payload_get(struct side_payload *payload,
+		const struct side_event_description *desc,
+		const struct side_serialize_plan *plan,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct)
+	__attribute__((visibility("hidden")));
+void side_payload_put(struct side_payload *payload)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_PAYLOAD_H */
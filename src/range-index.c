@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "range-index.h"
+
+#define RANGE_INDEX_SLOTS		1024
+#define RANGE_INDEX_PROBES		16
+/* Direct indexing of ranges spanning at most this many values. */
+#define RANGE_INDEX_DENSE_MAX_VALUES	256
+/* Nested ranges can make positions quadratic: give up above this. */
+#define RANGE_INDEX_MAX_POSITIONS	65536
+
+struct range {
+	int64_t begin;
+	int64_t end;
+};
+
+/* Disjoint and sorted. */
+struct range_segment {
+	int64_t begin;
+	int64_t end;
+	uint32_t first_pos;
+	uint32_t nr_pos;
+};
+
+struct side_range_index {
+	uint32_t refcount;		/* Registered type instances. */
+	uint32_t nr_segments;
+	int64_t dense_base;
+	uint32_t dense_len;		/* 0: binary search. */
+	uint32_t *dense;		/* Segment number + 1, 0 if no range. */
+	struct range_segment *segments;
+	uint32_t *pos;
+};
+
+/*
+ * Slots are claimed by setting their key, and are only reused by the
+ * same key once their index is removed.
+ */
+struct range_index_slot {
+	const void *key;
+	struct side_range_index *index;
+};
+
+static struct range_index_slot range_index_slots[RANGE_INDEX_SLOTS];
+
+static
+size_t range_index_hash(const void *key)
+{
+	uint64_t v = (uint64_t) (uintptr_t) key;
+
+	return (size_t) ((v * 0x9E3779B97F4A7C15ULL) >> 32) & (RANGE_INDEX_SLOTS - 1);
+}
+
+static
+int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Boundary equal to v. */
+static
+uint32_t find_bound(const int64_t *bounds, uint32_t nr_bounds, int64_t v)
+{
+	uint32_t lo = 0, hi = nr_bounds;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (bounds[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static
+void range_index_free(struct side_range_index *index)
+{
+	if (!index)
+		return;
+	free(index->dense);
+	free(index->segments);
+	free(index->pos);
+	free(index);
+}
+
+/*
+ * The boundaries of the ranges (their beginning, and the value
+ * following their end) delimit elementary segments: each range is the
+ * union of consecutive segments. Ranges are appended to the positions
+ * of their segments in list order, and empty segments are dropped.
+ */
+static
+struct side_range_index *range_index_build(const struct range *ranges, uint32_t nr_ranges)
+{
+	struct side_range_index *index = NULL;
+	uint32_t i, nr_bounds = 0, nr_segments = 0, nr_pos = 0;
+	uint32_t *count = NULL, *segment_of = NULL;
+	int64_t *bounds;
+
+	for (i = 0; i < nr_ranges; i++) {
+		/* Left to the linear scan to report. */
+		if (ranges[i].end < ranges[i].begin)
+			return NULL;
+	}
+	bounds = (int64_t *) malloc(2 * (size_t) nr_ranges * sizeof(int64_t));
+	if (!bounds)
+		return NULL;
+	for (i = 0; i < nr_ranges; i++) {
+		bounds[nr_bounds++] = ranges[i].begin;
+		if (ranges[i].end < INT64_MAX)
+			bounds[nr_bounds++] = ranges[i].end + 1;
+	}
+	qsort(bounds, nr_bounds, sizeof(int64_t), cmp_int64);
+	for (i = 1, nr_segments = 1; i < nr_bounds; i++) {
+		if (bounds[i] != bounds[nr_segments - 1])
+			bounds[nr_segments++] = bounds[i];
+	}
+	nr_bounds = nr_segments;
+
+	count = (uint32_t *) calloc(nr_bounds, sizeof(uint32_t));
+	segment_of = (uint32_t *) calloc(nr_bounds, sizeof(uint32_t));
+	if (!count || !segment_of)
+		goto end;
+	for (i = 0; i < nr_ranges; i++) {
+		uint32_t s;
+
+		for (s = find_bound(bounds, nr_bounds, ranges[i].begin);
+				s < nr_bounds && bounds[s] <= ranges[i].end; s++) {
+			if (++nr_pos > RANGE_INDEX_MAX_POSITIONS)
+				goto end;
+			count[s]++;
+		}
+	}
+
+	index = (struct side_range_index *) calloc(1, sizeof(struct side_range_index));
+	if (!index)
+		goto end;
+	for (i = 0, nr_segments = 0; i < nr_bounds; i++) {
+		if (count[i])
+			nr_segments++;
+	}
+	index->segments = (struct range_segment *) calloc(nr_segments, sizeof(struct range_segment));
+	index->pos = (uint32_t *) calloc(nr_pos, sizeof(uint32_t));
+	if (!index->segments || !index->pos)
+		goto error;
+
+	for (i = 0, nr_segments = 0, nr_pos = 0; i < nr_bounds; i++) {
+		struct range_segment *segment;
+
+		if (!count[i])
+			continue;
+		segment = &index->segments[nr_segments];
+		segment->begin = bounds[i];
+		segment->end = i + 1 < nr_bounds ? bounds[i + 1] - 1 : INT64_MAX;
+		segment->first_pos = nr_pos;
+		nr_pos += count[i];
+		segment_of[i] = nr_segments++;
+	}
+	index->nr_segments = nr_segments;
+	for (i = 0; i < nr_ranges; i++) {
+		uint32_t s;
+
+		for (s = find_bound(bounds, nr_bounds, ranges[i].begin);
+				s < nr_bounds && bounds[s] <= ranges[i].end; s++) {
+			struct range_segment *segment = &index->segments[segment_of[s]];
+
+			index->pos[segment->first_pos + segment->nr_pos++] = i;
+		}
+	}
+
+	if ((uint64_t) index->segments[nr_segments - 1].end - (uint64_t) index->segments[0].begin
+			< RANGE_INDEX_DENSE_MAX_VALUES) {
+		index->dense_base = index->segments[0].begin;
+		index->dense_len = (uint32_t) ((uint64_t) index->segments[nr_segments - 1].end
+				- (uint64_t) index->dense_base) + 1;
+		index->dense = (uint32_t *) calloc(index->dense_len, sizeof(uint32_t));
+		if (!index->dense)
+			goto error;
+		for (i = 0; i < nr_segments; i++) {
+			uint64_t v;
+
+			for (v = (uint64_t) index->segments[i].begin - (uint64_t) index->dense_base;
+					v <= (uint64_t) index->segments[i].end - (uint64_t) index->dense_base; v++)
+				index->dense[v] = i + 1;
+		}
+	}
+	index->refcount = 1;
+	goto end;
+
+error:
+	range_index_free(index);
+	index = NULL;
+end:
+	free(segment_of);
+	free(count);
+	free(bounds);
+	return index;
+}
+
+/*
+ * Key of the ranges of a type, and a copy of its ranges. Returns NULL
+ * if the type has no ranges to index.
+ */
+static
+const void *type_ranges(const struct side_type *type, struct range **_ranges, uint32_t *_nr_ranges,
+		bool copy)
+{
+	const struct side_enum_mappings *mappings;
+	struct range *ranges = NULL;
+	const void *key;
+	uint32_t i, nr;
+
+	switch (side_enum_get(type->type)) {
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_type_variant *variant = side_ptr_get(type->u.side_variant);
+
+		nr = side_array_length(&variant->options);
+		if (nr < SIDE_RANGE_INDEX_MIN_RANGES)
+			return NULL;
+		if (copy) {
+			ranges = (struct range *) calloc(nr, sizeof(struct range));
+			if (!ranges)
+				return NULL;
+			for (i = 0; i < nr; i++) {
+				ranges[i].begin = (side_array_at(&variant->options, i))->range_begin;
+				ranges[i].end = (side_array_at(&variant->options, i))->range_end;
+			}
+		}
+		key = variant;
+		goto end;
+	}
+	case SIDE_TYPE_ENUM:
+		mappings = side_ptr_get(type->u.side_enum.mappings);
+		break;
+	case SIDE_TYPE_GATHER_ENUM:
+		mappings = side_ptr_get(type->u.side_gather.u.side_enum.mappings);
+		break;
+	default:
+		return NULL;
+	}
+	nr = side_array_length(&mappings->mappings);
+	if (nr < SIDE_RANGE_INDEX_MIN_RANGES)
+		return NULL;
+	if (copy) {
+		ranges = (struct range *) calloc(nr, sizeof(struct range));
+		if (!ranges)
+			return NULL;
+		for (i = 0; i < nr; i++) {
+			ranges[i].begin = (side_array_at(&mappings->mappings, i))->range_begin;
+			ranges[i].end = (side_array_at(&mappings->mappings, i))->range_end;
+		}
+	}
+	key = mappings;
+end:
+	*_ranges = ranges;
+	*_nr_ranges = nr;
+	return key;
+}
+
+static
+struct range_index_slot *slot_find(const void *key)
+{
+	size_t i, hash = range_index_hash(key);
+
+	for (i = 0; i < RANGE_INDEX_PROBES; i++) {
+		struct range_index_slot *slot = &range_index_slots[(hash + i) & (RANGE_INDEX_SLOTS - 1)];
+		const void *slot_key = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+
+		if (!slot_key)
+			return NULL;
+		if (slot_key == key)
+			return slot;
+	}
+	return NULL;
+}
+
+void side_range_index_add(const struct side_type *type)
+{
+	struct side_range_index *index;
+	struct range_index_slot *slot;
+	struct range *ranges;
+	uint32_t nr_ranges;
+	const void *key;
+	size_t i, hash;
+
+	key = type_ranges(type, &ranges, &nr_ranges, false);
+	if (!key)
+		return;
+	slot = slot_find(key);
+	if (slot && slot->index) {
+		slot->index->refcount++;
+		return;
+	}
+	if (!slot) {
+		hash = range_index_hash(key);
+		for (i = 0; i < RANGE_INDEX_PROBES; i++) {
+			struct range_index_slot *s = &range_index_slots[(hash + i) & (RANGE_INDEX_SLOTS - 1)];
+
+			if (!s->key) {
+				slot = s;
+				break;
+			}
+		}
+		/* Slots exhausted: scanned linearly. */
+		if (!slot)
+			return;
+	}
+	if (!type_ranges(type, &ranges, &nr_ranges, true))
+		return;
+	index = range_index_build(ranges, nr_ranges);
+	free(ranges);
+	if (!index)
+		return;
+	__atomic_store_n(&slot->index, index, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+}
+
+void side_range_index_remove(const struct side_type *type)
+{
+	struct range_index_slot *slot;
+	struct side_range_index *index;
+	struct range *ranges;
+	uint32_t nr_ranges;
+	const void *key;
+
+	key = type_ranges(type, &ranges, &nr_ranges, false);
+	if (!key)
+		return;
+	slot = slot_find(key);
+	if (!slot || !slot->index)
+		return;
+	index = slot->index;
+	if (--index->refcount)
+		return;
+	/* Events using the index are unreachable. */
+	__atomic_store_n(&slot->index, NULL, __ATOMIC_RELAXED);
+	range_index_free(index);
+}
+
+const struct side_range_index *side_range_index_find(const void *ranges)
+{
+	struct range_index_slot *slot = slot_find(ranges);
+
+	if (!slot)
+		return NULL;
+	return __atomic_load_n(&slot->index, __ATOMIC_ACQUIRE);
+}
+
+uint32_t side_range_index_lookup(const struct side_range_index *index, int64_t v,
+		const uint32_t **pos)
+{
+	const struct range_segment *segment;
+
+	if (index->dense_len) {
+		uint64_t offset = (uint64_t) v - (uint64_t) index->dense_base;
+		uint32_t s;
+
+		if (offset >= index->dense_len)
+			return 0;
+		s = index->dense[offset];
+		if (!s)
+			return 0;
+		segment = &index->segments[s - 1];
+	} else {
+		uint32_t lo = 0, hi = index->nr_segments;
+
+		while (lo < hi) {
+			uint32_t mid = lo + (hi - lo) / 2;
+
+			if (index->segments[mid].end < v)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == index->nr_segments || index->segments[lo].begin > v)
+			return 0;
+		segment = &index->segments[lo];
+	}
+	*pos = &index->pos[segment->first_pos];
+	return segment->nr_pos;
+}
+
+void side_range_index_exit(void)
+{
+	size_t i;
+
+	for (i = 0; i < RANGE_INDEX_SLOTS; i++)
+		range_index_free(range_index_slots[i].index);
+	memset(range_index_slots, 0, sizeof(range_index_slots));
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_RANGE_INDEX_H
+#define _SIDE_RANGE_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * Value lookup indexes of the variant options and enumeration mappings
+ * of registered events. The ranges of a list are split into disjoint
+ * segments, each holding the positions of the ranges containing it, in
+ * list order. A value is looked up by direct indexing when the ranges
+ * span few values, and by binary search of the segments otherwise.
+ *
+ * Indexes are keyed by the address of their struct side_type_variant or
+ * struct side_enum_mappings, and only built for lists of at least
+ * SIDE_RANGE_INDEX_MIN_RANGES ranges. Lists without an index, because
+ * they are short, have invalid ranges, or because memory or index slots
+ * ran out, are scanned linearly by their users.
+ *
+ * side_range_index_add(), side_range_index_remove() and
+ * side_range_index_exit() must be called with the event lock held.
+ * Lookups need no lock: the index of a list is not freed while an
+ * event using it is registered.
+ */
+
+#define SIDE_RANGE_INDEX_MIN_RANGES	4
+
+struct side_range_index;
+
+/* Index the ranges of a variant or enumeration type, if any. */
+void side_range_index_add(const struct side_type *type)
+	__attribute__((visibility("hidden")));
+void side_range_index_remove(const struct side_type *type)
+	__attribute__((visibility("hidden")));
+/* ranges is a struct side_type_variant or struct side_enum_mappings. */
+const struct side_range_index *side_range_index_find(const void *ranges)
+	__attribute__((visibility("hidden")));
+/*
+ * Set *pos to the positions of the ranges containing v, in list order,
+ * and return their number.
+ */
+uint32_t side_range_index_lookup(const struct side_range_index *index, int64_t v,
+		const uint32_t **pos)
+	__attribute__((visibility("hidden")));
+void side_range_index_exit(void)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_RANGE_INDEX_H */
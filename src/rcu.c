@@ -12,8 +12,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <time.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <linux/membarrier.h>
+#include <linux/mempolicy.h>
 
 #include "rcu.h"
 #include "smp.h"
@@ -23,6 +26,31 @@
  * available, use them to replace barriers and atomics on the fast-path.
  */
 unsigned int side_rcu_rseq_membarrier_available;
+/*
+ * If only membarrier is available, the read-side fallback uses relaxed
+ * atomics and compiler barriers, and the grace period relies on
+ * membarrier to order them. This only saves the fences of SEQ_CST
+ * atomics on weakly ordered architectures: atomic read-modify-writes
+ * are lock-prefixed on x86 whatever their memory order.
+ */
+unsigned int side_rcu_membarrier_available;
+
+__thread struct side_rcu_cpu_hint side_rcu_cpu_hint;
+
+/*
+ * Maximum number of cpu_used bitmap words snapshot by a reader scan.
+ * CPUs beyond this limit are always scanned.
+ */
+#define SIDE_RCU_SCAN_MAX_WORDS		64
+
+/* NUMA node placement hints are only provided for the first nodes. */
+#define SIDE_RCU_MAX_NUMA_NODES		1024
+
+struct side_rcu_call_node {
+	struct side_rcu_call_node *next;
+	void (*func)(void *ptr);
+	void *ptr;
+};
 
 static int
 membarrier(int cmd, unsigned int flags, int cpu_id)
@@ -30,6 +58,23 @@ membarrier(int cmd, unsigned int flags, int cpu_id)
 	return syscall(__NR_membarrier, cmd, flags, cpu_id);
 }
 
+/*
+ * Full memory barrier with respect to the read-side compiler barriers
+ * when membarrier is used, SEQ_CST fence otherwise.
+ */
+static
+void gp_full_barrier(void)
+{
+	if (side_rcu_membarrier_available) {
+		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
+			perror("membarrier");
+			abort();
+		}
+	} else {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
 /*
  * Wait/wakeup scheme with single waiter/many wakers.
  */
@@ -43,7 +88,7 @@ void wait_gp_prepare(struct side_rcu_gp_state *gp_state)
 	 * state, thus ensuring that load of RCU reader's counters does
 	 * not leak outside of futex state=-1.
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -62,7 +107,7 @@ void wait_gp_end(struct side_rcu_gp_state *gp_state)
 	 * futex value, thus ensuring that load of RCU reader's counters
 	 * does not leak outside of futex state=-1.
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -81,7 +126,7 @@ void wait_gp(struct side_rcu_gp_state *gp_state)
 	 * orders load of RCU reader's counter state before loading the
 	 * futex value.
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -112,15 +157,48 @@ void wait_gp(struct side_rcu_gp_state *gp_state)
 	return;
 }
 
-/* active_readers is an input/output parameter. */
+static
+int cpu_used_nr_words(struct side_rcu_gp_state *gp_state)
+{
+	return (gp_state->nr_cpus + SIDE_BITS_PER_LONG - 1) / SIDE_BITS_PER_LONG;
+}
+
+static
+unsigned long cpu_used_scan_mask(const unsigned long *snapshot, int word)
+{
+	if (word >= SIDE_RCU_SCAN_MAX_WORDS)
+		return ~0UL;
+	return snapshot[word];
+}
+
+#define cpu_used_for_each(gp_state, snapshot, cpu, word, bits)		\
+	for (word = 0; word < cpu_used_nr_words(gp_state); word++)	\
+		for (bits = cpu_used_scan_mask(snapshot, word);		\
+			bits && (cpu = word * SIDE_BITS_PER_LONG + __builtin_ctzl(bits)) < (gp_state)->nr_cpus; \
+			bits &= bits - 1)
+
+/*
+ * active_readers is an input/output parameter.
+ *
+ * Only the CPUs marked as used in a single snapshot of the cpu_used
+ * bitmap are scanned, so "end" and "begin" counts are read from the
+ * same set of CPUs. A CPU missing from the snapshot has no reader
+ * which began before the grace period, because readers mark the CPU
+ * as used before incrementing its "begin" count.
+ */
 static
 void check_active_readers(struct side_rcu_gp_state *gp_state, bool *active_readers)
 {
+	unsigned long snapshot[SIDE_RCU_SCAN_MAX_WORDS];
 	uintptr_t sum[2] = { 0, 0 };	/* begin - end */
-	int i;
+	unsigned long bits;
+	int i, word;
 
-	for (i = 0; i < gp_state->nr_cpus; i++) {
-		struct side_rcu_cpu_gp_state *cpu_state = &gp_state->percpu_state[i];
+	for (word = 0; word < cpu_used_nr_words(gp_state) && word < SIDE_RCU_SCAN_MAX_WORDS; word++)
+		snapshot[word] = __atomic_load_n(&gp_state->cpu_used[word], __ATOMIC_RELAXED);
+
+	cpu_used_for_each(gp_state, snapshot, i, word, bits) {
+		struct side_rcu_cpu_gp_state *cpu_state = gp_state->percpu_state[i];
 
 		if (active_readers[0]) {
 			sum[0] -= __atomic_load_n(&cpu_state->count[0].end, __ATOMIC_RELAXED);
@@ -142,7 +220,7 @@ void check_active_readers(struct side_rcu_gp_state *gp_state, bool *active_reade
 	 * incremented before "end", as guaranteed by memory barriers
 	 * (A) or (B).
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -151,8 +229,8 @@ void check_active_readers(struct side_rcu_gp_state *gp_state, bool *active_reade
 		__atomic_thread_fence(__ATOMIC_SEQ_CST);
 	}
 
-	for (i = 0; i < gp_state->nr_cpus; i++) {
-		struct side_rcu_cpu_gp_state *cpu_state = &gp_state->percpu_state[i];
+	cpu_used_for_each(gp_state, snapshot, i, word, bits) {
+		struct side_rcu_cpu_gp_state *cpu_state = gp_state->percpu_state[i];
 
 		if (active_readers[0]) {
 			sum[0] += __atomic_load_n(&cpu_state->count[0].begin, __ATOMIC_RELAXED);
@@ -201,6 +279,36 @@ void wait_for_prev_period_readers(struct side_rcu_gp_state *gp_state, bool *acti
 	}
 }
 
+static
+uint64_t gp_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void gp_stats_add(struct side_rcu_gp_state *gp_state, uint64_t start_ns)
+{
+	uint64_t ns = gp_monotonic_ns() - start_ns, max;
+
+	(void) __atomic_add_fetch(&gp_state->nr_waits, 1, __ATOMIC_RELAXED);
+	(void) __atomic_add_fetch(&gp_state->wait_ns, ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&gp_state->max_wait_ns, __ATOMIC_RELAXED);
+	while (ns > max && !__atomic_compare_exchange_n(&gp_state->max_wait_ns, &max, ns,
+			false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void side_rcu_gp_stats(struct side_rcu_gp_state *gp_state, uint64_t *nr_waits,
+		uint64_t *wait_ns, uint64_t *max_wait_ns)
+{
+	*nr_waits = __atomic_load_n(&gp_state->nr_waits, __ATOMIC_RELAXED);
+	*wait_ns = __atomic_load_n(&gp_state->wait_ns, __ATOMIC_RELAXED);
+	*max_wait_ns = __atomic_load_n(&gp_state->max_wait_ns, __ATOMIC_RELAXED);
+}
+
 /*
  * The grace period completes when it observes that there are no active
  * readers within each of the periods.
@@ -212,6 +320,8 @@ void wait_for_prev_period_readers(struct side_rcu_gp_state *gp_state, bool *acti
 void side_rcu_wait_grace_period(struct side_rcu_gp_state *gp_state)
 {
 	bool active_readers[2] = { true, true };
+	uint64_t start_ns = gp_monotonic_ns();
+	unsigned long seq_target;
 
 	/*
 	 * This memory barrier (D) pairs with memory barriers (A) and
@@ -224,7 +334,7 @@ void side_rcu_wait_grace_period(struct side_rcu_gp_state *gp_state)
 	 * exist after the grace period completes are ordered after
 	 * loads and stores performed before the grace period.
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -242,8 +352,33 @@ void side_rcu_wait_grace_period(struct side_rcu_gp_state *gp_state)
 	if (!active_readers[0] && !active_readers[1])
 		goto end;
 
+	/*
+	 * Snapshot the grace period sequence after barrier (D). Any
+	 * grace period started after this point also covers our prior
+	 * stores: if a grace period is in progress (odd sequence), wait
+	 * for the following one to complete. This lets concurrent
+	 * updaters share grace periods rather than each running their
+	 * own.
+	 */
+	seq_target = (__atomic_load_n(&gp_state->gp_seq, __ATOMIC_RELAXED) + 3) & ~1UL;
+
 	pthread_mutex_lock(&gp_state->gp_lock);
 
+	if ((long) (gp_state->gp_seq - seq_target) >= 0)
+		goto unlock;
+	__atomic_store_n(&gp_state->gp_seq, gp_state->gp_seq + 1, __ATOMIC_RELAXED);
+	/*
+	 * Order the sequence increment before the reader state loads.
+	 * The readers scan performed before the snapshot only covers
+	 * our own stores, so restart from a fresh scan which covers all
+	 * updaters waiting on this grace period.
+	 */
+	gp_full_barrier();
+	active_readers[0] = active_readers[1] = true;
+	check_active_readers(gp_state, active_readers);
+	if (!active_readers[0] && !active_readers[1])
+		goto seq_end;
+
 	wait_for_prev_period_readers(gp_state, active_readers);
 	/*
 	 * If the reader scan detected that there are no readers in the
@@ -251,12 +386,14 @@ void side_rcu_wait_grace_period(struct side_rcu_gp_state *gp_state)
 	 * immediately.
 	 */
 	if (!active_readers[gp_state->period])
-		goto unlock;
+		goto seq_end;
 
 	/* Flip period: 0 -> 1, 1 -> 0. */
 	(void) __atomic_xor_fetch(&gp_state->period, 1, __ATOMIC_RELAXED);
 
 	wait_for_prev_period_readers(gp_state, active_readers);
+seq_end:
+	__atomic_store_n(&gp_state->gp_seq, gp_state->gp_seq + 1, __ATOMIC_RELAXED);
 unlock:
 	pthread_mutex_unlock(&gp_state->gp_lock);
 end:
@@ -272,7 +409,7 @@ end:
 	 * are ordered before loads and stores performed after the grace
 	 * period.
 	 */
-	if (side_rcu_rseq_membarrier_available) {
+	if (side_rcu_membarrier_available) {
 		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) {
 			perror("membarrier");
 			abort();
@@ -280,6 +417,278 @@ end:
 	} else {
 		__atomic_thread_fence(__ATOMIC_SEQ_CST);
 	}
+	gp_stats_add(gp_state, start_ns);
+}
+
+static
+void *call_worker_func(void *arg)
+{
+	struct side_rcu_gp_state *gp_state = (struct side_rcu_gp_state *) arg;
+	struct side_rcu_call_state *call = &gp_state->call;
+
+	for (;;) {
+		struct side_rcu_call_node *node, *next;
+		uint64_t nr_completed = 0;
+
+		pthread_mutex_lock(&call->lock);
+		while (!call->head && !call->worker_exit)
+			pthread_cond_wait(&call->worker_cond, &call->lock);
+		if (!call->head) {
+			pthread_mutex_unlock(&call->lock);
+			break;
+		}
+		pthread_mutex_unlock(&call->lock);
+
+		/*
+		 * The worker lock is held while the batch is owned by
+		 * the worker, which allows fork to wait for worker
+		 * quiescence.
+		 */
+		pthread_mutex_lock(&call->worker_lock);
+		pthread_mutex_lock(&call->lock);
+		node = call->head;
+		call->head = NULL;
+		call->tail = &call->head;
+		pthread_mutex_unlock(&call->lock);
+
+		/* A single grace period for the whole batch. */
+		if (node)
+			side_rcu_wait_grace_period(gp_state);
+		for (; node; node = next) {
+			next = node->next;
+			node->func(node->ptr);
+			free(node);
+			nr_completed++;
+		}
+
+		pthread_mutex_lock(&call->lock);
+		call->nr_completed += nr_completed;
+		pthread_cond_broadcast(&call->barrier_cond);
+		pthread_mutex_unlock(&call->lock);
+		pthread_mutex_unlock(&call->worker_lock);
+	}
+	return NULL;
+}
+
+/*
+ * Called with call->lock held. Fails once the worker is exiting, so
+ * callbacks are invoked synchronously instead of starting a worker
+ * which is never joined.
+ */
+static
+int call_worker_ensure_running(struct side_rcu_gp_state *gp_state)
+{
+	struct side_rcu_call_state *call = &gp_state->call;
+
+	if (call->worker_exit)
+		return -1;
+	if (call->worker_running)
+		return 0;
+	if (pthread_create(&call->worker, NULL, call_worker_func, gp_state))
+		return -1;
+	call->worker_running = true;
+	return 0;
+}
+
+void side_rcu_call(struct side_rcu_gp_state *gp_state, void (*func)(void *ptr), void *ptr)
+{
+	struct side_rcu_call_state *call = &gp_state->call;
+	struct side_rcu_call_node *node;
+
+	node = (struct side_rcu_call_node *) calloc(1, sizeof(struct side_rcu_call_node));
+	if (!node)
+		goto sync;
+	node->func = func;
+	node->ptr = ptr;
+	pthread_mutex_lock(&call->lock);
+	if (call_worker_ensure_running(gp_state)) {
+		pthread_mutex_unlock(&call->lock);
+		free(node);
+		goto sync;
+	}
+	*call->tail = node;
+	call->tail = &node->next;
+	call->nr_enqueued++;
+	pthread_cond_signal(&call->worker_cond);
+	pthread_mutex_unlock(&call->lock);
+	return;
+
+sync:
+	/* Fallback to synchronous reclaim. */
+	side_rcu_wait_grace_period(gp_state);
+	func(ptr);
+}
+
+void side_rcu_barrier(struct side_rcu_gp_state *gp_state)
+{
+	struct side_rcu_call_state *call = &gp_state->call;
+	uint64_t target;
+
+	pthread_mutex_lock(&call->lock);
+	target = call->nr_enqueued;
+	/* An exiting worker invokes all queued callbacks before exiting. */
+	if (call->nr_completed != target && !call->worker_running &&
+	    call_worker_ensure_running(gp_state))
+		abort();
+	while (call->nr_completed < target)
+		pthread_cond_wait(&call->barrier_cond, &call->lock);
+	pthread_mutex_unlock(&call->lock);
+}
+
+/*
+ * Wait for the worker to complete its current batch, and prevent it
+ * from starting a new one until after fork.
+ */
+void side_rcu_before_fork(struct side_rcu_gp_state *gp_state)
+{
+	pthread_mutex_lock(&gp_state->call.worker_lock);
+	pthread_mutex_lock(&gp_state->call.lock);
+}
+
+void side_rcu_after_fork_parent(struct side_rcu_gp_state *gp_state)
+{
+	pthread_mutex_unlock(&gp_state->call.lock);
+	pthread_mutex_unlock(&gp_state->call.worker_lock);
+}
+
+/*
+ * The worker thread does not exist in the child process after a fork.
+ * Re-initialize the synchronization primitives. Callbacks still queued
+ * are handled by a worker created on demand.
+ */
+void side_rcu_after_fork_child(struct side_rcu_gp_state *gp_state)
+{
+	struct side_rcu_call_state *call = &gp_state->call;
+
+	pthread_mutex_init(&call->lock, NULL);
+	pthread_mutex_init(&call->worker_lock, NULL);
+	pthread_cond_init(&call->worker_cond, NULL);
+	pthread_cond_init(&call->barrier_cond, NULL);
+	call->worker_running = false;
+	if (call->head) {
+		pthread_mutex_lock(&call->lock);
+		if (call_worker_ensure_running(gp_state))
+			abort();
+		pthread_mutex_unlock(&call->lock);
+	}
+}
+
+/*
+ * Prefer allocation of the chunk pages on the given NUMA node. This is
+ * only a hint: pages are also placed on the node of the first CPU
+ * touching them, which belongs to this node. Returns -1 if the kernel
+ * does not apply the policy.
+ */
+static
+int percpu_chunk_bind_node(void *addr, size_t len, int node)
+{
+#ifdef __NR_mbind
+	unsigned long nodemask[SIDE_RCU_MAX_NUMA_NODES / SIDE_BITS_PER_LONG];
+
+	if (node >= SIDE_RCU_MAX_NUMA_NODES)
+		return -1;
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[node / SIDE_BITS_PER_LONG] = 1UL << (node % SIDE_BITS_PER_LONG);
+	/* The kernel reads maxnode - 1 bits of the mask. */
+	if (syscall(__NR_mbind, addr, len, MPOL_PREFERRED, nodemask,
+			(unsigned long) SIDE_RCU_MAX_NUMA_NODES + 1, 0))
+		return -1;
+	return 0;
+#else
+	(void) addr;
+	(void) len;
+	(void) node;
+	return -1;
+#endif
+}
+
+/*
+ * Allocate the per-cpu state in one chunk per NUMA node, so each CPU
+ * increments counters located on its local node. Entries are padded to
+ * twice the cache line size detected at runtime to prevent false
+ * sharing caused by adjacent cache line prefetch.
+ *
+ * When indexing by mm_cid, the index is not related to a CPU, so a
+ * single chunk is used.
+ */
+static
+void percpu_state_alloc(struct side_rcu_gp_state *rcu_gp)
+{
+	size_t stride, page_size = sysconf(_SC_PAGESIZE);
+	int i, node, nr_nodes = 1, line_size;
+	int *cpu_node, *node_nr_cpus;
+	bool bind_node;
+
+	line_size = get_cache_line_size();
+	if (line_size <= 0)
+		line_size = SIDE_CACHE_LINE_SIZE;
+	stride = 2 * line_size;
+	while (stride < sizeof(struct side_rcu_cpu_gp_state))
+		stride += 2 * line_size;
+
+	rcu_gp->percpu_state = (struct side_rcu_cpu_gp_state **)
+		calloc(rcu_gp->nr_cpus, sizeof(struct side_rcu_cpu_gp_state *));
+	cpu_node = (int *) calloc(rcu_gp->nr_cpus, sizeof(int));
+	if (!rcu_gp->percpu_state || !cpu_node)
+		abort();
+	if (!rcu_gp->index_mm_cid) {
+		for (i = 0; i < rcu_gp->nr_cpus; i++) {
+			node = get_cpu_numa_node(i);
+			if (node < 0)
+				node = 0;
+			cpu_node[i] = node;
+			if (node >= nr_nodes)
+				nr_nodes = node + 1;
+		}
+	}
+	node_nr_cpus = (int *) calloc(nr_nodes, sizeof(int));
+	rcu_gp->chunks = (struct side_rcu_percpu_chunk *)
+		calloc(nr_nodes, sizeof(struct side_rcu_percpu_chunk));
+	if (!node_nr_cpus || !rcu_gp->chunks)
+		abort();
+	for (i = 0; i < rcu_gp->nr_cpus; i++)
+		node_nr_cpus[cpu_node[i]]++;
+	rcu_gp->nr_chunks = nr_nodes;
+	bind_node = nr_nodes > 1;
+	for (node = 0; node < nr_nodes; node++) {
+		struct side_rcu_percpu_chunk *chunk = &rcu_gp->chunks[node];
+
+		if (!node_nr_cpus[node])
+			continue;
+		chunk->len = (node_nr_cpus[node] * stride + page_size - 1) & ~(page_size - 1);
+		/* Anonymous mappings are zero-filled. */
+		chunk->addr = mmap(NULL, chunk->len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (chunk->addr == MAP_FAILED)
+			abort();
+		/* Stop binding chunks if the kernel refuses the policy. */
+		if (bind_node && percpu_chunk_bind_node(chunk->addr, chunk->len, node))
+			bind_node = false;
+		/* Reuse the per-node count as allocation index. */
+		node_nr_cpus[node] = 0;
+	}
+	for (i = 0; i < rcu_gp->nr_cpus; i++) {
+		node = cpu_node[i];
+		rcu_gp->percpu_state[i] = (struct side_rcu_cpu_gp_state *)
+			((char *) rcu_gp->chunks[node].addr + node_nr_cpus[node]++ * stride);
+	}
+	free(node_nr_cpus);
+	free(cpu_node);
+}
+
+static
+void percpu_state_free(struct side_rcu_gp_state *rcu_gp)
+{
+	int i;
+
+	for (i = 0; i < rcu_gp->nr_chunks; i++) {
+		struct side_rcu_percpu_chunk *chunk = &rcu_gp->chunks[i];
+
+		if (chunk->len && munmap(chunk->addr, chunk->len))
+			perror("munmap");
+	}
+	free(rcu_gp->chunks);
+	free(rcu_gp->percpu_state);
 }
 
 void side_rcu_gp_init(struct side_rcu_gp_state *rcu_gp)
@@ -291,21 +700,62 @@ void side_rcu_gp_init(struct side_rcu_gp_state *rcu_gp)
 	if (!rcu_gp->nr_cpus)
 		abort();
 	pthread_mutex_init(&rcu_gp->gp_lock, NULL);
-	rcu_gp->percpu_state = (struct side_rcu_cpu_gp_state *)
-		calloc(rcu_gp->nr_cpus, sizeof(struct side_rcu_cpu_gp_state));
-	if (!rcu_gp->percpu_state)
-		abort();
+	pthread_mutex_init(&rcu_gp->call.lock, NULL);
+	pthread_mutex_init(&rcu_gp->call.worker_lock, NULL);
+	pthread_cond_init(&rcu_gp->call.worker_cond, NULL);
+	pthread_cond_init(&rcu_gp->call.barrier_cond, NULL);
+	rcu_gp->call.tail = &rcu_gp->call.head;
 	if (!membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0))
 		has_membarrier = true;
 	if (rseq_available(RSEQ_AVAILABLE_QUERY_LIBC))
 		has_rseq = true;
+	if (has_membarrier)
+		side_rcu_membarrier_available = 1;
 	if (has_membarrier && has_rseq)
 		side_rcu_rseq_membarrier_available = 1;
+	/*
+	 * Indexing by mm_cid keeps the used indexes compact for
+	 * processes restricted to a few CPUs of a large machine.
+	 */
+	if (side_rcu_rseq_membarrier_available && rseq_mm_cid_available()) {
+		const char *env = getenv("LIBSIDE_RCU_MM_CID");
+
+		if (env && atoi(env))
+			rcu_gp->index_mm_cid = true;
+	}
+	percpu_state_alloc(rcu_gp);
+	rcu_gp->cpu_used = (unsigned long *)
+		calloc(cpu_used_nr_words(rcu_gp), sizeof(unsigned long));
+	if (!rcu_gp->cpu_used)
+		abort();
 }
 
 void side_rcu_gp_exit(struct side_rcu_gp_state *rcu_gp)
 {
+	struct side_rcu_call_state *call = &rcu_gp->call;
+	bool join;
+
+	/* The worker exits after invoking all queued callbacks. */
+	pthread_mutex_lock(&call->lock);
+	call->worker_exit = true;
+	join = call->worker_running;
+	pthread_cond_signal(&call->worker_cond);
+	pthread_mutex_unlock(&call->lock);
+	if (join && pthread_join(call->worker, NULL))
+		abort();
+	/*
+	 * The worker invoked the callbacks queued before exiting, and
+	 * side_rcu_call() invokes the others synchronously.
+	 */
+	pthread_mutex_lock(&call->lock);
+	call->worker_running = false;
+	pthread_mutex_unlock(&call->lock);
+	pthread_cond_destroy(&call->barrier_cond);
+	pthread_cond_destroy(&call->worker_cond);
+	pthread_mutex_destroy(&call->worker_lock);
+	pthread_mutex_destroy(&call->lock);
 	rseq_prepare_unload();
 	pthread_mutex_destroy(&rcu_gp->gp_lock);
-	free(rcu_gp->percpu_state);
+	free(rcu_gp->cpu_used);
+	percpu_state_free(rcu_gp);
 }
@@ -17,7 +17,9 @@
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <side/macros.h>
+#include <side/endian.h>
 
+/* Cache line size used when it cannot be detected at runtime. */
 #define SIDE_CACHE_LINE_SIZE		256
 
 struct side_rcu_percpu_count {
@@ -27,16 +29,71 @@ struct side_rcu_percpu_count {
 	uintptr_t rseq_end;
 };
 
+/*
+ * Per-cpu state is allocated with a stride based on the cache line
+ * size detected at runtime, within per-NUMA-node chunks.
+ */
 struct side_rcu_cpu_gp_state {
 	struct side_rcu_percpu_count count[2];
-} __attribute__((__aligned__(SIDE_CACHE_LINE_SIZE)));
+};
+
+struct side_rcu_percpu_chunk {
+	void *addr;
+	size_t len;
+};
+
+struct side_rcu_call_node;
+
+/*
+ * Deferred reclamation queue. Callbacks queued with side_rcu_call()
+ * are invoked by a worker thread after a grace period. Many callbacks
+ * queued concurrently share a single grace period.
+ */
+struct side_rcu_call_state {
+	pthread_mutex_t lock;		/* Protects queue and worker state. */
+	pthread_mutex_t worker_lock;	/* Held by worker while processing a batch. */
+	pthread_cond_t worker_cond;
+	pthread_cond_t barrier_cond;
+	struct side_rcu_call_node *head, **tail;
+	uint64_t nr_enqueued;
+	uint64_t nr_completed;
+	pthread_t worker;
+	bool worker_running;
+	bool worker_exit;
+};
 
 struct side_rcu_gp_state {
-	struct side_rcu_cpu_gp_state *percpu_state;
+	struct side_rcu_cpu_gp_state **percpu_state;	/* Indexed by CPU or mm_cid. */
+	/*
+	 * Index per-cpu state with the rseq memory map concurrency ID
+	 * rather than the CPU number.
+	 */
+	bool index_mm_cid;
+	/*
+	 * Bitmap of CPUs which have ever been used by a reader. Bits are
+	 * set by readers and never cleared. Grace periods only scan the
+	 * per-cpu state of CPUs present in this bitmap.
+	 */
+	unsigned long *cpu_used;
 	int nr_cpus;
 	int32_t futex;
 	unsigned int period;
+	/*
+	 * Grace period sequence number, odd while a grace period is in
+	 * progress. Protected by gp_lock.
+	 */
+	unsigned long gp_seq;
 	pthread_mutex_t gp_lock;
+	/*
+	 * side_rcu_wait_grace_period() calls and time spent waiting, in
+	 * nanoseconds. Updated with relaxed atomics.
+	 */
+	uint64_t nr_waits;
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+	struct side_rcu_call_state call;
+	struct side_rcu_percpu_chunk *chunks;
+	int nr_chunks;
 };
 
 struct side_rcu_read_state {
@@ -45,6 +102,23 @@ struct side_rcu_read_state {
 };
 
 extern unsigned int side_rcu_rseq_membarrier_available __attribute__((visibility("hidden")));
+extern unsigned int side_rcu_membarrier_available __attribute__((visibility("hidden")));
+
+/*
+ * CPU number hint used by the read-side fallback. Any per-cpu state
+ * can be used with atomic increments, so the CPU number returned by
+ * sched_getcpu() is only refreshed every SIDE_RCU_CPU_HINT_REFRESH
+ * read-side critical sections to keep the state mostly CPU-local.
+ */
+#define SIDE_RCU_CPU_HINT_REFRESH	256
+
+struct side_rcu_cpu_hint {
+	int cpu;
+	unsigned int nr_uses;
+};
+
+extern __thread struct side_rcu_cpu_hint side_rcu_cpu_hint
+	__attribute__((visibility("hidden"), tls_model("initial-exec")));
 
 static inline
 int futex(int32_t *uaddr, int op, int32_t val,
@@ -67,6 +141,72 @@ void side_rcu_wake_up_gp(struct side_rcu_gp_state *gp_state)
 	}
 }
 
+/*
+ * Mark the CPU as used by readers before its counters are incremented.
+ * The SEQ_CST read-modify-write orders the bitmap update before the
+ * counter increment. This is a slow path only taken the first time a
+ * CPU is used.
+ */
+static inline
+void side_rcu_mark_cpu_used(struct side_rcu_gp_state *gp_state, int cpu)
+{
+	unsigned long *word = &gp_state->cpu_used[cpu / SIDE_BITS_PER_LONG];
+	unsigned long mask = 1UL << (cpu % SIDE_BITS_PER_LONG);
+
+	if (side_unlikely(!(__atomic_load_n(word, __ATOMIC_RELAXED) & mask)))
+		(void) __atomic_fetch_or(word, mask, __ATOMIC_SEQ_CST);
+}
+
+static inline
+int side_rcu_rseq_index(struct side_rcu_gp_state *gp_state)
+{
+	if (gp_state->index_mm_cid)
+		return rseq_current_mm_cid();
+	return rseq_cpu_start();
+}
+
+static inline
+int side_rcu_rseq_inc(struct side_rcu_gp_state *gp_state, uintptr_t *count, int cpu)
+{
+	if (gp_state->index_mm_cid)
+		return rseq_load_add_store__ptr(RSEQ_MO_RELAXED, RSEQ_PERCPU_MM_CID,
+				(intptr_t *) count, 1, cpu);
+	return rseq_load_add_store__ptr(RSEQ_MO_RELAXED, RSEQ_PERCPU_CPU_ID,
+			(intptr_t *) count, 1, cpu);
+}
+
+static inline
+int side_rcu_fallback_cpu(void)
+{
+	struct side_rcu_cpu_hint *hint = &side_rcu_cpu_hint;
+
+	if (side_unlikely(!(hint->nr_uses++ % SIDE_RCU_CPU_HINT_REFRESH))) {
+		int cpu = sched_getcpu();
+
+		hint->cpu = cpu < 0 ? 0 : cpu;
+	}
+	return hint->cpu;
+}
+
+/*
+ * Select the per-CPU state, among nr_cpus, of counters updated outside
+ * of rseq critical sections. Threads may share a CPU state when they
+ * migrate, so the counters must be updated with atomics.
+ */
+static inline
+int side_rcu_percpu_index(int nr_cpus)
+{
+	int cpu;
+
+	if (side_rcu_rseq_membarrier_available)
+		cpu = rseq_cpu_start();
+	else
+		cpu = side_rcu_fallback_cpu();
+	if (side_unlikely(cpu < 0 || cpu >= nr_cpus))
+		cpu = 0;
+	return cpu;
+}
+
 static inline
 void side_rcu_read_begin(struct side_rcu_gp_state *gp_state, struct side_rcu_read_state *read_state)
 {
@@ -75,14 +215,14 @@ void side_rcu_read_begin(struct side_rcu_gp_state *gp_state, struct side_rcu_rea
 	unsigned int period;
 	int cpu;
 
-	cpu = rseq_cpu_start();
+	cpu = side_rcu_rseq_index(gp_state);
+	side_rcu_mark_cpu_used(gp_state, cpu);
 	period = __atomic_load_n(&gp_state->period, __ATOMIC_RELAXED);
-	cpu_gp_state = &gp_state->percpu_state[cpu];
+	cpu_gp_state = gp_state->percpu_state[cpu];
 	read_state->percpu_count = begin_cpu_count = &cpu_gp_state->count[period];
 	read_state->cpu = cpu;
 	if (side_likely(side_rcu_rseq_membarrier_available &&
-			!rseq_load_add_store__ptr(RSEQ_MO_RELAXED, RSEQ_PERCPU_CPU_ID,
-				   (intptr_t *)&begin_cpu_count->rseq_begin, 1, cpu))) {
+			!side_rcu_rseq_inc(gp_state, &begin_cpu_count->rseq_begin, cpu))) {
 		/*
 		 * This compiler barrier (A) is paired with membarrier() at (C),
 		 * (D), (E). It effectively upgrades this compiler barrier to a
@@ -99,13 +239,24 @@ void side_rcu_read_begin(struct side_rcu_gp_state *gp_state, struct side_rcu_rea
 		rseq_barrier();
 		return;
 	}
-	/* Fallback to atomic increment and SEQ_CST. */
-	cpu = sched_getcpu();
-	if (side_unlikely(cpu < 0))
-		cpu = 0;
+	/* Fallback to atomic increment. */
+	cpu = side_rcu_fallback_cpu();
+	side_rcu_mark_cpu_used(gp_state, cpu);
 	read_state->cpu = cpu;
-	cpu_gp_state = &gp_state->percpu_state[cpu];
+	cpu_gp_state = gp_state->percpu_state[cpu];
 	read_state->percpu_count = begin_cpu_count = &cpu_gp_state->count[period];
+	if (side_likely(side_rcu_membarrier_available)) {
+		/*
+		 * Relaxed atomic increment followed by compiler barrier
+		 * (A), paired with membarrier() at (C), (D), (E). The
+		 * increment stays atomic because threads share the
+		 * per-cpu state, which keeps its lock prefix on x86.
+		 */
+		(void) __atomic_add_fetch(&begin_cpu_count->begin, 1, __ATOMIC_RELAXED);
+		rseq_barrier();
+		return;
+	}
+	/* Barrier (A) is implied by SEQ_CST. */
 	(void) __atomic_add_fetch(&begin_cpu_count->begin, 1, __ATOMIC_SEQ_CST);
 }
 
@@ -130,8 +281,7 @@ void side_rcu_read_end(struct side_rcu_gp_state *gp_state, struct side_rcu_read_
 	 */
 	rseq_barrier();
 	if (side_likely(side_rcu_rseq_membarrier_available &&
-			!rseq_load_add_store__ptr(RSEQ_MO_RELAXED, RSEQ_PERCPU_CPU_ID,
-				   (intptr_t *)&begin_cpu_count->rseq_end, 1, cpu))) {
+			!side_rcu_rseq_inc(gp_state, &begin_cpu_count->rseq_end, cpu))) {
 		/*
 		 * This barrier (F) is paired with membarrier()
 		 * at (G). It orders increment of the begin/end
@@ -140,6 +290,15 @@ void side_rcu_read_end(struct side_rcu_gp_state *gp_state, struct side_rcu_read_
 		rseq_barrier();
 		goto end;
 	}
+	if (side_likely(side_rcu_membarrier_available)) {
+		/*
+		 * Fallback to relaxed atomic increment. This compiler
+		 * barrier (F) is paired with membarrier() at (G).
+		 */
+		(void) __atomic_add_fetch(&begin_cpu_count->end, 1, __ATOMIC_RELAXED);
+		rseq_barrier();
+		goto end;
+	}
 	/*
 	 * Fallback to atomic increment and SEQ_CST.
 	 * This barrier (F) implied by SEQ_CST is paired with SEQ_CST
@@ -161,6 +320,21 @@ end:
 #define side_rcu_assign_pointer(p, v)	__atomic_store_n(&(p), v, __ATOMIC_RELEASE);
 
 void side_rcu_wait_grace_period(struct side_rcu_gp_state *gp_state) __attribute__((visibility("hidden")));
+/* Wait statistics of side_rcu_wait_grace_period(). */
+void side_rcu_gp_stats(struct side_rcu_gp_state *gp_state, uint64_t *nr_waits,
+		uint64_t *wait_ns, uint64_t *max_wait_ns)
+	__attribute__((visibility("hidden")));
+/*
+ * Invoke func(ptr) after a grace period, from a worker thread. Only
+ * waits for readers if the callback cannot be queued.
+ */
+void side_rcu_call(struct side_rcu_gp_state *gp_state, void (*func)(void *ptr), void *ptr)
+	__attribute__((visibility("hidden")));
+/* Wait for all callbacks previously queued with side_rcu_call(). */
+void side_rcu_barrier(struct side_rcu_gp_state *gp_state) __attribute__((visibility("hidden")));
+void side_rcu_before_fork(struct side_rcu_gp_state *gp_state) __attribute__((visibility("hidden")));
+void side_rcu_after_fork_parent(struct side_rcu_gp_state *gp_state) __attribute__((visibility("hidden")));
+void side_rcu_after_fork_child(struct side_rcu_gp_state *gp_state) __attribute__((visibility("hidden")));
 void side_rcu_gp_init(struct side_rcu_gp_state *rcu_gp) __attribute__((visibility("hidden")));
 void side_rcu_gp_exit(struct side_rcu_gp_state *rcu_gp) __attribute__((visibility("hidden")));
 
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_RING_BUFFER_CONTROL_H
+#define _SIDE_RING_BUFFER_CONTROL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ * Control region of the ring buffer tracer, a shared mapping of
+ * "<path>.ctl" through which a session daemon enables and disables
+ * events recorded in the ring buffer of a process, without running
+ * code in that process.
+ *
+ * The process publishes its registered events at their event ID, which
+ * is the record ID of their records in the ring buffer. The daemon sets
+ * the requested state of events, then increments request_seq and wakes
+ * it as a futex. The ring buffer tracer control thread, blocked on that
+ * futex, registers or unregisters the ring buffer callback of the
+ * events whose requested state differs from their enabled state, which
+ * updates the enabled state of the event description. It then stores
+ * the request_seq it observed before applying the requests into
+ * applied_seq, and wakes it as a futex.
+ *
+ * The layout is:
+ *
+ *   struct side_ring_buffer_control_header (at offset 0)
+ *   nr_events struct side_ring_buffer_control_event, indexed by
+ *   event ID, at event_offset, event_size bytes apart
+ *
+ * Events with an ID of nr_events or more cannot be controlled, and
+ * keep the initial state.
+ */
+
+#define SIDE_RING_BUFFER_CONTROL_MAGIC		"SIDECTRL"
+#define SIDE_RING_BUFFER_CONTROL_VERSION	1
+
+/* Names are truncated to fit, including the terminating NUL. */
+#define SIDE_RING_BUFFER_CONTROL_NAME_LEN	64
+
+struct side_ring_buffer_control_header {
+	char magic[8];			/* Written last. */
+	uint32_t version;
+	uint32_t pid;
+	uint32_t nr_events;
+	uint32_t event_size;
+	uint64_t event_offset;
+	/* Updated by the process. One past the largest event ID in use. */
+	uint32_t id_limit;
+	/* Futexes. */
+	uint32_t request_seq;		/* Incremented by the daemon. */
+	uint32_t applied_seq;		/* Updated by the process. */
+	uint32_t padding;
+};
+
+/*
+ * seq is odd while the process updates the event, and is incremented
+ * twice each time an event ID is published or unpublished. A request
+ * written while the event ID is republished may be overwritten with the
+ * initial state.
+ */
+struct side_ring_buffer_control_event {
+	uint32_t seq;
+	uint32_t registered;		/* Written by the process. */
+	uint32_t requested;		/* Written by the daemon, 0 or 1. */
+	uint32_t enabled;		/* Written by the process. */
+	uint32_t loglevel;		/* enum side_loglevel */
+	uint32_t flags;			/* Event description flags. */
+	char provider_name[SIDE_RING_BUFFER_CONTROL_NAME_LEN];
+	char event_name[SIDE_RING_BUFFER_CONTROL_NAME_LEN];
+};
+
+/* Daemon helpers, usable on a mapping of the control region. */
+
+static inline
+struct side_ring_buffer_control_event *side_ring_buffer_control_get_event(
+		const struct side_ring_buffer_control_header *header, uint32_t id)
+{
+	return (struct side_ring_buffer_control_event *) ((char *) header + header->event_offset +
+			(uint64_t) id * header->event_size);
+}
+
+/*
+ * Copy the event at id into *event. Returns false if the process was
+ * updating it.
+ */
+static inline
+bool side_ring_buffer_control_read_event(const struct side_ring_buffer_control_header *header,
+		uint32_t id, struct side_ring_buffer_control_event *event)
+{
+	const struct side_ring_buffer_control_event *src = side_ring_buffer_control_get_event(header, id);
+	uint32_t seq;
+
+	seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1)
+		return false;
+	memcpy(event, src, sizeof(*event));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&src->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/*
+ * Request the event at id to be enabled or disabled, and wake the
+ * process. Returns the sequence number to pass to
+ * side_ring_buffer_control_wait().
+ */
+static inline
+uint32_t side_ring_buffer_control_request(struct side_ring_buffer_control_header *header,
+		uint32_t id, bool enable)
+{
+	struct side_ring_buffer_control_event *event = side_ring_buffer_control_get_event(header, id);
+	uint32_t seq;
+
+	__atomic_store_n(&event->requested, enable ? 1 : 0, __ATOMIC_RELAXED);
+	seq = __atomic_add_fetch(&header->request_seq, 1, __ATOMIC_SEQ_CST);
+	(void) syscall(__NR_futex, &header->request_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+	return seq;
+}
+
+/*
+ * Wait for the process to apply the requests up to seq, waiting at
+ * most timeout (NULL to wait forever) for each update of applied_seq.
+ * Returns false on timeout.
+ */
+static inline
+bool side_ring_buffer_control_wait(struct side_ring_buffer_control_header *header,
+		uint32_t seq, const struct timespec *timeout)
+{
+	for (;;) {
+		uint32_t applied = __atomic_load_n(&header->applied_seq, __ATOMIC_ACQUIRE);
+
+		if ((int32_t) (applied - seq) >= 0)
+			return true;
+		if (syscall(__NR_futex, &header->applied_seq, FUTEX_WAIT, applied,
+				timeout, NULL, 0) && errno == ETIMEDOUT)
+			return false;
+	}
+}
+
+#endif /* _SIDE_RING_BUFFER_CONTROL_H */
@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Binary ring buffer tracer, enabled by setting LIBSIDE_RING_BUFFER to
+ * the path of the file backing the buffers.
+ *
+ * Each event record is a ring buffer record header, with the event ID
+ * as record ID, followed by a 64-bit timestamp (side_timestamp()) and
+ * the event payload. Event declarations are appended to "<path>.meta", and
+ * their CTF 2 metadata to "<path>.ctf2".
+ *
+ * The ring buffer tracer registers payload callbacks: payloads are
+ * serialized once per event occurrence by libside, and shared with
+ * the payload callbacks of other tracers (see payload.c for the
+ * encoding).
+ *
+ * A declaration is u32 size, u32 event ID, u64 timestamp, u32
+ * loglevel, u32 flags, provider and event names, then the encoding of
+ * the fields (see side_payload_encode_fields()). Events using gather
+ * arrays or gather variable-length arrays are not traced.
+ *
+ * When LIBSIDE_RING_BUFFER_CONTROL is set, the traced events are
+ * published in the "<path>.ctl" control region (see
+ * ring-buffer-control.h), and the ring buffer callback is only
+ * registered on the events enabled through it. Requests of the session
+ * daemon are applied by a control thread.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <side/trace.h>
+
+#include "ctf2-metadata.h"
+#include "event-registry.h"
+#include "payload.h"
+#include "rcu.h"
+#include "ring-buffer.h"
+#include "ring-buffer-control.h"
+
+#define RB_DEFAULT_SUBBUF_SIZE	(64 * 1024)
+#define RB_DEFAULT_NR_SUBBUFS	4
+
+/* Events with a larger encoding are dropped. */
+#define RB_MAX_RECORD_SIZE	4096
+
+/* Declarations with a larger encoding are not traced. */
+#define RB_MAX_DECLARATION_SIZE	65536
+
+static struct side_tracer_handle *rb_tracer_handle;
+static struct side_ring_buffer *rb;
+static uint64_t rb_tracer_key;
+static int rb_meta_fd = -1;
+static int rb_ctf2_fd = -1;
+
+#define RB_DEFAULT_CONTROL_NR_EVENTS	4096
+
+/* Control state of each event ID, protected by the event lock. */
+#define RB_CONTROL_PUBLISHED	(1U << 0)
+#define RB_CONTROL_ENABLED	(1U << 1)
+
+static struct side_ring_buffer_control_header *rb_control;
+static size_t rb_control_len;
+static uint8_t *rb_control_state;
+/* Initial state of the events, and state of the events not controlled. */
+static bool rb_control_default_enabled = true;
+static pthread_t rb_control_thread_id;
+static bool rb_control_thread_created;
+static bool rb_control_exit;
+
+/*
+ * Records are the event payload shared by the payload callbacks of the
+ * occurrence, preceded by the occurrence timestamp, also shared with
+ * the other tracers.
+ */
+static
+void rb_payload(const struct side_event_description *desc __attribute__((unused)),
+		const void *payload, size_t len,
+		void *priv, void *caller_addr __attribute__((unused)),
+		uint64_t timestamp)
+{
+	const struct side_event_registry_entry *entry = (const struct side_event_registry_entry *) priv;
+	struct side_ring_buffer_ctx rb_ctx;
+	size_t size = sizeof(struct side_ring_buffer_record_header) + sizeof(timestamp) + len;
+	char *p;
+
+	if (side_unlikely(!payload || size > RB_MAX_RECORD_SIZE)) {
+		side_ring_buffer_record_lost(rb);
+		return;
+	}
+	if (!side_ring_buffer_reserve(rb, &rb_ctx, size, entry->id))
+		return;
+	p = rb_ctx.data + sizeof(struct side_ring_buffer_record_header);
+	memcpy(p, &timestamp, sizeof(timestamp));
+	memcpy(p + sizeof(timestamp), payload, len);
+	side_ring_buffer_commit(rb, &rb_ctx);
+}
+
+/*
+ * Encode the declaration of an event, and append it to the metadata if
+ * append is true. Returns false if the event cannot be traced.
+ */
+static
+bool rb_declare_event(const struct side_event_description *desc, uint32_t id, bool append)
+{
+	struct side_payload_writer ctx;
+	uint32_t size;
+	char *buf;
+	bool ret = false;
+
+	buf = (char *) malloc(RB_MAX_DECLARATION_SIZE);
+	if (!buf)
+		return false;
+	ctx.p = buf;
+	ctx.end = buf + RB_MAX_DECLARATION_SIZE;
+	ctx.error = false;
+	side_payload_write_u32(&ctx, 0);
+	side_payload_write_u32(&ctx, id);
+	side_payload_write_u64(&ctx, side_timestamp());
+	side_payload_write_u32(&ctx, side_enum_get(desc->loglevel));
+	side_payload_write_u32(&ctx, (uint32_t) desc->flags);
+	side_payload_write_cstr(&ctx, side_ptr_get(desc->provider_name));
+	side_payload_write_cstr(&ctx, side_ptr_get(desc->event_name));
+	side_payload_encode_fields(&ctx, side_ptr_get(desc->fields.elements), desc->fields.length);
+	if (ctx.error)
+		goto end;
+	size = ctx.p - buf;
+	memcpy(buf, &size, sizeof(size));
+	if (append && rb_meta_fd >= 0 && write(rb_meta_fd, buf, size) != (ssize_t) size)
+		fprintf(stderr, "libside: cannot write ring buffer metadata\n");
+	ret = true;
+end:
+	free(buf);
+	return ret;
+}
+
+static
+void rb_write_ctf2(const char *metadata)
+{
+	size_t len;
+
+	if (!metadata || rb_ctf2_fd < 0)
+		return;
+	len = strlen(metadata);
+	if (write(rb_ctf2_fd, metadata, len) != (ssize_t) len)
+		fprintf(stderr, "libside: cannot write ring buffer CTF 2 metadata\n");
+}
+
+static
+void rb_callback_entry(struct side_tracer_callback_batch_entry *batch_entry,
+		struct side_event_registry_entry *entry)
+{
+	batch_entry->desc = entry->desc;
+	batch_entry->u.payload_timestamp = rb_payload;
+	batch_entry->flags = SIDE_TRACER_CALLBACK_FLAG_PAYLOAD |
+			SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP;
+	/* The registry entry outlives the callbacks of its event. */
+	batch_entry->priv = entry;
+	batch_entry->key = rb_tracer_key;
+}
+
+/*
+ * Update the control region event at id, which is unpublished if desc
+ * is NULL. Called with the event lock held.
+ */
+static
+void rb_control_publish(uint32_t id, const struct side_event_description *desc, bool enabled)
+{
+	struct side_ring_buffer_control_event *event = side_ring_buffer_control_get_event(rb_control, id);
+	uint32_t seq = event->seq;
+
+	__atomic_store_n(&event->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (desc) {
+		event->loglevel = side_enum_get(desc->loglevel);
+		event->flags = (uint32_t) desc->flags;
+		snprintf(event->provider_name, sizeof(event->provider_name), "%s",
+			side_ptr_get(desc->provider_name));
+		snprintf(event->event_name, sizeof(event->event_name), "%s",
+			side_ptr_get(desc->event_name));
+		__atomic_store_n(&event->requested, enabled ? 1 : 0, __ATOMIC_RELAXED);
+	} else {
+		memset(event->provider_name, 0, sizeof(event->provider_name));
+		memset(event->event_name, 0, sizeof(event->event_name));
+	}
+	__atomic_store_n(&event->enabled, enabled ? 1 : 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->registered, desc ? 1 : 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&event->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Publish an inserted event in the control region, or unpublish a
+ * removed event. Returns true if the ring buffer callback is to be
+ * registered on the inserted event, or was registered on the removed
+ * event. Called with the event lock held.
+ */
+static
+bool rb_control_event_notification(const struct side_event_description *desc, uint32_t id,
+		bool insert)
+{
+	bool enabled;
+
+	if (!rb_control)
+		return true;
+	if (id >= rb_control->nr_events)
+		return rb_control_default_enabled;
+	if (insert) {
+		enabled = rb_control_default_enabled;
+		rb_control_state[id] = RB_CONTROL_PUBLISHED | (enabled ? RB_CONTROL_ENABLED : 0);
+		rb_control_publish(id, desc, enabled);
+	} else {
+		enabled = rb_control_state[id] & RB_CONTROL_ENABLED;
+		rb_control_state[id] = 0;
+		rb_control_publish(id, NULL, false);
+	}
+	return enabled;
+}
+
+/*
+ * Register or unregister the ring buffer callback of the published
+ * events whose requested state differs from their enabled state, with
+ * a single grace period.
+ */
+static
+void rb_control_apply(void)
+{
+	struct side_tracer_callback_batch_entry *entries;
+	uint32_t i, id, limit, nr_enable = 0, nr_disable = 0;
+
+	side_event_registry_lock();
+	limit = side_event_registry_id_limit();
+	if (limit > rb_control->nr_events)
+		limit = rb_control->nr_events;
+	entries = (struct side_tracer_callback_batch_entry *)
+		calloc(limit ? limit : 1, sizeof(struct side_tracer_callback_batch_entry));
+	if (!entries)
+		abort();
+	/* Events to enable fill the array from the start, events to disable from the end. */
+	for (id = 0; id < limit; id++) {
+		struct side_event_registry_entry *entry;
+		bool requested;
+
+		if (!(rb_control_state[id] & RB_CONTROL_PUBLISHED))
+			continue;
+		entry = side_event_registry_lookup_id(id);
+		if (!entry)
+			continue;
+		requested = __atomic_load_n(&side_ring_buffer_control_get_event(rb_control, id)->requested,
+				__ATOMIC_RELAXED);
+		if (requested == !!(rb_control_state[id] & RB_CONTROL_ENABLED))
+			continue;
+		if (requested)
+			rb_callback_entry(&entries[nr_enable++], entry);
+		else
+			rb_callback_entry(&entries[limit - ++nr_disable], entry);
+	}
+	/* Fails only while libside is exiting. */
+	if (side_tracer_callback_register_batch(entries, nr_enable))
+		nr_enable = 0;
+	if (side_tracer_callback_unregister_batch(&entries[limit - nr_disable], nr_disable))
+		nr_disable = 0;
+	for (i = 0; i < limit; i++) {
+		const struct side_event_registry_entry *entry;
+		bool enabled;
+
+		if (i < nr_enable)
+			enabled = true;
+		else if (i >= limit - nr_disable)
+			enabled = false;
+		else
+			continue;
+		entry = (const struct side_event_registry_entry *) entries[i].priv;
+		if (enabled)
+			rb_control_state[entry->id] |= RB_CONTROL_ENABLED;
+		else
+			rb_control_state[entry->id] &= ~RB_CONTROL_ENABLED;
+		__atomic_store_n(&side_ring_buffer_control_get_event(rb_control, entry->id)->enabled,
+				enabled ? 1 : 0, __ATOMIC_RELAXED);
+	}
+	side_event_registry_unlock();
+	free(entries);
+}
+
+/*
+ * The control thread applies the requests, then sleeps on request_seq
+ * until the daemon, or rb_tracer_exit(), increments it.
+ */
+static
+void *rb_control_thread(void *arg __attribute__((unused)))
+{
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&rb_control->request_seq, __ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&rb_control_exit, __ATOMIC_RELAXED))
+			break;
+		rb_control_apply();
+		__atomic_store_n(&rb_control->applied_seq, seq, __ATOMIC_RELEASE);
+		(void) futex((int32_t *) &rb_control->applied_seq, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+		(void) futex((int32_t *) &rb_control->request_seq, FUTEX_WAIT, (int32_t) seq, NULL, NULL, 0);
+	}
+	return NULL;
+}
+
+static
+void rb_tracer_event_notification(enum side_tracer_notification notif,
+		struct side_event_description **events, uint32_t nr_events,
+		void *priv __attribute__((unused)))
+{
+	struct side_tracer_callback_batch_entry *entries;
+	uint32_t i, nr_entries = 0;
+	int ret;
+
+	entries = (struct side_tracer_callback_batch_entry *)
+		calloc(nr_events, sizeof(struct side_tracer_callback_batch_entry));
+	if (nr_events && !entries)
+		abort();
+	for (i = 0; i < nr_events; i++) {
+		struct side_event_description *event = events[i];
+		struct side_event_registry_entry *entry;
+
+		/* Skip NULL pointers */
+		if (!event)
+			continue;
+		if (event->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION)
+			continue;
+		/* Notifications are called with the event lock held. */
+		entry = side_event_registry_lookup_desc(event);
+		if (!entry)
+			continue;
+		if (!rb_declare_event(event, entry->id, notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS))
+			continue;
+		if (notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS) {
+			char *metadata = side_ctf2_event_metadata(event, entry->id);
+
+			rb_write_ctf2(metadata);
+			free(metadata);
+		}
+		if (!rb_control_event_notification(event, entry->id,
+				notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS))
+			continue;
+		rb_callback_entry(&entries[nr_entries++], entry);
+	}
+	if (rb_control) {
+		uint32_t limit = side_event_registry_id_limit();
+
+		if (limit > rb_control->nr_events)
+			limit = rb_control->nr_events;
+		__atomic_store_n(&rb_control->id_limit, limit, __ATOMIC_RELEASE);
+	}
+	if (notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS)
+		ret = side_tracer_callback_register_batch(entries, nr_entries);
+	else
+		ret = side_tracer_callback_unregister_batch(entries, nr_entries);
+	if (ret)
+		abort();
+	free(entries);
+}
+
+static
+uint64_t rb_getenv_u64(const char *name, uint64_t default_value)
+{
+	const char *env = getenv(name);
+
+	if (!env || !*env)
+		return default_value;
+	return strtoull(env, NULL, 0);
+}
+
+/*
+ * Map the control region at path, with room for nr_events event IDs.
+ * Returns false on error.
+ */
+static
+bool rb_control_create(const char *path, uint32_t nr_events)
+{
+	struct side_ring_buffer_control_header *header;
+	size_t event_offset, len;
+	void *addr;
+	int fd;
+
+	if (!nr_events)
+		return false;
+	event_offset = (sizeof(struct side_ring_buffer_control_header) + 63) & ~(size_t) 63;
+	len = event_offset + (size_t) nr_events * sizeof(struct side_ring_buffer_control_event);
+	rb_control_state = (uint8_t *) calloc(nr_events, sizeof(uint8_t));
+	if (!rb_control_state)
+		return false;
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto error;
+	if (ftruncate(fd, len)) {
+		(void) close(fd);
+		goto error;
+	}
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	(void) close(fd);
+	if (addr == MAP_FAILED)
+		goto error;
+	header = (struct side_ring_buffer_control_header *) addr;
+	header->version = SIDE_RING_BUFFER_CONTROL_VERSION;
+	header->pid = (uint32_t) getpid();
+	header->nr_events = nr_events;
+	header->event_size = sizeof(struct side_ring_buffer_control_event);
+	header->event_offset = event_offset;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(header->magic, SIDE_RING_BUFFER_CONTROL_MAGIC, sizeof(header->magic));
+	rb_control = header;
+	rb_control_len = len;
+	return true;
+
+error:
+	free(rb_control_state);
+	rb_control_state = NULL;
+	return false;
+}
+
+static
+void rb_control_destroy(void)
+{
+	if (!rb_control)
+		return;
+	(void) munmap(rb_control, rb_control_len);
+	rb_control = NULL;
+	free(rb_control_state);
+	rb_control_state = NULL;
+}
+
+static __attribute__((constructor))
+void rb_tracer_init(void);
+static
+void rb_tracer_init(void)
+{
+	struct side_ring_buffer_config config = {
+		.mode = SIDE_RING_BUFFER_MODE_DISCARD,
+	};
+	const char *path = getenv("LIBSIDE_RING_BUFFER"), *mode, *control;
+	char *meta_path, *metadata;
+
+	if (!path || !*path)
+		return;
+	mode = getenv("LIBSIDE_RING_BUFFER_MODE");
+	if (mode && !strcmp(mode, "overwrite"))
+		config.mode = SIDE_RING_BUFFER_MODE_OVERWRITE;
+	config.subbuf_size = rb_getenv_u64("LIBSIDE_RING_BUFFER_SUBBUF_SIZE", RB_DEFAULT_SUBBUF_SIZE);
+	config.nr_subbufs = rb_getenv_u64("LIBSIDE_RING_BUFFER_NR_SUBBUFS", RB_DEFAULT_NR_SUBBUFS);
+	config.path = path;
+	rb = side_ring_buffer_create(&config);
+	if (!rb) {
+		fprintf(stderr, "libside: cannot create ring buffer \"%s\"\n", path);
+		return;
+	}
+	if (asprintf(&meta_path, "%s.meta", path) < 0)
+		abort();
+	rb_meta_fd = open(meta_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if (rb_meta_fd < 0)
+		fprintf(stderr, "libside: cannot create ring buffer metadata \"%s\"\n", meta_path);
+	free(meta_path);
+	if (asprintf(&meta_path, "%s.ctf2", path) < 0)
+		abort();
+	rb_ctf2_fd = open(meta_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if (rb_ctf2_fd < 0)
+		fprintf(stderr, "libside: cannot create ring buffer CTF 2 metadata \"%s\"\n", meta_path);
+	free(meta_path);
+	metadata = side_ctf2_trace_metadata();
+	rb_write_ctf2(metadata);
+	free(metadata);
+	control = getenv("LIBSIDE_RING_BUFFER_CONTROL");
+	if (control && *control) {
+		rb_control_default_enabled = strcmp(control, "disabled") != 0;
+		if (asprintf(&meta_path, "%s.ctl", path) < 0)
+			abort();
+		if (!rb_control_create(meta_path, rb_getenv_u64("LIBSIDE_RING_BUFFER_CONTROL_EVENTS",
+				RB_DEFAULT_CONTROL_NR_EVENTS)))
+			fprintf(stderr, "libside: cannot create ring buffer control region \"%s\"\n", meta_path);
+		free(meta_path);
+	}
+	if (side_tracer_request_key(&rb_tracer_key))
+		abort();
+	rb_tracer_handle = side_tracer_event_notification_register(rb_tracer_event_notification, NULL);
+	if (!rb_tracer_handle)
+		abort();
+	if (rb_control) {
+		if (pthread_create(&rb_control_thread_id, NULL, rb_control_thread, NULL))
+			fprintf(stderr, "libside: cannot create ring buffer control thread\n");
+		else
+			rb_control_thread_created = true;
+	}
+}
+
+static __attribute__((destructor))
+void rb_tracer_exit(void);
+static
+void rb_tracer_exit(void)
+{
+	if (!rb)
+		return;
+	if (rb_control_thread_created) {
+		__atomic_store_n(&rb_control_exit, true, __ATOMIC_RELAXED);
+		(void) __atomic_add_fetch(&rb_control->request_seq, 1, __ATOMIC_SEQ_CST);
+		(void) futex((int32_t *) &rb_control->request_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+		if (pthread_join(rb_control_thread_id, NULL))
+			abort();
+		rb_control_thread_created = false;
+	}
+	side_tracer_event_notification_unregister(rb_tracer_handle);
+	side_ring_buffer_flush(rb);
+	side_ring_buffer_destroy(rb);
+	rb = NULL;
+	if (rb_meta_fd >= 0)
+		(void) close(rb_meta_fd);
+	rb_meta_fd = -1;
+	if (rb_ctf2_fd >= 0)
+		(void) close(rb_ctf2_fd);
+	rb_ctf2_fd = -1;
+	rb_control_destroy();
+}
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <rseq/rseq.h>
+#include <side/macros.h>
+
+#include "ring-buffer.h"
+#include "smp.h"
+
+#define SIDE_RING_BUFFER_PAGE_ALIGN	4096
+
+struct side_ring_buffer {
+	struct side_ring_buffer_header *header;
+	size_t len;			/* Mapping length. */
+	uint64_t subbuf_size;
+	uint64_t buf_size;		/* Per CPU. */
+	uint32_t nr_subbufs;
+	uint32_t nr_cpus;
+	enum side_ring_buffer_mode mode;
+	bool use_rseq;
+};
+
+static
+uint64_t side_ring_buffer_align(uint64_t v, uint64_t align)
+{
+	return (v + align - 1) & ~(align - 1);
+}
+
+static
+bool side_ring_buffer_is_power_of_2(uint64_t v)
+{
+	return v && !(v & (v - 1));
+}
+
+struct side_ring_buffer *side_ring_buffer_create(const struct side_ring_buffer_config *config)
+{
+	struct side_ring_buffer_header *header;
+	uint64_t data_offset, cpu_stride, cpu_offset;
+	struct side_ring_buffer *rb;
+	int nr_cpus, fd = -1;
+	size_t len;
+	void *addr;
+
+	if (!side_ring_buffer_is_power_of_2(config->nr_subbufs) ||
+	    !side_ring_buffer_is_power_of_2(config->subbuf_size) ||
+	    config->subbuf_size < SIDE_RING_BUFFER_PAGE_ALIGN ||
+	    config->subbuf_size > UINT32_MAX)
+		return NULL;
+	nr_cpus = get_possible_cpus_array_len();
+	if (nr_cpus <= 0)
+		return NULL;
+	rb = (struct side_ring_buffer *) calloc(1, sizeof(struct side_ring_buffer));
+	if (!rb)
+		return NULL;
+	data_offset = side_ring_buffer_align(sizeof(struct side_ring_buffer_cpu) +
+			2 * config->nr_subbufs * sizeof(uintptr_t), SIDE_RING_BUFFER_PAGE_ALIGN);
+	cpu_stride = data_offset + config->nr_subbufs * config->subbuf_size;
+	cpu_offset = side_ring_buffer_align(sizeof(struct side_ring_buffer_header), SIDE_RING_BUFFER_PAGE_ALIGN);
+	len = cpu_offset + (uint64_t) nr_cpus * cpu_stride;
+
+	if (config->path) {
+		fd = open(config->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd < 0)
+			goto error;
+		if (ftruncate(fd, len))
+			goto error;
+		addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	} else {
+		addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (addr == MAP_FAILED)
+		goto error;
+	if (fd >= 0)
+		(void) close(fd);
+
+	header = (struct side_ring_buffer_header *) addr;
+	header->version = SIDE_RING_BUFFER_VERSION;
+	header->mode = config->mode;
+	header->nr_cpus = nr_cpus;
+	header->nr_subbufs = config->nr_subbufs;
+	header->subbuf_size = config->subbuf_size;
+	header->cpu_offset = cpu_offset;
+	header->cpu_stride = cpu_stride;
+	header->data_offset = data_offset;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(header->magic, SIDE_RING_BUFFER_MAGIC, sizeof(header->magic));
+
+	rb->header = header;
+	rb->len = len;
+	rb->subbuf_size = config->subbuf_size;
+	rb->buf_size = config->subbuf_size * config->nr_subbufs;
+	rb->nr_subbufs = config->nr_subbufs;
+	rb->nr_cpus = nr_cpus;
+	rb->mode = config->mode;
+	/* The rseq area of threads is only updated once libc registers it. */
+	rb->use_rseq = rseq_available(RSEQ_AVAILABLE_QUERY_LIBC);
+	return rb;
+
+error:
+	if (fd >= 0)
+		(void) close(fd);
+	free(rb);
+	return NULL;
+}
+
+void side_ring_buffer_destroy(struct side_ring_buffer *rb)
+{
+	if (!rb)
+		return;
+	(void) munmap(rb->header, rb->len);
+	free(rb);
+}
+
+const struct side_ring_buffer_header *side_ring_buffer_get_header(const struct side_ring_buffer *rb)
+{
+	return rb->header;
+}
+
+static
+int side_ring_buffer_current_cpu(const struct side_ring_buffer *rb)
+{
+	int cpu;
+
+	if (rb->use_rseq)
+		cpu = rseq_cpu_start();
+	else
+		cpu = sched_getcpu();
+	if (side_unlikely(cpu < 0 || (uint32_t) cpu >= rb->nr_cpus))
+		cpu = 0;
+	return cpu;
+}
+
+/*
+ * A sub-buffer can be written to once the previous lap is fully
+ * committed and, in discard mode, once it has been released by the
+ * reader.
+ */
+static
+bool side_ring_buffer_subbuf_writable(const struct side_ring_buffer *rb,
+		const struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	uintptr_t lap = pos / rb->buf_size;
+
+	if (side_ring_buffer_commit_count(rb->header, cpu_buf, pos) != lap * rb->subbuf_size)
+		return false;
+	if (rb->mode == SIDE_RING_BUFFER_MODE_DISCARD &&
+	    pos - __atomic_load_n(&cpu_buf->read_pos, __ATOMIC_ACQUIRE) >= rb->buf_size)
+		return false;
+	return true;
+}
+
+static
+void side_ring_buffer_add_commit(struct side_ring_buffer *rb, struct side_ring_buffer_cpu *cpu_buf,
+		int cpu, uintptr_t pos, uint32_t len)
+{
+	uint32_t index = side_ring_buffer_subbuf_index(rb->header, pos);
+
+	/* Order the record contents before the commit count update. */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (side_likely(rb->use_rseq &&
+			!rseq_load_add_store__ptr(RSEQ_MO_RELAXED, RSEQ_PERCPU_CPU_ID,
+				(intptr_t *) &cpu_buf->commit_count[rb->nr_subbufs + index], len, cpu)))
+		return;
+	/* Migrated since the reservation, or no rseq. */
+	(void) __atomic_add_fetch(&cpu_buf->commit_count[index], len, __ATOMIC_RELAXED);
+}
+
+static
+void side_ring_buffer_write_padding(struct side_ring_buffer *rb, struct side_ring_buffer_cpu *cpu_buf,
+		int cpu, uintptr_t pos, uint32_t len)
+{
+	struct side_ring_buffer_record_header padding = {
+		.size = len,
+		.id = SIDE_RING_BUFFER_ID_PADDING,
+	};
+
+	memcpy((char *) side_ring_buffer_subbuf_data(rb->header, cpu_buf, pos) + (pos & (rb->subbuf_size - 1)),
+		&padding, sizeof(padding));
+	side_ring_buffer_add_commit(rb, cpu_buf, cpu, pos, len);
+}
+
+bool side_ring_buffer_reserve(struct side_ring_buffer *rb, struct side_ring_buffer_ctx *ctx,
+		uint32_t len, uint32_t id)
+{
+	struct side_ring_buffer_record_header record_header;
+	struct side_ring_buffer_cpu *cpu_buf;
+	uintptr_t old_pos, begin, pad;
+	int cpu;
+
+	len = side_ring_buffer_align(len, SIDE_RING_BUFFER_ALIGN);
+	cpu = side_ring_buffer_current_cpu(rb);
+	cpu_buf = side_ring_buffer_get_cpu(rb->header, cpu);
+	if (side_unlikely(len > rb->subbuf_size))
+		goto lost;
+	old_pos = __atomic_load_n(&cpu_buf->write_pos, __ATOMIC_RELAXED);
+	do {
+		uintptr_t offset = old_pos & (rb->subbuf_size - 1);
+
+		pad = offset + len > rb->subbuf_size ? rb->subbuf_size - offset : 0;
+		begin = old_pos + pad;
+		/* Entering a sub-buffer. */
+		if (!(begin & (rb->subbuf_size - 1)) &&
+		    side_unlikely(!side_ring_buffer_subbuf_writable(rb, cpu_buf, begin)))
+			goto lost;
+	} while (!__atomic_compare_exchange_n(&cpu_buf->write_pos, &old_pos, begin + len,
+			false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	if (pad)
+		side_ring_buffer_write_padding(rb, cpu_buf, cpu, old_pos, pad);
+	ctx->cpu_buf = cpu_buf;
+	ctx->pos = begin;
+	ctx->len = len;
+	ctx->cpu = cpu;
+	ctx->data = (char *) side_ring_buffer_subbuf_data(rb->header, cpu_buf, begin) +
+			(begin & (rb->subbuf_size - 1));
+	record_header.size = len;
+	record_header.id = id;
+	memcpy(ctx->data, &record_header, sizeof(record_header));
+	return true;
+
+lost:
+	(void) __atomic_add_fetch(&cpu_buf->lost, 1, __ATOMIC_RELAXED);
+	return false;
+}
+
+void side_ring_buffer_commit(struct side_ring_buffer *rb, const struct side_ring_buffer_ctx *ctx)
+{
+	side_ring_buffer_add_commit(rb, ctx->cpu_buf, ctx->cpu, ctx->pos, ctx->len);
+}
+
+void side_ring_buffer_discard(struct side_ring_buffer *rb, const struct side_ring_buffer_ctx *ctx)
+{
+	uint32_t id = SIDE_RING_BUFFER_ID_PADDING;
+
+	memcpy(ctx->data + offsetof(struct side_ring_buffer_record_header, id), &id, sizeof(id));
+	side_ring_buffer_add_commit(rb, ctx->cpu_buf, ctx->cpu, ctx->pos, ctx->len);
+	(void) __atomic_add_fetch(&ctx->cpu_buf->lost, 1, __ATOMIC_RELAXED);
+}
+
+void side_ring_buffer_record_lost(struct side_ring_buffer *rb)
+{
+	struct side_ring_buffer_cpu *cpu_buf = side_ring_buffer_get_cpu(rb->header,
+			side_ring_buffer_current_cpu(rb));
+
+	(void) __atomic_add_fetch(&cpu_buf->lost, 1, __ATOMIC_RELAXED);
+}
+
+void side_ring_buffer_flush(struct side_ring_buffer *rb)
+{
+	uint32_t cpu;
+
+	for (cpu = 0; cpu < rb->nr_cpus; cpu++) {
+		struct side_ring_buffer_cpu *cpu_buf = side_ring_buffer_get_cpu(rb->header, cpu);
+		uintptr_t pos = __atomic_load_n(&cpu_buf->write_pos, __ATOMIC_RELAXED);
+		uintptr_t offset = pos & (rb->subbuf_size - 1);
+
+		if (!offset)
+			continue;
+		__atomic_store_n(&cpu_buf->write_pos, pos + rb->subbuf_size - offset, __ATOMIC_RELAXED);
+		side_ring_buffer_write_padding(rb, cpu_buf, cpu, pos, rb->subbuf_size - offset);
+	}
+}
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_RING_BUFFER_H
+#define _SIDE_RING_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-CPU ring buffers written without locks.
+ *
+ * Writers reserve space in the buffer of their current CPU by moving
+ * its write position with a compare-and-swap, and commit by adding the
+ * record size to the commit count of its sub-buffer. Commit counts are
+ * updated with rseq when available and with atomic increments
+ * otherwise, in separate counters, so a writer preempted and migrated
+ * between reserve and commit stays correct. The write position is only
+ * contended by writers migrated away from the CPU during a reservation.
+ *
+ * Records never cross a sub-buffer boundary: the unused end of a
+ * sub-buffer is filled with a padding record. A sub-buffer is complete
+ * once the sum of its commit counts reaches the sub-buffer size times
+ * its lap number plus one.
+ *
+ * The buffers live in a single mapping which can be backed by a file,
+ * so an external reader can map it. The layout is:
+ *
+ *   struct side_ring_buffer_header (at offset 0)
+ *   For each CPU, at cpu_offset + cpu * cpu_stride:
+ *     struct side_ring_buffer_cpu, including both commit count arrays
+ *     nr_subbufs * subbuf_size bytes of data, at data_offset
+ *
+ * Positions and counts are free-running native words.
+ */
+
+#define SIDE_RING_BUFFER_MAGIC		"SIDERING"
+#define SIDE_RING_BUFFER_VERSION	1
+
+/* Record sizes and offsets are multiples of this alignment. */
+#define SIDE_RING_BUFFER_ALIGN		8
+
+#define SIDE_RING_BUFFER_ID_PADDING	UINT32_MAX
+
+enum side_ring_buffer_mode {
+	/* Drop new records while the buffer is full. */
+	SIDE_RING_BUFFER_MODE_DISCARD = 0,
+	/* Overwrite the oldest sub-buffer (flight recorder). */
+	SIDE_RING_BUFFER_MODE_OVERWRITE = 1,
+};
+
+struct side_ring_buffer_header {
+	char magic[8];			/* Written last. */
+	uint32_t version;
+	uint32_t mode;			/* enum side_ring_buffer_mode */
+	uint32_t nr_cpus;
+	uint32_t nr_subbufs;		/* Per CPU, power of two. */
+	uint64_t subbuf_size;		/* Bytes, power of two. */
+	uint64_t cpu_offset;
+	uint64_t cpu_stride;
+	uint64_t data_offset;		/* Relative to each per-CPU buffer. */
+};
+
+struct side_ring_buffer_cpu {
+	/* Updated by writers. */
+	uintptr_t write_pos;
+	uintptr_t lost;			/* Records dropped. */
+	/* Updated by the reader releasing sub-buffers, in discard mode. */
+	uintptr_t read_pos __attribute__((aligned(64)));
+	/*
+	 * Followed, on their own cache line, by nr_subbufs atomic commit
+	 * counts, then by nr_subbufs rseq commit counts.
+	 */
+	uintptr_t commit_count[] __attribute__((aligned(64)));
+};
+
+struct side_ring_buffer_record_header {
+	uint32_t size;			/* Including the header, bytes. */
+	uint32_t id;
+};
+
+struct side_ring_buffer_config {
+	enum side_ring_buffer_mode mode;
+	uint32_t nr_subbufs;		/* Power of two. */
+	uint64_t subbuf_size;		/* Power of two, at least one page. */
+	const char *path;		/* Backing file, or NULL for anonymous memory. */
+};
+
+struct side_ring_buffer;
+
+struct side_ring_buffer_ctx {
+	struct side_ring_buffer_cpu *cpu_buf;
+	uintptr_t pos;
+	uint32_t len;
+	int cpu;
+	char *data;			/* Record header followed by len - 8 bytes. */
+};
+
+struct side_ring_buffer *side_ring_buffer_create(const struct side_ring_buffer_config *config)
+	__attribute__((visibility("hidden")));
+void side_ring_buffer_destroy(struct side_ring_buffer *rb) __attribute__((visibility("hidden")));
+const struct side_ring_buffer_header *side_ring_buffer_get_header(const struct side_ring_buffer *rb)
+	__attribute__((visibility("hidden")));
+/*
+ * Reserve a record of len bytes, including its header, in the buffer of
+ * the current CPU. Returns false if the record is dropped.
+ */
+bool side_ring_buffer_reserve(struct side_ring_buffer *rb, struct side_ring_buffer_ctx *ctx,
+		uint32_t len, uint32_t id) __attribute__((visibility("hidden")));
+void side_ring_buffer_commit(struct side_ring_buffer *rb, const struct side_ring_buffer_ctx *ctx)
+	__attribute__((visibility("hidden")));
+/*
+ * Commit a reserved record as padding, and account for it as dropped.
+ */
+void side_ring_buffer_discard(struct side_ring_buffer *rb, const struct side_ring_buffer_ctx *ctx)
+	__attribute__((visibility("hidden")));
+/* Account for a record dropped by the writer itself. */
+void side_ring_buffer_record_lost(struct side_ring_buffer *rb) __attribute__((visibility("hidden")));
+/*
+ * Fill the current sub-buffer of each CPU with padding, so all
+ * committed records are part of complete sub-buffers. Writers must be
+ * quiescent.
+ */
+void side_ring_buffer_flush(struct side_ring_buffer *rb) __attribute__((visibility("hidden")));
+
+/* Reader helpers, usable on a mapping of the buffers. */
+
+static inline
+struct side_ring_buffer_cpu *side_ring_buffer_get_cpu(const struct side_ring_buffer_header *header,
+		uint32_t cpu)
+{
+	return (struct side_ring_buffer_cpu *) ((char *) header + header->cpu_offset +
+			(uint64_t) cpu * header->cpu_stride);
+}
+
+static inline
+uint32_t side_ring_buffer_subbuf_index(const struct side_ring_buffer_header *header, uintptr_t pos)
+{
+	return (pos / header->subbuf_size) & (header->nr_subbufs - 1);
+}
+
+static inline
+const char *side_ring_buffer_subbuf_data(const struct side_ring_buffer_header *header,
+		const struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	return (const char *) cpu_buf + header->data_offset +
+		(uint64_t) side_ring_buffer_subbuf_index(header, pos) * header->subbuf_size;
+}
+
+/* Sum of the commit counts of the sub-buffer containing pos. */
+static inline
+uintptr_t side_ring_buffer_commit_count(const struct side_ring_buffer_header *header,
+		const struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	uint32_t index = side_ring_buffer_subbuf_index(header, pos);
+
+	return __atomic_load_n(&cpu_buf->commit_count[index], __ATOMIC_ACQUIRE) +
+		__atomic_load_n(&cpu_buf->commit_count[header->nr_subbufs + index], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns true if the sub-buffer starting at pos is complete. In
+ * overwrite mode, readers copying a sub-buffer must check with
+ * side_ring_buffer_subbuf_overwritten() afterwards that writers did not
+ * start overwriting it.
+ */
+static inline
+bool side_ring_buffer_subbuf_complete(const struct side_ring_buffer_header *header,
+		const struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	uintptr_t lap = pos / (header->subbuf_size * header->nr_subbufs);
+
+	return side_ring_buffer_commit_count(header, cpu_buf, pos) ==
+		(lap + 1) * header->subbuf_size;
+}
+
+static inline
+bool side_ring_buffer_subbuf_overwritten(const struct side_ring_buffer_header *header,
+		const struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&cpu_buf->write_pos, __ATOMIC_RELAXED) - pos >
+		header->subbuf_size * header->nr_subbufs;
+}
+
+/* Give the sub-buffer starting at pos back to writers, in discard mode. */
+static inline
+void side_ring_buffer_subbuf_release(const struct side_ring_buffer_header *header,
+		struct side_ring_buffer_cpu *cpu_buf, uintptr_t pos)
+{
+	__atomic_store_n(&cpu_buf->read_pos, pos + header->subbuf_size, __ATOMIC_RELEASE);
+}
+
+#endif /* _SIDE_RING_BUFFER_H */
@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serialize-plan.h"
+#include "visit-description.h"
+
+struct plan_compile_ctx {
+	struct side_serialize_plan *plan;
+	uint32_t max_ops;
+	uint32_t arg_index;		/* Field being planned. */
+	uint32_t record_depth;		/* Gather structure nesting. */
+	uint64_t record_offset;		/* Of the innermost gather structure. */
+	bool unsupported;
+};
+
+static
+void plan_append(struct plan_compile_ctx *ctx, uint16_t label, enum side_serialize_plan_access access,
+		uint64_t offset, uint32_t size)
+{
+	struct side_serialize_plan *plan = ctx->plan;
+	struct side_serialize_plan_op *op;
+
+	if (ctx->unsupported)
+		return;
+	if ((uint64_t) plan->size + size > UINT32_MAX) {
+		ctx->unsupported = true;
+		return;
+	}
+	if (ctx->record_depth) {
+		/* Record fields are read through the record argument. */
+		label = SIDE_TYPE_GATHER_STRUCT;
+		offset += ctx->record_offset;
+		op = plan->nr_ops ? &plan->ops[plan->nr_ops - 1] : NULL;
+		if (op && op->arg_index == ctx->arg_index && access == SIDE_SERIALIZE_PLAN_ACCESS_GATHER
+				&& op->access == SIDE_SERIALIZE_PLAN_ACCESS_GATHER
+				&& op->offset + op->size == offset) {
+			op->size += size;
+			plan->size += size;
+			return;
+		}
+	}
+	if (plan->nr_ops == ctx->max_ops) {
+		struct side_serialize_plan *new_plan;
+
+		new_plan = (struct side_serialize_plan *) realloc(plan, sizeof(struct side_serialize_plan) +
+				2 * ctx->max_ops * sizeof(struct side_serialize_plan_op));
+		if (!new_plan) {
+			ctx->unsupported = true;
+			return;
+		}
+		ctx->plan = plan = new_plan;
+		ctx->max_ops *= 2;
+	}
+	op = &plan->ops[plan->nr_ops++];
+	op->offset = offset;
+	op->output_offset = plan->size;
+	op->size = size;
+	op->arg_index = ctx->arg_index;
+	op->label = label;
+	op->access = access;
+	plan->size += size;
+}
+
+static
+enum side_serialize_plan_access plan_gather_access(enum side_type_gather_access_mode access_mode)
+{
+	if (access_mode == SIDE_TYPE_GATHER_ACCESS_POINTER)
+		return SIDE_SERIALIZE_PLAN_ACCESS_GATHER_POINTER;
+	return SIDE_SERIALIZE_PLAN_ACCESS_GATHER;
+}
+
+static
+void plan_null_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_NULL, SIDE_SERIALIZE_PLAN_ACCESS_STACK,
+		0, 0);
+}
+
+static
+void plan_bool_type(const struct side_type *type_desc, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_BOOL, SIDE_SERIALIZE_PLAN_ACCESS_STACK,
+		0, type_desc->u.side_bool.bool_size);
+}
+
+static
+void plan_integer_type(const struct side_type *type_desc, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, side_enum_get(type_desc->type), SIDE_SERIALIZE_PLAN_ACCESS_STACK,
+		0, type_desc->u.side_integer.integer_size);
+}
+
+static
+void plan_byte_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_BYTE, SIDE_SERIALIZE_PLAN_ACCESS_STACK,
+		0, 1);
+}
+
+static
+void plan_float_type(const struct side_type *type_desc, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, side_enum_get(type_desc->type), SIDE_SERIALIZE_PLAN_ACCESS_STACK,
+		0, type_desc->u.side_float.float_size);
+}
+
+static
+void plan_gather_bool_type(const struct side_type_gather_bool *type, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_GATHER_BOOL,
+		plan_gather_access(side_enum_get(type->access_mode)),
+		type->offset, type->type.bool_size);
+}
+
+static
+void plan_gather_byte_type(const struct side_type_gather_byte *type, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_GATHER_BYTE,
+		plan_gather_access(side_enum_get(type->access_mode)),
+		type->offset, 1);
+}
+
+static
+void plan_gather_integer_type(const struct side_type_gather_integer *type, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_GATHER_INTEGER,
+		plan_gather_access(side_enum_get(type->access_mode)),
+		type->offset, type->type.integer_size);
+}
+
+static
+void plan_gather_pointer_type(const struct side_type_gather_integer *type, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_GATHER_POINTER,
+		plan_gather_access(side_enum_get(type->access_mode)),
+		type->offset, type->type.integer_size);
+}
+
+static
+void plan_gather_float_type(const struct side_type_gather_float *type, void *priv)
+{
+	plan_append((struct plan_compile_ctx *) priv, SIDE_TYPE_GATHER_FLOAT,
+		plan_gather_access(side_enum_get(type->access_mode)),
+		type->offset, type->type.float_size);
+}
+
+/* Fields of a record are read at their offset within the structure. */
+static
+void plan_before_gather_struct(const struct side_type_gather_struct *type, void *priv)
+{
+	struct plan_compile_ctx *ctx = (struct plan_compile_ctx *) priv;
+
+	if (side_enum_get(type->access_mode) != SIDE_TYPE_GATHER_ACCESS_DIRECT) {
+		ctx->unsupported = true;
+		return;
+	}
+	ctx->record_depth++;
+	ctx->record_offset += type->offset;
+}
+
+static
+void plan_after_gather_struct(const struct side_type_gather_struct *type, void *priv)
+{
+	struct plan_compile_ctx *ctx = (struct plan_compile_ctx *) priv;
+
+	if (side_enum_get(type->access_mode) != SIDE_TYPE_GATHER_ACCESS_DIRECT)
+		return;
+	ctx->record_depth--;
+	ctx->record_offset -= type->offset;
+}
+
+static
+void plan_after_field(const struct side_event_field *field __attribute__((unused)), void *priv)
+{
+	struct plan_compile_ctx *ctx = (struct plan_compile_ctx *) priv;
+	struct side_serialize_plan *plan = ctx->plan;
+
+	if (ctx->record_depth)
+		return;
+	/* Each argument is checked by at least one operation. */
+	if (!plan->nr_ops || plan->ops[plan->nr_ops - 1].arg_index != ctx->arg_index)
+		ctx->unsupported = true;
+	ctx->arg_index++;
+}
+
+/* Types without a fixed size, or without a single argument per field. */
+
+static
+void plan_unsupported_type(const struct side_type *type_desc __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_struct(const struct side_type_struct *side_struct __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_variant(const struct side_type_variant *side_variant __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_array(const struct side_type_array *side_array __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_vla(const struct side_type_vla *side_vla __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_vla_visitor(const struct side_type_vla_visitor *side_vla_visitor __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_gather_string(const struct side_type_gather_string *type __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_gather_array(const struct side_type_gather_array *type __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_gather_vla(const struct side_type_gather_vla *type __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+static
+void plan_unsupported_lazy(const struct side_type_lazy *type __attribute__((unused)), void *priv)
+{
+	((struct plan_compile_ctx *) priv)->unsupported = true;
+}
+
+/* Enumerations are planned as their underlying type. */
+static const struct side_description_visitor plan_compile_visitor = {
+	.after_field_func = plan_after_field,
+	.null_type_func = plan_null_type,
+	.bool_type_func = plan_bool_type,
+	.integer_type_func = plan_integer_type,
+	.byte_type_func = plan_byte_type,
+	.pointer_type_func = plan_integer_type,
+	.float_type_func = plan_float_type,
+	.string_type_func = plan_unsupported_type,
+	.before_struct_type_func = plan_unsupported_struct,
+	.before_variant_type_func = plan_unsupported_variant,
+	.before_array_type_func = plan_unsupported_array,
+	.before_vla_type_func = plan_unsupported_vla,
+	.before_vla_visitor_type_func = plan_unsupported_vla_visitor,
+	.before_optional_type_func = plan_unsupported_type,
+	.before_lazy_type_func = plan_unsupported_lazy,
+	.gather_bool_type_func = plan_gather_bool_type,
+	.gather_byte_type_func = plan_gather_byte_type,
+	.gather_integer_type_func = plan_gather_integer_type,
+	.gather_pointer_type_func = plan_gather_pointer_type,
+	.gather_float_type_func = plan_gather_float_type,
+	.gather_string_type_func = plan_unsupported_gather_string,
+	.before_gather_struct_type_func = plan_before_gather_struct,
+	.after_gather_struct_type_func = plan_after_gather_struct,
+	.before_gather_array_type_func = plan_unsupported_gather_array,
+	.before_gather_vla_type_func = plan_unsupported_gather_vla,
+	.dynamic_type_func = plan_unsupported_type,
+};
+
+struct side_serialize_plan *side_serialize_plan_compile(const struct side_event_description *desc)
+{
+	uint32_t nr_fields = side_array_length(&desc->fields);
+	struct plan_compile_ctx ctx = {
+		.max_ops = nr_fields,
+		.arg_index = 0,
+		.record_depth = 0,
+		.record_offset = 0,
+		.unsupported = false,
+	};
+
+	if (!nr_fields)
+		return NULL;
+	ctx.plan = (struct side_serialize_plan *) calloc(1, sizeof(struct side_serialize_plan) +
+			nr_fields * sizeof(struct side_serialize_plan_op));
+	if (!ctx.plan)
+		return NULL;
+	description_visitor_event(&plan_compile_visitor, desc, &ctx);
+	if (ctx.unsupported || ctx.arg_index != nr_fields) {
+		free(ctx.plan);
+		return NULL;
+	}
+	ctx.plan->nr_args = nr_fields;
+	return ctx.plan;
+}
+
+void side_serialize_plan_destroy(struct side_serialize_plan *plan)
+{
+	free(plan);
+}
+
+bool side_serialize_plan_run(const struct side_serialize_plan *plan,
+		const struct side_arg_vec *side_arg_vec, void *buf)
+{
+	const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
+	char *out = (char *) buf;
+	uint32_t i;
+
+	if (side_unlikely(side_arg_vec->len != plan->nr_args))
+		return false;
+	for (i = 0; i < plan->nr_ops; i++) {
+		const struct side_serialize_plan_op *op = &plan->ops[i];
+		const struct side_arg *arg = &sav[op->arg_index];
+		const char *src;
+
+		if (side_unlikely(side_enum_get(arg->type) != op->label))
+			return false;
+		switch (op->access) {
+		case SIDE_SERIALIZE_PLAN_ACCESS_STACK:
+			src = (const char *) &arg->u.side_static;
+			break;
+		case SIDE_SERIALIZE_PLAN_ACCESS_GATHER:
+			src = (const char *) side_ptr_get(arg->u.side_static.side_integer_gather_ptr) + op->offset;
+			break;
+		case SIDE_SERIALIZE_PLAN_ACCESS_GATHER_POINTER:
+			memcpy(&src, (const char *) side_ptr_get(arg->u.side_static.side_integer_gather_ptr) + op->offset,
+				sizeof(src));
+			break;
+		default:
+			return false;
+		}
+		memcpy(out + op->output_offset, src, op->size);
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_SERIALIZE_PLAN_H
+#define _SIDE_SERIALIZE_PLAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * Serialization plan of an event with a fixed layout: every field is a
+ * basic type, an enumeration of a basic type, a gather basic type
+ * other than a string, or a gather structure of such gather fields
+ * (a packed record: the argument points to a native C structure).
+ * Running the plan copies each field value in its declared byte order,
+ * back to back, without interpreting the type description. The fields
+ * of a record which are contiguous in memory are copied at once.
+ */
+
+enum side_serialize_plan_access {
+	SIDE_SERIALIZE_PLAN_ACCESS_STACK,	/* Argument value storage. */
+	SIDE_SERIALIZE_PLAN_ACCESS_GATHER,	/* Gather pointer + offset. */
+	SIDE_SERIALIZE_PLAN_ACCESS_GATHER_POINTER,	/* Dereference gather pointer + offset. */
+};
+
+struct side_serialize_plan_op {
+	uint64_t offset;		/* Gather offset, bytes. */
+	uint32_t output_offset;		/* Offset within the serialized payload. */
+	uint32_t size;			/* Bytes. */
+	uint32_t arg_index;		/* Argument read. */
+	uint16_t label;			/* Expected argument type label. */
+	uint8_t access;			/* enum side_serialize_plan_access */
+};
+
+struct side_serialize_plan {
+	uint32_t size;			/* Serialized payload size, bytes. */
+	uint32_t nr_args;		/* One per field. */
+	uint32_t nr_ops;		/* In argument order. */
+	struct side_serialize_plan_op ops[];
+};
+
+/*
+ * Returns NULL if the event layout is not fixed, if the event has no
+ * field, or on allocation failure.
+ */
+struct side_serialize_plan *side_serialize_plan_compile(const struct side_event_description *desc)
+	__attribute__((visibility("hidden")));
+void side_serialize_plan_destroy(struct side_serialize_plan *plan)
+	__attribute__((visibility("hidden")));
+/*
+ * Write plan->size bytes to buf. Returns false if the arguments do not
+ * match the event description, in which case the content of buf is
+ * undefined.
+ */
+bool side_serialize_plan_run(const struct side_serialize_plan *plan,
+		const struct side_arg_vec *side_arg_vec, void *buf)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_SERIALIZE_PLAN_H */
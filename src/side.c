@@ -9,11 +9,27 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <poll.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <fnmatch.h>
+#include <errno.h>
+#include <time.h>
 
 #include "compiler.h"
 #include "rcu.h"
 #include "list.h"
 #include "rculist.h"
+#include "jump-label.h"
+#include "slab.h"
+#include "event-registry.h"
+#include "type-intern.h"
+#include "user-events.h"
+#include "visit-arg-vec.h"
+#include "filter.h"
+#include "payload.h"
+#include "clock.h"
+#include "stats.h"
 
 /* Top 8 bits reserved for shared tracer use. */
 #if SIDE_BITS_PER_LONG == 64
@@ -21,15 +37,32 @@
 # define SIDE_EVENT_ENABLED_SHARED_USER_EVENT_MASK 	0x8000000000000000ULL
 # define SIDE_EVENT_ENABLED_SHARED_PTRACE_MASK 		0x4000000000000000ULL
 
-/* Allow 2^56 private tracer references on an event. */
-# define SIDE_EVENT_ENABLED_PRIVATE_MASK		0x00FFFFFFFFFFFFFFULL
+/*
+ * Allow 2^32 private tracer references on an event. Bits 32 to 47 are
+ * SIDE_EVENT_ENABLED_USDT_MASK, updated by the kernel, and bit 55 is
+ * SIDE_EVENT_ENABLED_SAMPLING_MASK.
+ */
+# define SIDE_EVENT_ENABLED_PRIVATE_MASK		0x00000000FFFFFFFFULL
 #else
 # define SIDE_EVENT_ENABLED_SHARED_MASK			0xFF000000UL
 # define SIDE_EVENT_ENABLED_SHARED_USER_EVENT_MASK	0x80000000UL
 # define SIDE_EVENT_ENABLED_SHARED_PTRACE_MASK		0x40000000UL
 
-/* Allow 2^24 private tracer references on an event. */
-# define SIDE_EVENT_ENABLED_PRIVATE_MASK		0x00FFFFFFUL
+/*
+ * Allow 2^23 private tracer references on an event. The top private
+ * bit is SIDE_EVENT_ENABLED_SAMPLING_MASK.
+ */
+# define SIDE_EVENT_ENABLED_PRIVATE_MASK		0x007FFFFFUL
+#endif
+
+/*
+ * The kernel updates the USDT semaphore outside of the lifetime of
+ * libside: it does not enable the callbacks of the event.
+ */
+#ifdef SIDE_EVENT_ENABLED_USDT_MASK
+# define SIDE_EVENT_ENABLED_CALL_MASK			(~SIDE_EVENT_ENABLED_USDT_MASK)
+#else
+# define SIDE_EVENT_ENABLED_CALL_MASK			(~(uintptr_t) 0)
 #endif
 
 #define SIDE_KEY_RESERVED_RANGE_END			0x8
@@ -41,20 +74,42 @@
 /* Key 0x2 is reserved for ptrace. */
 #define SIDE_KEY_PTRACE					0x2
 
-#define SIDE_RETRY_BUSY_LOOP_ATTEMPTS			100
-#define SIDE_RETRY_DELAY_MS				1
+/* Known enum side_tracer_callback_flag bits. */
+#define SIDE_TRACER_CALLBACK_FLAGS_MASK			\
+	(SIDE_TRACER_CALLBACK_FLAG_PAYLOAD | SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP)
 
 struct side_events_register_handle {
 	struct side_list_node node;
 	struct side_event_description **events;
+	struct side_event_registry_entry *registry_entries;	/* nr_events entries. */
 	uint32_t nr_events;
 };
 
+struct side_jump_entries_handle {
+	struct side_list_node node;
+	struct side_jump_entry *start;	/* Sorted by event state. */
+	struct side_jump_entry *stop;
+};
+
 struct side_tracer_handle {
 	struct side_list_node node;
 	void (*cb)(enum side_tracer_notification notif,
 		struct side_event_description **events, uint32_t nr_events, void *priv);
 	void *priv;
+	enum side_tracer_notification_mode mode;
+	/* Inserted events not notified yet, in deferred modes. */
+	struct side_event_description **pending_events;
+	uint32_t nr_pending_events;
+	uint32_t max_pending_events;
+};
+
+struct side_tracer_enable_rule_handle {
+	struct side_list_node node;
+	struct side_tracer_enable_rule rule;	/* Owns its patterns. */
+	/* Registered events the rule registered its callback on. */
+	struct side_event_description **events;
+	uint32_t nr_events;
+	uint32_t max_events;
 };
 
 struct side_statedump_notification {
@@ -62,12 +117,41 @@ struct side_statedump_notification {
 	uint64_t key;
 };
 
+/* Notifications preallocated in the free list at initialization. */
+#define SIDE_STATEDUMP_NOTIFICATION_PREALLOC		16
+
+/*
+ * The statedump_request_key received by statedump callbacks points to
+ * the request being run: the pending keys of a handle are coalesced
+ * into a single callback invocation, and the statedump events are
+ * fanned out to each requested key.
+ */
+struct side_statedump_request {
+	struct side_list_head notifications;	/* List of struct side_statedump_notification. */
+	struct side_statedump_cursor *cursor;	/* NULL unless resumable. */
+};
+
 struct side_statedump_request_handle {
 	struct side_list_node node;			/* Statedump request RCU list node. */
 	struct side_list_head notification_queue;	/* Queue of struct side_statedump_notification */
 	void (*cb)(void *statedump_request_key);
+	enum side_statedump_status (*resumable_cb)(void *statedump_request_key,
+			struct side_statedump_cursor *cursor);
 	char *name;
 	enum side_statedump_mode mode;
+	bool running;					/* Claimed by an agent thread. */
+	/*
+	 * Request in progress, owned by the thread running the handle.
+	 * Only resumable state dumps stay in progress between runs.
+	 */
+	struct side_statedump_request request;
+	struct side_statedump_cursor cursor;
+	/* Time spent running the request in progress. */
+	uint64_t run_ns;
+	/* Completed state dumps. Updated with relaxed atomics. */
+	uint64_t nr_statedumps;
+	uint64_t statedump_ns;
+	uint64_t statedump_max_ns;
 };
 
 struct side_callback {
@@ -79,23 +163,127 @@ struct side_callback {
 			const struct side_arg_vec *side_arg_vec,
 			const struct side_arg_dynamic_struct *var_struct,
 			void *priv, void *caller_addr);
+		side_tracer_callback_payload_func payload;
+		side_tracer_callback_timestamp_func call_timestamp;
+		side_tracer_callback_variadic_timestamp_func call_variadic_timestamp;
+		side_tracer_callback_payload_timestamp_func payload_timestamp;
 	} u;
 	void *priv;
 	uint64_t key;
+	const struct side_filter *filter;	/* NULL if not filtered. */
+	/* Performance counters, NULL unless enabled. Owned by the event. */
+	struct side_callback_stats_state *stats;
+	uint32_t flags;				/* enum side_tracer_callback_flag */
+};
+
+/*
+ * Callbacks invoked by calls targeting a single key: callbacks
+ * registered with that key and with SIDE_KEY_MATCH_ALL, in
+ * registration order.
+ */
+struct side_callback_key_view {
+	uint64_t key;
+	const struct side_callback *callbacks;	/* NULL-terminated. */
+};
+
+/* Sampling counters of a CPU. */
+struct side_sampling_cpu_state {
+	uint32_t count;		/* Occurrences, for the sampling period. */
+	uint32_t nr_kept;	/* Occurrences kept within the rate limit window. */
+	uint64_t window;	/* Rate limit window, in seconds. */
+} __attribute__((aligned(SIDE_SLAB_ALIGN)));
+
+/*
+ * Occurrences of an event a thread skips before its next occurrence
+ * reaches the sampling period, so side_event_sample() skips them
+ * without entering an RCU read-side critical section nor updating
+ * shared counters. A countdown is set when an occurrence reaches the
+ * period, and only counts for the event which set it: occurrences of
+ * events sharing its slot use the per-CPU counters. Countdowns are
+ * invalidated when a sampling policy changes or an event is removed.
+ */
+struct side_sampling_countdown {
+	const struct side_event_state *event_state;
+	unsigned long generation;
+	uint32_t remaining;
+};
+
+#define SIDE_SAMPLING_COUNTDOWN_SLOTS	8
+
+/*
+ * Sampling policy of an event. Read by side_event_sample() through the
+ * event callback table, within RCU read-side critical sections.
+ */
+struct side_event_sampling_state {
+	struct side_list_node node;
+	const struct side_event_description *desc;
+	struct side_event_sampling sampling;
+	struct side_sampling_cpu_state *percpu;
+	int nr_cpus;
+};
+
+/* Per-key views of a callback table. */
+struct side_callback_index {
+	/* Callbacks registered with SIDE_KEY_MATCH_ALL, for keys without a view. */
+	const struct side_callback *match_all;	/* NULL-terminated. */
+	const struct side_callback_key_view *views;	/* Sorted by key. */
+	uint32_t nr_views;
+	/*
+	 * All registered callbacks, including those filtered out by the
+	 * loglevel thresholds. nr_callbacks entries, in registration order.
+	 */
+	const struct side_callback *registered;
+	struct side_event_sampling_state *sampling;	/* NULL if not sampled. */
+	struct side_event_stats_state *stats;		/* NULL unless enabled. */
+	/* Serialization plan of the payload callbacks, or NULL. */
+	const struct side_serialize_plan *plan;
+	size_t alloc_len;
+};
+
+/*
+ * Published callback arrays are allocated within a table, which also
+ * holds per-key views of the callbacks, so calls targeting a key (e.g.
+ * statedump) only iterate on matching callbacks. The views, a copy of
+ * all registered callbacks and the index are allocated after the
+ * callback array. The callback array and views only contain callbacks
+ * for which the loglevel threshold of their key enables the event.
+ *
+ * Tables are allocated from the slab, aligned on SIDE_SLAB_ALIGN. For
+ * events with a single callback, the index pointer, the callback and
+ * the call pointer of the NULL terminator, which is all the call loop
+ * reads, fit in a single cache line. The rest of the terminator
+ * spills over the next cache line, which is not accessed.
+ */
+struct side_callback_table {
+	const struct side_callback_index *index;
+	struct side_callback cb[];		/* All callbacks, NULL-terminated. */
 };
 
 enum agent_thread_state {
 	AGENT_THREAD_STATE_BLOCKED = 0,
-	AGENT_THREAD_STATE_HANDLE_REQUEST = (1 << 0),
-	AGENT_THREAD_STATE_EXIT = (1 << 1),
-	AGENT_THREAD_STATE_PAUSE = (1 << 2),
-	AGENT_THREAD_STATE_PAUSE_ACK = (1 << 3),
+	AGENT_THREAD_STATE_EXIT = (1 << 0),
+	AGENT_THREAD_STATE_PAUSE = (1 << 1),
 };
 
+#define SIDE_STATEDUMP_AGENT_MAX_THREADS		64
+
+/*
+ * The agent threads form a pool: each thread claims a handle with
+ * pending requests and runs them, so independent handles are dumped in
+ * parallel. The requests of a given handle are run by a single thread
+ * at a time, in queue order.
+ *
+ * The threads are created when the first request is queued for an
+ * agent thread handle, so a child process only creates them if it
+ * requests a state dump. The fork pause handshake waits on the state
+ * and nr_paused futexes.
+ */
 struct statedump_agent_thread {
 	long ref;
-	pthread_t id;
-	enum agent_thread_state state;
+	unsigned int nr_threads;	/* Created threads. */
+	int32_t nr_paused;		/* Threads which acknowledged the pause. */
+	pthread_t id[SIDE_STATEDUMP_AGENT_MAX_THREADS];
+	int32_t state;			/* enum agent_thread_state flags. */
 	pthread_cond_t worker_cond;
 	pthread_cond_t waiter_cond;
 };
@@ -126,12 +314,87 @@ static pthread_mutex_t side_key_lock = PTHREAD_MUTEX_INITIALIZER;
  */
 static pthread_mutex_t side_agent_thread_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Loglevel thresholds, protected by side_event_lock. Callbacks are only
+ * invoked for events with a loglevel at or below (more severe than) the
+ * threshold of their key, or the process-wide threshold for keys
+ * without a threshold of their own.
+ */
+struct side_key_loglevel {
+	uint64_t key;
+	uint32_t loglevel;
+};
+
+static uint32_t side_loglevel_threshold = SIDE_LOGLEVEL_DEBUG;
+static struct side_key_loglevel *side_key_loglevels;
+static uint32_t nr_side_key_loglevels;
+
 /* Dynamic tracer key allocation. */
 static uint64_t side_key_next = SIDE_KEY_RESERVED_RANGE_END;
 
 static struct statedump_agent_thread statedump_agent_thread;
 
+/*
+ * The notification thread delivers the events inserted for tracers in
+ * SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_THREAD mode, after a delay
+ * coalescing bursts of registrations. It is created when events are
+ * first queued. The side_notification_thread_lock nests inside the
+ * side_event_lock, and is not held by the thread while it takes the
+ * side_event_lock.
+ */
+struct side_notification_thread {
+	pthread_t id;
+	bool created;
+	bool pending;
+	bool exit;
+	pthread_cond_t cond;
+};
+
+#define SIDE_NOTIFICATION_DEFAULT_DELAY_MS		10
+
+static pthread_mutex_t side_notification_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct side_notification_thread side_notification_thread = {
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+static unsigned int side_notification_delay_ms = SIDE_NOTIFICATION_DEFAULT_DELAY_MS;
+
+/*
+ * The stats thread runs the "side_stats" state dump every period, for
+ * all tracers. It is created at initialization if a period is set.
+ */
+struct side_stats_thread {
+	pthread_t id;
+	bool created;
+	bool exit;
+	pthread_cond_t cond;		/* Uses CLOCK_MONOTONIC. */
+};
+
+static pthread_mutex_t side_stats_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct side_stats_thread side_stats_thread;
+static unsigned int side_stats_period_ms;
+/* Owned by the stats thread. */
+static struct side_statedump_request_handle *side_stats_statedump_handle;
+
+/* Agent thread pool configuration, set at initialization. */
+static unsigned int statedump_agent_nr_threads = 1;
+static cpu_set_t statedump_agent_cpuset;
+static bool statedump_agent_cpuset_set;
+
 static DEFINE_SIDE_LIST_HEAD(side_events_list);
+static DEFINE_SIDE_LIST_HEAD(side_jump_entries_list);
+/* Event sampling policies, protected by side_event_lock. */
+static DEFINE_SIDE_LIST_HEAD(side_sampling_list);
+/* Invalidates the sampling countdowns. Updated with side_event_lock held. */
+static unsigned long side_sampling_generation;
+static __thread struct side_sampling_countdown side_sampling_countdown[SIDE_SAMPLING_COUNTDOWN_SLOTS]
+	__attribute__((tls_model("initial-exec")));
+/* Tracer enablement rules, protected by side_event_lock. */
+static DEFINE_SIDE_LIST_HEAD(side_enable_rule_list);
+
+/* Static key code patching is available. */
+static bool jump_label_available;
+/* Sites were patched since the last instruction fetch serialization. */
+static bool jump_label_sync_pending;
 static DEFINE_SIDE_LIST_HEAD(side_tracer_list);
 
 /*
@@ -140,6 +403,9 @@ static DEFINE_SIDE_LIST_HEAD(side_tracer_list);
  */
 static DEFINE_SIDE_LIST_HEAD(side_statedump_list);
 
+/* Free statedump notifications, protected by side_statedump_lock. */
+static DEFINE_SIDE_LIST_HEAD(side_statedump_notification_free_list);
+
 /*
  * The empty callback has a NULL function callback pointer, which stops
  * iteration on the array of callbacks immediately.
@@ -151,6 +417,23 @@ side_static_event(side_statedump_begin, "side", "statedump_begin",
 side_static_event(side_statedump_end, "side", "statedump_end",
 	SIDE_LOGLEVEL_INFO, side_field_list(side_field_string("name")));
 
+/* Performance counters, emitted by the "side_stats" state dump. */
+side_static_event(side_stats_grace_periods, "side", "stats_grace_periods",
+	SIDE_LOGLEVEL_INFO, side_field_list(side_field_u64("nr_grace_periods"),
+		side_field_u64("grace_period_ns"), side_field_u64("grace_period_max_ns")));
+side_static_event(side_stats_statedump, "side", "stats_statedump",
+	SIDE_LOGLEVEL_INFO, side_field_list(side_field_string("name"),
+		side_field_u64("nr_statedumps"), side_field_u64("statedump_ns"),
+		side_field_u64("statedump_max_ns")));
+side_static_event(side_stats_event, "side", "stats_event",
+	SIDE_LOGLEVEL_INFO, side_field_list(side_field_string("provider"),
+		side_field_string("event"), side_field_u64("nr_hits")));
+side_static_event(side_stats_callback, "side", "stats_callback",
+	SIDE_LOGLEVEL_INFO, side_field_list(side_field_string("provider"),
+		side_field_string("event"), side_field_pointer("call"),
+		side_field_pointer("priv"), side_field_u64("key"),
+		side_field_u64("nr_samples"), side_field_u64("sampled_ns")));
+
 /*
  * side_ptrace_hook is a place holder for a debugger breakpoint.
  * var_struct is NULL if not variadic.
@@ -167,13 +450,134 @@ void side_ptrace_hook(const struct side_event_state *event_state __attribute__((
 {
 }
 
+/*
+ * Return the NULL-terminated array of callbacks matching key.
+ */
+static inline __attribute__((always_inline))
+const struct side_callback *side_callbacks_for_key(const struct side_callback *callbacks, uint64_t key)
+{
+	const struct side_callback_index *index;
+	uint32_t low = 0, high;
+
+	/* The empty callback array is not within a table. */
+	if (key == SIDE_KEY_MATCH_ALL || callbacks->u.call == NULL)
+		return callbacks;
+	index = side_container_of(callbacks, const struct side_callback_table, cb[0])->index;
+	high = index->nr_views;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		uint64_t view_key = index->views[mid].key;
+
+		if (view_key == key)
+			return index->views[mid].callbacks;
+		if (view_key < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return index->match_all;
+}
+
+/*
+ * Invoke a callback registered with flags. The payload is serialized
+ * by the first payload callback of the event occurrence, and the
+ * timestamp read by its first timestamp callback (*timestamp is 0
+ * until then). Both are shared with the following callbacks.
+ * callbacks is the callback array of the event.
+ */
+static
+void side_call_extended(const struct side_callback *side_cb, const struct side_callback *callbacks,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct,
+		struct side_payload *payload, uint64_t *timestamp,
+		void *caller_addr)
+{
+	const struct side_serialize_plan *plan;
+	const void *data = NULL;
+	size_t len = 0;
+
+	if ((side_cb->flags & SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP) && !*timestamp)
+		*timestamp = side_clock_read();
+	if (!(side_cb->flags & SIDE_TRACER_CALLBACK_FLAG_PAYLOAD)) {
+		if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			side_cb->u.call_variadic_timestamp(desc, side_arg_vec, var_struct,
+					side_cb->priv, caller_addr, *timestamp);
+		else
+			side_cb->u.call_timestamp(desc, side_arg_vec, side_cb->priv,
+					caller_addr, *timestamp);
+		return;
+	}
+	plan = side_container_of(callbacks, const struct side_callback_table, cb[0])->index->plan;
+	if (side_payload_get(payload, desc, plan, side_arg_vec, var_struct)) {
+		data = payload->data;
+		len = payload->len;
+	}
+	if (side_cb->flags & SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP)
+		side_cb->u.payload_timestamp(desc, data, len, side_cb->priv, caller_addr, *timestamp);
+	else
+		side_cb->u.payload(desc, data, len, side_cb->priv, caller_addr);
+}
+
+/*
+ * Count an occurrence in the performance counters of the event.
+ * Returns true if its callbacks should be timed.
+ */
+static inline __attribute__((always_inline))
+bool side_call_stats_hit(const struct side_callback *callbacks)
+{
+	struct side_event_stats_state *stats;
+
+	if (callbacks->u.call == NULL)
+		return false;
+	stats = side_container_of(callbacks, const struct side_callback_table, cb[0])->index->stats;
+	return stats && side_event_stats_hit(stats);
+}
+
+/*
+ * Invoke the callbacks matching key, timing each of them into its
+ * performance counters.
+ */
+static __attribute__((noinline))
+void side_call_timed(const struct side_callback *callbacks, uint64_t key,
+		const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct,
+		void *caller_addr)
+{
+	struct side_payload payload = SIDE_PAYLOAD_INIT;
+	const struct side_callback *side_cb;
+	uint64_t timestamp = 0;
+
+	for (side_cb = side_callbacks_for_key(callbacks, key); side_cb->u.call != NULL; side_cb++) {
+		uint64_t start;
+
+		if (side_cb->filter && !side_filter_match(side_cb->filter, side_arg_vec))
+			continue;
+		start = side_clock_read();
+		if (side_cb->flags)
+			side_call_extended(side_cb, callbacks, desc, side_arg_vec, var_struct,
+					&payload, &timestamp, caller_addr);
+		else if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			side_cb->u.call_variadic(desc, side_arg_vec, var_struct, side_cb->priv, caller_addr);
+		else
+			side_cb->u.call(desc, side_arg_vec, side_cb->priv, caller_addr);
+		if (side_cb->stats)
+			side_callback_stats_add(side_cb->stats, side_clock_read() - start);
+	}
+	if (side_unlikely(payload.data))
+		side_payload_put(&payload);
+}
+
 static inline __attribute__((always_inline))
 void _side_call(const struct side_event_state *event_state, const struct side_arg_vec *side_arg_vec, uint64_t key)
 {
 	void *caller_addr = __builtin_return_address(0);
+	struct side_payload payload = SIDE_PAYLOAD_INIT;
+	const struct side_callback *side_cb, *callbacks;
+	uint64_t timestamp = 0;
 	struct side_rcu_read_state rcu_read_state;
 	const struct side_event_state_0 *es0;
-	const struct side_callback *side_cb;
 	uintptr_t enabled;
 
 	if (side_unlikely(finalized))
@@ -187,19 +591,32 @@ void _side_call(const struct side_event_state *event_state, const struct side_ar
 	enabled = __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED);
 	if (side_unlikely(enabled & SIDE_EVENT_ENABLED_SHARED_MASK)) {
 		if ((enabled & SIDE_EVENT_ENABLED_SHARED_USER_EVENT_MASK) &&
-		    (key == SIDE_KEY_MATCH_ALL || key == SIDE_KEY_USER_EVENT)) {
-			// TODO: User event integration: call kernel write.
-		}
+		    (key == SIDE_KEY_MATCH_ALL || key == SIDE_KEY_USER_EVENT))
+			side_user_event_write(es0, side_arg_vec);
 		if ((enabled & SIDE_EVENT_ENABLED_SHARED_PTRACE_MASK) &&
 		    (key == SIDE_KEY_MATCH_ALL || key == SIDE_KEY_PTRACE))
 			side_ptrace_hook(event_state, side_arg_vec, NULL, caller_addr);
 	}
 	side_rcu_read_begin(&event_rcu_gp, &rcu_read_state);
-	for (side_cb = side_rcu_dereference(es0->callbacks); side_cb->u.call != NULL; side_cb++) {
-		if (key != SIDE_KEY_MATCH_ALL && side_cb->key != SIDE_KEY_MATCH_ALL && side_cb->key != key)
+	callbacks = side_rcu_dereference(es0->callbacks);
+	if (side_unlikely(side_stats_enabled) && side_call_stats_hit(callbacks)) {
+		side_call_timed(callbacks, key, es0->desc, side_arg_vec, NULL, caller_addr);
+		goto end;
+	}
+	side_cb = side_callbacks_for_key(callbacks, key);
+	for (; side_cb->u.call != NULL; side_cb++) {
+		if (side_cb->filter && !side_filter_match(side_cb->filter, side_arg_vec))
 			continue;
+		if (side_unlikely(side_cb->flags)) {
+			side_call_extended(side_cb, callbacks, es0->desc, side_arg_vec, NULL,
+					&payload, &timestamp, caller_addr);
+			continue;
+		}
 		side_cb->u.call(es0->desc, side_arg_vec, side_cb->priv, caller_addr);
 	}
+	if (side_unlikely(payload.data))
+		side_payload_put(&payload);
+end:
 	side_rcu_read_end(&event_rcu_gp, &rcu_read_state);
 }
 
@@ -208,11 +625,64 @@ void side_call(const struct side_event_state *event_state, const struct side_arg
 	_side_call(event_state, side_arg_vec, SIDE_KEY_MATCH_ALL);
 }
 
+/*
+ * Skip the per-call checks of side_call(): the event state version and
+ * variadic flag are known when the instrumentation is compiled. Events
+ * without callbacks, including before initialization and after
+ * finalization, are not enabled, ignoring the USDT semaphore. Shared
+ * tracers use the complete path.
+ */
+void side_call_v0(const struct side_event_state *event_state, const struct side_arg_vec *side_arg_vec)
+{
+	const struct side_event_state_0 *es0 = side_container_of(event_state, const struct side_event_state_0, parent);
+	struct side_payload payload = SIDE_PAYLOAD_INIT;
+	const struct side_callback *side_cb, *callbacks;
+	uint64_t timestamp = 0;
+	struct side_rcu_read_state rcu_read_state;
+	uintptr_t enabled;
+	void *caller_addr;
+
+	enabled = __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED);
+	if (side_unlikely(enabled & SIDE_EVENT_ENABLED_SHARED_MASK)) {
+		_side_call(event_state, side_arg_vec, SIDE_KEY_MATCH_ALL);
+		return;
+	}
+	if (side_unlikely(!(enabled & SIDE_EVENT_ENABLED_CALL_MASK)))
+		return;
+	caller_addr = __builtin_return_address(0);
+	side_rcu_read_begin(&event_rcu_gp, &rcu_read_state);
+	callbacks = side_rcu_dereference(es0->callbacks);
+	if (side_unlikely(side_stats_enabled) && side_call_stats_hit(callbacks)) {
+		side_call_timed(callbacks, SIDE_KEY_MATCH_ALL, es0->desc, side_arg_vec, NULL, caller_addr);
+		goto end;
+	}
+	for (side_cb = callbacks; side_cb->u.call != NULL; side_cb++) {
+		if (side_cb->filter && !side_filter_match(side_cb->filter, side_arg_vec))
+			continue;
+		if (side_unlikely(side_cb->flags)) {
+			side_call_extended(side_cb, callbacks, es0->desc, side_arg_vec, NULL,
+					&payload, &timestamp, caller_addr);
+			continue;
+		}
+		side_cb->u.call(es0->desc, side_arg_vec, side_cb->priv, caller_addr);
+	}
+	if (side_unlikely(payload.data))
+		side_payload_put(&payload);
+end:
+	side_rcu_read_end(&event_rcu_gp, &rcu_read_state);
+}
+
 void side_statedump_call(const struct side_event_state *event_state,
 		const struct side_arg_vec *side_arg_vec,
 		void *statedump_request_key)
 {
-	_side_call(event_state, side_arg_vec, *(const uint64_t *) statedump_request_key);
+	struct side_statedump_request *request = (struct side_statedump_request *) statedump_request_key;
+	struct side_statedump_notification *notif;
+
+	if (request->cursor)
+		request->cursor->nr_events++;
+	side_list_for_each_entry(notif, &request->notifications, node)
+		_side_call(event_state, side_arg_vec, notif->key);
 }
 
 static inline __attribute__((always_inline))
@@ -222,9 +692,11 @@ void _side_call_variadic(const struct side_event_state *event_state,
 		uint64_t key)
 {
 	void *caller_addr = __builtin_return_address(0);
+	struct side_payload payload = SIDE_PAYLOAD_INIT;
+	const struct side_callback *side_cb, *callbacks;
+	uint64_t timestamp = 0;
 	struct side_rcu_read_state rcu_read_state;
 	const struct side_event_state_0 *es0;
-	const struct side_callback *side_cb;
 	uintptr_t enabled;
 
 	if (side_unlikely(finalized))
@@ -237,20 +709,31 @@ void _side_call_variadic(const struct side_event_state *event_state,
 	assert(es0->desc->flags & SIDE_EVENT_FLAG_VARIADIC);
 	enabled = __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED);
 	if (side_unlikely(enabled & SIDE_EVENT_ENABLED_SHARED_MASK)) {
-		if ((enabled & SIDE_EVENT_ENABLED_SHARED_USER_EVENT_MASK) &&
-		    (key == SIDE_KEY_MATCH_ALL || key == SIDE_KEY_USER_EVENT)) {
-			// TODO: User event integration: call kernel write.
-		}
+		/* Variadic events are not registered as user events. */
 		if ((enabled & SIDE_EVENT_ENABLED_SHARED_PTRACE_MASK) &&
 		    (key == SIDE_KEY_MATCH_ALL || key == SIDE_KEY_PTRACE))
 			side_ptrace_hook(event_state, side_arg_vec, var_struct, caller_addr);
 	}
 	side_rcu_read_begin(&event_rcu_gp, &rcu_read_state);
-	for (side_cb = side_rcu_dereference(es0->callbacks); side_cb->u.call_variadic != NULL; side_cb++) {
-		if (key != SIDE_KEY_MATCH_ALL && side_cb->key != SIDE_KEY_MATCH_ALL && side_cb->key != key)
+	callbacks = side_rcu_dereference(es0->callbacks);
+	if (side_unlikely(side_stats_enabled) && side_call_stats_hit(callbacks)) {
+		side_call_timed(callbacks, key, es0->desc, side_arg_vec, var_struct, caller_addr);
+		goto end;
+	}
+	side_cb = side_callbacks_for_key(callbacks, key);
+	for (; side_cb->u.call_variadic != NULL; side_cb++) {
+		if (side_cb->filter && !side_filter_match(side_cb->filter, side_arg_vec))
+			continue;
+		if (side_unlikely(side_cb->flags)) {
+			side_call_extended(side_cb, callbacks, es0->desc, side_arg_vec, var_struct,
+					&payload, &timestamp, caller_addr);
 			continue;
+		}
 		side_cb->u.call_variadic(es0->desc, side_arg_vec, var_struct, side_cb->priv, caller_addr);
 	}
+	if (side_unlikely(payload.data))
+		side_payload_put(&payload);
+end:
 	side_rcu_read_end(&event_rcu_gp, &rcu_read_state);
 }
 
@@ -261,12 +744,161 @@ void side_call_variadic(const struct side_event_state *event_state,
 	_side_call_variadic(event_state, side_arg_vec, var_struct, SIDE_KEY_MATCH_ALL);
 }
 
+void side_call_variadic_v0(const struct side_event_state *event_state,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct)
+{
+	const struct side_event_state_0 *es0 = side_container_of(event_state, const struct side_event_state_0, parent);
+	struct side_payload payload = SIDE_PAYLOAD_INIT;
+	const struct side_callback *side_cb, *callbacks;
+	uint64_t timestamp = 0;
+	struct side_rcu_read_state rcu_read_state;
+	uintptr_t enabled;
+	void *caller_addr;
+
+	enabled = __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED);
+	if (side_unlikely(enabled & SIDE_EVENT_ENABLED_SHARED_MASK)) {
+		_side_call_variadic(event_state, side_arg_vec, var_struct, SIDE_KEY_MATCH_ALL);
+		return;
+	}
+	if (side_unlikely(!(enabled & SIDE_EVENT_ENABLED_CALL_MASK)))
+		return;
+	caller_addr = __builtin_return_address(0);
+	side_rcu_read_begin(&event_rcu_gp, &rcu_read_state);
+	callbacks = side_rcu_dereference(es0->callbacks);
+	if (side_unlikely(side_stats_enabled) && side_call_stats_hit(callbacks)) {
+		side_call_timed(callbacks, SIDE_KEY_MATCH_ALL, es0->desc, side_arg_vec, var_struct, caller_addr);
+		goto end;
+	}
+	for (side_cb = callbacks; side_cb->u.call_variadic != NULL; side_cb++) {
+		if (side_cb->filter && !side_filter_match(side_cb->filter, side_arg_vec))
+			continue;
+		if (side_unlikely(side_cb->flags)) {
+			side_call_extended(side_cb, callbacks, es0->desc, side_arg_vec, var_struct,
+					&payload, &timestamp, caller_addr);
+			continue;
+		}
+		side_cb->u.call_variadic(es0->desc, side_arg_vec, var_struct, side_cb->priv, caller_addr);
+	}
+	if (side_unlikely(payload.data))
+		side_payload_put(&payload);
+end:
+	side_rcu_read_end(&event_rcu_gp, &rcu_read_state);
+}
+
+/*
+ * Returns true if the occurrence is kept by the sampling policy. The
+ * occurrence reaches the sampling period if the thread countdown of the
+ * event expired, otherwise its position is counted on the CPU state.
+ * Reaching the period sets the thread countdown for the next one.
+ */
+static
+bool side_event_sampling_keep(const struct side_event_state *event_state,
+		struct side_event_sampling_state *sampling_state,
+		struct side_sampling_countdown *countdown, unsigned long generation)
+{
+	const struct side_event_sampling *sampling = &sampling_state->sampling;
+	struct side_sampling_cpu_state *cpu_state;
+
+	cpu_state = &sampling_state->percpu[side_rcu_percpu_index(sampling_state->nr_cpus)];
+	if ((countdown->event_state != event_state || countdown->generation != generation) &&
+	    sampling->period > 1 &&
+	    __atomic_add_fetch(&cpu_state->count, 1, __ATOMIC_RELAXED) % sampling->period)
+		return false;
+	countdown->event_state = event_state;
+	countdown->generation = generation;
+	countdown->remaining = sampling->period > 1 ? sampling->period - 1 : 0;
+	if (sampling->max_per_second) {
+		struct timespec ts;
+		uint64_t window;
+
+		if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts))
+			return true;
+		window = (uint64_t) ts.tv_sec;
+		if (__atomic_load_n(&cpu_state->window, __ATOMIC_RELAXED) != window) {
+			__atomic_store_n(&cpu_state->window, window, __ATOMIC_RELAXED);
+			__atomic_store_n(&cpu_state->nr_kept, 0, __ATOMIC_RELAXED);
+		}
+		if (__atomic_add_fetch(&cpu_state->nr_kept, 1, __ATOMIC_RELAXED) > sampling->max_per_second)
+			return false;
+	}
+	return true;
+}
+
+bool side_event_sample(const struct side_event_state *event_state)
+{
+	const struct side_event_state_0 *es0 = side_container_of(event_state, const struct side_event_state_0, parent);
+	struct side_sampling_countdown *countdown;
+	struct side_event_sampling_state *sampling_state;
+	struct side_rcu_read_state rcu_read_state;
+	const struct side_callback *side_cb;
+	unsigned long generation;
+	bool keep = false;
+
+	countdown = &side_sampling_countdown[(uintptr_t) es0 / sizeof(*es0) % SIDE_SAMPLING_COUNTDOWN_SLOTS];
+	/*
+	 * Pairs with the release store which follows the publication of
+	 * the callback table holding a new sampling policy, so countdowns
+	 * are only set from the policy of their generation.
+	 */
+	generation = __atomic_load_n(&side_sampling_generation, __ATOMIC_ACQUIRE);
+	if (countdown->event_state == event_state && countdown->generation == generation &&
+	    countdown->remaining) {
+		countdown->remaining--;
+		return false;
+	}
+	side_rcu_read_begin(&event_rcu_gp, &rcu_read_state);
+	side_cb = side_rcu_dereference(es0->callbacks);
+	/* Any callback implies a table. */
+	if (side_cb->u.call != NULL) {
+		sampling_state = side_container_of(side_cb, const struct side_callback_table, cb[0])->index->sampling;
+		keep = !sampling_state || side_event_sampling_keep(event_state, sampling_state,
+				countdown, generation);
+	}
+	side_rcu_read_end(&event_rcu_gp, &rcu_read_state);
+	return keep;
+}
+
 void side_statedump_call_variadic(const struct side_event_state *event_state,
 		const struct side_arg_vec *side_arg_vec,
 		const struct side_arg_dynamic_struct *var_struct,
 		void *statedump_request_key)
 {
-	_side_call_variadic(event_state, side_arg_vec, var_struct, *(const uint64_t *) statedump_request_key);
+	struct side_statedump_request *request = (struct side_statedump_request *) statedump_request_key;
+	struct side_statedump_notification *notif;
+
+	if (request->cursor)
+		request->cursor->nr_events++;
+	side_list_for_each_entry(notif, &request->notifications, node)
+		_side_call_variadic(event_state, side_arg_vec, var_struct, notif->key);
+}
+
+const struct side_arg *side_arg_lazy_value(const struct side_type *type_desc,
+		const struct side_arg *arg)
+{
+	const struct side_type_lazy *side_lazy = side_ptr_get(type_desc->u.side_lazy);
+	struct side_arg_lazy *lazy = side_ptr_get(arg->u.side_static.side_lazy);
+	side_lazy_func func;
+
+	switch (side_enum_get(lazy->state)) {
+	case SIDE_ARG_LAZY_EVALUATED:
+		return &lazy->value;
+	case SIDE_ARG_LAZY_ERROR:
+		return NULL;
+	default:
+		break;
+	}
+	/*
+	 * The callbacks of an event are invoked sequentially by the
+	 * instrumented thread, which owns the argument.
+	 */
+	func = side_ptr_get(side_lazy->func);
+	if (func(side_ptr_get(lazy->app_ctx), &lazy->value) != SIDE_VISITOR_STATUS_OK) {
+		side_enum_set(lazy->state, SIDE_ARG_LAZY_ERROR);
+		return NULL;
+	}
+	side_enum_set(lazy->state, SIDE_ARG_LAZY_EVALUATED);
+	return &lazy->value;
 }
 
 static
@@ -276,175 +908,1419 @@ const struct side_callback *side_tracer_callback_lookup(
 {
 	struct side_event_state *event_state = side_ptr_get(desc->state);
 	const struct side_event_state_0 *es0;
-	const struct side_callback *cb;
+	const struct side_callback *cbs;
+	uint32_t i;
 
 	if (side_unlikely(event_state->version != 0))
 		abort();
 	es0 = side_container_of(event_state, const struct side_event_state_0, parent);
-	for (cb = es0->callbacks; cb->u.call != NULL; cb++) {
+	if (!es0->nr_callbacks)
+		return NULL;
+	cbs = side_container_of(es0->callbacks, const struct side_callback_table, cb[0])->index->registered;
+	for (i = 0; i < es0->nr_callbacks; i++) {
+		const struct side_callback *cb = &cbs[i];
+
 		if ((void *) cb->u.call == call && cb->priv == priv && cb->key == key)
 			return cb;
 	}
 	return NULL;
 }
 
+/* Called with side_event_lock held. */
 static
-int _side_tracer_callback_register(struct side_event_description *desc,
-		void *call, void *priv, uint64_t key)
+bool side_callback_loglevel_enabled(uint64_t key, uint32_t loglevel)
 {
-	struct side_event_state *event_state;
-	struct side_callback *old_cb, *new_cb;
-	struct side_event_state_0 *es0;
-	int ret = SIDE_ERROR_OK;
-	uint32_t old_nr_cb;
+	uint32_t threshold = side_loglevel_threshold, i;
 
-	if (!call)
-		return SIDE_ERROR_INVAL;
-	if (finalized)
-		return SIDE_ERROR_EXITING;
-	if (!initialized)
-		side_init();
-	pthread_mutex_lock(&side_event_lock);
-	event_state = side_ptr_get(desc->state);
-	if (side_unlikely(event_state->version != 0))
-		abort();
-	es0 = side_container_of(event_state, struct side_event_state_0, parent);
-	old_nr_cb = es0->nr_callbacks;
-	if (old_nr_cb == UINT32_MAX) {
-		ret = SIDE_ERROR_INVAL;
-		goto unlock;
+	if (key != SIDE_KEY_MATCH_ALL) {
+		for (i = 0; i < nr_side_key_loglevels; i++) {
+			if (side_key_loglevels[i].key == key) {
+				threshold = side_key_loglevels[i].loglevel;
+				break;
+			}
+		}
 	}
-	/* Reject duplicate (call, priv) tuples. */
-	if (side_tracer_callback_lookup(desc, call, priv, key)) {
-		ret = SIDE_ERROR_EXIST;
-		goto unlock;
+	return loglevel <= threshold;
+}
+
+static
+int side_key_cmp(const void *a, const void *b)
+{
+	uint64_t key_a = *(const uint64_t *) a, key_b = *(const uint64_t *) b;
+
+	if (key_a < key_b)
+		return -1;
+	if (key_a > key_b)
+		return 1;
+	return 0;
+}
+
+static
+struct side_callback *side_callback_view_fill(struct side_callback *view,
+		const struct side_callback *cbs, uint32_t nr_cbs, uint64_t key)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_cbs; i++) {
+		if (cbs[i].key == SIDE_KEY_MATCH_ALL || cbs[i].key == key)
+			*view++ = cbs[i];
 	}
-	old_cb = (struct side_callback *) es0->callbacks;
-	/* old_nr_cb + 1 (new cb) + 1 (NULL) */
-	new_cb = (struct side_callback *) calloc(old_nr_cb + 2, sizeof(struct side_callback));
-	if (!new_cb) {
-		ret = SIDE_ERROR_NOMEM;
-		goto unlock;
+	/* Skip NULL terminator, zeroed by calloc. */
+	return view + 1;
+}
+
+/*
+ * Create a callback table from nr_cbs registered callbacks, for an
+ * event of the given loglevel, sampling policy and serialization
+ * plan. Returns the table callback array, or NULL on allocation
+ * failure. Called with side_event_lock held.
+ *
+ * stats are the event performance counters, or NULL if they are
+ * disabled or could not be allocated. They are owned by the event
+ * registry entry and outlive the table.
+ */
+static
+struct side_callback *side_callback_table_create(const struct side_callback *cbs, uint32_t nr_cbs,
+		uint32_t loglevel, struct side_event_sampling_state *sampling,
+		struct side_event_stats_state *stats,
+		const struct side_serialize_plan *plan)
+{
+	uint32_t i, nr_active = 0, nr_keys = 0, nr_views = 0, nr_match_all = 0;
+	struct side_callback_key_view *views;
+	struct side_callback_index *index;
+	struct side_callback_table *table;
+	struct side_callback *pos, *active;
+	uint64_t *keys;
+	size_t len;
+
+	active = (struct side_callback *) calloc(nr_cbs ? nr_cbs : 1, sizeof(struct side_callback));
+	if (!active)
+		return NULL;
+	keys = (uint64_t *) calloc(nr_cbs ? nr_cbs : 1, sizeof(uint64_t));
+	if (!keys) {
+		free(active);
+		return NULL;
 	}
-	memcpy(new_cb, old_cb, old_nr_cb);
-	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
-		new_cb[old_nr_cb].u.call_variadic =
-			(side_tracer_callback_variadic_func) call;
-	else
-		new_cb[old_nr_cb].u.call =
-			(side_tracer_callback_func) call;
-	new_cb[old_nr_cb].priv = priv;
-	new_cb[old_nr_cb].key = key;
+	for (i = 0; i < nr_cbs; i++) {
+		if (!side_callback_loglevel_enabled(cbs[i].key, loglevel))
+			continue;
+		active[nr_active++] = cbs[i];
+		if (cbs[i].key == SIDE_KEY_MATCH_ALL)
+			nr_match_all++;
+		else
+			keys[nr_keys++] = cbs[i].key;
+	}
+	qsort(keys, nr_keys, sizeof(uint64_t), side_key_cmp);
+	for (i = 0; i < nr_keys; i++) {
+		if (!i || keys[i] != keys[nr_views - 1])
+			keys[nr_views++] = keys[i];
+	}
+	/*
+	 * Active callbacks, match-all callbacks, one view per key,
+	 * registered callbacks, then the index.
+	 */
+	len = sizeof(struct side_callback_table)
+		+ (nr_active + 1) * sizeof(struct side_callback)
+		+ (nr_match_all + 1) * sizeof(struct side_callback)
+		+ ((size_t) nr_keys + (size_t) nr_views * (nr_match_all + 1)) * sizeof(struct side_callback)
+		+ nr_views * sizeof(struct side_callback_key_view)
+		+ nr_cbs * sizeof(struct side_callback)
+		+ sizeof(struct side_callback_index);
+	table = (struct side_callback_table *) side_slab_zalloc(len);
+	if (!table) {
+		free(keys);
+		free(active);
+		return NULL;
+	}
+	memcpy(table->cb, active, nr_active * sizeof(struct side_callback));
+	pos = &table->cb[nr_active + 1];
+	pos = side_callback_view_fill(pos, active, nr_active, SIDE_KEY_MATCH_ALL);
+	views = (struct side_callback_key_view *) pos;
+	pos = (struct side_callback *) &views[nr_views];
+	for (i = 0; i < nr_views; i++) {
+		views[i].key = keys[i];
+		views[i].callbacks = pos;
+		pos = side_callback_view_fill(pos, active, nr_active, keys[i]);
+	}
+	memcpy(pos, cbs, nr_cbs * sizeof(struct side_callback));
+	index = (struct side_callback_index *) &pos[nr_cbs];
+	index->match_all = &table->cb[nr_active + 1];
+	index->views = views;
+	index->nr_views = nr_views;
+	index->registered = pos;
+	index->sampling = sampling;
+	index->stats = stats;
+	index->plan = plan;
+	index->alloc_len = len;
+	table->index = index;
+	free(keys);
+	free(active);
+	return table->cb;
+}
+
+static
+void side_callback_table_free(void *ptr)
+{
+	struct side_callback *cbs = (struct side_callback *) ptr;
+	struct side_callback_table *table;
+
+	if (cbs == (struct side_callback *) &side_empty_callback)
+		return;
+	table = side_container_of(cbs, struct side_callback_table, cb[0]);
+	side_slab_free(table, table->index->alloc_len);
+}
+
+static
+struct side_event_state *side_jump_entry_key(const struct side_jump_entry *entry)
+{
+	return *(struct side_event_state * const *) (uintptr_t) entry->key_ref;
+}
+
+static
+int side_jump_entry_cmp(const void *a, const void *b)
+{
+	uintptr_t key_a = (uintptr_t) side_jump_entry_key((const struct side_jump_entry *) a);
+	uintptr_t key_b = (uintptr_t) side_jump_entry_key((const struct side_jump_entry *) b);
+
+	if (key_a < key_b)
+		return -1;
+	if (key_a > key_b)
+		return 1;
+	return 0;
+}
+
+/* Called with side_event_lock held. */
+static
+void side_jump_entry_patch(const struct side_jump_entry *entry, bool enable)
+{
+	if (side_jump_label_patch(entry, enable))
+		jump_label_sync_pending = true;
+}
+
+/*
+ * Sites of events registered as user events stay jumps, because the
+ * kernel sets their enabled state bit without notifying libside. The
+ * ptrace bit and the USDT semaphore are not observed by NOP sites:
+ * LIBSIDE_JUMP_LABEL=0 keeps all sites as jumps for those consumers.
+ * Called with side_event_lock held.
+ */
+static
+bool side_event_jump_enabled(const struct side_event_state_0 *es0)
+{
+	return __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED) != 0 ||
+		side_user_event_registered(es0);
+}
+
+/*
+ * Patch the static key sites of an event to follow its enabled state.
+ * Called with side_event_lock held.
+ */
+static
+void side_event_update_jump_sites(struct side_event_state_0 *es0)
+{
+	struct side_jump_entries_handle *handle;
+	bool enable;
+
+	if (!jump_label_available)
+		return;
+	enable = side_event_jump_enabled(es0);
+	side_list_for_each_entry(handle, &side_jump_entries_list, node) {
+		struct side_jump_entry *low = handle->start, *high = handle->stop;
+
+		/* Find the first entry for this event. */
+		while (low < high) {
+			struct side_jump_entry *mid = low + (high - low) / 2;
+
+			if ((uintptr_t) side_jump_entry_key(mid) < (uintptr_t) &es0->parent)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		for (; low < handle->stop && side_jump_entry_key(low) == &es0->parent; low++)
+			side_jump_entry_patch(low, enable);
+	}
+}
+
+/* Called with side_event_lock held. */
+static
+void side_jump_label_sync_pending(void)
+{
+	if (!jump_label_sync_pending)
+		return;
+	side_jump_label_sync();
+	jump_label_sync_pending = false;
+}
+
+/* Called with side_event_lock held. */
+static
+struct side_event_sampling_state *side_event_sampling_lookup(const struct side_event_description *desc)
+{
+	struct side_event_sampling_state *sampling_state;
+
+	side_list_for_each_entry(sampling_state, &side_sampling_list, node) {
+		if (sampling_state->desc == desc)
+			return sampling_state;
+	}
+	return NULL;
+}
+
+static
+void side_event_sampling_state_free(void *ptr)
+{
+	struct side_event_sampling_state *sampling_state = (struct side_event_sampling_state *) ptr;
+
+	side_slab_free(sampling_state->percpu,
+		sampling_state->nr_cpus * sizeof(struct side_sampling_cpu_state));
+	free(sampling_state);
+}
+
+/*
+ * Returns the performance counters of a registered event, created if
+ * needed, or NULL if they are disabled or cannot be allocated. Called
+ * with side_event_lock held.
+ */
+static
+struct side_event_stats_state *side_event_stats_state_get(struct side_event_registry_entry *registry_entry)
+{
+	if (!side_stats_enabled || !registry_entry)
+		return NULL;
+	if (!registry_entry->stats)
+		registry_entry->stats = side_event_stats_create(event_rcu_gp.nr_cpus);
+	return registry_entry->stats;
+}
+
+/* Called with side_event_lock held. */
+static
+struct side_callback_stats_state *side_callback_stats_state_get(const struct side_event_description *desc,
+		void *call, void *priv, uint64_t key)
+{
+	struct side_event_stats_state *stats;
+
+	if (!side_stats_enabled)
+		return NULL;
+	stats = side_event_stats_state_get(side_event_registry_lookup_desc(desc));
+	if (!stats)
+		return NULL;
+	return side_event_stats_callback(stats, call, priv, key);
+}
+
+/*
+ * Publish a new callback table for the nr_cbs registered callbacks, and
+ * update the enabled state of the event. Called with side_event_lock
+ * held. On success, *old_cb_p is set to the previous callback array
+ * which must be freed by the caller after a grace period, or NULL if
+ * there is nothing to free.
+ */
+static
+int side_event_publish_callbacks(struct side_event_description *desc,
+		const struct side_callback *cbs, uint32_t nr_cbs,
+		struct side_callback **old_cb_p)
+{
+	struct side_event_state *event_state = side_ptr_get(desc->state);
+	struct side_callback *old_cb, *new_cb;
+	struct side_event_sampling_state *sampling_state;
+	struct side_event_registry_entry *registry_entry;
+	struct side_event_state_0 *es0;
+	bool was_enabled, enabled, was_sampled, sampled;
+	uintptr_t enabled_state;
+
+	if (side_unlikely(event_state->version != 0))
+		abort();
+	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	old_cb = (struct side_callback *) es0->callbacks;
+	sampling_state = side_event_sampling_lookup(desc);
+	registry_entry = side_event_registry_lookup_desc(desc);
+	if (nr_cbs) {
+		new_cb = side_callback_table_create(cbs, nr_cbs, side_enum_get(desc->loglevel),
+				sampling_state, side_event_stats_state_get(registry_entry),
+				registry_entry ? registry_entry->plan : NULL);
+		if (!new_cb)
+			return SIDE_ERROR_NOMEM;
+	} else {
+		new_cb = (struct side_callback *) &side_empty_callback;
+	}
+	enabled_state = __atomic_load_n(&es0->enabled, __ATOMIC_RELAXED);
+	was_enabled = enabled_state & SIDE_EVENT_ENABLED_PRIVATE_MASK;
+	was_sampled = enabled_state & SIDE_EVENT_ENABLED_SAMPLING_MASK;
+	enabled = new_cb->u.call != NULL;
+	sampled = enabled && sampling_state;
 	/* High order bits are already zeroed. */
 	side_rcu_assign_pointer(es0->callbacks, new_cb);
-	side_rcu_wait_grace_period(&event_rcu_gp);
-	if (old_nr_cb)
-		free(old_cb);
-	es0->nr_callbacks++;
-	/* Increment concurrently with kernel setting the top bits. */
-	if (!old_nr_cb)
+	*old_cb_p = es0->nr_callbacks ? old_cb : NULL;
+	es0->nr_callbacks = nr_cbs;
+	/*
+	 * Update concurrently with kernel setting the top bits. The
+	 * sampling flag is set before enabling the event, and cleared
+	 * after disabling it.
+	 */
+	if (!was_sampled && sampled)
+		(void) __atomic_or_fetch(&es0->enabled, SIDE_EVENT_ENABLED_SAMPLING_MASK, __ATOMIC_RELAXED);
+	if (!was_enabled && enabled)
 		(void) __atomic_add_fetch(&es0->enabled, 1, __ATOMIC_RELAXED);
+	else if (was_enabled && !enabled)
+		(void) __atomic_add_fetch(&es0->enabled, -1, __ATOMIC_RELAXED);
+	if (was_sampled && !sampled)
+		(void) __atomic_and_fetch(&es0->enabled, ~SIDE_EVENT_ENABLED_SAMPLING_MASK, __ATOMIC_RELAXED);
+	if (was_enabled != enabled)
+		side_event_update_jump_sites(es0);
+	return SIDE_ERROR_OK;
+}
+
+/* Store call in the callback union member selected by flags. */
+static
+void side_callback_set_call(struct side_callback *cb, const struct side_event_description *desc,
+		uint32_t flags, void *call)
+{
+	switch (flags) {
+	case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD:
+		cb->u.payload = (side_tracer_callback_payload_func) call;
+		break;
+	case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD | SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+		cb->u.payload_timestamp = (side_tracer_callback_payload_timestamp_func) call;
+		break;
+	case SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+		if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			cb->u.call_variadic_timestamp = (side_tracer_callback_variadic_timestamp_func) call;
+		else
+			cb->u.call_timestamp = (side_tracer_callback_timestamp_func) call;
+		break;
+	default:
+		if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			cb->u.call_variadic = (side_tracer_callback_variadic_func) call;
+		else
+			cb->u.call = (side_tracer_callback_func) call;
+		break;
+	}
+}
+
+/*
+ * Publish a new callback array containing the (call, priv, key) tuple,
+ * filtered by filter if non-NULL, of the callback kind selected by
+ * flags (enum side_tracer_callback_flag). Called with side_event_lock
+ * held. On success, *old_cb_p is set to the
+ * previous callback array which must be freed by the caller after a
+ * grace period, or NULL if there is nothing to free.
+ */
+static
+int side_tracer_callback_publish_register(struct side_event_description *desc,
+		void *call, void *priv, uint64_t key,
+		const struct side_filter *filter, uint32_t flags,
+		struct side_callback **old_cb_p)
+{
+	struct side_event_state *event_state;
+	struct side_event_state_0 *es0;
+	struct side_callback *cbs;
+	uint32_t old_nr_cb;
+	int ret;
+
+	if (!call)
+		return SIDE_ERROR_INVAL;
+	if (filter && filter->desc != desc)
+		return SIDE_ERROR_INVAL;
+	if (flags & ~SIDE_TRACER_CALLBACK_FLAGS_MASK)
+		return SIDE_ERROR_INVAL;
+	event_state = side_ptr_get(desc->state);
+	if (side_unlikely(event_state->version != 0))
+		abort();
+	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	old_nr_cb = es0->nr_callbacks;
+	if (old_nr_cb == UINT32_MAX)
+		return SIDE_ERROR_INVAL;
+	/* Reject duplicate (call, priv) tuples. */
+	if (side_tracer_callback_lookup(desc, call, priv, key))
+		return SIDE_ERROR_EXIST;
+	/* old_nr_cb + 1 (new cb) */
+	cbs = (struct side_callback *) calloc(old_nr_cb + 1, sizeof(struct side_callback));
+	if (!cbs)
+		return SIDE_ERROR_NOMEM;
+	if (old_nr_cb)
+		memcpy(cbs, side_container_of(es0->callbacks, const struct side_callback_table, cb[0])->index->registered,
+			old_nr_cb * sizeof(struct side_callback));
+	side_callback_set_call(&cbs[old_nr_cb], desc, flags, call);
+	cbs[old_nr_cb].priv = priv;
+	cbs[old_nr_cb].key = key;
+	cbs[old_nr_cb].filter = filter;
+	cbs[old_nr_cb].stats = side_callback_stats_state_get(desc, call, priv, key);
+	cbs[old_nr_cb].flags = flags;
+	ret = side_event_publish_callbacks(desc, cbs, old_nr_cb + 1, old_cb_p);
+	free(cbs);
+	return ret;
+}
+
+/*
+ * Publish a new callback array without the (call, priv, key) tuple.
+ * Called with side_event_lock held. On success, *old_cb_p is set to the
+ * previous callback array which must be freed by the caller after a
+ * grace period.
+ */
+static
+int side_tracer_callback_publish_unregister(struct side_event_description *desc,
+		void *call, void *priv, uint64_t key,
+		struct side_callback **old_cb_p)
+{
+	const struct side_callback *cb_pos, *old_cbs;
+	struct side_event_state *event_state;
+	struct side_event_state_0 *es0;
+	struct side_callback *cbs;
+	uint32_t pos_idx;
+	uint32_t old_nr_cb;
+	int ret;
+
+	if (!call)
+		return SIDE_ERROR_INVAL;
+	event_state = side_ptr_get(desc->state);
+	if (side_unlikely(event_state->version != 0))
+		abort();
+	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	cb_pos = side_tracer_callback_lookup(desc, call, priv, key);
+	if (!cb_pos)
+		return SIDE_ERROR_NOENT;
+	old_nr_cb = es0->nr_callbacks;
+	if (old_nr_cb == 1)
+		return side_event_publish_callbacks(desc, NULL, 0, old_cb_p);
+	old_cbs = side_container_of(es0->callbacks, const struct side_callback_table, cb[0])->index->registered;
+	pos_idx = cb_pos - old_cbs;
+	/* Remove entry at pos_idx. */
+	/* old_nr_cb - 1 (removed cb) */
+	cbs = (struct side_callback *) calloc(old_nr_cb - 1, sizeof(struct side_callback));
+	if (!cbs)
+		return SIDE_ERROR_NOMEM;
+	memcpy(cbs, old_cbs, pos_idx * sizeof(struct side_callback));
+	memcpy(&cbs[pos_idx], &old_cbs[pos_idx + 1],
+		(old_nr_cb - pos_idx - 1) * sizeof(struct side_callback));
+	ret = side_event_publish_callbacks(desc, cbs, old_nr_cb - 1, old_cb_p);
+	free(cbs);
+	return ret;
+}
+
+static
+int _side_tracer_callback_register(struct side_event_description *desc,
+		void *call, void *priv, uint64_t key,
+		const struct side_filter *filter, uint32_t flags)
+{
+	struct side_callback *old_cb;
+	int ret;
+
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	ret = side_tracer_callback_publish_register(desc, call, priv, key, filter, flags, &old_cb);
+	if (ret)
+		goto unlock;
+	/* Adding a callback does not need to wait for readers. */
+	if (old_cb)
+		side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cb);
+unlock:
+	side_jump_label_sync_pending();
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_tracer_callback_register(struct side_event_description *desc,
+		side_tracer_callback_func call,
+		void *priv, uint64_t key)
+{
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call, priv, key, NULL, 0);
+}
+
+int side_tracer_callback_variadic_register(struct side_event_description *desc,
+		side_tracer_callback_variadic_func call_variadic,
+		void *priv, uint64_t key)
+{
+	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call_variadic, priv, key, NULL, 0);
+}
+
+int side_tracer_callback_filter_register(struct side_event_description *desc,
+		side_tracer_callback_func call,
+		void *priv, uint64_t key,
+		const struct side_filter *filter)
+{
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call, priv, key, filter, 0);
+}
+
+int side_tracer_callback_variadic_filter_register(struct side_event_description *desc,
+		side_tracer_callback_variadic_func call_variadic,
+		void *priv, uint64_t key,
+		const struct side_filter *filter)
+{
+	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call_variadic, priv, key, filter, 0);
+}
+
+static int _side_tracer_callback_unregister(struct side_event_description *desc,
+		void *call, void *priv, uint64_t key)
+{
+	struct side_callback *old_cb;
+	int ret;
+
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	ret = side_tracer_callback_publish_unregister(desc, call, priv, key, &old_cb);
+	if (ret)
+		goto unlock;
+	side_jump_label_sync_pending();
+	side_rcu_wait_grace_period(&event_rcu_gp);
+	side_callback_table_free(old_cb);
 unlock:
 	pthread_mutex_unlock(&side_event_lock);
 	return ret;
 }
 
-int side_tracer_callback_register(struct side_event_description *desc,
-		side_tracer_callback_func call,
-		void *priv, uint64_t key)
+int side_tracer_callback_unregister(struct side_event_description *desc,
+		side_tracer_callback_func call,
+		void *priv, uint64_t key)
+{
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_unregister(desc, (void *) call, priv, key);
+}
+
+int side_tracer_callback_variadic_unregister(struct side_event_description *desc,
+		side_tracer_callback_variadic_func call_variadic,
+		void *priv, uint64_t key)
+{
+	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_unregister(desc, (void *) call_variadic, priv, key);
+}
+
+int side_tracer_callback_payload_register(struct side_event_description *desc,
+		side_tracer_callback_payload_func call_payload,
+		void *priv, uint64_t key)
+{
+	return _side_tracer_callback_register(desc, (void *) call_payload, priv, key, NULL,
+			SIDE_TRACER_CALLBACK_FLAG_PAYLOAD);
+}
+
+int side_tracer_callback_payload_unregister(struct side_event_description *desc,
+		side_tracer_callback_payload_func call_payload,
+		void *priv, uint64_t key)
+{
+	return _side_tracer_callback_unregister(desc, (void *) call_payload, priv, key);
+}
+
+int side_tracer_callback_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_timestamp_func call,
+		void *priv, uint64_t key)
+{
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call, priv, key, NULL,
+			SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP);
+}
+
+int side_tracer_callback_variadic_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_variadic_timestamp_func call_variadic,
+		void *priv, uint64_t key)
+{
+	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_register(desc, (void *) call_variadic, priv, key, NULL,
+			SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP);
+}
+
+int side_tracer_callback_payload_timestamp_register(struct side_event_description *desc,
+		side_tracer_callback_payload_timestamp_func call_payload,
+		void *priv, uint64_t key)
+{
+	return _side_tracer_callback_register(desc, (void *) call_payload, priv, key, NULL,
+			SIDE_TRACER_CALLBACK_FLAG_PAYLOAD | SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP);
+}
+
+int side_tracer_callback_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_timestamp_func call,
+		void *priv, uint64_t key)
+{
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_unregister(desc, (void *) call, priv, key);
+}
+
+int side_tracer_callback_variadic_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_variadic_timestamp_func call_variadic,
+		void *priv, uint64_t key)
+{
+	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
+		return SIDE_ERROR_INVAL;
+	return _side_tracer_callback_unregister(desc, (void *) call_variadic, priv, key);
+}
+
+int side_tracer_callback_payload_timestamp_unregister(struct side_event_description *desc,
+		side_tracer_callback_payload_timestamp_func call_payload,
+		void *priv, uint64_t key)
+{
+	return _side_tracer_callback_unregister(desc, (void *) call_payload, priv, key);
+}
+
+uint64_t side_timestamp(void)
+{
+	return side_clock_read();
+}
+
+/*
+ * Apply a batch of callback registrations or unregistrations. Callback
+ * arrays replaced by registrations are reclaimed asynchronously.
+ * Unregistration waits for a single grace period before freeing all
+ * the callback arrays replaced by the batch, so the caller can free
+ * the callbacks private data on return. Processing stops at the first
+ * entry which fails. Entries preceding the failing entry stay applied.
+ */
+static
+int side_tracer_callback_batch(const struct side_tracer_callback_batch_entry *entries,
+		uint32_t nr_entries, bool unregister)
+{
+	struct side_callback **old_cbs;
+	uint32_t i, nr_old_cbs = 0;
+	int ret = SIDE_ERROR_OK;
+
+	if (!nr_entries)
+		return SIDE_ERROR_OK;
+	if (!entries)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	old_cbs = (struct side_callback **) calloc(nr_entries, sizeof(struct side_callback *));
+	if (!old_cbs)
+		return SIDE_ERROR_NOMEM;
+	pthread_mutex_lock(&side_event_lock);
+	for (i = 0; i < nr_entries; i++) {
+		const struct side_tracer_callback_batch_entry *entry = &entries[i];
+		struct side_callback *old_cb = NULL;
+		void *call;
+
+		if (!entry->desc) {
+			ret = SIDE_ERROR_INVAL;
+			break;
+		}
+		switch (entry->flags & SIDE_TRACER_CALLBACK_FLAGS_MASK) {
+		case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD:
+			call = (void *) entry->u.payload;
+			break;
+		case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD | SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+			call = (void *) entry->u.payload_timestamp;
+			break;
+		case SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+			if (entry->desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+				call = (void *) entry->u.call_variadic_timestamp;
+			else
+				call = (void *) entry->u.call_timestamp;
+			break;
+		default:
+			if (entry->desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+				call = (void *) entry->u.call_variadic;
+			else
+				call = (void *) entry->u.call;
+			break;
+		}
+		if (unregister)
+			ret = side_tracer_callback_publish_unregister(entry->desc,
+					call, entry->priv, entry->key, &old_cb);
+		else
+			ret = side_tracer_callback_publish_register(entry->desc,
+					call, entry->priv, entry->key, NULL, entry->flags, &old_cb);
+		if (ret)
+			break;
+		if (old_cb)
+			old_cbs[nr_old_cbs++] = old_cb;
+	}
+	side_jump_label_sync_pending();
+	if (!unregister) {
+		for (i = 0; i < nr_old_cbs; i++)
+			side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cbs[i]);
+	} else if (nr_old_cbs) {
+		side_rcu_wait_grace_period(&event_rcu_gp);
+		for (i = 0; i < nr_old_cbs; i++)
+			side_callback_table_free(old_cbs[i]);
+	}
+	pthread_mutex_unlock(&side_event_lock);
+	free(old_cbs);
+	return ret;
+}
+
+int side_tracer_callback_register_batch(const struct side_tracer_callback_batch_entry *entries,
+		uint32_t nr_entries)
+{
+	return side_tracer_callback_batch(entries, nr_entries, false);
+}
+
+int side_tracer_callback_unregister_batch(const struct side_tracer_callback_batch_entry *entries,
+		uint32_t nr_entries)
+{
+	return side_tracer_callback_batch(entries, nr_entries, true);
+}
+
+/* Returns the rule callback for the event, or NULL if it does not match. */
+static
+void *side_enable_rule_match(const struct side_tracer_enable_rule *rule,
+		const struct side_event_description *desc)
+{
+	void *call;
+
+	switch (rule->flags) {
+	case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD:
+		call = (void *) rule->payload;
+		break;
+	case SIDE_TRACER_CALLBACK_FLAG_PAYLOAD | SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+		call = (void *) rule->payload_timestamp;
+		break;
+	case SIDE_TRACER_CALLBACK_FLAG_TIMESTAMP:
+		if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			call = (void *) rule->call_variadic_timestamp;
+		else
+			call = (void *) rule->call_timestamp;
+		break;
+	default:
+		if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+			call = (void *) rule->call_variadic;
+		else
+			call = (void *) rule->call;
+		break;
+	}
+	if (!call)
+		return NULL;
+	if (side_enum_get(desc->loglevel) > rule->loglevel)
+		return NULL;
+	if (fnmatch(rule->provider_pattern, side_ptr_get(desc->provider_name), 0) ||
+	    fnmatch(rule->event_pattern, side_ptr_get(desc->event_name), 0))
+		return NULL;
+	return call;
+}
+
+/*
+ * Make room to record one more event in the events the rule registered
+ * its callback on. Called with side_event_lock held.
+ */
+static
+bool side_enable_rule_reserve_event(struct side_tracer_enable_rule_handle *rule_handle)
+{
+	struct side_event_description **new_events;
+	uint32_t new_max;
+
+	if (rule_handle->nr_events < rule_handle->max_events)
+		return true;
+	new_max = rule_handle->max_events ? 2 * rule_handle->max_events : 64;
+	new_events = (struct side_event_description **) realloc(rule_handle->events,
+			new_max * sizeof(struct side_event_description *));
+	if (!new_events)
+		return false;
+	rule_handle->events = new_events;
+	rule_handle->max_events = new_max;
+	return true;
+}
+
+/*
+ * Forget the events which are not registered anymore from the events
+ * recorded by the enablement rules. Called with side_event_lock held.
+ */
+static
+void side_enable_rules_forget_events(void)
+{
+	struct side_tracer_enable_rule_handle *rule_handle;
+
+	side_list_for_each_entry(rule_handle, &side_enable_rule_list, node) {
+		uint32_t i, nr_events = 0;
+
+		for (i = 0; i < rule_handle->nr_events; i++) {
+			if (side_event_registry_lookup_desc(rule_handle->events[i]))
+				rule_handle->events[nr_events++] = rule_handle->events[i];
+		}
+		rule_handle->nr_events = nr_events;
+	}
+}
+
+/*
+ * Publish the callback array of an event being registered with the
+ * callbacks of all the matching enablement rules, and record the event
+ * in the rules which registered their callback. Called with
+ * side_event_lock held.
+ */
+static
+int side_event_apply_enable_rules(struct side_event_description *desc)
+{
+	struct side_tracer_enable_rule_handle *rule_handle;
+	struct side_event_state *event_state;
+	struct side_event_state_0 *es0;
+	struct side_callback *cbs, *old_cb;
+	uint32_t nr_registered, nr_cb, nr_rules = 0, i;
+	int ret;
+
+	if (desc->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION)
+		return SIDE_ERROR_OK;
+	side_list_for_each_entry(rule_handle, &side_enable_rule_list, node) {
+		if (side_enable_rule_match(&rule_handle->rule, desc))
+			nr_rules++;
+	}
+	if (!nr_rules)
+		return SIDE_ERROR_OK;
+	event_state = side_ptr_get(desc->state);
+	if (side_unlikely(event_state->version != 0))
+		abort();
+	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	nr_registered = nr_cb = es0->nr_callbacks;
+	if (nr_cb > UINT32_MAX - nr_rules)
+		return SIDE_ERROR_INVAL;
+	cbs = (struct side_callback *) calloc(nr_cb + nr_rules, sizeof(struct side_callback));
+	if (!cbs)
+		return SIDE_ERROR_NOMEM;
+	if (nr_cb)
+		memcpy(cbs, side_container_of(es0->callbacks, const struct side_callback_table, cb[0])->index->registered,
+			nr_cb * sizeof(struct side_callback));
+	side_list_for_each_entry(rule_handle, &side_enable_rule_list, node) {
+		const struct side_tracer_enable_rule *rule = &rule_handle->rule;
+		void *call = side_enable_rule_match(rule, desc);
+
+		if (!call || side_tracer_callback_lookup(desc, call, rule->priv, rule->key))
+			continue;
+		/* Rules with the same callback tuple register it once. */
+		for (i = nr_registered; i < nr_cb; i++) {
+			if ((void *) cbs[i].u.call == call && cbs[i].priv == rule->priv &&
+			    cbs[i].key == rule->key)
+				break;
+		}
+		if (i < nr_cb || !side_enable_rule_reserve_event(rule_handle))
+			continue;
+		side_callback_set_call(&cbs[nr_cb], desc, rule->flags, call);
+		cbs[nr_cb].priv = rule->priv;
+		cbs[nr_cb].key = rule->key;
+		cbs[nr_cb].stats = side_callback_stats_state_get(desc, call, rule->priv, rule->key);
+		cbs[nr_cb].flags = rule->flags;
+		nr_cb++;
+		rule_handle->events[rule_handle->nr_events++] = desc;
+	}
+	ret = side_event_publish_callbacks(desc, cbs, nr_cb, &old_cb);
+	free(cbs);
+	if (ret) {
+		/* The event was recorded last by the rules which matched it. */
+		side_list_for_each_entry(rule_handle, &side_enable_rule_list, node) {
+			if (rule_handle->nr_events &&
+			    rule_handle->events[rule_handle->nr_events - 1] == desc)
+				rule_handle->nr_events--;
+		}
+		return ret;
+	}
+	if (old_cb)
+		side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cb);
+	return SIDE_ERROR_OK;
+}
+
+struct side_tracer_enable_rule_handle *side_tracer_enable_rule_register(
+		const struct side_tracer_enable_rule *rule)
+{
+	struct side_tracer_enable_rule_handle *rule_handle;
+	struct side_events_register_handle *events_handle;
+
+	if (!rule || !rule->provider_pattern || !rule->event_pattern)
+		return NULL;
+	if (rule->flags & ~SIDE_TRACER_CALLBACK_FLAGS_MASK)
+		return NULL;
+	if (finalized)
+		return NULL;
+	if (!initialized)
+		side_init();
+	rule_handle = (struct side_tracer_enable_rule_handle *)
+			calloc(1, sizeof(struct side_tracer_enable_rule_handle));
+	if (!rule_handle)
+		return NULL;
+	rule_handle->rule = *rule;
+	rule_handle->rule.provider_pattern = strdup(rule->provider_pattern);
+	rule_handle->rule.event_pattern = strdup(rule->event_pattern);
+	if (!rule_handle->rule.provider_pattern || !rule_handle->rule.event_pattern) {
+		free((char *) rule_handle->rule.provider_pattern);
+		free((char *) rule_handle->rule.event_pattern);
+		free(rule_handle);
+		return NULL;
+	}
+	pthread_mutex_lock(&side_event_lock);
+	side_list_insert_node_tail(&side_enable_rule_list, &rule_handle->node);
+	/* Apply the rule to the events already registered. */
+	side_list_for_each_entry(events_handle, &side_events_list, node) {
+		uint32_t i;
+
+		for (i = 0; i < events_handle->nr_events; i++) {
+			struct side_event_description *event = events_handle->events[i];
+			struct side_callback *old_cb;
+			void *call;
+
+			/* Skip NULL pointers */
+			if (!event || event->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION)
+				continue;
+			call = side_enable_rule_match(rule, event);
+			if (!call || !side_enable_rule_reserve_event(rule_handle))
+				continue;
+			/*
+			 * A callback already registered with the same tuple
+			 * is not owned by the rule.
+			 */
+			if (side_tracer_callback_publish_register(event, call, rule->priv,
+					rule->key, NULL, rule->flags, &old_cb))
+				continue;
+			rule_handle->events[rule_handle->nr_events++] = event;
+			if (old_cb)
+				side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cb);
+		}
+	}
+	side_jump_label_sync_pending();
+	pthread_mutex_unlock(&side_event_lock);
+	return rule_handle;
+}
+
+void side_tracer_enable_rule_unregister(struct side_tracer_enable_rule_handle *rule_handle)
+{
+	const struct side_tracer_enable_rule *rule = &rule_handle->rule;
+	struct side_callback **old_cbs = NULL;
+	uint32_t nr_old_cbs = 0, i;
+
+	if (finalized)
+		return;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	side_list_remove_node(&rule_handle->node);
+	if (rule_handle->nr_events) {
+		old_cbs = (struct side_callback **) calloc(rule_handle->nr_events,
+				sizeof(struct side_callback *));
+		if (!old_cbs)
+			abort();
+	}
+	/* Only unregister the callbacks registered by the rule. */
+	for (i = 0; i < rule_handle->nr_events; i++) {
+		struct side_event_description *event = rule_handle->events[i];
+		struct side_callback *old_cb;
+		void *call;
+
+		call = side_enable_rule_match(rule, event);
+		if (!call)
+			continue;
+		if (side_tracer_callback_publish_unregister(event, call, rule->priv,
+				rule->key, &old_cb))
+			continue;
+		if (old_cb)
+			old_cbs[nr_old_cbs++] = old_cb;
+	}
+	side_jump_label_sync_pending();
+	if (nr_old_cbs) {
+		side_rcu_wait_grace_period(&event_rcu_gp);
+		for (i = 0; i < nr_old_cbs; i++)
+			side_callback_table_free(old_cbs[i]);
+	}
+	pthread_mutex_unlock(&side_event_lock);
+	free(old_cbs);
+	free(rule_handle->events);
+	free((char *) rule_handle->rule.provider_pattern);
+	free((char *) rule_handle->rule.event_pattern);
+	free(rule_handle);
+}
+
+/*
+ * Republish the callback tables of all events with callbacks after a
+ * loglevel threshold change. Called with side_event_lock held.
+ */
+static
+int side_events_update_loglevel(void)
+{
+	struct side_events_register_handle *events_handle;
+	int ret = SIDE_ERROR_OK;
+
+	side_list_for_each_entry(events_handle, &side_events_list, node) {
+		uint32_t i;
+
+		for (i = 0; i < events_handle->nr_events; i++) {
+			struct side_event_description *event = events_handle->events[i];
+			struct side_event_state *event_state;
+			struct side_event_state_0 *es0;
+			struct side_callback *old_cb;
+
+			/* Skip NULL pointers */
+			if (!event)
+				continue;
+			event_state = side_ptr_get(event->state);
+			if (side_unlikely(event_state->version != 0))
+				abort();
+			es0 = side_container_of(event_state, struct side_event_state_0, parent);
+			if (!es0->nr_callbacks)
+				continue;
+			ret = side_event_publish_callbacks(event,
+					side_container_of(es0->callbacks, const struct side_callback_table, cb[0])->index->registered,
+					es0->nr_callbacks, &old_cb);
+			if (ret)
+				goto end;
+			if (old_cb)
+				side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cb);
+		}
+	}
+end:
+	side_jump_label_sync_pending();
+	return ret;
+}
+
+int side_loglevel_threshold_set(enum side_loglevel loglevel)
+{
+	int ret;
+
+	if ((uint32_t) loglevel > SIDE_LOGLEVEL_DEBUG)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	side_loglevel_threshold = loglevel;
+	ret = side_events_update_loglevel();
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_tracer_key_loglevel_threshold_set(uint64_t key, enum side_loglevel loglevel)
+{
+	struct side_key_loglevel *key_loglevels;
+	uint32_t i;
+	int ret;
+
+	if (key == SIDE_KEY_MATCH_ALL || (uint32_t) loglevel > SIDE_LOGLEVEL_DEBUG)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	for (i = 0; i < nr_side_key_loglevels; i++) {
+		if (side_key_loglevels[i].key == key)
+			break;
+	}
+	if (i == nr_side_key_loglevels) {
+		key_loglevels = (struct side_key_loglevel *) realloc(side_key_loglevels,
+				(nr_side_key_loglevels + 1) * sizeof(struct side_key_loglevel));
+		if (!key_loglevels) {
+			ret = SIDE_ERROR_NOMEM;
+			goto unlock;
+		}
+		side_key_loglevels = key_loglevels;
+		side_key_loglevels[nr_side_key_loglevels++].key = key;
+	}
+	side_key_loglevels[i].loglevel = loglevel;
+	ret = side_events_update_loglevel();
+unlock:
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_tracer_key_loglevel_threshold_unset(uint64_t key)
+{
+	uint32_t i;
+	int ret;
+
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	for (i = 0; i < nr_side_key_loglevels; i++) {
+		if (side_key_loglevels[i].key == key)
+			break;
+	}
+	if (i == nr_side_key_loglevels) {
+		ret = SIDE_ERROR_NOENT;
+		goto unlock;
+	}
+	side_key_loglevels[i] = side_key_loglevels[--nr_side_key_loglevels];
+	ret = side_events_update_loglevel();
+unlock:
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+/*
+ * Replace the sampling policy of an event and republish its callback
+ * table. A NULL sampling removes the policy. The previous policy is
+ * reclaimed after a grace period. Called with side_event_lock held.
+ */
+static
+int side_event_sampling_replace(struct side_event_description *desc,
+		const struct side_event_sampling *sampling)
+{
+	struct side_event_sampling_state *old_state, *new_state = NULL;
+	struct side_event_state *event_state = side_ptr_get(desc->state);
+	struct side_event_state_0 *es0;
+	struct side_callback *old_cb = NULL;
+	int ret;
+
+	if (side_unlikely(event_state->version != 0))
+		abort();
+	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	old_state = side_event_sampling_lookup(desc);
+	if (!sampling && !old_state)
+		return SIDE_ERROR_NOENT;
+	if (sampling) {
+		new_state = (struct side_event_sampling_state *)
+				calloc(1, sizeof(struct side_event_sampling_state));
+		if (!new_state)
+			return SIDE_ERROR_NOMEM;
+		new_state->desc = desc;
+		new_state->sampling = *sampling;
+		new_state->nr_cpus = event_rcu_gp.nr_cpus;
+		new_state->percpu = (struct side_sampling_cpu_state *)
+			side_slab_zalloc(new_state->nr_cpus * sizeof(struct side_sampling_cpu_state));
+		if (!new_state->percpu) {
+			free(new_state);
+			return SIDE_ERROR_NOMEM;
+		}
+		side_list_insert_node_tail(&side_sampling_list, &new_state->node);
+	}
+	if (old_state)
+		side_list_remove_node(&old_state->node);
+	ret = side_event_publish_callbacks(desc,
+			es0->nr_callbacks ? side_container_of(es0->callbacks,
+				const struct side_callback_table, cb[0])->index->registered : NULL,
+			es0->nr_callbacks, &old_cb);
+	if (ret) {
+		/* Restore the previous policy. */
+		if (new_state) {
+			side_list_remove_node(&new_state->node);
+			side_event_sampling_state_free(new_state);
+		}
+		if (old_state)
+			side_list_insert_node_tail(&side_sampling_list, &old_state->node);
+		return ret;
+	}
+	/* Ordered after the table publication. */
+	__atomic_store_n(&side_sampling_generation, side_sampling_generation + 1, __ATOMIC_RELEASE);
+	side_jump_label_sync_pending();
+	if (old_cb)
+		side_rcu_call(&event_rcu_gp, side_callback_table_free, old_cb);
+	if (old_state)
+		side_rcu_call(&event_rcu_gp, side_event_sampling_state_free, old_state);
+	return SIDE_ERROR_OK;
+}
+
+int side_event_sampling_set(struct side_event_description *desc,
+		const struct side_event_sampling *sampling)
+{
+	int ret;
+
+	if (!desc || !sampling)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	ret = side_event_sampling_replace(desc, sampling);
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_event_sampling_unset(struct side_event_description *desc)
+{
+	int ret;
+
+	if (!desc)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	ret = side_event_sampling_replace(desc, NULL);
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+/* Called with side_event_lock held. */
+static
+void side_events_update_user_event_jump_sites(struct side_event_description **events, uint32_t nr_events)
+{
+	uint32_t i;
+
+	if (!jump_label_available)
+		return;
+	for (i = 0; i < nr_events; i++) {
+		struct side_event_state_0 *es0;
+
+		/* Skip NULL pointers */
+		if (!events[i])
+			continue;
+		es0 = side_container_of(side_ptr_get(events[i]->state), struct side_event_state_0, parent);
+		if (side_user_event_registered(es0))
+			side_event_update_jump_sites(es0);
+	}
+	side_jump_label_sync_pending();
+}
+
+/*
+ * Intern the fields of each event, so events with the same layout
+ * share a serialization plan, which binary tracers use to serialize
+ * fixed layout events without walking their description. Events
+ * without a plan are serialized by visiting their description. Called
+ * with side_event_lock held.
+ */
+static
+void side_events_intern(struct side_events_register_handle *events_handle)
+{
+	uint32_t i;
+
+	for (i = 0; i < events_handle->nr_events; i++) {
+		struct side_event_description *event = events_handle->events[i];
+		struct side_event_registry_entry *entry = &events_handle->registry_entries[i];
+
+		/* Skip NULL pointers */
+		if (!event)
+			continue;
+		if (event->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION)
+			continue;
+		entry->layout = side_type_intern_event(event);
+		entry->plan = side_type_intern_layout_plan(entry->layout);
+	}
+}
+
+/* Notify the pending inserted events. Called with side_event_lock held. */
+static
+void side_tracer_flush_events(struct side_tracer_handle *tracer_handle)
 {
-	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
-		return SIDE_ERROR_INVAL;
-	return _side_tracer_callback_register(desc, (void *) call, priv, key);
+	if (!tracer_handle->nr_pending_events)
+		return;
+	tracer_handle->cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
+		tracer_handle->pending_events, tracer_handle->nr_pending_events,
+		tracer_handle->priv);
+	free(tracer_handle->pending_events);
+	tracer_handle->pending_events = NULL;
+	tracer_handle->nr_pending_events = 0;
+	tracer_handle->max_pending_events = 0;
 }
 
-int side_tracer_callback_variadic_register(struct side_event_description *desc,
-		side_tracer_callback_variadic_func call_variadic,
-		void *priv, uint64_t key)
+/*
+ * Queue inserted events for a deferred mode tracer. Called with
+ * side_event_lock held. The pending events and the inserted events are
+ * notified immediately if the queue cannot grow.
+ */
+static
+void side_tracer_queue_events(struct side_tracer_handle *tracer_handle,
+		struct side_event_description **events, uint32_t nr_events)
 {
-	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
-		return SIDE_ERROR_INVAL;
-	return _side_tracer_callback_register(desc, (void *) call_variadic, priv, key);
+	uint32_t i;
+
+	for (i = 0; i < nr_events; i++) {
+		/* Skip NULL pointers */
+		if (!events[i])
+			continue;
+		if (tracer_handle->nr_pending_events == tracer_handle->max_pending_events) {
+			struct side_event_description **new_events;
+			uint32_t new_max;
+
+			new_max = tracer_handle->max_pending_events ? 2 * tracer_handle->max_pending_events : 64;
+			new_events = (struct side_event_description **) realloc(tracer_handle->pending_events,
+					new_max * sizeof(struct side_event_description *));
+			if (!new_events) {
+				side_tracer_flush_events(tracer_handle);
+				tracer_handle->cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
+					&events[i], nr_events - i, tracer_handle->priv);
+				return;
+			}
+			tracer_handle->pending_events = new_events;
+			tracer_handle->max_pending_events = new_max;
+		}
+		tracer_handle->pending_events[tracer_handle->nr_pending_events++] = events[i];
+	}
 }
 
-static int _side_tracer_callback_unregister(struct side_event_description *desc,
-		void *call, void *priv, uint64_t key)
+static
+void *side_notification_thread_func(void *arg __attribute__((unused)))
 {
-	struct side_event_state *event_state;
-	struct side_callback *old_cb, *new_cb;
-	const struct side_callback *cb_pos;
-	struct side_event_state_0 *es0;
-	uint32_t pos_idx;
-	int ret = SIDE_ERROR_OK;
-	uint32_t old_nr_cb;
+	for (;;) {
+		struct side_tracer_handle *tracer_handle;
 
-	if (!call)
-		return SIDE_ERROR_INVAL;
-	if (finalized)
-		return SIDE_ERROR_EXITING;
-	if (!initialized)
-		side_init();
-	pthread_mutex_lock(&side_event_lock);
-	event_state = side_ptr_get(desc->state);
-	if (side_unlikely(event_state->version != 0))
-		abort();
-	es0 = side_container_of(event_state, struct side_event_state_0, parent);
-	cb_pos = side_tracer_callback_lookup(desc, call, priv, key);
-	if (!cb_pos) {
-		ret = SIDE_ERROR_NOENT;
-		goto unlock;
-	}
-	old_nr_cb = es0->nr_callbacks;
-	old_cb = (struct side_callback *) es0->callbacks;
-	if (old_nr_cb == 1) {
-		new_cb = (struct side_callback *) &side_empty_callback;
-	} else {
-		pos_idx = cb_pos - es0->callbacks;
-		/* Remove entry at pos_idx. */
-		/* old_nr_cb - 1 (removed cb) + 1 (NULL) */
-		new_cb = (struct side_callback *) calloc(old_nr_cb, sizeof(struct side_callback));
-		if (!new_cb) {
-			ret = SIDE_ERROR_NOMEM;
-			goto unlock;
+		pthread_mutex_lock(&side_notification_thread_lock);
+		while (!side_notification_thread.pending && !side_notification_thread.exit)
+			pthread_cond_wait(&side_notification_thread.cond, &side_notification_thread_lock);
+		if (side_notification_thread.exit) {
+			pthread_mutex_unlock(&side_notification_thread_lock);
+			break;
+		}
+		side_notification_thread.pending = false;
+		pthread_mutex_unlock(&side_notification_thread_lock);
+
+		/* Coalesce the registrations of a burst of library loads. */
+		(void) poll(NULL, 0, side_notification_delay_ms);
+
+		pthread_mutex_lock(&side_event_lock);
+		side_list_for_each_entry(tracer_handle, &side_tracer_list, node) {
+			if (tracer_handle->mode == SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_THREAD)
+				side_tracer_flush_events(tracer_handle);
 		}
-		memcpy(new_cb, old_cb, pos_idx);
-		memcpy(&new_cb[pos_idx], &old_cb[pos_idx + 1], old_nr_cb - pos_idx - 1);
+		pthread_mutex_unlock(&side_event_lock);
 	}
-	/* High order bits are already zeroed. */
-	side_rcu_assign_pointer(es0->callbacks, new_cb);
-	side_rcu_wait_grace_period(&event_rcu_gp);
-	free(old_cb);
-	es0->nr_callbacks--;
-	/* Decrement concurrently with kernel setting the top bits. */
-	if (old_nr_cb == 1)
-		(void) __atomic_add_fetch(&es0->enabled, -1, __ATOMIC_RELAXED);
-unlock:
-	pthread_mutex_unlock(&side_event_lock);
-	return ret;
+	return NULL;
 }
 
-int side_tracer_callback_unregister(struct side_event_description *desc,
-		side_tracer_callback_func call,
-		void *priv, uint64_t key)
+/* Called with side_event_lock held. */
+static
+void side_notification_thread_wake(void)
 {
-	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
-		return SIDE_ERROR_INVAL;
-	return _side_tracer_callback_unregister(desc, (void *) call, priv, key);
+	pthread_mutex_lock(&side_notification_thread_lock);
+	if (!side_notification_thread.created) {
+		if (pthread_create(&side_notification_thread.id, NULL,
+				side_notification_thread_func, NULL))
+			abort();
+		side_notification_thread.created = true;
+	}
+	side_notification_thread.pending = true;
+	pthread_cond_signal(&side_notification_thread.cond);
+	pthread_mutex_unlock(&side_notification_thread_lock);
 }
 
-int side_tracer_callback_variadic_unregister(struct side_event_description *desc,
-		side_tracer_callback_variadic_func call_variadic,
-		void *priv, uint64_t key)
+static
+void side_notification_thread_exit(void)
 {
-	if (!(desc->flags & SIDE_EVENT_FLAG_VARIADIC))
-		return SIDE_ERROR_INVAL;
-	return _side_tracer_callback_unregister(desc, (void *) call_variadic, priv, key);
+	pthread_mutex_lock(&side_notification_thread_lock);
+	if (!side_notification_thread.created) {
+		pthread_mutex_unlock(&side_notification_thread_lock);
+		return;
+	}
+	side_notification_thread.exit = true;
+	pthread_cond_signal(&side_notification_thread.cond);
+	pthread_mutex_unlock(&side_notification_thread_lock);
+	if (pthread_join(side_notification_thread.id, NULL))
+		abort();
+	side_notification_thread.created = false;
+	side_notification_thread.exit = false;
+}
+
+/* Called with side_event_lock held. */
+static
+void side_events_intern_release(struct side_events_register_handle *events_handle)
+{
+	uint32_t i;
+
+	for (i = 0; i < events_handle->nr_events; i++) {
+		struct side_event_description *event = events_handle->events[i];
+
+		/* Skip NULL pointers */
+		if (!event)
+			continue;
+		if (event->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION)
+			continue;
+		side_type_intern_event_release(event, events_handle->registry_entries[i].layout);
+	}
 }
 
 struct side_events_register_handle *side_events_register(struct side_event_description **events, uint32_t nr_events)
 {
 	struct side_events_register_handle *events_handle = NULL;
 	struct side_tracer_handle *tracer_handle;
+	bool wake_notification_thread = false;
 
 	if (finalized)
 		return NULL;
@@ -456,15 +2332,48 @@ struct side_events_register_handle *side_events_register(struct side_event_descr
 		return NULL;
 	events_handle->events = events;
 	events_handle->nr_events = nr_events;
+	events_handle->registry_entries = (struct side_event_registry_entry *)
+			calloc(nr_events ? nr_events : 1, sizeof(struct side_event_registry_entry));
+	if (!events_handle->registry_entries) {
+		free(events_handle);
+		return NULL;
+	}
 
 	pthread_mutex_lock(&side_event_lock);
+	/* Index events before notifying tracers, so they can query their ID. */
+	if (side_event_registry_insert(events_handle->registry_entries, events, nr_events)) {
+		pthread_mutex_unlock(&side_event_lock);
+		free(events_handle->registry_entries);
+		free(events_handle);
+		return NULL;
+	}
+	side_events_intern(events_handle);
 	side_list_insert_node_tail(&side_events_list, &events_handle->node);
+	if (!side_list_empty(&side_enable_rule_list)) {
+		uint32_t i;
+
+		for (i = 0; i < nr_events; i++) {
+			/* Skip NULL pointers */
+			if (events[i])
+				(void) side_event_apply_enable_rules(events[i]);
+		}
+		side_jump_label_sync_pending();
+	}
+	side_user_events_register(events, nr_events);
+	side_events_update_user_event_jump_sites(events, nr_events);
 	side_list_for_each_entry(tracer_handle, &side_tracer_list, node) {
-		tracer_handle->cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
-			events, nr_events, tracer_handle->priv);
+		if (tracer_handle->mode == SIDE_TRACER_NOTIFICATION_MODE_SYNC) {
+			tracer_handle->cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
+				events, nr_events, tracer_handle->priv);
+			continue;
+		}
+		side_tracer_queue_events(tracer_handle, events, nr_events);
+		if (tracer_handle->mode == SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_THREAD)
+			wake_notification_thread = true;
 	}
+	if (wake_notification_thread)
+		side_notification_thread_wake();
 	pthread_mutex_unlock(&side_event_lock);
-	//TODO: User event integration: call event batch register ioctl
 	return events_handle;
 }
 
@@ -472,6 +2381,7 @@ static
 void side_event_remove_callbacks(struct side_event_description *desc)
 {
 	struct side_event_state *event_state = side_ptr_get(desc->state);
+	struct side_event_sampling_state *sampling_state;
 	struct side_event_state_0 *es0;
 	struct side_callback *old_cb;
 	uint32_t nr_cb;
@@ -479,11 +2389,21 @@ void side_event_remove_callbacks(struct side_event_description *desc)
 	if (side_unlikely(event_state->version != 0))
 		abort();
 	es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	sampling_state = side_event_sampling_lookup(desc);
+	if (sampling_state) {
+		side_list_remove_node(&sampling_state->node);
+		(void) __atomic_and_fetch(&es0->enabled, ~SIDE_EVENT_ENABLED_SAMPLING_MASK, __ATOMIC_RELAXED);
+		/* The event state may be reused by events registered later. */
+		__atomic_store_n(&side_sampling_generation, side_sampling_generation + 1, __ATOMIC_RELAXED);
+		/* Instrumentation is unreachable. */
+		side_event_sampling_state_free(sampling_state);
+	}
 	nr_cb = es0->nr_callbacks;
 	if (!nr_cb)
 		return;
 	old_cb = (struct side_callback *) es0->callbacks;
-	(void) __atomic_add_fetch(&es0->enabled, -1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&es0->enabled, __ATOMIC_RELAXED) & SIDE_EVENT_ENABLED_PRIVATE_MASK)
+		(void) __atomic_add_fetch(&es0->enabled, -1, __ATOMIC_RELAXED);
 	/*
 	 * Setting the state back to 0 cb and empty callbacks out of
 	 * caution. This should not matter because instrumentation is
@@ -495,7 +2415,124 @@ void side_event_remove_callbacks(struct side_event_description *desc)
 	 * No need to wait for grace period because instrumentation is
 	 * unreachable.
 	 */
-	free(old_cb);
+	side_callback_table_free(old_cb);
+}
+
+struct side_event_description *side_event_lookup(const char *provider_name,
+		const char *event_name)
+{
+	struct side_event_registry_entry *entry;
+
+	if (!provider_name || !event_name)
+		return NULL;
+	if (finalized)
+		return NULL;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	entry = side_event_registry_lookup_name(provider_name, event_name);
+	pthread_mutex_unlock(&side_event_lock);
+	return entry ? entry->desc : NULL;
+}
+
+uint32_t side_event_get_id(const struct side_event_description *desc)
+{
+	struct side_event_registry_entry *entry;
+
+	if (!desc)
+		return SIDE_EVENT_ID_INVALID;
+	if (finalized)
+		return SIDE_EVENT_ID_INVALID;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	entry = side_event_registry_lookup_desc(desc);
+	pthread_mutex_unlock(&side_event_lock);
+	return entry ? entry->id : SIDE_EVENT_ID_INVALID;
+}
+
+struct side_event_description *side_event_from_id(uint32_t id)
+{
+	struct side_event_registry_entry *entry;
+
+	if (finalized)
+		return NULL;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	entry = side_event_registry_lookup_id(id);
+	pthread_mutex_unlock(&side_event_lock);
+	return entry ? entry->desc : NULL;
+}
+
+void side_event_registry_lock(void)
+{
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+}
+
+void side_event_registry_unlock(void)
+{
+	pthread_mutex_unlock(&side_event_lock);
+}
+
+uint32_t side_event_id_limit(void)
+{
+	uint32_t limit;
+
+	if (finalized)
+		return 0;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	limit = side_event_registry_id_limit();
+	pthread_mutex_unlock(&side_event_lock);
+	return limit;
+}
+
+const struct side_type *side_type_interned(const struct side_type *type)
+{
+	const struct side_type *canonical;
+
+	if (!type)
+		return NULL;
+	if (finalized)
+		return NULL;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	canonical = side_type_intern_lookup(type);
+	pthread_mutex_unlock(&side_event_lock);
+	return canonical;
+}
+
+int side_event_glob(const char *provider_pattern, const char *event_pattern,
+		void (*cb)(struct side_event_description *desc, uint32_t id, void *priv),
+		void *priv)
+{
+	uint32_t id, limit;
+
+	if (!provider_pattern || !event_pattern || !cb)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	limit = side_event_registry_id_limit();
+	for (id = 0; id < limit; id++) {
+		struct side_event_registry_entry *entry = side_event_registry_lookup_id(id);
+
+		if (!entry)
+			continue;
+		if (fnmatch(provider_pattern, side_ptr_get(entry->desc->provider_name), 0) ||
+		    fnmatch(event_pattern, side_ptr_get(entry->desc->event_name), 0))
+			continue;
+		cb(entry->desc, id, priv);
+	}
+	pthread_mutex_unlock(&side_event_lock);
+	return SIDE_ERROR_OK;
 }
 
 /*
@@ -516,6 +2553,8 @@ void side_events_unregister(struct side_events_register_handle *events_handle)
 	pthread_mutex_lock(&side_event_lock);
 	side_list_remove_node(&events_handle->node);
 	side_list_for_each_entry(tracer_handle, &side_tracer_list, node) {
+		/* Notify pending insertions before removals. */
+		side_tracer_flush_events(tracer_handle);
 		tracer_handle->cb(SIDE_TRACER_NOTIFICATION_REMOVE_EVENTS,
 			events_handle->events, events_handle->nr_events,
 			tracer_handle->priv);
@@ -527,20 +2566,91 @@ void side_events_unregister(struct side_events_register_handle *events_handle)
 		if (!event)
 			continue;
 		side_event_remove_callbacks(event);
+		type_visitor_forget_event(event);
+		/* Instrumentation is unreachable. */
+		side_event_stats_destroy(events_handle->registry_entries[i].stats);
 	}
+	side_user_events_unregister(events_handle->events, events_handle->nr_events);
+	side_event_registry_remove(events_handle->registry_entries, events_handle->nr_events);
+	side_enable_rules_forget_events();
+	side_events_intern_release(events_handle);
 	pthread_mutex_unlock(&side_event_lock);
-	//TODO: User event integration: call event batch unregister ioctl
+	free(events_handle->registry_entries);
 	free(events_handle);
 }
 
-struct side_tracer_handle *side_tracer_event_notification_register(
+struct side_jump_entries_handle *side_jump_entries_register(struct side_jump_entry *start,
+		struct side_jump_entry *stop)
+{
+	struct side_jump_entries_handle *handle;
+	struct side_jump_entry *entry;
+
+	if (finalized)
+		return NULL;
+	if (!initialized)
+		side_init();
+	/* Sites stay jumps to the enabled state load if not patched. */
+	if (!jump_label_available || !start || start >= stop)
+		return NULL;
+	handle = (struct side_jump_entries_handle *)
+			calloc(1, sizeof(struct side_jump_entries_handle));
+	if (!handle)
+		return NULL;
+	pthread_mutex_lock(&side_event_lock);
+	qsort(start, stop - start, sizeof(struct side_jump_entry), side_jump_entry_cmp);
+	handle->start = start;
+	handle->stop = stop;
+	for (entry = start; entry < stop; entry++) {
+		struct side_event_state *event_state = side_jump_entry_key(entry);
+		struct side_event_state_0 *es0;
+
+		if (side_unlikely(event_state->version != 0))
+			abort();
+		es0 = side_container_of(event_state, struct side_event_state_0, parent);
+		side_jump_entry_patch(entry, side_event_jump_enabled(es0));
+	}
+	side_list_insert_node_tail(&side_jump_entries_list, &handle->node);
+	side_jump_label_sync_pending();
+	pthread_mutex_unlock(&side_event_lock);
+	return handle;
+}
+
+/* Restore the sites as jumps to the enabled state load. */
+void side_jump_entries_unregister(struct side_jump_entries_handle *handle)
+{
+	struct side_jump_entry *entry;
+
+	if (!handle)
+		return;
+	if (finalized)
+		return;
+	if (!initialized)
+		side_init();
+	pthread_mutex_lock(&side_event_lock);
+	side_list_remove_node(&handle->node);
+	for (entry = handle->start; entry < handle->stop; entry++)
+		side_jump_entry_patch(entry, true);
+	side_jump_label_sync_pending();
+	pthread_mutex_unlock(&side_event_lock);
+	free(handle);
+}
+
+struct side_tracer_handle *side_tracer_event_notification_register_mode(
 		void (*cb)(enum side_tracer_notification notif,
 			struct side_event_description **events, uint32_t nr_events, void *priv),
-		void *priv)
+		void *priv, enum side_tracer_notification_mode mode)
 {
 	struct side_tracer_handle *tracer_handle;
 	struct side_events_register_handle *events_handle;
 
+	switch (mode) {
+	case SIDE_TRACER_NOTIFICATION_MODE_SYNC:
+	case SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_THREAD:
+	case SIDE_TRACER_NOTIFICATION_MODE_DEFERRED_FLUSH:
+		break;
+	default:
+		return NULL;
+	}
 	if (finalized)
 		return NULL;
 	if (!initialized)
@@ -552,15 +2662,43 @@ struct side_tracer_handle *side_tracer_event_notification_register(
 	pthread_mutex_lock(&side_event_lock);
 	tracer_handle->cb = cb;
 	tracer_handle->priv = priv;
+	tracer_handle->mode = mode;
 	side_list_insert_node_tail(&side_tracer_list, &tracer_handle->node);
 	side_list_for_each_entry(events_handle, &side_events_list, node) {
-		cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
-			events_handle->events, events_handle->nr_events, priv);
+		if (mode == SIDE_TRACER_NOTIFICATION_MODE_SYNC)
+			cb(SIDE_TRACER_NOTIFICATION_INSERT_EVENTS,
+				events_handle->events, events_handle->nr_events, priv);
+		else
+			side_tracer_queue_events(tracer_handle,
+				events_handle->events, events_handle->nr_events);
 	}
+	/* Notify the events already registered at once. */
+	side_tracer_flush_events(tracer_handle);
 	pthread_mutex_unlock(&side_event_lock);
 	return tracer_handle;
 }
 
+struct side_tracer_handle *side_tracer_event_notification_register(
+		void (*cb)(enum side_tracer_notification notif,
+			struct side_event_description **events, uint32_t nr_events, void *priv),
+		void *priv)
+{
+	return side_tracer_event_notification_register_mode(cb, priv,
+			SIDE_TRACER_NOTIFICATION_MODE_SYNC);
+}
+
+int side_tracer_event_notification_flush(struct side_tracer_handle *tracer_handle)
+{
+	if (!tracer_handle)
+		return SIDE_ERROR_INVAL;
+	if (finalized)
+		return SIDE_ERROR_EXITING;
+	pthread_mutex_lock(&side_event_lock);
+	side_tracer_flush_events(tracer_handle);
+	pthread_mutex_unlock(&side_event_lock);
+	return SIDE_ERROR_OK;
+}
+
 void side_tracer_event_notification_unregister(struct side_tracer_handle *tracer_handle)
 {
 	struct side_events_register_handle *events_handle;
@@ -570,6 +2708,8 @@ void side_tracer_event_notification_unregister(struct side_tracer_handle *tracer
 	if (!initialized)
 		side_init();
 	pthread_mutex_lock(&side_event_lock);
+	/* Notify pending insertions before removals. */
+	side_tracer_flush_events(tracer_handle);
 	side_list_for_each_entry(events_handle, &side_events_list, node) {
 		tracer_handle->cb(SIDE_TRACER_NOTIFICATION_REMOVE_EVENTS,
 			events_handle->events, events_handle->nr_events,
@@ -580,20 +2720,58 @@ void side_tracer_event_notification_unregister(struct side_tracer_handle *tracer
 	free(tracer_handle);
 }
 
-/* Called with side_statedump_lock held. */
+static
+void statedump_agent_thread_create(void);
+
+/* Called with side_statedump_lock held. */
+static
+struct side_statedump_notification *side_statedump_notification_alloc(void)
+{
+	struct side_statedump_notification *notif;
+
+	if (side_list_empty(&side_statedump_notification_free_list)) {
+		notif = (struct side_statedump_notification *) calloc(1, sizeof(struct side_statedump_notification));
+		if (!notif)
+			abort();
+		return notif;
+	}
+	notif = side_container_of(side_statedump_notification_free_list.node.next,
+			struct side_statedump_notification, node);
+	side_list_remove_node(&notif->node);
+	return notif;
+}
+
+/* Called with side_statedump_lock held. */
+static
+void side_statedump_notification_free(struct side_statedump_notification *notif)
+{
+	side_list_insert_node_head(&side_statedump_notification_free_list, &notif->node);
+}
+
+/*
+ * Called with side_statedump_lock held. A pending request for all keys
+ * covers the requests for specific keys, and a key is only queued once.
+ */
 static
 void queue_statedump_pending(struct side_statedump_request_handle *handle, uint64_t key)
 {
-	struct side_statedump_notification *notif;
+	struct side_statedump_notification *notif, *tmp;
 
-	notif = (struct side_statedump_notification *) calloc(1, sizeof(struct side_statedump_notification));
-	if (!notif)
-		abort();
+	side_list_for_each_entry_safe(notif, tmp, &handle->notification_queue, node) {
+		if (notif->key == SIDE_KEY_MATCH_ALL || notif->key == key)
+			return;
+		if (key == SIDE_KEY_MATCH_ALL) {
+			side_list_remove_node(&notif->node);
+			side_statedump_notification_free(notif);
+		}
+	}
+	notif = side_statedump_notification_alloc();
 	notif->key = key;
 	side_list_insert_node_tail(&handle->notification_queue, &notif->node);
 	if (handle->mode == SIDE_STATEDUMP_MODE_AGENT_THREAD) {
-		(void)__atomic_or_fetch(&statedump_agent_thread.state, AGENT_THREAD_STATE_HANDLE_REQUEST, __ATOMIC_SEQ_CST);
-		pthread_cond_broadcast(&statedump_agent_thread.worker_cond);
+		if (!statedump_agent_thread.nr_threads)
+			statedump_agent_thread_create();
+		pthread_cond_signal(&statedump_agent_thread.worker_cond);
 	}
 }
 
@@ -606,45 +2784,132 @@ void unqueue_statedump_pending(struct side_statedump_request_handle *handle, uin
 	side_list_for_each_entry_safe(notif, tmp, &handle->notification_queue, node) {
 		if (key == SIDE_KEY_MATCH_ALL || key == notif->key) {
 			side_list_remove_node(&notif->node);
-			free(notif);
+			side_statedump_notification_free(notif);
 		}
 	}
 }
 
 static
-void side_statedump_run(struct side_statedump_request_handle *handle,
-		struct side_statedump_notification *notif)
+uint64_t side_monotonic_ns(void)
 {
-	side_statedump_event_call(side_statedump_begin, &notif->key,
-		side_arg_list(side_arg_string(handle->name)));
-	/* Invoke the state dump callback specifically for the tracer key. */
-	handle->cb(&notif->key);
-	side_statedump_event_call(side_statedump_end, &notif->key,
-		side_arg_list(side_arg_string(handle->name)));
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+bool side_statedump_cursor_budget_exhausted(const struct side_statedump_cursor *cursor)
+{
+	if (cursor->event_budget && cursor->nr_events >= cursor->event_budget)
+		return true;
+	if (cursor->deadline && side_monotonic_ns() >= cursor->deadline)
+		return true;
+	return false;
 }
 
+/*
+ * Run the request in progress on the handle, or the pending requests
+ * if there is none. The state dump callback is invoked once for all the
+ * requested keys. Returns true if a resumable state dump is still in
+ * progress.
+ */
 static
-void _side_statedump_run_pending_requests(struct side_statedump_request_handle *handle)
+bool side_statedump_run(struct side_statedump_request_handle *handle,
+		uint64_t time_budget_ns, uint64_t event_budget)
 {
+	enum side_statedump_status status = SIDE_STATEDUMP_STATUS_DONE;
+	struct side_statedump_request *request = &handle->request;
 	struct side_statedump_notification *notif, *tmp;
-	DEFINE_SIDE_LIST_HEAD(tmp_head);
+	uint64_t start, ns, max;
+	bool begin = false;
 
 	pthread_mutex_lock(&side_statedump_lock);
-	side_list_splice(&handle->notification_queue, &tmp_head);
-	side_list_head_init(&handle->notification_queue);
+	if (side_list_empty(&request->notifications)) {
+		side_list_splice(&handle->notification_queue, &request->notifications);
+		side_list_head_init(&handle->notification_queue);
+		begin = true;
+	}
 	pthread_mutex_unlock(&side_statedump_lock);
 
-	/* We are now sole owner of the tmp_head list. */
-	side_list_for_each_entry(notif, &tmp_head, node)
-		side_statedump_run(handle, notif);
-	side_list_for_each_entry_safe(notif, tmp, &tmp_head, node)
-		free(notif);
+	/* We are now sole owner of the request notifications list. */
+	if (side_list_empty(&request->notifications))
+		return false;
+	start = side_clock_read();
+	if (begin) {
+		handle->run_ns = 0;
+		side_statedump_event_call(side_statedump_begin, request,
+			side_arg_list(side_arg_string(handle->name)));
+	}
+	if (handle->resumable_cb) {
+		struct side_statedump_cursor *cursor = &handle->cursor;
+
+		if (begin)
+			cursor->position = 0;
+		cursor->deadline = time_budget_ns ? side_monotonic_ns() + time_budget_ns : 0;
+		cursor->event_budget = event_budget;
+		cursor->nr_events = 0;
+		status = handle->resumable_cb(request, cursor);
+	} else {
+		handle->cb(request);
+	}
+	if (status == SIDE_STATEDUMP_STATUS_MORE) {
+		handle->run_ns += side_clock_read() - start;
+		return true;
+	}
+	side_statedump_event_call(side_statedump_end, request,
+		side_arg_list(side_arg_string(handle->name)));
+	ns = handle->run_ns + side_clock_read() - start;
+	(void) __atomic_add_fetch(&handle->nr_statedumps, 1, __ATOMIC_RELAXED);
+	(void) __atomic_add_fetch(&handle->statedump_ns, ns, __ATOMIC_RELAXED);
+	/* A handle is run by a single thread at a time. */
+	max = __atomic_load_n(&handle->statedump_max_ns, __ATOMIC_RELAXED);
+	if (ns > max)
+		__atomic_store_n(&handle->statedump_max_ns, ns, __ATOMIC_RELAXED);
 
-	if (handle->mode == SIDE_STATEDUMP_MODE_AGENT_THREAD) {
-		pthread_mutex_lock(&side_statedump_lock);
-		pthread_cond_broadcast(&statedump_agent_thread.waiter_cond);
-		pthread_mutex_unlock(&side_statedump_lock);
+	pthread_mutex_lock(&side_statedump_lock);
+	side_list_for_each_entry_safe(notif, tmp, &request->notifications, node)
+		side_statedump_notification_free(notif);
+	side_list_head_init(&request->notifications);
+	pthread_mutex_unlock(&side_statedump_lock);
+	return false;
+}
+
+/*
+ * Called with side_statedump_lock held. Returns the first agent thread
+ * handle with pending requests which is not claimed by another agent
+ * thread, or NULL.
+ */
+static
+struct side_statedump_request_handle *statedump_agent_claim_handle(void)
+{
+	struct side_statedump_request_handle *handle;
+
+	side_list_for_each_entry(handle, &side_statedump_list, node) {
+		if (handle->mode != SIDE_STATEDUMP_MODE_AGENT_THREAD || handle->running)
+			continue;
+		if (side_list_empty(&handle->notification_queue))
+			continue;
+		handle->running = true;
+		return handle;
+	}
+	return NULL;
+}
+
+static
+void statedump_agent_pause(void)
+{
+	(void)__atomic_add_fetch(&statedump_agent_thread.nr_paused, 1, __ATOMIC_SEQ_CST);
+	/* Only side_before_fork() waits for the acknowledge. */
+	(void) futex(&statedump_agent_thread.nr_paused, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	for (;;) {
+		int32_t state = __atomic_load_n(&statedump_agent_thread.state, __ATOMIC_SEQ_CST);
+
+		if (!(state & AGENT_THREAD_STATE_PAUSE))
+			break;
+		(void) futex(&statedump_agent_thread.state, FUTEX_WAIT_PRIVATE, state, NULL, NULL, 0);
 	}
+	(void)__atomic_sub_fetch(&statedump_agent_thread.nr_paused, 1, __ATOMIC_SEQ_CST);
 }
 
 static
@@ -653,40 +2918,45 @@ void *statedump_agent_func(void *arg __attribute__((unused)))
 	for (;;) {
 		struct side_statedump_request_handle *handle;
 		struct side_rcu_read_state rcu_read_state;
-		enum agent_thread_state state;
+		int32_t state;
 
 		pthread_mutex_lock(&side_statedump_lock);
 		for (;;) {
 			state = __atomic_load_n(&statedump_agent_thread.state, __ATOMIC_SEQ_CST);
-			if (state == AGENT_THREAD_STATE_BLOCKED)
-				pthread_cond_wait(&statedump_agent_thread.worker_cond, &side_statedump_lock);
-			else
+			if (state != AGENT_THREAD_STATE_BLOCKED)
+				break;
+			handle = statedump_agent_claim_handle();
+			if (handle)
 				break;
+			pthread_cond_wait(&statedump_agent_thread.worker_cond, &side_statedump_lock);
 		}
-		pthread_mutex_unlock(&side_statedump_lock);
-		if (state & AGENT_THREAD_STATE_EXIT)
-			break;
-		if (state & AGENT_THREAD_STATE_PAUSE) {
-			int attempt = 0;
-
-			(void)__atomic_or_fetch(&statedump_agent_thread.state, AGENT_THREAD_STATE_PAUSE_ACK, __ATOMIC_SEQ_CST);
-			for (;;) {
-				state = __atomic_load_n(&statedump_agent_thread.state, __ATOMIC_SEQ_CST);
-				if (!(state & AGENT_THREAD_STATE_PAUSE))
-					break;
-				if (attempt > SIDE_RETRY_BUSY_LOOP_ATTEMPTS) {
-					(void)poll(NULL, 0, SIDE_RETRY_DELAY_MS);
-					continue;
-				}
-				attempt++;
-				side_cpu_relax();
-			}
+		if (state != AGENT_THREAD_STATE_BLOCKED) {
+			pthread_mutex_unlock(&side_statedump_lock);
+			if (state & AGENT_THREAD_STATE_EXIT)
+				break;
+			statedump_agent_pause();
 			continue;
 		}
-		(void)__atomic_and_fetch(&statedump_agent_thread.state, ~AGENT_THREAD_STATE_HANDLE_REQUEST, __ATOMIC_SEQ_CST);
+		/*
+		 * The handle is removed from the list with
+		 * side_statedump_lock held, and freed after a grace
+		 * period: entering the read-side critical section before
+		 * releasing the lock keeps it alive while it runs.
+		 */
 		side_rcu_read_begin(&statedump_rcu_gp, &rcu_read_state);
-		side_list_for_each_entry_rcu(handle, &side_statedump_list, node)
-			_side_statedump_run_pending_requests(handle);
+		pthread_mutex_unlock(&side_statedump_lock);
+
+		/* Agent threads run resumable state dumps without budget. */
+		while (side_statedump_run(handle, 0, 0))
+			;
+
+		pthread_mutex_lock(&side_statedump_lock);
+		handle->running = false;
+		/* Requests queued while running can be claimed by any thread. */
+		if (!side_list_empty(&handle->notification_queue))
+			pthread_cond_signal(&statedump_agent_thread.worker_cond);
+		pthread_cond_broadcast(&statedump_agent_thread.waiter_cond);
+		pthread_mutex_unlock(&side_statedump_lock);
 		side_rcu_read_end(&statedump_rcu_gp, &rcu_read_state);
 	}
 	return NULL;
@@ -698,22 +2968,42 @@ void statedump_agent_thread_init(void)
 	pthread_cond_init(&statedump_agent_thread.worker_cond, NULL);
 	pthread_cond_init(&statedump_agent_thread.waiter_cond, NULL);
 	statedump_agent_thread.state = AGENT_THREAD_STATE_BLOCKED;
+	statedump_agent_thread.nr_threads = 0;
+	statedump_agent_thread.nr_paused = 0;
 }
 
-/* Called with side_agent_thread_lock and side_statedump_lock held. */
 static
-void statedump_agent_thread_get(void)
+void statedump_agent_thread_create(void)
 {
-	int ret;
+	pthread_attr_t attr;
+	unsigned int i;
+
+	if (pthread_attr_init(&attr))
+		abort();
+	if (statedump_agent_cpuset_set &&
+			pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &statedump_agent_cpuset))
+		abort();
+	/* Read by side_before_fork() without side_statedump_lock. */
+	__atomic_store_n(&statedump_agent_thread.nr_threads, statedump_agent_nr_threads, __ATOMIC_SEQ_CST);
+	for (i = 0; i < statedump_agent_nr_threads; i++) {
+		if (pthread_create(&statedump_agent_thread.id[i], &attr,
+				statedump_agent_func, NULL))
+			abort();
+	}
+	if (pthread_attr_destroy(&attr))
+		abort();
+}
 
+/*
+ * Called with side_agent_thread_lock and side_statedump_lock held. The
+ * threads are created when a request is queued.
+ */
+static
+void statedump_agent_thread_get(void)
+{
 	if (statedump_agent_thread.ref++)
 		return;
 	statedump_agent_thread_init();
-	ret = pthread_create(&statedump_agent_thread.id, NULL,
-			statedump_agent_func, NULL);
-	if (ret) {
-		abort();
-	}
 }
 
 /*
@@ -744,19 +3034,23 @@ void statedump_agent_thread_fini(void)
 static
 void statedump_agent_thread_join(void)
 {
-	int ret;
-	void *retval;
+	unsigned int i;
 
-	ret = pthread_join(statedump_agent_thread.id, &retval);
-	if (ret) {
-		abort();
+	for (i = 0; i < statedump_agent_thread.nr_threads; i++) {
+		void *retval;
+
+		if (pthread_join(statedump_agent_thread.id[i], &retval))
+			abort();
 	}
 	statedump_agent_thread_fini();
 }
 
+static
 struct side_statedump_request_handle *
-	side_statedump_request_notification_register(const char *state_name,
+	_side_statedump_request_notification_register(const char *state_name,
 		void (*statedump_cb)(void *statedump_request_key),
+		enum side_statedump_status (*resumable_cb)(void *statedump_request_key,
+			struct side_statedump_cursor *cursor),
 		enum side_statedump_mode mode)
 {
 	struct side_statedump_request_handle *handle;
@@ -774,9 +3068,13 @@ struct side_statedump_request_handle *
 	if (!name)
 		goto name_nomem;
 	handle->cb = statedump_cb;
+	handle->resumable_cb = resumable_cb;
 	handle->name = name;
 	handle->mode = mode;
 	side_list_head_init(&handle->notification_queue);
+	side_list_head_init(&handle->request.notifications);
+	if (resumable_cb)
+		handle->request.cursor = &handle->cursor;
 
 	if (mode == SIDE_STATEDUMP_MODE_AGENT_THREAD)
 		pthread_mutex_lock(&side_agent_thread_lock);
@@ -792,7 +3090,7 @@ struct side_statedump_request_handle *
 		pthread_mutex_unlock(&side_agent_thread_lock);
 
 		pthread_mutex_lock(&side_statedump_lock);
-		while (!side_list_empty(&handle->notification_queue))
+		while (!side_list_empty(&handle->notification_queue) || handle->running)
 			pthread_cond_wait(&statedump_agent_thread.waiter_cond, &side_statedump_lock);
 		pthread_mutex_unlock(&side_statedump_lock);
 	}
@@ -804,8 +3102,28 @@ name_nomem:
 	return NULL;
 }
 
+struct side_statedump_request_handle *
+	side_statedump_request_notification_register(const char *state_name,
+		void (*statedump_cb)(void *statedump_request_key),
+		enum side_statedump_mode mode)
+{
+	return _side_statedump_request_notification_register(state_name,
+			statedump_cb, NULL, mode);
+}
+
+struct side_statedump_request_handle *
+	side_statedump_request_resumable_notification_register(const char *state_name,
+		enum side_statedump_status (*statedump_cb)(void *statedump_request_key,
+			struct side_statedump_cursor *cursor),
+		enum side_statedump_mode mode)
+{
+	return _side_statedump_request_notification_register(state_name,
+			NULL, statedump_cb, mode);
+}
+
 void side_statedump_request_notification_unregister(struct side_statedump_request_handle *handle)
 {
+	struct side_statedump_notification *notif, *tmp;
 	bool join = false;
 
 	if (finalized)
@@ -827,6 +3145,11 @@ void side_statedump_request_notification_unregister(struct side_statedump_reques
 		pthread_mutex_unlock(&side_agent_thread_lock);
 
 	side_rcu_wait_grace_period(&statedump_rcu_gp);
+	/* Abandon the resumable state dump in progress. */
+	pthread_mutex_lock(&side_statedump_lock);
+	side_list_for_each_entry_safe(notif, tmp, &handle->request.notifications, node)
+		side_statedump_notification_free(notif);
+	pthread_mutex_unlock(&side_statedump_lock);
 	free(handle->name);
 	free(handle);
 }
@@ -839,7 +3162,8 @@ bool side_statedump_poll_pending_requests(struct side_statedump_request_handle *
 	if (handle->mode != SIDE_STATEDUMP_MODE_POLLING)
 		return false;
 	pthread_mutex_lock(&side_statedump_lock);
-	ret = !side_list_empty(&handle->notification_queue);
+	ret = !side_list_empty(&handle->notification_queue) ||
+		!side_list_empty(&handle->request.notifications);
 	pthread_mutex_unlock(&side_statedump_lock);
 	return ret;
 }
@@ -852,7 +3176,17 @@ int side_statedump_run_pending_requests(struct side_statedump_request_handle *ha
 {
 	if (handle->mode != SIDE_STATEDUMP_MODE_POLLING)
 		return SIDE_ERROR_INVAL;
-	_side_statedump_run_pending_requests(handle);
+	while (side_statedump_run(handle, 0, 0))
+		;
+	return SIDE_ERROR_OK;
+}
+
+int side_statedump_run_pending_requests_budget(struct side_statedump_request_handle *handle,
+		uint64_t time_budget_ns, uint64_t event_budget)
+{
+	if (handle->mode != SIDE_STATEDUMP_MODE_POLLING)
+		return SIDE_ERROR_INVAL;
+	(void) side_statedump_run(handle, time_budget_ns, event_budget);
 	return SIDE_ERROR_OK;
 }
 
@@ -868,7 +3202,7 @@ int side_tracer_statedump_request(uint64_t key)
 	pthread_mutex_lock(&side_statedump_lock);
 	side_list_for_each_entry(handle, &side_statedump_list, node)
 		queue_statedump_pending(handle, key);
-	pthread_mutex_lock(&side_statedump_lock);
+	pthread_mutex_unlock(&side_statedump_lock);
 	return SIDE_ERROR_OK;
 }
 
@@ -884,7 +3218,7 @@ int side_tracer_statedump_request_cancel(uint64_t key)
 	pthread_mutex_lock(&side_statedump_lock);
 	side_list_for_each_entry(handle, &side_statedump_list, node)
 		unqueue_statedump_pending(handle, key);
-	pthread_mutex_lock(&side_statedump_lock);
+	pthread_mutex_unlock(&side_statedump_lock);
 	return SIDE_ERROR_OK;
 }
 
@@ -907,6 +3241,225 @@ end:
 	return ret;
 }
 
+int side_stats_get(struct side_stats *stats)
+{
+	uint64_t nr_waits, wait_ns, max_wait_ns;
+
+	if (!stats)
+		return SIDE_ERROR_INVAL;
+	if (!initialized)
+		side_init();
+	side_rcu_gp_stats(&event_rcu_gp, &stats->nr_grace_periods,
+			&stats->grace_period_ns, &stats->grace_period_max_ns);
+	side_rcu_gp_stats(&statedump_rcu_gp, &nr_waits, &wait_ns, &max_wait_ns);
+	stats->nr_grace_periods += nr_waits;
+	stats->grace_period_ns += wait_ns;
+	if (max_wait_ns > stats->grace_period_max_ns)
+		stats->grace_period_max_ns = max_wait_ns;
+	return SIDE_ERROR_OK;
+}
+
+int side_event_stats_get(const struct side_event_description *desc,
+		struct side_event_stats *stats)
+{
+	struct side_event_registry_entry *entry;
+	int ret = SIDE_ERROR_OK;
+
+	if (!desc || !stats)
+		return SIDE_ERROR_INVAL;
+	if (!side_stats_enabled)
+		return SIDE_ERROR_NOENT;
+	pthread_mutex_lock(&side_event_lock);
+	entry = side_event_registry_lookup_desc(desc);
+	if (!entry) {
+		ret = SIDE_ERROR_NOENT;
+		goto end;
+	}
+	stats->nr_hits = entry->stats ? side_event_stats_nr_hits(entry->stats) : 0;
+end:
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_tracer_callback_stats_get(const struct side_event_description *desc,
+		void *call, void *priv, uint64_t key,
+		struct side_callback_stats *stats)
+{
+	struct side_event_registry_entry *entry;
+	struct side_callback_stats_state *cb_stats = NULL;
+	int ret = SIDE_ERROR_OK;
+
+	if (!desc || !stats)
+		return SIDE_ERROR_INVAL;
+	if (!side_stats_enabled)
+		return SIDE_ERROR_NOENT;
+	pthread_mutex_lock(&side_event_lock);
+	entry = side_event_registry_lookup_desc(desc);
+	if (entry && entry->stats)
+		cb_stats = side_event_stats_callback_lookup(entry->stats, call, priv, key);
+	if (!cb_stats) {
+		ret = SIDE_ERROR_NOENT;
+		goto end;
+	}
+	stats->nr_samples = __atomic_load_n(&cb_stats->nr_samples, __ATOMIC_RELAXED);
+	stats->sampled_ns = __atomic_load_n(&cb_stats->sampled_ns, __ATOMIC_RELAXED);
+end:
+	pthread_mutex_unlock(&side_event_lock);
+	return ret;
+}
+
+int side_statedump_stats_get(struct side_statedump_request_handle *handle,
+		struct side_statedump_stats *stats)
+{
+	if (!handle || !stats)
+		return SIDE_ERROR_INVAL;
+	stats->nr_statedumps = __atomic_load_n(&handle->nr_statedumps, __ATOMIC_RELAXED);
+	stats->statedump_ns = __atomic_load_n(&handle->statedump_ns, __ATOMIC_RELAXED);
+	stats->statedump_max_ns = __atomic_load_n(&handle->statedump_max_ns, __ATOMIC_RELAXED);
+	return SIDE_ERROR_OK;
+}
+
+/*
+ * Emit the performance counters. Events are walked with the event lock
+ * held, which keeps their descriptions and counters alive, and
+ * state dump handles within a statedump RCU read-side critical section.
+ */
+static
+void side_stats_dump(void *statedump_request_key)
+{
+	struct side_statedump_request_handle *handle;
+	struct side_events_register_handle *events_handle;
+	struct side_rcu_read_state rcu_read_state;
+	struct side_stats stats;
+	uint32_t i;
+
+	(void) side_stats_get(&stats);
+	side_statedump_event_call(side_stats_grace_periods, statedump_request_key,
+		side_arg_list(side_arg_u64(stats.nr_grace_periods),
+			side_arg_u64(stats.grace_period_ns),
+			side_arg_u64(stats.grace_period_max_ns)));
+	side_rcu_read_begin(&statedump_rcu_gp, &rcu_read_state);
+	side_list_for_each_entry_rcu(handle, &side_statedump_list, node) {
+		struct side_statedump_stats statedump_stats;
+
+		(void) side_statedump_stats_get(handle, &statedump_stats);
+		side_statedump_event_call(side_stats_statedump, statedump_request_key,
+			side_arg_list(side_arg_string(handle->name),
+				side_arg_u64(statedump_stats.nr_statedumps),
+				side_arg_u64(statedump_stats.statedump_ns),
+				side_arg_u64(statedump_stats.statedump_max_ns)));
+	}
+	side_rcu_read_end(&statedump_rcu_gp, &rcu_read_state);
+	if (!side_stats_enabled)
+		return;
+	pthread_mutex_lock(&side_event_lock);
+	side_list_for_each_entry(events_handle, &side_events_list, node) {
+		for (i = 0; i < events_handle->nr_events; i++) {
+			const struct side_event_registry_entry *entry = &events_handle->registry_entries[i];
+			struct side_callback_stats_state *cb_stats;
+			const char *provider, *event;
+
+			if (!events_handle->events[i] || !entry->stats)
+				continue;
+			provider = side_ptr_get(entry->desc->provider_name);
+			event = side_ptr_get(entry->desc->event_name);
+			side_statedump_event_call(side_stats_event, statedump_request_key,
+				side_arg_list(side_arg_string(provider), side_arg_string(event),
+					side_arg_u64(side_event_stats_nr_hits(entry->stats))));
+			side_list_for_each_entry(cb_stats, &entry->stats->callbacks, node) {
+				side_statedump_event_call(side_stats_callback, statedump_request_key,
+					side_arg_list(side_arg_string(provider), side_arg_string(event),
+						side_arg_pointer(cb_stats->call),
+						side_arg_pointer(cb_stats->priv),
+						side_arg_u64(cb_stats->key),
+						side_arg_u64(__atomic_load_n(&cb_stats->nr_samples, __ATOMIC_RELAXED)),
+						side_arg_u64(__atomic_load_n(&cb_stats->sampled_ns, __ATOMIC_RELAXED))));
+			}
+		}
+	}
+	pthread_mutex_unlock(&side_event_lock);
+}
+
+static
+void *side_stats_thread_func(void *arg __attribute__((unused)))
+{
+	struct timespec deadline;
+
+	if (!side_stats_statedump_handle)
+		side_stats_statedump_handle = side_statedump_request_notification_register("side_stats",
+				side_stats_dump, SIDE_STATEDUMP_MODE_POLLING);
+	if (!side_stats_statedump_handle)
+		return NULL;
+	(void) clock_gettime(CLOCK_MONOTONIC, &deadline);
+	pthread_mutex_lock(&side_stats_thread_lock);
+	for (;;) {
+		deadline.tv_sec += side_stats_period_ms / 1000;
+		deadline.tv_nsec += (side_stats_period_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while (!side_stats_thread.exit &&
+		       pthread_cond_timedwait(&side_stats_thread.cond, &side_stats_thread_lock,
+				&deadline) != ETIMEDOUT)
+			;
+		if (side_stats_thread.exit)
+			break;
+		pthread_mutex_unlock(&side_stats_thread_lock);
+
+		pthread_mutex_lock(&side_statedump_lock);
+		queue_statedump_pending(side_stats_statedump_handle, SIDE_KEY_MATCH_ALL);
+		pthread_mutex_unlock(&side_statedump_lock);
+		(void) side_statedump_run_pending_requests(side_stats_statedump_handle);
+
+		pthread_mutex_lock(&side_stats_thread_lock);
+	}
+	pthread_mutex_unlock(&side_stats_thread_lock);
+	return NULL;
+}
+
+/* Called with side_stats_thread_lock held. */
+static
+void side_stats_thread_create(void)
+{
+	pthread_condattr_t attr;
+
+	if (pthread_condattr_init(&attr))
+		abort();
+	if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC))
+		abort();
+	if (pthread_cond_init(&side_stats_thread.cond, &attr))
+		abort();
+	if (pthread_condattr_destroy(&attr))
+		abort();
+	side_stats_thread.exit = false;
+	if (pthread_create(&side_stats_thread.id, NULL, side_stats_thread_func, NULL))
+		abort();
+	side_stats_thread.created = true;
+}
+
+static
+void side_stats_thread_exit(void)
+{
+	pthread_mutex_lock(&side_stats_thread_lock);
+	if (!side_stats_thread.created) {
+		pthread_mutex_unlock(&side_stats_thread_lock);
+		return;
+	}
+	side_stats_thread.exit = true;
+	pthread_cond_signal(&side_stats_thread.cond);
+	pthread_mutex_unlock(&side_stats_thread_lock);
+	if (pthread_join(side_stats_thread.id, NULL))
+		abort();
+	if (pthread_cond_destroy(&side_stats_thread.cond))
+		abort();
+	side_stats_thread.created = false;
+	if (side_stats_statedump_handle) {
+		side_statedump_request_notification_unregister(side_stats_statedump_handle);
+		side_stats_statedump_handle = NULL;
+	}
+}
+
 /*
  * Use of pthread_atfork depends on glibc 2.24 to eliminate hangs when
  * waiting for the agent thread if the agent thread calls malloc. This
@@ -917,67 +3470,207 @@ end:
 static
 void side_before_fork(void)
 {
-	int attempt = 0;
-
+	side_rcu_before_fork(&event_rcu_gp);
+	side_rcu_before_fork(&statedump_rcu_gp);
+	side_slab_before_fork();
+	pthread_mutex_lock(&side_stats_thread_lock);
+	pthread_mutex_lock(&side_notification_thread_lock);
 	pthread_mutex_lock(&side_agent_thread_lock);
 	if (!statedump_agent_thread.ref)
 		return;
-	/* Pause agent thread. */
+	/* Pause agent threads. */
 	pthread_mutex_lock(&side_statedump_lock);
 	(void)__atomic_or_fetch(&statedump_agent_thread.state, AGENT_THREAD_STATE_PAUSE, __ATOMIC_SEQ_CST);
 	pthread_cond_broadcast(&statedump_agent_thread.worker_cond);
 	pthread_mutex_unlock(&side_statedump_lock);
-	/* Wait for agent thread acknowledge. */
-	while (!(__atomic_load_n(&statedump_agent_thread.state, __ATOMIC_SEQ_CST) & AGENT_THREAD_STATE_PAUSE_ACK)) {
-		if (attempt > SIDE_RETRY_BUSY_LOOP_ATTEMPTS) {
-			(void)poll(NULL, 0, SIDE_RETRY_DELAY_MS);
-			continue;
-		}
-		attempt++;
-		side_cpu_relax();
+	/* Wait for all agent threads to acknowledge. */
+	for (;;) {
+		int32_t nr_paused = __atomic_load_n(&statedump_agent_thread.nr_paused, __ATOMIC_SEQ_CST);
+
+		if (nr_paused == (int32_t) __atomic_load_n(&statedump_agent_thread.nr_threads, __ATOMIC_SEQ_CST))
+			break;
+		(void) futex(&statedump_agent_thread.nr_paused, FUTEX_WAIT_PRIVATE, nr_paused, NULL, NULL, 0);
 	}
 }
 
 static
 void side_after_fork_parent(void)
 {
-	if (statedump_agent_thread.ref)
+	if (statedump_agent_thread.ref) {
 		(void)__atomic_and_fetch(&statedump_agent_thread.state,
-			~(AGENT_THREAD_STATE_PAUSE | AGENT_THREAD_STATE_PAUSE_ACK),
-			__ATOMIC_SEQ_CST);
+			~AGENT_THREAD_STATE_PAUSE, __ATOMIC_SEQ_CST);
+		(void) futex(&statedump_agent_thread.state, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+	}
 	pthread_mutex_unlock(&side_agent_thread_lock);
+	pthread_mutex_unlock(&side_notification_thread_lock);
+	pthread_mutex_unlock(&side_stats_thread_lock);
+	side_slab_after_fork_parent();
+	side_rcu_after_fork_parent(&statedump_rcu_gp);
+	side_rcu_after_fork_parent(&event_rcu_gp);
 }
 
 /*
- * The agent thread does not exist in the child process after a fork.
- * Re-initialize its data structures and create a new agent thread.
+ * The agent threads do not exist in the child process after a fork.
+ * Re-initialize their data structures. New agent threads are created
+ * when the child queues a request, or now if requests are pending.
  */
 static
 void side_after_fork_child(void)
 {
 	if (statedump_agent_thread.ref) {
-		int ret;
+		struct side_statedump_request_handle *handle;
 
 		statedump_agent_thread_fini();
 		statedump_agent_thread_init();
-		ret = pthread_create(&statedump_agent_thread.id, NULL,
-				statedump_agent_func, NULL);
-		if (ret) {
-			abort();
+		side_list_for_each_entry(handle, &side_statedump_list, node) {
+			if (handle->mode == SIDE_STATEDUMP_MODE_AGENT_THREAD &&
+					!side_list_empty(&handle->notification_queue)) {
+				statedump_agent_thread_create();
+				break;
+			}
 		}
 	}
 	pthread_mutex_unlock(&side_agent_thread_lock);
+	/*
+	 * The notification thread does not exist in the child process. It
+	 * is created again when events are queued, and pending
+	 * notifications are delivered by the next flush.
+	 */
+	side_notification_thread.created = false;
+	side_notification_thread.pending = false;
+	pthread_mutex_unlock(&side_notification_thread_lock);
+	/* The stats thread keeps emitting the counters of the child. */
+	if (side_stats_thread.created)
+		side_stats_thread_create();
+	pthread_mutex_unlock(&side_stats_thread_lock);
+	side_slab_after_fork_child();
+	side_rcu_after_fork_child(&statedump_rcu_gp);
+	side_rcu_after_fork_child(&event_rcu_gp);
+}
+
+enum side_rcu_read_mode side_rcu_get_read_mode(void)
+{
+	if (!initialized)
+		side_init();
+	if (side_rcu_rseq_membarrier_available)
+		return SIDE_RCU_READ_MODE_RSEQ_MEMBARRIER;
+	if (side_rcu_membarrier_available)
+		return SIDE_RCU_READ_MODE_MEMBARRIER;
+	return SIDE_RCU_READ_MODE_ATOMIC;
+}
+
+/* Parse a CPU list such as "0-3,8". */
+static
+bool side_parse_cpu_list(const char *str, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+	for (;;) {
+		unsigned long first, last;
+		char *end;
+
+		first = strtoul(str, &end, 10);
+		if (end == str)
+			return false;
+		last = first;
+		if (*end == '-') {
+			str = end + 1;
+			last = strtoul(str, &end, 10);
+			if (end == str || last < first)
+				return false;
+		}
+		if (last >= CPU_SETSIZE)
+			return false;
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+		if (*end == '\0')
+			return CPU_COUNT(set) != 0;
+		if (*end != ',')
+			return false;
+		str = end + 1;
+	}
+}
+
+static
+void statedump_notification_prealloc(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&side_statedump_lock);
+	for (i = 0; i < SIDE_STATEDUMP_NOTIFICATION_PREALLOC; i++) {
+		struct side_statedump_notification *notif;
+
+		notif = (struct side_statedump_notification *) calloc(1, sizeof(struct side_statedump_notification));
+		if (!notif)
+			abort();
+		side_statedump_notification_free(notif);
+	}
+	pthread_mutex_unlock(&side_statedump_lock);
+}
+
+static
+void statedump_agent_config_init(void)
+{
+	const char *env;
+
+	env = getenv("LIBSIDE_STATEDUMP_AGENT_THREADS");
+	if (env) {
+		unsigned long nr;
+		char *end;
+
+		nr = strtoul(env, &end, 10);
+		if (*env && !*end && nr >= 1 && nr <= SIDE_STATEDUMP_AGENT_MAX_THREADS)
+			statedump_agent_nr_threads = nr;
+	}
+	env = getenv("LIBSIDE_STATEDUMP_AGENT_CPUS");
+	if (env)
+		statedump_agent_cpuset_set = side_parse_cpu_list(env, &statedump_agent_cpuset);
+	env = getenv("LIBSIDE_TRACER_NOTIFICATION_DELAY_MS");
+	if (env) {
+		unsigned long delay;
+		char *end;
+
+		delay = strtoul(env, &end, 10);
+		if (*env && !*end && delay <= INT_MAX)
+			side_notification_delay_ms = delay;
+	}
+	env = getenv("LIBSIDE_STATS_PERIOD_MS");
+	if (env) {
+		unsigned long period;
+		char *end;
+
+		period = strtoul(env, &end, 10);
+		if (*env && !*end && period <= INT_MAX)
+			side_stats_period_ms = period;
+	}
 }
 
 void side_init(void)
 {
 	if (initialized)
 		return;
+	side_clock_init();
+	side_stats_init();
 	side_rcu_gp_init(&event_rcu_gp);
 	side_rcu_gp_init(&statedump_rcu_gp);
+	{
+		const char *env = getenv("LIBSIDE_JUMP_LABEL");
+
+		/* Static key sites can be left unpatched with LIBSIDE_JUMP_LABEL=0. */
+		if (!env || strcmp(env, "0"))
+			jump_label_available = side_jump_label_init();
+	}
+	statedump_agent_config_init();
+	statedump_notification_prealloc();
+	side_user_events_init(&event_rcu_gp);
+	type_visitor_init();
 	if (pthread_atfork(side_before_fork, side_after_fork_parent, side_after_fork_child))
 		abort();
 	initialized = true;
+	if (side_stats_period_ms) {
+		pthread_mutex_lock(&side_stats_thread_lock);
+		side_stats_thread_create();
+		pthread_mutex_unlock(&side_stats_thread_lock);
+	}
 }
 
 /*
@@ -988,12 +3681,24 @@ void side_init(void)
 void side_exit(void)
 {
 	struct side_events_register_handle *handle, *tmp;
+	struct side_statedump_notification *notif, *tmp_notif;
 
 	if (finalized)
 		return;
+	side_stats_thread_exit();
+	side_notification_thread_exit();
 	side_list_for_each_entry_safe(handle, tmp, &side_events_list, node)
 		side_events_unregister(handle);
 	side_rcu_gp_exit(&event_rcu_gp);
 	side_rcu_gp_exit(&statedump_rcu_gp);
+	side_user_events_exit();
+	side_event_registry_exit();
+	side_type_intern_exit();
+	free(side_key_loglevels);
+	side_key_loglevels = NULL;
+	nr_side_key_loglevels = 0;
+	side_list_for_each_entry_safe(notif, tmp_notif, &side_statedump_notification_free_list, node)
+		free(notif);
+	side_list_head_init(&side_statedump_notification_free_list);
 	finalized = true;
 }
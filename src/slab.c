@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+/* Size classes: SIDE_SLAB_ALIGN << 0 to SIDE_SLAB_ALIGN << (SIDE_SLAB_NR_CLASSES - 1). */
+#define SIDE_SLAB_NR_CLASSES	7
+#define SIDE_SLAB_CHUNK_SIZE	(64 * 1024)
+
+struct side_slab_free_object {
+	struct side_slab_free_object *next;
+};
+
+struct side_slab_class {
+	struct side_slab_free_object *free_list;
+	char *pos;		/* Next unused object in the current chunk. */
+	char *end;		/* End of the current chunk. */
+};
+
+static struct side_slab_class slab_classes[SIDE_SLAB_NR_CLASSES];
+static pthread_mutex_t side_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the size class index, or -1 if too large for the slab. */
+static
+int side_slab_class_index(size_t len)
+{
+	size_t size = SIDE_SLAB_ALIGN;
+	int i;
+
+	for (i = 0; i < SIDE_SLAB_NR_CLASSES; i++, size <<= 1) {
+		if (len <= size)
+			return i;
+	}
+	return -1;
+}
+
+void *side_slab_zalloc(size_t len)
+{
+	size_t size;
+	void *ptr;
+	int index;
+
+	index = side_slab_class_index(len);
+	if (index < 0) {
+		if (posix_memalign(&ptr, SIDE_SLAB_ALIGN, len))
+			return NULL;
+		memset(ptr, 0, len);
+		return ptr;
+	}
+	size = (size_t) SIDE_SLAB_ALIGN << index;
+	pthread_mutex_lock(&side_slab_lock);
+	if (slab_classes[index].free_list) {
+		ptr = slab_classes[index].free_list;
+		slab_classes[index].free_list = slab_classes[index].free_list->next;
+	} else {
+		/* Chunks are never freed. */
+		if (slab_classes[index].pos == slab_classes[index].end) {
+			void *chunk;
+
+			if (posix_memalign(&chunk, SIDE_SLAB_ALIGN, SIDE_SLAB_CHUNK_SIZE)) {
+				pthread_mutex_unlock(&side_slab_lock);
+				return NULL;
+			}
+			slab_classes[index].pos = (char *) chunk;
+			slab_classes[index].end = (char *) chunk + SIDE_SLAB_CHUNK_SIZE;
+		}
+		ptr = slab_classes[index].pos;
+		slab_classes[index].pos += size;
+	}
+	pthread_mutex_unlock(&side_slab_lock);
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void side_slab_free(void *ptr, size_t len)
+{
+	struct side_slab_free_object *object = (struct side_slab_free_object *) ptr;
+	int index;
+
+	if (!ptr)
+		return;
+	index = side_slab_class_index(len);
+	if (index < 0) {
+		free(ptr);
+		return;
+	}
+	pthread_mutex_lock(&side_slab_lock);
+	object->next = slab_classes[index].free_list;
+	slab_classes[index].free_list = object;
+	pthread_mutex_unlock(&side_slab_lock);
+}
+
+void side_slab_before_fork(void)
+{
+	pthread_mutex_lock(&side_slab_lock);
+}
+
+void side_slab_after_fork_parent(void)
+{
+	pthread_mutex_unlock(&side_slab_lock);
+}
+
+void side_slab_after_fork_child(void)
+{
+	pthread_mutex_init(&side_slab_lock, NULL);
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_SLAB_H
+#define _SIDE_SLAB_H
+
+#include <stddef.h>
+
+/* Alignment and smallest size class of slab objects. */
+#define SIDE_SLAB_ALIGN		64
+
+/*
+ * Allocate zeroed memory aligned on SIDE_SLAB_ALIGN. Small objects of
+ * the same size class are packed contiguously within chunks, in
+ * allocation order. Returns NULL on allocation failure.
+ */
+void *side_slab_zalloc(size_t len) __attribute__((visibility("hidden")));
+/* len must match the length passed to side_slab_zalloc(). */
+void side_slab_free(void *ptr, size_t len) __attribute__((visibility("hidden")));
+void side_slab_before_fork(void) __attribute__((visibility("hidden")));
+void side_slab_after_fork_parent(void) __attribute__((visibility("hidden")));
+void side_slab_after_fork_child(void) __attribute__((visibility("hidden")));
+
+#endif /* _SIDE_SLAB_H */
@@ -276,3 +276,64 @@ int get_possible_cpus_array_len(void)
 
 	return possible_cpus_array_len_cache;
 }
+
+/*
+ * Returns the L1 data cache line size in bytes, or 0 if unknown.
+ *
+ * Use sysconf, with a fallback on the coherency line size of cpu0 from
+ * sysfs.
+ */
+int get_cache_line_size(void)
+{
+	char buf[32];
+	long size = 0;
+	char *endptr;
+
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+	if (size > 0 && size <= INT_MAX)
+		return (int) size;
+#endif
+	if (get_cpu_mask_from_sysfs(buf, sizeof(buf),
+			"/sys/devices/system/cpu/cpu0/cache/index0/coherency_line_size") <= 0)
+		return 0;
+	size = strtol(buf, &endptr, 10);
+	if (endptr == buf || size <= 0 || size > INT_MAX)
+		return 0;
+	return (int) size;
+}
+
+/*
+ * Returns the NUMA node of a CPU, or -1 if unknown.
+ *
+ * The sysfs directory of each CPU contains a "node" followed by an
+ * integer entry for its NUMA node.
+ */
+int get_cpu_numa_node(int cpu)
+{
+	char path[PATH_MAX];
+	struct dirent *entry;
+	int node = -1;
+	DIR *cpudir;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	cpudir = opendir(path);
+	if (cpudir == NULL)
+		return -1;
+	while ((entry = readdir(cpudir))) {
+		char *endptr;
+		long node_id;
+
+		if (strncmp(entry->d_name, "node", 4) != 0)
+			continue;
+		node_id = strtol(entry->d_name + 4, &endptr, 10);
+		if ((endptr != entry->d_name + 4) && (*endptr == '\0')
+				&& node_id >= 0 && node_id < INT_MAX) {
+			node = (int) node_id;
+			break;
+		}
+	}
+	if (closedir(cpudir))
+		perror("closedir");
+	return node;
+}
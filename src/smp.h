@@ -8,5 +8,7 @@
 #define _SIDE_SMP_H
 
 int get_possible_cpus_array_len(void) __attribute__((visibility("hidden")));
+int get_cache_line_size(void) __attribute__((visibility("hidden")));
+int get_cpu_numa_node(int cpu) __attribute__((visibility("hidden")));
 
 #endif /* _SIDE_SMP_H */
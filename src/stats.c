@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+bool side_stats_enabled;
+
+void side_stats_init(void)
+{
+	const char *env = getenv("LIBSIDE_STATS");
+
+	side_stats_enabled = env && !strcmp(env, "1");
+}
+
+struct side_event_stats_state *side_event_stats_create(int nr_cpus)
+{
+	struct side_event_stats_state *stats;
+
+	stats = (struct side_event_stats_state *) calloc(1, sizeof(struct side_event_stats_state));
+	if (!stats)
+		return NULL;
+	stats->nr_cpus = nr_cpus;
+	stats->percpu = (struct side_stats_cpu_state *)
+		side_slab_zalloc(nr_cpus * sizeof(struct side_stats_cpu_state));
+	if (!stats->percpu) {
+		free(stats);
+		return NULL;
+	}
+	side_list_head_init(&stats->callbacks);
+	return stats;
+}
+
+void side_event_stats_destroy(struct side_event_stats_state *stats)
+{
+	struct side_callback_stats_state *cb_stats, *tmp;
+
+	if (!stats)
+		return;
+	side_list_for_each_entry_safe(cb_stats, tmp, &stats->callbacks, node)
+		free(cb_stats);
+	side_slab_free(stats->percpu, stats->nr_cpus * sizeof(struct side_stats_cpu_state));
+	free(stats);
+}
+
+struct side_callback_stats_state *side_event_stats_callback_lookup(struct side_event_stats_state *stats,
+		void *call, void *priv, uint64_t key)
+{
+	struct side_callback_stats_state *cb_stats;
+
+	side_list_for_each_entry(cb_stats, &stats->callbacks, node) {
+		if (cb_stats->call == call && cb_stats->priv == priv && cb_stats->key == key)
+			return cb_stats;
+	}
+	return NULL;
+}
+
+struct side_callback_stats_state *side_event_stats_callback(struct side_event_stats_state *stats,
+		void *call, void *priv, uint64_t key)
+{
+	struct side_callback_stats_state *cb_stats;
+
+	cb_stats = side_event_stats_callback_lookup(stats, call, priv, key);
+	if (cb_stats)
+		return cb_stats;
+	cb_stats = (struct side_callback_stats_state *) calloc(1, sizeof(struct side_callback_stats_state));
+	if (!cb_stats)
+		return NULL;
+	cb_stats->call = call;
+	cb_stats->priv = priv;
+	cb_stats->key = key;
+	side_list_insert_node_tail(&stats->callbacks, &cb_stats->node);
+	return cb_stats;
+}
+
+uint64_t side_event_stats_nr_hits(const struct side_event_stats_state *stats)
+{
+	uint64_t nr_hits = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < stats->nr_cpus; cpu++)
+		nr_hits += __atomic_load_n(&stats->percpu[cpu].nr_hits, __ATOMIC_RELAXED);
+	return nr_hits;
+}
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_STATS_H
+#define _SIDE_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+#include "list.h"
+#include "rcu.h"
+#include "slab.h"
+
+/*
+ * Event and callback performance counters, enabled by LIBSIDE_STATS=1.
+ * Events count the occurrences which reach their callbacks per CPU,
+ * and one occurrence out of SIDE_STATS_SAMPLE_PERIOD on each CPU times
+ * each of its callbacks. The counters of a callback are kept per
+ * (call, priv, key) tuple for the lifetime of the event, so they
+ * accumulate across registrations of the same callback.
+ *
+ * Event statistics are created with the event lock held, and freed
+ * when their event is unregistered, at which point the instrumentation
+ * is unreachable.
+ */
+
+#define SIDE_STATS_SAMPLE_PERIOD	64
+
+struct side_stats_cpu_state {
+	uint64_t nr_hits;
+} __attribute__((aligned(SIDE_SLAB_ALIGN)));
+
+struct side_callback_stats_state {
+	struct side_list_node node;
+	void *call;
+	void *priv;
+	uint64_t key;
+	/* Updated with relaxed atomics. */
+	uint64_t nr_samples;
+	uint64_t sampled_ns;
+};
+
+struct side_event_stats_state {
+	struct side_stats_cpu_state *percpu;
+	int nr_cpus;
+	/* Protected by the event lock. */
+	struct side_list_head callbacks;
+};
+
+extern bool side_stats_enabled __attribute__((visibility("hidden")));
+
+/* Read LIBSIDE_STATS. Called once, by side_init(). */
+void side_stats_init(void) __attribute__((visibility("hidden")));
+/* Returns NULL on allocation failure. */
+struct side_event_stats_state *side_event_stats_create(int nr_cpus)
+	__attribute__((visibility("hidden")));
+void side_event_stats_destroy(struct side_event_stats_state *stats)
+	__attribute__((visibility("hidden")));
+/*
+ * Returns the counters of the (call, priv, key) tuple, created if
+ * needed, or NULL on allocation failure.
+ */
+struct side_callback_stats_state *side_event_stats_callback(struct side_event_stats_state *stats,
+		void *call, void *priv, uint64_t key)
+	__attribute__((visibility("hidden")));
+/* Returns NULL if the tuple has no counters. */
+struct side_callback_stats_state *side_event_stats_callback_lookup(struct side_event_stats_state *stats,
+		void *call, void *priv, uint64_t key)
+	__attribute__((visibility("hidden")));
+uint64_t side_event_stats_nr_hits(const struct side_event_stats_state *stats)
+	__attribute__((visibility("hidden")));
+
+/* Count an occurrence. Returns true if its callbacks should be timed. */
+static inline
+bool side_event_stats_hit(struct side_event_stats_state *stats)
+{
+	int cpu = side_rcu_percpu_index(stats->nr_cpus);
+
+	return !(__atomic_add_fetch(&stats->percpu[cpu].nr_hits, 1, __ATOMIC_RELAXED)
+			% SIDE_STATS_SAMPLE_PERIOD);
+}
+
+static inline
+void side_callback_stats_add(struct side_callback_stats_state *stats, uint64_t ns)
+{
+	(void) __atomic_add_fetch(&stats->nr_samples, 1, __ATOMIC_RELAXED);
+	(void) __atomic_add_fetch(&stats->sampled_ns, ns, __ATOMIC_RELAXED);
+}
+
+#endif /* _SIDE_STATS_H */
@@ -5,14 +5,21 @@
 
 #include <stdint.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
-#include <iconv.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <side/trace.h>
 
+#include "async-pipeline.h"
+#include "integer-array.h"
+#include "range-index.h"
+#include "utf.h"
 #include "visit-arg-vec.h"
 #include "visit-description.h"
 
@@ -21,6 +28,9 @@ static bool print_caller = false;
 
 #define MAX_NESTING	32
 
+/* Gather integer array elements loaded at once. */
+#define TRACER_INTEGER_BATCH	64
+
 enum tracer_display_base {
 	TRACER_DISPLAY_BASE_2,
 	TRACER_DISPLAY_BASE_8,
@@ -42,127 +52,309 @@ static struct side_tracer_handle *tracer_handle;
 
 static uint64_t tracer_key;
 
+/* Field paths printed, from LIBSIDE_TRACER_FIELDS. NULL prints all fields. */
+static const char *tracer_fields;
+
+/*
+ * Projection of an event printed with tracer_fields, passed as callback
+ * private data. Only accessed by event notifications, which are
+ * serialized by libside.
+ */
+struct tracer_event_projection {
+	struct tracer_event_projection *next;
+	const struct side_event_description *desc;
+	struct side_field_projection *projection;
+};
+
+static struct tracer_event_projection *tracer_projections;
+
 static struct side_description_visitor description_visitor;
 
+#define TRACER_OUTPUT_BUFFER_SIZE	8192
+
+/*
+ * Per-thread output buffer. Events are formatted into the buffer, which
+ * is written to the output file descriptor with a single write() every
+ * tracer_flush_events events, or when it is full. The buffer of the
+ * asynchronous consumer is written at the end of each batch instead.
+ */
+struct tracer_output_buffer {
+	size_t len;
+	unsigned int nr_events;		/* Events since the last flush. */
+	bool registered;		/* Flushed on thread exit. */
+	bool batched;			/* Flushed at the end of batches. */
+	char *utf8;			/* UTF-16/32 string conversions. */
+	size_t utf8_size;
+	char data[TRACER_OUTPUT_BUFFER_SIZE];
+};
+
+static int tracer_output_fd = STDOUT_FILENO;
+static unsigned int tracer_flush_events = 1;
+static pthread_key_t tracer_output_key;
+
+#define TRACER_ASYNC_QUEUE_SIZE		(256 * 1024)
+
+/* Events formatted by a consumer thread, from LIBSIDE_TRACER_ASYNC. */
+static struct side_async_pipeline *tracer_pipeline;
+
+static __thread struct tracer_output_buffer tracer_output;
+
 static
-void tracer_convert_string_to_utf8(const void *p, uint8_t unit_size, enum side_type_label_byte_order byte_order,
-		size_t *strlen_with_null,
-		char **output_str)
+void tracer_output_flush(struct tracer_output_buffer *buf)
 {
-	size_t ret, inbytesleft = 0, outbytesleft, bufsize, input_size;
-	const char *str = p, *fromcode;
-	char *inbuf = (char *) p, *outbuf, *buf;
-	iconv_t cd;
+	size_t pos = 0;
 
-	switch (unit_size) {
-	case 1:
-		if (strlen_with_null)
-			*strlen_with_null = strlen(str) + 1;
-		*output_str = (char *) str;
+	if (!buf->len)
 		return;
-	case 2:
-	{
-		const uint16_t *p16 = p;
-
-		switch (byte_order) {
-		case SIDE_TYPE_BYTE_ORDER_LE:
-		{
-			fromcode = "UTF-16LE";
-			break;
+	/* Keep the order of the application output written to stdout. */
+	if (tracer_output_fd == STDOUT_FILENO)
+		(void) fflush(stdout);
+	while (pos < buf->len) {
+		ssize_t ret = write(tracer_output_fd, buf->data + pos, buf->len - pos);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;	/* Drop the output. */
 		}
-		case SIDE_TYPE_BYTE_ORDER_BE:
-		{
-			fromcode = "UTF-16BE";
-			break;
-		}
-		default:
-			fprintf(stderr, "Unknown byte order\n");
-			abort();
-		}
-		for (; *p16; p16++)
-			inbytesleft += 2;
-		input_size = inbytesleft + 2;
-		/*
-		 * Worse case is U+FFFF UTF-16 (2 bytes) converting to
-		 * { ef, bf, bf } UTF-8 (3 bytes).
-		 */
-		bufsize = inbytesleft / 2 * 3 + 1;
-		break;
+		pos += ret;
 	}
-	case 4:
-	{
-		const uint32_t *p32 = p;
+	buf->len = 0;
+	buf->nr_events = 0;
+}
 
-		switch (byte_order) {
-		case SIDE_TYPE_BYTE_ORDER_LE:
-		{
-			fromcode = "UTF-32LE";
-			break;
-		}
-		case SIDE_TYPE_BYTE_ORDER_BE:
-		{
-			fromcode = "UTF-32BE";
-			break;
-		}
-		default:
-			fprintf(stderr, "Unknown byte order\n");
-			abort();
-		}
-		for (; *p32; p32++)
-			inbytesleft += 4;
-		input_size = inbytesleft + 4;
-		/*
-		 * Each 4-byte UTF-32 character converts to at most a
-		 * 4-byte UTF-8 character.
-		 */
-		bufsize = inbytesleft + 1;
-		break;
+static
+void tracer_output_thread_exit(void *arg)
+{
+	struct tracer_output_buffer *buf = arg;
+
+	tracer_output_flush(buf);
+	free(buf->utf8);
+	buf->utf8 = NULL;
+	buf->utf8_size = 0;
+}
+
+/* Returns room for len bytes, len <= TRACER_OUTPUT_BUFFER_SIZE. */
+static
+char *tracer_output_reserve(size_t len)
+{
+	struct tracer_output_buffer *buf = &tracer_output;
+
+	if (side_unlikely(TRACER_OUTPUT_BUFFER_SIZE - buf->len < len))
+		tracer_output_flush(buf);
+	return buf->data + buf->len;
+}
+
+static
+void tracer_output_commit(size_t len)
+{
+	tracer_output.len += len;
+}
+
+/* End of an event or of a notification. */
+static
+void tracer_output_end(void)
+{
+	struct tracer_output_buffer *buf = &tracer_output;
+
+	if (side_unlikely(!buf->registered)) {
+		(void) pthread_setspecific(tracer_output_key, buf);
+		buf->registered = true;
 	}
-	default:
-		fprintf(stderr, "Unknown string unit size %" PRIu8 "\n", unit_size);
-		abort();
+	if (++buf->nr_events >= tracer_flush_events && !buf->batched)
+		tracer_output_flush(buf);
+}
+
+static
+void tracer_write(const char *s, size_t len)
+{
+	while (len) {
+		size_t chunk = len < TRACER_OUTPUT_BUFFER_SIZE ? len : TRACER_OUTPUT_BUFFER_SIZE;
+
+		memcpy(tracer_output_reserve(chunk), s, chunk);
+		tracer_output_commit(chunk);
+		s += chunk;
+		len -= chunk;
 	}
+}
 
-	cd = iconv_open("UTF8", fromcode);
-	if (cd == (iconv_t) -1) {
-		perror("iconv_open");
-		abort();
+static
+void tracer_puts(const char *s)
+{
+	tracer_write(s, strlen(s));
+}
+
+static
+void tracer_putc(char c)
+{
+	*tracer_output_reserve(1) = c;
+	tracer_output_commit(1);
+}
+
+static
+void tracer_printf(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+static
+void tracer_printf(const char *fmt, ...)
+{
+	struct tracer_output_buffer *buf = &tracer_output;
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(buf->data + buf->len, TRACER_OUTPUT_BUFFER_SIZE - buf->len, fmt, ap);
+	va_end(ap);
+	if (side_likely(ret >= 0 && (size_t) ret < TRACER_OUTPUT_BUFFER_SIZE - buf->len)) {
+		buf->len += ret;
+		return;
 	}
-	buf = malloc(bufsize);
-	if (!buf) {
-		abort();
+	tracer_output_flush(buf);
+	va_start(ap, fmt);
+	ret = vsnprintf(buf->data, TRACER_OUTPUT_BUFFER_SIZE, fmt, ap);
+	va_end(ap);
+	if (ret >= 0 && ret < TRACER_OUTPUT_BUFFER_SIZE) {
+		buf->len = ret;
+		return;
 	}
-	outbuf = (char *) buf;
-	outbytesleft = bufsize;
-	ret = iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
-	if (ret == (size_t) -1) {
-		perror("iconv");
-		abort();
+	/* Larger than the buffer: write it directly. */
+	va_start(ap, fmt);
+	(void) vdprintf(tracer_output_fd, fmt, ap);
+	va_end(ap);
+}
+
+static
+void tracer_print_u64(uint64_t v)
+{
+	char tmp[20], *p = tmp + sizeof(tmp);
+	size_t len;
+
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	len = tmp + sizeof(tmp) - p;
+	memcpy(tracer_output_reserve(len), p, len);
+	tracer_output_commit(len);
+}
+
+static
+void tracer_print_s64(int64_t v)
+{
+	if (v < 0) {
+		tracer_putc('-');
+		tracer_print_u64(-(uint64_t) v);
+	} else {
+		tracer_print_u64(v);
 	}
-	if (inbytesleft) {
-		fprintf(stderr, "Buffer too small to convert string input\n");
+}
+
+/* Digits of v in base 2^shift, at least min_digits. */
+static
+void tracer_print_pow2(uint64_t v, unsigned int shift, int min_digits)
+{
+	static const char digits[] = "0123456789abcdef";
+	char tmp[64], *p = tmp + sizeof(tmp);
+	uint64_t mask = (1ULL << shift) - 1;
+	size_t len;
+
+	do {
+		*--p = digits[v & mask];
+		v >>= shift;
+	} while (v || tmp + sizeof(tmp) - p < min_digits);
+	len = tmp + sizeof(tmp) - p;
+	memcpy(tracer_output_reserve(len), p, len);
+	tracer_output_commit(len);
+}
+
+/* Same output as printf("0x%" PRIx64 "%016" PRIx64) if high is nonzero. */
+static
+void tracer_print_hex(uint64_t high, uint64_t low)
+{
+	tracer_write("0x", 2);
+	if (high) {
+		tracer_print_pow2(high, 4, 1);
+		tracer_print_pow2(low, 4, 16);
+	} else {
+		tracer_print_pow2(low, 4, 1);
+	}
+}
+
+/*
+ * Returns the string length in code units, and its size in bytes
+ * including the null terminator in *strlen_with_null.
+ */
+static
+size_t tracer_string_units(const void *p, uint8_t unit_size, enum side_type_label_byte_order byte_order,
+		size_t *strlen_with_null)
+{
+	size_t nr_units;
+
+	switch (unit_size) {
+	case 1:
+	case 2:
+	case 4:
+		break;
+	default:
+		fprintf(stderr, "Unknown string unit size %" PRIu8 "\n", unit_size);
 		abort();
 	}
-	(*outbuf++) = '\0';
-	if (iconv_close(cd) == -1) {
-		perror("iconv_close");
+	if (unit_size != 1 && byte_order != SIDE_TYPE_BYTE_ORDER_LE && byte_order != SIDE_TYPE_BYTE_ORDER_BE) {
+		fprintf(stderr, "Unknown byte order\n");
 		abort();
 	}
+	nr_units = side_utf_strlen(p, unit_size);
 	if (strlen_with_null)
-		*strlen_with_null = input_size;
-	*output_str = buf;
+		*strlen_with_null = (nr_units + 1) * unit_size;
+	return nr_units;
 }
 
+/*
+ * Returns the string p in UTF-8, either p itself or a conversion into a
+ * per-thread buffer which stays valid until the next conversion.
+ */
 static
-void tracer_print_type_string(const void *p, uint8_t unit_size, enum side_type_label_byte_order byte_order,
+const char *tracer_convert_string_to_utf8(const void *p, uint8_t unit_size, enum side_type_label_byte_order byte_order,
 		size_t *strlen_with_null)
 {
-	char *output_str = NULL;
+	struct tracer_output_buffer *buf = &tracer_output;
+	size_t nr_units, size, len;
 
-	tracer_convert_string_to_utf8(p, unit_size, byte_order, strlen_with_null, &output_str);
-	printf("\"%s\"", output_str);
-	if (output_str != p)
-		free(output_str);
+	nr_units = tracer_string_units(p, unit_size, byte_order, strlen_with_null);
+	if (unit_size == 1)
+		return p;
+	size = SIDE_UTF8_MAX_SIZE(nr_units, unit_size) + 1;
+	if (side_unlikely(size > buf->utf8_size)) {
+		char *utf8 = realloc(buf->utf8, size);
+
+		if (!utf8)
+			abort();
+		buf->utf8 = utf8;
+		buf->utf8_size = size;
+	}
+	len = side_utf_to_utf8(buf->utf8, p, nr_units, unit_size, byte_order);
+	buf->utf8[len] = '\0';
+	return buf->utf8;
+}
+
+static
+void tracer_print_type_string(const void *p, uint8_t unit_size, enum side_type_label_byte_order byte_order,
+		size_t *strlen_with_null)
+{
+	size_t nr_units, size;
+
+	nr_units = tracer_string_units(p, unit_size, byte_order, strlen_with_null);
+	size = SIDE_UTF8_MAX_SIZE(nr_units, unit_size);
+	tracer_putc('"');
+	if (unit_size == 1) {
+		tracer_write(p, nr_units);
+	} else if (side_likely(size <= TRACER_OUTPUT_BUFFER_SIZE)) {
+		/* Transcode straight into the output buffer. */
+		tracer_output_commit(side_utf_to_utf8(tracer_output_reserve(size),
+			p, nr_units, unit_size, byte_order));
+	} else {
+		tracer_puts(tracer_convert_string_to_utf8(p, unit_size, byte_order, NULL));
+	}
+	tracer_putc('"');
 }
 
 static
@@ -259,15 +451,11 @@ enum tracer_display_base get_attr_display_base(const struct side_attr *_attr, ui
 
 	for (i = 0; i < nr_attr; i++) {
 		const struct side_attr *attr = &_attr[i];
-		char *utf8_str = NULL;
-		bool cmp;
-
-		tracer_convert_string_to_utf8(side_ptr_get(attr->key.p), attr->key.unit_size,
-			side_enum_get(attr->key.byte_order), NULL, &utf8_str);
-		cmp = strcmp(utf8_str, "std.integer.base");
-		if (utf8_str != side_ptr_get(attr->key.p))
-			free(utf8_str);
-		if (!cmp) {
+		const char *utf8_str;
+
+		utf8_str = tracer_convert_string_to_utf8(side_ptr_get(attr->key.p), attr->key.unit_size,
+			side_enum_get(attr->key.byte_order), NULL);
+		if (!strcmp(utf8_str, "std.integer.base")) {
 			int64_t val = get_attr_integer64_value(attr);
 
 			switch (val) {
@@ -291,62 +479,50 @@ enum tracer_display_base get_attr_display_base(const struct side_attr *_attr, ui
 static
 void tracer_print_attr_type(const char *separator, const struct side_attr *attr)
 {
-	char *utf8_str = NULL;
+	const char *utf8_str;
 
-	tracer_convert_string_to_utf8(side_ptr_get(attr->key.p), attr->key.unit_size,
-		side_enum_get(attr->key.byte_order), NULL, &utf8_str);
-	printf("{ key%s \"%s\", value%s ", separator, utf8_str, separator);
-	if (utf8_str != side_ptr_get(attr->key.p))
-		free(utf8_str);
+	utf8_str = tracer_convert_string_to_utf8(side_ptr_get(attr->key.p), attr->key.unit_size,
+		side_enum_get(attr->key.byte_order), NULL);
+	tracer_printf("{ key%s \"%s\", value%s ", separator, utf8_str, separator);
 	switch (side_enum_get(attr->value.type)) {
 	case SIDE_ATTR_TYPE_BOOL:
-		printf("%s", attr->value.u.bool_value ? "true" : "false");
+		tracer_puts(attr->value.u.bool_value ? "true" : "false");
 		break;
 	case SIDE_ATTR_TYPE_U8:
-		printf("%" PRIu8, attr->value.u.integer_value.side_u8);
+		tracer_print_u64(attr->value.u.integer_value.side_u8);
 		break;
 	case SIDE_ATTR_TYPE_U16:
-		printf("%" PRIu16, attr->value.u.integer_value.side_u16);
+		tracer_print_u64(attr->value.u.integer_value.side_u16);
 		break;
 	case SIDE_ATTR_TYPE_U32:
-		printf("%" PRIu32, attr->value.u.integer_value.side_u32);
+		tracer_print_u64(attr->value.u.integer_value.side_u32);
 		break;
 	case SIDE_ATTR_TYPE_U64:
-		printf("%" PRIu64, attr->value.u.integer_value.side_u64);
+		tracer_print_u64(attr->value.u.integer_value.side_u64);
 		break;
 	case SIDE_ATTR_TYPE_U128:
-		if (attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_HIGH] == 0) {
-			printf("0x%" PRIx64, attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_LOW]);
-		} else {
-			printf("0x%" PRIx64 "%016" PRIx64,
-				attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_HIGH],
-				attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_LOW]);
-		}
+		tracer_print_hex((uint64_t) attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_HIGH],
+			(uint64_t) attr->value.u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_LOW]);
 		break;
 	case SIDE_ATTR_TYPE_S8:
-		printf("%" PRId8, attr->value.u.integer_value.side_s8);
+		tracer_print_s64(attr->value.u.integer_value.side_s8);
 		break;
 	case SIDE_ATTR_TYPE_S16:
-		printf("%" PRId16, attr->value.u.integer_value.side_s16);
+		tracer_print_s64(attr->value.u.integer_value.side_s16);
 		break;
 	case SIDE_ATTR_TYPE_S32:
-		printf("%" PRId32, attr->value.u.integer_value.side_s32);
+		tracer_print_s64(attr->value.u.integer_value.side_s32);
 		break;
 	case SIDE_ATTR_TYPE_S64:
-		printf("%" PRId64, attr->value.u.integer_value.side_s64);
+		tracer_print_s64(attr->value.u.integer_value.side_s64);
 		break;
 	case SIDE_ATTR_TYPE_S128:
-		if (attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_HIGH] == 0) {
-			printf("0x%" PRIx64, attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_LOW]);
-		} else {
-			printf("0x%" PRIx64 "%016" PRIx64,
-				attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_HIGH],
-				attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_LOW]);
-		}
+		tracer_print_hex((uint64_t) attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_HIGH],
+			(uint64_t) attr->value.u.integer_value.side_s128_split[SIDE_INTEGER128_SPLIT_LOW]);
 		break;
 	case SIDE_ATTR_TYPE_FLOAT_BINARY16:
 #if __HAVE_FLOAT16
-		printf("%g", (double) attr->value.u.float_value.side_float_binary16);
+		tracer_printf("%g", (double) attr->value.u.float_value.side_float_binary16);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary16 float type\n");
@@ -354,7 +530,7 @@ void tracer_print_attr_type(const char *separator, const struct side_attr *attr)
 #endif
 	case SIDE_ATTR_TYPE_FLOAT_BINARY32:
 #if __HAVE_FLOAT32
-		printf("%g", (double) attr->value.u.float_value.side_float_binary32);
+		tracer_printf("%g", (double) attr->value.u.float_value.side_float_binary32);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary32 float type\n");
@@ -362,7 +538,7 @@ void tracer_print_attr_type(const char *separator, const struct side_attr *attr)
 #endif
 	case SIDE_ATTR_TYPE_FLOAT_BINARY64:
 #if __HAVE_FLOAT64
-		printf("%g", (double) attr->value.u.float_value.side_float_binary64);
+		tracer_printf("%g", (double) attr->value.u.float_value.side_float_binary64);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary64 float type\n");
@@ -370,7 +546,7 @@ void tracer_print_attr_type(const char *separator, const struct side_attr *attr)
 #endif
 	case SIDE_ATTR_TYPE_FLOAT_BINARY128:
 #if __HAVE_FLOAT128
-		printf("%Lg", (long double) attr->value.u.float_value.side_float_binary128);
+		tracer_printf("%Lg", (long double) attr->value.u.float_value.side_float_binary128);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary128 float type\n");
@@ -385,7 +561,7 @@ void tracer_print_attr_type(const char *separator, const struct side_attr *attr)
 		fprintf(stderr, "ERROR: <UNKNOWN ATTRIBUTE TYPE>");
 		abort();
 	}
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -396,12 +572,12 @@ void print_attributes(const char *prefix_str, const char *separator,
 
 	if (!nr_attr)
 		return;
-	printf("%s%s [", prefix_str, separator);
+	tracer_printf("%s%s [", prefix_str, separator);
 	for (i = 0; i < nr_attr; i++) {
-		printf("%s", i ? ", " : " ");
+		tracer_puts(i ? ", " : " ");
 		tracer_print_attr_type(separator, &attr[i]);
 	}
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static
@@ -534,14 +710,33 @@ union int_value tracer_load_integer_value(const struct side_type_integer *type_i
 	return v;
 }
 
+static
+void print_enum_label(const struct side_enum_mapping *mapping, uint32_t *print_count)
+{
+	tracer_puts((*print_count)++ ? ", " : "");
+	tracer_print_type_string(side_ptr_get(mapping->label.p), mapping->label.unit_size,
+		side_enum_get(mapping->label.byte_order), NULL);
+}
+
 static
 void print_enum_labels(const struct side_enum_mappings *mappings, union int_value v)
 {
+	const struct side_enum_mapping *mapping;
+	const struct side_range_index *index;
 	uint32_t print_count = 0;
 
 	side_check_value_s64(v);
-	printf(", labels: [ ");
-	const struct side_enum_mapping *mapping;
+	tracer_puts(", labels: [ ");
+	if (side_array_length(&mappings->mappings) >= SIDE_RANGE_INDEX_MIN_RANGES
+			&& (index = side_range_index_find(mappings))) {
+		const uint32_t *pos;
+		uint32_t i, nr_pos;
+
+		nr_pos = side_range_index_lookup(index, v.s[SIDE_INTEGER128_SPLIT_LOW], &pos);
+		for (i = 0; i < nr_pos; i++)
+			print_enum_label(side_array_at(&mappings->mappings, pos[i]), &print_count);
+		goto end;
+	}
 	side_for_each_element_in_array(mapping, &mappings->mappings) {
 
 		if (mapping->range_end < mapping->range_begin) {
@@ -549,15 +744,13 @@ void print_enum_labels(const struct side_enum_mappings *mappings, union int_valu
 				mapping->range_begin, mapping->range_end);
 			abort();
 		}
-		if (v.s[SIDE_INTEGER128_SPLIT_LOW] >= mapping->range_begin && v.s[SIDE_INTEGER128_SPLIT_LOW] <= mapping->range_end) {
-			printf("%s", print_count++ ? ", " : "");
-			tracer_print_type_string(side_ptr_get(mapping->label.p), mapping->label.unit_size,
-				side_enum_get(mapping->label.byte_order), NULL);
-		}
+		if (v.s[SIDE_INTEGER128_SPLIT_LOW] >= mapping->range_begin && v.s[SIDE_INTEGER128_SPLIT_LOW] <= mapping->range_end)
+			print_enum_label(mapping, &print_count);
 	}
+end:
 	if (!print_count)
-		printf("<NO LABEL>");
-	printf(" ]");
+		tracer_puts("<NO LABEL>");
+	tracer_puts(" ]");
 }
 
 static
@@ -591,23 +784,26 @@ uint32_t elem_type_to_stride(const struct side_type *elem_type)
 static
 void print_integer_binary(uint64_t v[NR_SIDE_INTEGER128_SPLIT], int bits)
 {
-	int bit;
+	char *p = tracer_output_reserve(2 + 128);
+	int bit, len = 0;
 
-	printf("0b");
+	p[len++] = '0';
+	p[len++] = 'b';
 	if (bits > 64) {
 		bits -= 64;
 		v[SIDE_INTEGER128_SPLIT_HIGH] <<= 64 - bits;
 		for (bit = 0; bit < bits; bit++) {
-			printf("%c", v[SIDE_INTEGER128_SPLIT_HIGH] & (1ULL << 63) ? '1' : '0');
+			p[len++] = v[SIDE_INTEGER128_SPLIT_HIGH] & (1ULL << 63) ? '1' : '0';
 			v[SIDE_INTEGER128_SPLIT_HIGH] <<= 1;
 		}
 		bits = 64;
 	}
 	v[SIDE_INTEGER128_SPLIT_LOW] <<= 64 - bits;
 	for (bit = 0; bit < bits; bit++) {
-		printf("%c", v[SIDE_INTEGER128_SPLIT_LOW] & (1ULL << 63) ? '1' : '0');
+		p[len++] = v[SIDE_INTEGER128_SPLIT_LOW] & (1ULL << 63) ? '1' : '0';
 		v[SIDE_INTEGER128_SPLIT_LOW] <<= 1;
 	}
+	tracer_output_commit(len);
 }
 
 static
@@ -615,8 +811,8 @@ void tracer_print_type_header(const char *prefix, const char *separator,
 		const struct side_attr *attr, uint32_t nr_attr)
 {
 	print_attributes("attr", separator, attr, nr_attr);
-	printf("%s", nr_attr ? ", " : "");
-	printf("%s%s ", prefix, separator);
+	tracer_puts(nr_attr ? ", " : "");
+	tracer_printf("%s%s ", prefix, separator);
 }
 
 static
@@ -677,7 +873,7 @@ void tracer_print_type_bool(const char *separator,
 	if (len_bits < 64)
 		v &= (1ULL << len_bits) - 1;
 	tracer_print_type_header("value", separator, side_array_elements(&type_bool->attributes), side_array_length(&type_bool->attributes));
-	printf("%s", v ? "true" : "false");
+	tracer_puts(v ? "true" : "false");
 }
 
 /* 2^128 - 1 */
@@ -798,18 +994,15 @@ void u128_tostring_base_8(union int_value v, char str[U128_BASE_8_ARRAY_LEN])
 	str[str_i] = '\0';
 }
 
+/* Print an integer value loaded from its storage. */
 static
-void tracer_print_type_integer(const char *separator,
+void tracer_print_type_integer_value(const char *separator,
 		const struct side_type_integer *type_integer,
-		const union side_integer_value *value,
-		uint16_t offset_bits,
+		union int_value v, uint16_t len_bits,
 		enum tracer_display_base default_base)
 {
 	enum tracer_display_base base;
-	union int_value v;
-	uint16_t len_bits;
 
-	v = tracer_load_integer_value(type_integer, value, offset_bits, &len_bits);
 	tracer_print_type_header("value", separator, side_array_elements(&type_integer->attributes), side_array_length(&type_integer->attributes));
 	base = get_attr_display_base(side_array_elements(&type_integer->attributes), side_array_length(&type_integer->attributes), default_base);
 	switch (base) {
@@ -825,29 +1018,30 @@ void tracer_print_type_integer(const char *separator,
 			v.u[SIDE_INTEGER128_SPLIT_HIGH] &= (1ULL << (len_bits - 64)) - 1;
 		}
 		if (len_bits <= 64) {
-			printf("0o%" PRIo64, v.u[SIDE_INTEGER128_SPLIT_LOW]);
+			tracer_write("0o", 2);
+			tracer_print_pow2(v.u[SIDE_INTEGER128_SPLIT_LOW], 3, 1);
 		} else {
 			char str[U128_BASE_8_ARRAY_LEN];
 
 			u128_tostring_base_8(v, str);
-			printf("0o%s", str);
+			tracer_printf("0o%s", str);
 		}
 		break;
 	case TRACER_DISPLAY_BASE_10:
 		if (len_bits <= 64) {
 			if (type_integer->signedness)
-				printf("%" PRId64, v.s[SIDE_INTEGER128_SPLIT_LOW]);
+				tracer_print_s64(v.s[SIDE_INTEGER128_SPLIT_LOW]);
 			else
-				printf("%" PRIu64, v.u[SIDE_INTEGER128_SPLIT_LOW]);
+				tracer_print_u64(v.u[SIDE_INTEGER128_SPLIT_LOW]);
 		} else {
 			if (type_integer->signedness) {
 				char str[S128_BASE_10_ARRAY_LEN];
 				s128_tostring_base_10(v, str);
-				printf("%s", str);
+				tracer_puts(str);
 			} else {
 				char str[U128_BASE_10_ARRAY_LEN];
 				u128_tostring_base_10(v, str);
-				printf("%s", str);
+				tracer_puts(str);
 			}
 		}
 		break;
@@ -859,19 +1053,28 @@ void tracer_print_type_integer(const char *separator,
 		} else if (len_bits < 128) {
 			v.u[SIDE_INTEGER128_SPLIT_HIGH] &= (1ULL << (len_bits - 64)) - 1;
 		}
-		if (len_bits <= 64 || v.u[SIDE_INTEGER128_SPLIT_HIGH] == 0) {
-			printf("0x%" PRIx64, v.u[SIDE_INTEGER128_SPLIT_LOW]);
-		} else {
-			printf("0x%" PRIx64 "%016" PRIx64,
-				v.u[SIDE_INTEGER128_SPLIT_HIGH],
-				v.u[SIDE_INTEGER128_SPLIT_LOW]);
-		}
+		tracer_print_hex(len_bits <= 64 ? 0 : v.u[SIDE_INTEGER128_SPLIT_HIGH],
+			v.u[SIDE_INTEGER128_SPLIT_LOW]);
 		break;
 	default:
 		abort();
 	}
 }
 
+static
+void tracer_print_type_integer(const char *separator,
+		const struct side_type_integer *type_integer,
+		const union side_integer_value *value,
+		uint16_t offset_bits,
+		enum tracer_display_base default_base)
+{
+	union int_value v;
+	uint16_t len_bits;
+
+	v = tracer_load_integer_value(type_integer, value, offset_bits, &len_bits);
+	tracer_print_type_integer_value(separator, type_integer, v, len_bits, default_base);
+}
+
 static
 void tracer_print_type_float(const char *separator,
 		const struct side_type_float *type_float,
@@ -894,7 +1097,7 @@ void tracer_print_type_float(const char *separator,
 
 		if (reverse_bo)
 			float16.u = side_bswap_16(float16.u);
-		printf("%g", (double) float16.f);
+		tracer_printf("%g", (double) float16.f);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary16 float type\n");
@@ -913,7 +1116,7 @@ void tracer_print_type_float(const char *separator,
 
 		if (reverse_bo)
 			float32.u = side_bswap_32(float32.u);
-		printf("%g", (double) float32.f);
+		tracer_printf("%g", (double) float32.f);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary32 float type\n");
@@ -932,7 +1135,7 @@ void tracer_print_type_float(const char *separator,
 
 		if (reverse_bo)
 			float64.u = side_bswap_64(float64.u);
-		printf("%g", (double) float64.f);
+		tracer_printf("%g", (double) float64.f);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary64 float type\n");
@@ -951,7 +1154,7 @@ void tracer_print_type_float(const char *separator,
 
 		if (reverse_bo)
 			side_bswap_128p(float128.arr);
-		printf("%Lg", (long double) float128.f);
+		tracer_printf("%Lg", (long double) float128.f);
 		break;
 #else
 		fprintf(stderr, "ERROR: Unsupported binary128 float type\n");
@@ -1010,8 +1213,8 @@ void tracer_before_print_event(const struct side_event_description *desc,
 	}
 
 	if (print_caller)
-		printf("caller: [%p], ", caller_addr);
-	printf("provider: %s, event: %s",
+		tracer_printf("caller: [%p], ", caller_addr);
+	tracer_printf("provider: %s, event: %s",
 		side_ptr_get(desc->provider_name),
 		side_ptr_get(desc->event_name));
 	print_attributes(", attr", ":", side_array_elements(&desc->attributes), side_array_length(&desc->attributes));
@@ -1023,7 +1226,8 @@ void tracer_after_print_event(const struct side_event_description *desc __attrib
 		const struct side_arg_dynamic_struct *var_struct __attribute__((unused)),
 		void *caller_addr __attribute__((unused)), void *priv __attribute__((unused)))
 {
-	printf("\n");
+	tracer_puts("\n");
+	tracer_output_end();
 }
 
 static
@@ -1032,7 +1236,7 @@ void tracer_before_print_static_fields(const struct side_arg_vec *side_arg_vec,
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 	uint32_t side_sav_len = side_arg_vec->len;
 
-	printf("%s", side_sav_len ? ", fields: {" : "");
+	tracer_puts(side_sav_len ? ", fields: {" : "");
 	push_nesting(ctx);
 }
 
@@ -1045,7 +1249,7 @@ void tracer_after_print_static_fields(const struct side_arg_vec *side_arg_vec, v
 
 	pop_nesting(ctx);
 	if (side_sav_len)
-		printf(" }");
+		tracer_puts(" }");
 }
 
 static
@@ -1056,7 +1260,7 @@ void tracer_before_print_variadic_fields(const struct side_arg_dynamic_struct *v
 	uint32_t var_struct_len = var_struct->len;
 
 	print_attributes(", attr ", "::", side_array_elements(&var_struct->attributes), side_array_length(&var_struct->attributes));
-	printf("%s", var_struct_len ? ", fields:: {" : "");
+	tracer_puts(var_struct_len ? ", fields:: {" : "");
 	push_nesting(ctx);
 }
 
@@ -1068,7 +1272,7 @@ void tracer_after_print_variadic_fields(const struct side_arg_dynamic_struct *va
 
 	pop_nesting(ctx);
 	if (var_struct_len)
-		printf(" }");
+		tracer_puts(" }");
 }
 
 static
@@ -1077,8 +1281,8 @@ void tracer_before_print_field(const struct side_event_field *item_desc, void *p
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(",");
-	printf(" %s: { ", side_ptr_get(item_desc->field_name));
+		tracer_puts(",");
+	tracer_printf(" %s: { ", side_ptr_get(item_desc->field_name));
 }
 
 static
@@ -1086,7 +1290,7 @@ void tracer_after_print_field(const struct side_event_field *item_desc __attribu
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1096,9 +1300,9 @@ void tracer_before_print_elem(const struct side_type *type_desc __attribute__((u
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(", { ");
+		tracer_puts(", { ");
 	else
-		printf(" { ");
+		tracer_puts(" { ");
 }
 
 static
@@ -1106,7 +1310,7 @@ void tracer_after_print_elem(const struct side_type *type_desc __attribute__((un
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1117,7 +1321,7 @@ void tracer_print_null(const struct side_type *type_desc,
 {
 	tracer_print_type_header("value", ":", side_array_elements(&type_desc->u.side_null.attributes),
 				side_array_length(&type_desc->u.side_null.attributes));
-	printf("<NULL TYPE>");
+	tracer_puts("<NULL TYPE>");
 }
 
 static
@@ -1142,7 +1346,7 @@ void tracer_print_byte(const struct side_type *type_desc __attribute__((unused))
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("value", ":", side_array_elements(&type_desc->u.side_byte.attributes), side_array_length(&type_desc->u.side_byte.attributes));
-	printf("0x%" PRIx8, item->u.side_static.byte_value);
+	tracer_print_hex(0, item->u.side_static.byte_value);
 }
 
 static
@@ -1179,8 +1383,8 @@ void tracer_before_print_struct(const struct side_type_struct *side_struct,
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_struct->attributes), side_array_length(&side_struct->attributes));
-	printf("%s", side_array_length(&side_struct->attributes) ? ", " : "");
-	printf("fields: {");
+	tracer_puts(side_array_length(&side_struct->attributes) ? ", " : "");
+	tracer_puts("fields: {");
 	push_nesting(ctx);
 }
 
@@ -1192,7 +1396,7 @@ void tracer_after_print_struct(const struct side_type_struct *side_struct __attr
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -1202,8 +1406,8 @@ void tracer_before_print_array(const struct side_type_array *side_array,
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_array->attributes), side_array_length(&side_array->attributes));
-	printf("%s", side_array_length(&side_array->attributes) ? ", " : "");
-	printf("elements: [");
+	tracer_puts(side_array_length(&side_array->attributes) ? ", " : "");
+	tracer_puts("elements: [");
 	push_nesting(ctx);
 }
 
@@ -1214,7 +1418,7 @@ void tracer_after_print_array(const struct side_type_array *side_array __attribu
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static
@@ -1224,8 +1428,8 @@ void do_tracer_before_print_vla(const struct side_type_vla *side_vla,
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_vla->attributes), side_array_length(&side_vla->attributes));
-	printf("%s", side_array_length(&side_vla->attributes) ? ", " : "");
-	printf("elements: [");
+	tracer_puts(side_array_length(&side_vla->attributes) ? ", " : "");
+	tracer_puts("elements: [");
 	push_nesting(ctx);
 }
 
@@ -1237,7 +1441,7 @@ void do_tracer_after_print_vla(const struct side_type_vla *side_vla __attribute_
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static
@@ -1294,8 +1498,8 @@ void tracer_before_print_vla_visitor(const struct side_type_vla_visitor *side_vl
 	}
 
 	print_attributes("attr", ":", side_array_elements(&side_vla_visitor->attributes), side_array_length(&side_vla_visitor->attributes));
-	printf("%s", side_array_length(&side_vla_visitor->attributes) ? ", " : "");
-	printf("elements: [");
+	tracer_puts(side_array_length(&side_vla_visitor->attributes) ? ", " : "");
+	tracer_puts("elements: [");
 	push_nesting(ctx);
 }
 
@@ -1306,7 +1510,7 @@ void tracer_after_print_vla_visitor(const struct side_type_vla_visitor *side_vla
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static void tracer_print_enum(const struct side_type *type_desc,
@@ -1323,10 +1527,10 @@ static void tracer_print_enum(const struct side_type *type_desc,
 	v = tracer_load_integer_value(&elem_type->u.side_integer,
 			&item->u.side_static.integer_value, 0, NULL);
 	print_attributes("attr", ":", side_array_elements(&mappings->attributes), side_array_length(&mappings->attributes));
-	printf("%s", side_array_length(&mappings->attributes) ? ", " : "");
-	printf("{ ");
+	tracer_puts(side_array_length(&mappings->attributes) ? ", " : "");
+	tracer_puts("{ ");
 	tracer_print_integer(elem_type, item, priv);
-	printf(" }");
+	tracer_puts(" }");
 	print_enum_labels(mappings, v);
 }
 
@@ -1372,27 +1576,38 @@ static void tracer_print_enum_bitmap(const struct side_type *type_desc,
 	stride_bit = elem_type_to_stride(elem_type);
 
 	print_attributes("attr", ":", side_array_elements(&side_enum_mappings->attributes), side_array_length(&side_enum_mappings->attributes));
-	printf("%s", side_array_length(&side_enum_mappings->attributes) ? ", " : "");
-	printf("labels: [ ");
+	tracer_puts(side_array_length(&side_enum_mappings->attributes) ? ", " : "");
+	tracer_puts("labels: [ ");
 	side_for_each_element_in_array(mapping, &side_enum_mappings->mappings) {
 
+		uint64_t bit, end = mapping->range_end;
 		bool match = false;
-		uint64_t bit;
 
 		if (mapping->range_end < mapping->range_begin) {
 			fprintf(stderr, "ERROR: Unexpected enum bitmap range: %" PRIu64 "-%" PRIu64 "\n",
 				mapping->range_begin, mapping->range_end);
 			abort();
 		}
-		for (bit = mapping->range_begin; bit <= mapping->range_end; bit++) {
-			if (bit > (nr_items * stride_bit) - 1)
-				break;
+		if (!nr_items)
+			continue;
+		if (end > (uint64_t) nr_items * stride_bit - 1)
+			end = (uint64_t) nr_items * stride_bit - 1;
+		/* Test the bits of the range within each element at once. */
+		for (bit = mapping->range_begin; bit <= end; bit += stride_bit - bit % stride_bit) {
+			uint64_t first = bit % stride_bit, last = bit - first + stride_bit - 1;
+			uint64_t mask, word;
+
+			if (last > end)
+				last = end;
+			last -= bit - first;
+			/* Only the low 64 bits of an element can be set. */
+			if (first > 63)
+				continue;
+			if (last > 63)
+				last = 63;
+			mask = (last - first == 63 ? ~0ULL : (1ULL << (last - first + 1)) - 1) << first;
 			if (side_enum_get(elem_type->type) == SIDE_TYPE_BYTE) {
-				uint8_t v = array_item[bit / 8].u.side_static.byte_value;
-				if (v & (1ULL << (bit % 8))) {
-					match = true;
-					goto match;
-				}
+				word = array_item[bit / 8].u.side_static.byte_value;
 			} else {
 				union int_value v = {};
 
@@ -1400,22 +1615,22 @@ static void tracer_print_enum_bitmap(const struct side_type *type_desc,
 						&array_item[bit / stride_bit].u.side_static.integer_value,
 						0, NULL);
 				side_check_value_u64(v);
-				if (v.u[SIDE_INTEGER128_SPLIT_LOW] & (1ULL << (bit % stride_bit))) {
-					match = true;
-					goto match;
-				}
+				word = v.u[SIDE_INTEGER128_SPLIT_LOW];
+			}
+			if (word & mask) {
+				match = true;
+				break;
 			}
 		}
-match:
 		if (match) {
-			printf("%s", print_count++ ? ", " : "");
+			tracer_puts(print_count++ ? ", " : "");
 			tracer_print_type_string(side_ptr_get(mapping->label.p), mapping->label.unit_size,
 				side_enum_get(mapping->label.byte_order), NULL);
 		}
 	}
 	if (!print_count)
-		printf("<NO LABEL>");
-	printf(" ]");
+		tracer_puts("<NO LABEL>");
+	tracer_puts(" ]");
 }
 
 static
@@ -1433,7 +1648,7 @@ void tracer_print_gather_byte(const struct side_type_gather_byte *type,
 {
 	tracer_print_type_header("value", ":", side_array_elements(&type->type.attributes),
 				side_array_length(&type->type.attributes));
-	printf("0x%" PRIx8, *_ptr);
+	tracer_print_hex(0, *_ptr);
 }
 
 static
@@ -1460,6 +1675,91 @@ void tracer_print_gather_float(const struct side_type_gather_float *type,
 	tracer_print_type_float(":", &type->type, value);
 }
 
+/*
+ * Elements of gather integer arrays are loaded in batches: byte order
+ * reversal and bit field extraction use the vector kernels.
+ */
+static
+void tracer_print_gather_integer_array(const struct side_type_gather_integer *type,
+	const void *ptr, uint32_t length, void *priv)
+{
+	const struct side_type_integer *type_integer = &type->type;
+	uint32_t size = type_integer->integer_size, i, j, n;
+	uint16_t len_bits = type_integer->len_bits ? type_integer->len_bits : size * CHAR_BIT;
+	bool reverse_bo = side_enum_get(type_integer->byte_order) != SIDE_TYPE_BYTE_ORDER_HOST;
+	const char *p = (const char *) ptr;
+
+	if (size > 8 || len_bits + type->offset_bits > size * CHAR_BIT) {
+		for (i = 0; i < length; i++) {
+			union side_integer_value value;
+
+			memcpy(&value, p + i * size, size);
+			tracer_before_print_elem(NULL, priv);
+			tracer_print_type_integer(":", type_integer, &value, type->offset_bits, TRACER_DISPLAY_BASE_10);
+			tracer_after_print_elem(NULL, priv);
+		}
+		return;
+	}
+	for (i = 0; i < length; i += n) {
+		uint64_t batch[TRACER_INTEGER_BATCH];
+		const char *elem = (const char *) batch;
+
+		n = length - i < TRACER_INTEGER_BATCH ? length - i : TRACER_INTEGER_BATCH;
+		if (reverse_bo)
+			side_integer_array_bswap(batch, p + i * size, n, size);
+		else
+			memcpy(batch, p + i * size, n * size);
+		side_integer_array_extract_bits(batch, batch, n, size, type->offset_bits, len_bits,
+			type_integer->signedness);
+		for (j = 0; j < n; j++, elem += size) {
+			union int_value v = {};
+
+			switch (size) {
+			case 1:
+				v.u[SIDE_INTEGER128_SPLIT_LOW] = type_integer->signedness ?
+					(uint64_t) (int64_t) *(const int8_t *) elem : *(const uint8_t *) elem;
+				break;
+			case 2:
+				v.u[SIDE_INTEGER128_SPLIT_LOW] = type_integer->signedness ?
+					(uint64_t) (int64_t) *(const int16_t *) elem : *(const uint16_t *) elem;
+				break;
+			case 4:
+				v.u[SIDE_INTEGER128_SPLIT_LOW] = type_integer->signedness ?
+					(uint64_t) (int64_t) *(const int32_t *) elem : *(const uint32_t *) elem;
+				break;
+			case 8:
+				v.u[SIDE_INTEGER128_SPLIT_LOW] = *(const uint64_t *) elem;
+				break;
+			default:
+				abort();
+			}
+			/* As tracer_load_integer_value(). */
+			if (type_integer->signedness && len_bits < 64 && v.s[SIDE_INTEGER128_SPLIT_LOW] < 0)
+				v.u[SIDE_INTEGER128_SPLIT_HIGH] = ~0ULL;
+			tracer_before_print_elem(NULL, priv);
+			tracer_print_type_integer_value(":", type_integer, v, len_bits, TRACER_DISPLAY_BASE_10);
+			tracer_after_print_elem(NULL, priv);
+		}
+	}
+}
+
+static
+void tracer_print_gather_float_array(const struct side_type_gather_float *type,
+	const void *ptr, uint32_t length, void *priv)
+{
+	const char *p = (const char *) ptr;
+	uint32_t i;
+
+	for (i = 0; i < length; i++) {
+		union side_float_value value;
+
+		memcpy(&value, p + i * type->type.float_size, type->type.float_size);
+		tracer_before_print_elem(NULL, priv);
+		tracer_print_type_float(":", &type->type, &value);
+		tracer_after_print_elem(NULL, priv);
+	}
+}
+
 static
 void tracer_print_gather_string(const struct side_type_gather_string *type,
 	const void *p, uint8_t unit_size,
@@ -1531,10 +1831,10 @@ void tracer_print_gather_enum(const struct side_type_gather_enum *type,
 
 	v = tracer_load_integer_value(&side_integer->type, value, 0, NULL);
 	print_attributes("attr", ":", side_array_elements(&mappings->attributes), side_array_length(&mappings->attributes));
-	printf("%s", side_array_length(&mappings->mappings) ? ", " : "");
-	printf("{ ");
+	tracer_puts(side_array_length(&mappings->mappings) ? ", " : "");
+	tracer_puts("{ ");
 	tracer_print_type_integer(":", &side_integer->type, value, 0, TRACER_DISPLAY_BASE_10);
-	printf(" }");
+	tracer_puts(" }");
 	print_enum_labels(mappings, v);
 }
 
@@ -1544,8 +1844,8 @@ void tracer_before_print_dynamic_field(const struct side_arg_dynamic_field *fiel
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(",");
-	printf(" %s:: { ", side_ptr_get(field->field_name));
+		tracer_puts(",");
+	tracer_printf(" %s:: { ", side_ptr_get(field->field_name));
 }
 
 static
@@ -1553,7 +1853,7 @@ void tracer_after_print_dynamic_field(const struct side_arg_dynamic_field *field
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1575,7 +1875,7 @@ void tracer_print_dynamic_null(const struct side_arg *item,
 {
 	tracer_print_type_header("value", "::", side_array_elements(&item->u.side_dynamic.side_null.attributes),
 				side_array_length(&item->u.side_dynamic.side_null.attributes));
-	printf("<NULL TYPE>");
+	tracer_puts("<NULL TYPE>");
 }
 
 static
@@ -1598,7 +1898,7 @@ void tracer_print_dynamic_byte(const struct side_arg *item,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("value", "::", side_array_elements(&item->u.side_dynamic.side_byte.type.attributes), side_array_length(&item->u.side_dynamic.side_byte.type.attributes));
-	printf("0x%" PRIx8, item->u.side_dynamic.side_byte.value);
+	tracer_print_hex(0, item->u.side_dynamic.side_byte.value);
 }
 
 static
@@ -1634,8 +1934,8 @@ void tracer_before_print_dynamic_struct(const struct side_arg_dynamic_struct *dy
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", "::", side_array_elements(&dynamic_struct->attributes), side_array_length(&dynamic_struct->attributes));
-	printf("%s", side_array_length(&dynamic_struct->attributes) ? ", " : "");
-	printf("fields:: {");
+	tracer_puts(side_array_length(&dynamic_struct->attributes) ? ", " : "");
+	tracer_puts("fields:: {");
 	push_nesting(ctx);
 }
 
@@ -1646,7 +1946,7 @@ void tracer_after_print_dynamic_struct(const struct side_arg_dynamic_struct *dyn
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -1660,8 +1960,8 @@ void tracer_before_print_dynamic_struct_visitor(const struct side_arg *item, voi
 		abort();
 
 	print_attributes("attr", "::", side_array_elements(&dynamic_struct_visitor->attributes), side_array_length(&dynamic_struct_visitor->attributes));
-	printf("%s", side_array_length(&dynamic_struct_visitor->attributes)? ", " : "");
-	printf("fields:: {");
+	tracer_puts(side_array_length(&dynamic_struct_visitor->attributes)? ", " : "");
+	tracer_puts("fields:: {");
 	push_nesting(ctx);
 }
 
@@ -1676,7 +1976,7 @@ void tracer_after_print_dynamic_struct_visitor(const struct side_arg *item, void
 		abort();
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -1685,8 +1985,8 @@ void tracer_before_print_dynamic_vla(const struct side_arg_dynamic_vla *dynamic_
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", "::", side_array_elements(&dynamic_vla->attributes), side_array_length(&dynamic_vla->attributes));
-	printf("%s", side_array_length(&dynamic_vla->attributes)? ", " : "");
-	printf("elements:: [");
+	tracer_puts(side_array_length(&dynamic_vla->attributes)? ", " : "");
+	tracer_puts("elements:: [");
 	push_nesting(ctx);
 }
 
@@ -1696,7 +1996,7 @@ void tracer_after_print_dynamic_vla(const struct side_arg_dynamic_vla *dynamic_v
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static
@@ -1710,8 +2010,8 @@ void tracer_before_print_dynamic_vla_visitor(const struct side_arg *item, void *
 		abort();
 
 	print_attributes("attr", "::", side_array_elements(&dynamic_vla_visitor->attributes), side_array_length(&dynamic_vla_visitor->attributes));
-	printf("%s", side_array_length(&dynamic_vla_visitor->attributes)? ", " : "");
-	printf("elements:: [");
+	tracer_puts(side_array_length(&dynamic_vla_visitor->attributes)? ", " : "");
+	tracer_puts("elements:: [");
 	push_nesting(ctx);
 }
 
@@ -1726,7 +2026,7 @@ void tracer_after_print_dynamic_vla_visitor(const struct side_arg *item, void *p
 		abort();
 
 	pop_nesting(ctx);
-	printf(" ]");
+	tracer_puts(" ]");
 }
 
 static struct side_type_visitor type_visitor = {
@@ -1771,6 +2071,8 @@ static struct side_type_visitor type_visitor = {
 	.gather_pointer_type_func = tracer_print_gather_pointer,
 	.gather_float_type_func = tracer_print_gather_float,
 	.gather_string_type_func = tracer_print_gather_string,
+	.gather_integer_array_type_func = tracer_print_gather_integer_array,
+	.gather_float_array_type_func = tracer_print_gather_float_array,
 
 	/* Gather compound types. */
 	.before_gather_struct_type_func = tracer_before_print_gather_struct,
@@ -1811,30 +2113,53 @@ static struct side_type_visitor type_visitor = {
 static
 void tracer_call(const struct side_event_description *desc,
 		const struct side_arg_vec *side_arg_vec,
-		void *priv __attribute__((unused)),
-		void *caller_addr)
+		void *priv, void *caller_addr)
 {
 	struct print_ctx ctx = {};
 
-	type_visitor_event(&type_visitor, desc, side_arg_vec, NULL, caller_addr, &ctx);
+	if (tracer_pipeline && side_async_pipeline_push(tracer_pipeline, desc, side_arg_vec,
+			priv, caller_addr))
+		return;
+	type_visitor_event(&type_visitor, desc, side_arg_vec, NULL, priv, caller_addr, &ctx);
 }
 
+static
+void tracer_consume(const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		void *priv, void *caller_addr)
+{
+	struct print_ctx ctx = {};
+
+	tracer_output.batched = true;
+	type_visitor_event(&type_visitor, desc, side_arg_vec, NULL, priv, caller_addr, &ctx);
+}
+
+static
+void tracer_consume_batch_end(void)
+{
+	tracer_output_flush(&tracer_output);
+}
+
+static const struct side_async_pipeline_ops tracer_pipeline_ops = {
+	.consume = tracer_consume,
+	.batch_end = tracer_consume_batch_end,
+};
+
 static
 void tracer_call_variadic(const struct side_event_description *desc,
 		const struct side_arg_vec *side_arg_vec,
 		const struct side_arg_dynamic_struct *var_struct,
-		void *priv __attribute__((unused)),
-		void *caller_addr)
+		void *priv, void *caller_addr)
 {
 	struct print_ctx ctx = {};
 
-	type_visitor_event(&type_visitor, desc, side_arg_vec, var_struct, caller_addr, &ctx);
+	type_visitor_event(&type_visitor, desc, side_arg_vec, var_struct, priv, caller_addr, &ctx);
 }
 
 static
 void before_print_description_event(const struct side_event_description *desc, void *priv __attribute__((unused)))
 {
-	printf("event description: provider: %s, event: %s", side_ptr_get(desc->provider_name), side_ptr_get(desc->event_name));
+	tracer_printf("event description: provider: %s, event: %s", side_ptr_get(desc->provider_name), side_ptr_get(desc->event_name));
 	print_attributes(", attr", ":", side_array_elements(&desc->attributes), side_array_length(&desc->attributes));
 }
 
@@ -1842,8 +2167,8 @@ static
 void after_print_description_event(const struct side_event_description *desc, void *priv __attribute__((unused)))
 {
 	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
-		printf(", <variadic fields>");
-	printf("\n");
+		tracer_puts(", <variadic fields>");
+	tracer_puts("\n");
 }
 
 static
@@ -1852,7 +2177,7 @@ void before_print_description_static_fields(const struct side_event_description
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 	uint32_t len = side_array_length(&desc->fields);
 
-	printf("%s", len ? ", fields: {" : "");
+	tracer_puts(len ? ", fields: {" : "");
 	push_nesting(ctx);
 }
 
@@ -1864,7 +2189,7 @@ void after_print_description_static_fields(const struct side_event_description *
 
 	pop_nesting(ctx);
 	if (len)
-		printf(" }");
+		tracer_puts(" }");
 }
 
 static
@@ -1873,8 +2198,8 @@ void before_print_description_field(const struct side_event_field *item_desc, vo
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(",");
-	printf(" %s: { ", side_ptr_get(item_desc->field_name));
+		tracer_puts(",");
+	tracer_printf(" %s: { ", side_ptr_get(item_desc->field_name));
 }
 
 static
@@ -1882,7 +2207,7 @@ void after_print_description_field(const struct side_event_field *item_desc __at
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1892,9 +2217,9 @@ void before_print_description_elem(const struct side_type *type_desc __attribute
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(", { ");
+		tracer_puts(", { ");
 	else
-		printf(" { ");
+		tracer_puts(" { ");
 }
 
 static
@@ -1902,7 +2227,7 @@ void after_print_description_elem(const struct side_type *type_desc __attribute_
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1912,12 +2237,12 @@ void before_print_description_option(const struct side_variant_option *option_de
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	if (get_nested_item_nr(ctx) != 0)
-		printf(",");
+		tracer_puts(",");
 	if (option_desc->range_begin == option_desc->range_end)
-		printf(" [ %" PRIu64 " ]: { ",
+		tracer_printf(" [ %" PRIu64 " ]: { ",
 			option_desc->range_begin);
 	else
-		printf(" [ %" PRIu64 " - %" PRIu64 " ]: { ",
+		tracer_printf(" [ %" PRIu64 " - %" PRIu64 " ]: { ",
 			option_desc->range_begin,
 			option_desc->range_end);
 }
@@ -1927,7 +2252,7 @@ void after_print_description_option(const struct side_variant_option *option_des
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf(" }");
+	tracer_puts(" }");
 	inc_nested_item_nr(ctx);
 }
 
@@ -1937,7 +2262,7 @@ void print_description_null(const struct side_type *type_desc,
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_null.attributes),
 				side_array_length(&type_desc->u.side_null.attributes));
-	printf("null");
+	tracer_puts("null");
 }
 
 static
@@ -1945,10 +2270,10 @@ void print_description_bool(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_bool.attributes), side_array_length(&type_desc->u.side_bool.attributes));
-	printf("bool { size: %" PRIu16, type_desc->u.side_bool.bool_size);
+	tracer_printf("bool { size: %" PRIu16, type_desc->u.side_bool.bool_size);
 	if (type_desc->u.side_bool.len_bits)
-		printf(", len_bits: %" PRIu16, type_desc->u.side_bool.len_bits);
-	printf(" }");
+		tracer_printf(", len_bits: %" PRIu16, type_desc->u.side_bool.len_bits);
+	tracer_puts(" }");
 }
 
 static
@@ -1956,13 +2281,13 @@ void print_description_integer(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_integer.attributes), side_array_length(&type_desc->u.side_integer.attributes));
-	printf("integer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
+	tracer_printf("integer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
 		type_desc->u.side_integer.integer_size,
 		type_desc->u.side_integer.signedness ? "true" : "false",
 		side_enum_get(type_desc->u.side_integer.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
 	if (type_desc->u.side_integer.len_bits)
-		printf(", len_bits: %" PRIu16, type_desc->u.side_integer.len_bits);
-	printf(" }");
+		tracer_printf(", len_bits: %" PRIu16, type_desc->u.side_integer.len_bits);
+	tracer_puts(" }");
 }
 
 static
@@ -1970,7 +2295,7 @@ void print_description_byte(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_byte.attributes), side_array_length(&type_desc->u.side_byte.attributes));
-	printf("byte");
+	tracer_puts("byte");
 }
 
 static
@@ -1978,13 +2303,13 @@ void print_description_pointer(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_integer.attributes), side_array_length(&type_desc->u.side_integer.attributes));
-	printf("pointer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
+	tracer_printf("pointer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
 		type_desc->u.side_integer.integer_size,
 		type_desc->u.side_integer.signedness ? "true" : "false",
 		side_enum_get(type_desc->u.side_integer.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
 	if (type_desc->u.side_integer.len_bits)
-		printf(", len_bits: %" PRIu16, type_desc->u.side_integer.len_bits);
-	printf(" }");
+		tracer_printf(", len_bits: %" PRIu16, type_desc->u.side_integer.len_bits);
+	tracer_puts(" }");
 }
 
 static
@@ -1992,10 +2317,10 @@ void print_description_float(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_float.attributes), side_array_length(&type_desc->u.side_float.attributes));
-	printf("float { size: %" PRIu16 ", byte_order: \"%s\"",
+	tracer_printf("float { size: %" PRIu16 ", byte_order: \"%s\"",
 		type_desc->u.side_float.float_size,
 		side_enum_get(type_desc->u.side_float.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2003,12 +2328,12 @@ void print_description_string(const struct side_type *type_desc,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type_desc->u.side_string.attributes), side_array_length(&type_desc->u.side_string.attributes));
-	printf("string { unit_size: %" PRIu8,
+	tracer_printf("string { unit_size: %" PRIu8,
 		type_desc->u.side_string.unit_size);
 	if (type_desc->u.side_string.unit_size > 1)
-		printf(", byte_order: \"%s\"",
+		tracer_printf(", byte_order: \"%s\"",
 			side_enum_get(type_desc->u.side_string.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2017,8 +2342,8 @@ void before_print_description_struct(const struct side_type_struct *side_struct,
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_struct->attributes), side_array_length(&side_struct->attributes));
-	printf("%s", side_array_length(&side_struct->attributes)? ", " : "");
-	printf("type: struct { fields: {");
+	tracer_puts(side_array_length(&side_struct->attributes)? ", " : "");
+	tracer_puts("type: struct { fields: {");
 	push_nesting(ctx);
 }
 
@@ -2029,7 +2354,7 @@ void after_print_description_struct(const struct side_type_struct *side_struct _
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" } }");
+	tracer_puts(" } }");
 }
 
 static
@@ -2038,8 +2363,8 @@ void before_print_description_variant(const struct side_type_variant *side_varia
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_variant->attributes), side_array_length(&side_variant->attributes));
-	printf("%s", side_array_length(&side_variant->attributes)? ", " : "");
-	printf("type: variant { options: {");
+	tracer_puts(side_array_length(&side_variant->attributes)? ", " : "");
+	tracer_puts("type: variant { options: {");
 	push_nesting(ctx);
 }
 
@@ -2049,7 +2374,7 @@ void after_print_description_variant(const struct side_type_variant *side_varian
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" } }");
+	tracer_puts(" } }");
 }
 
 static
@@ -2058,7 +2383,7 @@ void before_print_description_optional(const struct side_type *optional __attrib
 {
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
-	printf("type: optional {");
+	tracer_puts("type: optional {");
 	push_nesting(ctx);
 }
 
@@ -2068,7 +2393,27 @@ void after_print_description_optional(const struct side_type *optional __attribu
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" } }");
+	tracer_puts(" } }");
+}
+
+static
+void before_print_description_lazy(const struct side_type_lazy *side_lazy, void *priv)
+{
+	struct print_ctx *ctx = (struct print_ctx *) priv;
+
+	print_attributes("attr", ":", side_array_elements(&side_lazy->attributes), side_array_length(&side_lazy->attributes));
+	tracer_puts(side_array_length(&side_lazy->attributes)? ", " : "");
+	tracer_puts("type: lazy {");
+	push_nesting(ctx);
+}
+
+static
+void after_print_description_lazy(const struct side_type_lazy *side_lazy __attribute__((unused)), void *priv)
+{
+	struct print_ctx *ctx = (struct print_ctx *) priv;
+
+	pop_nesting(ctx);
+	tracer_puts(" }");
 }
 
 static
@@ -2077,8 +2422,8 @@ void before_print_description_array(const struct side_type_array *side_array, vo
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_array->attributes), side_array_length(&side_array->attributes));
-	printf("%s", side_array_length(&side_array->attributes)? ", " : "");
-	printf("type: array { length: %" PRIu32 ", element:", side_array->length);
+	tracer_puts(side_array_length(&side_array->attributes)? ", " : "");
+	tracer_printf("type: array { length: %" PRIu32 ", element:", side_array->length);
 	push_nesting(ctx);
 }
 
@@ -2089,7 +2434,7 @@ void after_print_description_array(const struct side_type_array *side_array __at
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2098,8 +2443,8 @@ void before_print_description_vla(const struct side_type_vla *side_vla, void *pr
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_vla->attributes), side_array_length(&side_vla->attributes));
-	printf("%s", side_array_length(&side_vla->attributes)? ", " : "");
-	printf("type: vla { length:");
+	tracer_puts(side_array_length(&side_vla->attributes)? ", " : "");
+	tracer_puts("type: vla { length:");
 	push_nesting(ctx);
 }
 
@@ -2109,7 +2454,7 @@ void after_length_print_description_vla(const struct side_type_vla *side_vla __a
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(", element:");
+	tracer_puts(", element:");
 	push_nesting(ctx);
 }
 
@@ -2119,7 +2464,7 @@ void after_element_print_description_vla(const struct side_type_vla *side_vla __
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2128,8 +2473,8 @@ void before_print_description_vla_visitor(const struct side_type_vla_visitor *si
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_vla_visitor->attributes), side_array_length(&side_vla_visitor->attributes));
-	printf("%s", side_array_length(&side_vla_visitor->attributes)? ", " : "");
-	printf("type: vla_visitor { length:");
+	tracer_puts(side_array_length(&side_vla_visitor->attributes)? ", " : "");
+	tracer_puts("type: vla_visitor { length:");
 	push_nesting(ctx);
 }
 
@@ -2139,7 +2484,7 @@ void after_length_print_description_vla_visitor(const struct side_type_vla_visit
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(", element:");
+	tracer_puts(", element:");
 	push_nesting(ctx);
 }
 
@@ -2149,7 +2494,7 @@ void after_element_print_description_vla_visitor(const struct side_type_vla_visi
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2159,7 +2504,7 @@ void do_before_print_description_enum(const char *type_name, const struct side_e
 	const struct side_enum_mapping *mapping;
 
 	tracer_print_type_header("type", ":", side_array_elements(&mappings->attributes), side_array_length(&mappings->attributes));
-	printf("%s { labels: { ", type_name);
+	tracer_printf("%s { labels: { ", type_name);
 	side_for_each_element_in_array (mapping, &mappings->mappings) {
 
 		if (mapping->range_end < mapping->range_begin) {
@@ -2167,26 +2512,26 @@ void do_before_print_description_enum(const char *type_name, const struct side_e
 				mapping->range_begin, mapping->range_end);
 			abort();
 		}
-		printf("%s", print_count++ ? ", " : "");
+		tracer_puts(print_count++ ? ", " : "");
 		if (mapping->range_begin == mapping->range_end)
-			printf("[ %" PRIu64 " ]: ", mapping->range_begin);
+			tracer_printf("[ %" PRIu64 " ]: ", mapping->range_begin);
 		else
-			printf("[ %" PRIu64 " - %" PRIu64 " ]: ",
+			tracer_printf("[ %" PRIu64 " - %" PRIu64 " ]: ",
 				mapping->range_begin, mapping->range_end);
 		tracer_print_type_string(side_ptr_get(mapping->label.p), mapping->label.unit_size,
 			side_enum_get(mapping->label.byte_order), NULL);
 	}
 	if (!print_count)
-		printf("<NO LABEL>");
+		tracer_puts("<NO LABEL>");
 
-	printf(" }, element: { ");
+	tracer_puts(" }, element: { ");
 }
 
 
 static
 void do_after_print_description_enum(const char *type_name __attribute__((unused)), const struct side_enum_mappings *mappings __attribute__((unused)), void *priv __attribute__((unused)))
 {
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2244,7 +2589,7 @@ void before_print_description_enum_bitmap(const struct side_type *type_desc, voi
 		abort();
 	}
 	tracer_print_type_header("type", ":", side_array_elements(&mappings->attributes), side_array_length(&mappings->attributes));
-	printf("enum_bitmap { labels: { ");
+	tracer_puts("enum_bitmap { labels: { ");
 	const struct side_enum_bitmap_mapping *mapping;
 	side_for_each_element_in_array(mapping, &mappings->mappings) {
 
@@ -2253,25 +2598,25 @@ void before_print_description_enum_bitmap(const struct side_type *type_desc, voi
 				mapping->range_begin, mapping->range_end);
 			abort();
 		}
-		printf("%s", print_count++ ? ", " : "");
+		tracer_puts(print_count++ ? ", " : "");
 		if (mapping->range_begin == mapping->range_end)
-			printf("[ %" PRIu64 " ]: ", mapping->range_begin);
+			tracer_printf("[ %" PRIu64 " ]: ", mapping->range_begin);
 		else
-			printf("[ %" PRIu64 " - %" PRIu64 " ]: ",
+			tracer_printf("[ %" PRIu64 " - %" PRIu64 " ]: ",
 				mapping->range_begin, mapping->range_end);
 		tracer_print_type_string(side_ptr_get(mapping->label.p), mapping->label.unit_size,
 			side_enum_get(mapping->label.byte_order), NULL);
 	}
 	if (!print_count)
-		printf("<NO LABEL>");
+		tracer_puts("<NO LABEL>");
 
-	printf(" }, element: { ");
+	tracer_puts(" }, element: { ");
 }
 
 static
 void after_print_description_enum_bitmap(const struct side_type *type_desc __attribute__((unused)), void *priv __attribute__((unused)))
 {
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2279,13 +2624,13 @@ void print_description_gather_bool(const struct side_type_gather_bool *type,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_bool { size: %" PRIu16, type->type.bool_size);
+	tracer_printf("gather_bool { size: %" PRIu16, type->type.bool_size);
 	if (type->type.len_bits)
-		printf(", len_bits: %" PRIu16, type->type.len_bits);
-	printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
+		tracer_printf(", len_bits: %" PRIu16, type->type.len_bits);
+	tracer_printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
 		type->offset, type->offset_bits,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2293,7 +2638,7 @@ void print_description_gather_byte(const struct side_type_gather_byte *type,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_byte { offset: %" PRIu64 ", access_mode: %s }",
+	tracer_printf("gather_byte { offset: %" PRIu64 ", access_mode: %s }",
 		type->offset,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
 }
@@ -2303,16 +2648,16 @@ void print_description_gather_integer(const struct side_type_gather_integer *typ
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_integer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
+	tracer_printf("gather_integer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
 		type->type.integer_size,
 		type->type.signedness ? "true" : "false",
 		side_enum_get(type->type.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
 	if (type->type.len_bits)
-		printf(", len_bits: %" PRIu16, type->type.len_bits);
-	printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
+		tracer_printf(", len_bits: %" PRIu16, type->type.len_bits);
+	tracer_printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
 		type->offset, type->offset_bits,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2320,16 +2665,16 @@ void print_description_gather_pointer(const struct side_type_gather_integer *typ
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_pointer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
+	tracer_printf("gather_pointer { size: %" PRIu16 ", signedness: %s, byte_order: \"%s\"",
 		type->type.integer_size,
 		type->type.signedness ? "true" : "false",
 		side_enum_get(type->type.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
 	if (type->type.len_bits)
-		printf(", len_bits: %" PRIu16, type->type.len_bits);
-	printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
+		tracer_printf(", len_bits: %" PRIu16, type->type.len_bits);
+	tracer_printf(", offset: %" PRIu64 ", offset_bits: %" PRIu16 ", access_mode: %s",
 		type->offset, type->offset_bits,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2337,13 +2682,13 @@ void print_description_gather_float(const struct side_type_gather_float *type,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_float { size: %" PRIu16 ", byte_order: \"%s\"",
+	tracer_printf("gather_float { size: %" PRIu16 ", byte_order: \"%s\"",
 		type->type.float_size,
 		side_enum_get(type->type.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
-	printf(", offset: %" PRIu64 ", access_mode: %s",
+	tracer_printf(", offset: %" PRIu64 ", access_mode: %s",
 		type->offset,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2351,15 +2696,15 @@ void print_description_gather_string(const struct side_type_gather_string *type,
 		void *priv __attribute__((unused)))
 {
 	tracer_print_type_header("type", ":", side_array_elements(&type->type.attributes), side_array_length(&type->type.attributes));
-	printf("gather_string { unit_size: %" PRIu8,
+	tracer_printf("gather_string { unit_size: %" PRIu8,
 		type->type.unit_size);
 	if (type->type.unit_size > 1)
-		printf(", byte_order: \"%s\"",
+		tracer_printf(", byte_order: \"%s\"",
 			side_enum_get(type->type.byte_order) == SIDE_TYPE_BYTE_ORDER_LE ? "le" : "be");
-	printf(", offset: %" PRIu64 ", access_mode: %s",
+	tracer_printf(", offset: %" PRIu64 ", access_mode: %s",
 		type->offset,
 		side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2369,8 +2714,8 @@ void before_print_description_gather_struct(const struct side_type_gather_struct
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_struct->attributes), side_array_length(&side_struct->attributes));
-	printf("%s", side_array_length(&side_struct->attributes)? ", " : "");
-	printf("type: gather_struct { size: %" PRIu32 ", offset: %" PRIu64 ", access_mode: %s, fields: {",
+	tracer_puts(side_array_length(&side_struct->attributes)? ", " : "");
+	tracer_printf("type: gather_struct { size: %" PRIu32 ", offset: %" PRIu64 ", access_mode: %s, fields: {",
 		side_gather_struct->size, side_gather_struct->offset,
 		side_enum_get(side_gather_struct->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
 	push_nesting(ctx);
@@ -2382,7 +2727,7 @@ void after_print_description_gather_struct(const struct side_type_gather_struct
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" } }");
+	tracer_puts(" } }");
 }
 
 static
@@ -2392,8 +2737,8 @@ void before_print_description_gather_array(const struct side_type_gather_array *
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_array->attributes), side_array_length(&side_array->attributes));
-	printf("%s", side_array_length(&side_array->attributes)? ", " : "");
-	printf("type: gather_array { offset: %" PRIu64 ", access_mode: %s, element:",
+	tracer_puts(side_array_length(&side_array->attributes)? ", " : "");
+	tracer_printf("type: gather_array { offset: %" PRIu64 ", access_mode: %s, element:",
 		side_gather_array->offset,
 		side_enum_get(side_gather_array->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
 	push_nesting(ctx);
@@ -2405,7 +2750,7 @@ void after_print_description_gather_array(const struct side_type_gather_array *s
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2415,8 +2760,8 @@ void before_print_description_gather_vla(const struct side_type_gather_vla *side
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	print_attributes("attr", ":", side_array_elements(&side_vla->attributes), side_array_length(&side_vla->attributes));
-	printf("%s", side_array_length(&side_vla->attributes)? ", " : "");
-	printf("type: gather_vla { offset: %" PRIu64 ", access_mode: %s, length:",
+	tracer_puts(side_array_length(&side_vla->attributes)? ", " : "");
+	tracer_printf("type: gather_vla { offset: %" PRIu64 ", access_mode: %s, length:",
 		side_gather_vla->offset,
 		side_enum_get(side_gather_vla->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT ? "\"direct\"" : "\"pointer\"");
 	push_nesting(ctx);
@@ -2428,7 +2773,7 @@ void after_length_print_description_gather_vla(const struct side_type_gather_vla
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(", element:");
+	tracer_puts(", element:");
 	push_nesting(ctx);
 }
 
@@ -2438,7 +2783,7 @@ void after_element_print_description_gather_vla(const struct side_type_gather_vl
 	struct print_ctx *ctx = (struct print_ctx *) priv;
 
 	pop_nesting(ctx);
-	printf(" }");
+	tracer_puts(" }");
 }
 
 static
@@ -2465,7 +2810,7 @@ void after_print_description_gather_enum(const struct side_type_gather_enum *typ
 static
 void print_description_dynamic(const struct side_type *type_desc __attribute__((unused)), void *priv __attribute__((unused)))
 {
-	printf("type: dynamic");
+	tracer_puts("type: dynamic");
 }
 
 static
@@ -2505,6 +2850,8 @@ struct side_description_visitor description_visitor = {
 	.after_element_vla_visitor_type_func = after_element_print_description_vla_visitor,
 	.before_optional_type_func = before_print_description_optional,
 	.after_optional_type_func = after_print_description_optional,
+	.before_lazy_type_func = before_print_description_lazy,
+	.after_lazy_type_func = after_print_description_lazy,
 
 	/* Stack-copy enumeration types. */
 	.before_enum_type_func = before_print_description_enum,
@@ -2545,17 +2892,64 @@ void print_event_description(const struct side_event_description *desc)
 	description_visitor_event(&description_visitor, desc, &ctx);
 }
 
+/* Returns the callback private data of an inserted event. */
+static
+void *tracer_projection_insert(const struct side_event_description *desc)
+{
+	struct tracer_event_projection *entry;
+
+	if (!tracer_fields)
+		return NULL;
+	entry = (struct tracer_event_projection *) calloc(1, sizeof(*entry));
+	if (!entry)
+		abort();
+	entry->desc = desc;
+	entry->projection = side_field_projection_compile(desc, tracer_fields);
+	if (!entry->projection)
+		abort();
+	entry->next = tracer_projections;
+	tracer_projections = entry;
+	return entry->projection;
+}
+
+/*
+ * Returns the callback private data of a removed event, and moves its
+ * projection to the removed list, freed after unregistration.
+ */
+static
+void *tracer_projection_remove(const struct side_event_description *desc,
+		struct tracer_event_projection **removed)
+{
+	struct tracer_event_projection **pos, *entry;
+
+	for (pos = &tracer_projections; (entry = *pos); pos = &entry->next) {
+		if (entry->desc != desc)
+			continue;
+		*pos = entry->next;
+		entry->next = *removed;
+		*removed = entry;
+		return entry->projection;
+	}
+	return NULL;
+}
+
 static
 void tracer_event_notification(enum side_tracer_notification notif,
 		struct side_event_description **events, uint32_t nr_events,
 		void *priv __attribute__((unused)))
 {
-	uint32_t i;
+	struct tracer_event_projection *removed = NULL;
+	struct side_tracer_callback_batch_entry *entries;
+	uint32_t i, nr_entries = 0;
 	int ret;
 
-	printf("----------------------------------------------------------\n");
-	printf("Tracer notified of events %s\n",
+	tracer_puts("----------------------------------------------------------\n");
+	tracer_printf("Tracer notified of events %s\n",
 		notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS ? "inserted" : "removed");
+	entries = (struct side_tracer_callback_batch_entry *)
+		calloc(nr_events, sizeof(struct side_tracer_callback_batch_entry));
+	if (nr_events && !entries)
+		abort();
 	for (i = 0; i < nr_events; i++) {
 		struct side_event_description *event = events[i];
 
@@ -2563,50 +2957,65 @@ void tracer_event_notification(enum side_tracer_notification notif,
 		if (!event)
 			continue;
 		if (event->version != SIDE_EVENT_DESCRIPTION_ABI_VERSION) {
-			printf("Error: event description ABI version (%u) does not match the version supported by the tracer (%u)\n",
+			tracer_printf("Error: event description ABI version (%u) does not match the version supported by the tracer (%u)\n",
 				event->version, SIDE_EVENT_DESCRIPTION_ABI_VERSION);
-				return;
+			break;
 		}
-		printf("provider: %s, event: %s\n",
+		tracer_printf("provider: %s, event: %s\n",
 			side_ptr_get(event->provider_name), side_ptr_get(event->event_name));
 		if (event->struct_size != side_offsetofend(struct side_event_description, side_event_description_orig_abi_last)) {
-			printf("Warning: Event %s.%s description contains fields unknown to the tracer\n",
+			tracer_printf("Warning: Event %s.%s description contains fields unknown to the tracer\n",
 				side_ptr_get(event->provider_name), side_ptr_get(event->event_name));
 		}
 		if (notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS) {
 			if (event->nr_side_type_label > _NR_SIDE_TYPE_LABEL) {
-				printf("Warning: event %s:%s may contain unknown field types (%u unknown types)\n",
+				tracer_printf("Warning: event %s:%s may contain unknown field types (%u unknown types)\n",
 					side_ptr_get(event->provider_name), side_ptr_get(event->event_name),
 					event->nr_side_type_label - _NR_SIDE_TYPE_LABEL);
 			}
 			if (event->nr_side_attr_type > _NR_SIDE_ATTR_TYPE) {
-				printf("Warning: event %s:%s may contain unknown attribute types (%u unknown types)\n",
+				tracer_printf("Warning: event %s:%s may contain unknown attribute types (%u unknown types)\n",
 					side_ptr_get(event->provider_name), side_ptr_get(event->event_name),
 					event->nr_side_attr_type - _NR_SIDE_ATTR_TYPE);
 			}
 			print_event_description(event);
-			if (event->flags & SIDE_EVENT_FLAG_VARIADIC) {
-				ret = side_tracer_callback_variadic_register(event, tracer_call_variadic, NULL, tracer_key);
-				if (ret)
-					abort();
-			} else {
-				ret = side_tracer_callback_register(event, tracer_call, NULL, tracer_key);
-				if (ret)
-					abort();
-			}
-		} else {
-			if (event->flags & SIDE_EVENT_FLAG_VARIADIC) {
-				ret = side_tracer_callback_variadic_unregister(event, tracer_call_variadic, NULL, tracer_key);
-				if (ret)
-					abort();
-			} else {
-				ret = side_tracer_callback_unregister(event, tracer_call, NULL, tracer_key);
-				if (ret)
-					abort();
-			}
 		}
+		entries[nr_entries].desc = event;
+		if (event->flags & SIDE_EVENT_FLAG_VARIADIC)
+			entries[nr_entries].u.call_variadic = tracer_call_variadic;
+		else
+			entries[nr_entries].u.call = tracer_call;
+		if (notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS)
+			entries[nr_entries].priv = tracer_projection_insert(event);
+		else
+			entries[nr_entries].priv = tracer_projection_remove(event, &removed);
+		entries[nr_entries].key = tracer_key;
+		nr_entries++;
 	}
-	printf("----------------------------------------------------------\n");
+	/* Enable or disable all events with a single grace period. */
+	if (notif == SIDE_TRACER_NOTIFICATION_INSERT_EVENTS)
+		ret = side_tracer_callback_register_batch(entries, nr_entries);
+	else
+		ret = side_tracer_callback_unregister_batch(entries, nr_entries);
+	if (ret)
+		abort();
+	free(entries);
+	/*
+	 * Queued events refer to the removed descriptions and projections.
+	 * The unregistration grace period ensures no event is queued
+	 * anymore.
+	 */
+	if (tracer_pipeline && notif == SIDE_TRACER_NOTIFICATION_REMOVE_EVENTS)
+		side_async_pipeline_drain(tracer_pipeline);
+	while (removed) {
+		struct tracer_event_projection *next = removed->next;
+
+		side_field_projection_destroy(removed->projection);
+		free(removed);
+		removed = next;
+	}
+	tracer_puts("----------------------------------------------------------\n");
+	tracer_output_end();
 }
 
 static __attribute__((constructor))
@@ -2614,8 +3023,50 @@ void tracer_init(void);
 static
 void tracer_init(void)
 {
+	const char *rcu_mode, *env;
+
+	env = getenv("LIBSIDE_TRACER_FD");
+	if (env && *env)
+		tracer_output_fd = atoi(env);
+	env = getenv("LIBSIDE_TRACER_FLUSH_EVENTS");
+	if (env && atoi(env) > 0)
+		tracer_flush_events = atoi(env);
+	env = getenv("LIBSIDE_TRACER_FIELDS");
+	if (env && *env)
+		tracer_fields = env;
+	env = getenv("LIBSIDE_TRACER_ASYNC");
+	if (env && atoi(env) > 0) {
+		size_t queue_size = TRACER_ASYNC_QUEUE_SIZE;
+
+		env = getenv("LIBSIDE_TRACER_ASYNC_QUEUE_SIZE");
+		if (env && atol(env) > 0)
+			queue_size = atol(env);
+		tracer_pipeline = side_async_pipeline_create(queue_size, &tracer_pipeline_ops);
+		if (!tracer_pipeline) {
+			fprintf(stderr, "Error: LIBSIDE_TRACER_ASYNC_QUEUE_SIZE must be a power of two\n");
+			abort();
+		}
+	}
+	if (pthread_key_create(&tracer_output_key, tracer_output_thread_exit))
+		abort();
 	if (side_tracer_request_key(&tracer_key))
 		abort();
+	switch (side_rcu_get_read_mode()) {
+	case SIDE_RCU_READ_MODE_RSEQ_MEMBARRIER:
+		rcu_mode = "rseq/membarrier";
+		break;
+	case SIDE_RCU_READ_MODE_MEMBARRIER:
+		rcu_mode = "membarrier";
+		break;
+	case SIDE_RCU_READ_MODE_ATOMIC:
+		rcu_mode = "atomic";
+		break;
+	default:
+		rcu_mode = "<UNKNOWN>";
+		break;
+	}
+	tracer_printf("Tracer: libside RCU read-side mode: %s\n", rcu_mode);
+	tracer_output_flush(&tracer_output);
 	tracer_handle = side_tracer_event_notification_register(tracer_event_notification, NULL);
 	if (!tracer_handle)
 		abort();
@@ -2627,4 +3078,15 @@ static
 void tracer_exit(void)
 {
 	side_tracer_event_notification_unregister(tracer_handle);
+	if (tracer_pipeline) {
+		struct side_async_pipeline_stats stats;
+
+		/* No more events are pushed once the notifications are unregistered. */
+		side_async_pipeline_get_stats(tracer_pipeline, &stats);
+		side_async_pipeline_destroy(tracer_pipeline);
+		tracer_printf("Tracer: asynchronous events: %" PRIu64 " queued, %" PRIu64 " dropped, queue depth: %" PRIu64 " bytes max\n",
+			stats.nr_events, stats.nr_dropped, stats.max_depth);
+		tracer_pipeline = NULL;
+	}
+	tracer_output_flush(&tracer_output);
 }
@@ -0,0 +1,967 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Types are compared through a canonical encoding of their
+ * description: labels, sizes, byte orders, gather offsets, field names,
+ * enumeration mappings and attributes, with integers in little endian,
+ * and nested types encoded in place. The content hash is the FNV-1a
+ * hash of the encoding, except for visitor and lazy function pointers:
+ * they are part of the encoding, so types calling different functions
+ * are not interned together, but not of the hash, which is therefore
+ * stable across processes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "range-index.h"
+#include "type-intern.h"
+#include "utf.h"
+
+#define SIDE_TYPE_INTERN_MIN_BUCKETS	64
+
+struct intern_encoder {
+	uint8_t *buf;		/* NULL when only hashing. */
+	size_t len;
+	size_t alloc_len;
+	uint64_t hash;
+	bool error;
+};
+
+struct intern_entry {
+	struct intern_entry *next;	/* Hash chain. */
+	uint64_t hash;
+	/* Instances in use, the first one is canonical. */
+	const void **instances;
+	uint32_t nr_instances;
+	uint32_t max_instances;
+};
+
+struct side_type_intern_layout {
+	struct intern_entry entry;	/* Instances are event descriptions. */
+	struct side_serialize_plan *plan;
+};
+
+struct intern_table {
+	struct intern_entry **buckets;
+	size_t nr_buckets;	/* Power of two. */
+	size_t nr_entries;
+};
+
+static struct intern_table type_table, layout_table;
+
+static
+void encoder_init(struct intern_encoder *enc, bool hash_only)
+{
+	memset(enc, 0, sizeof(*enc));
+	enc->hash = 0xcbf29ce484222325ULL;
+	if (!hash_only) {
+		enc->alloc_len = 256;
+		enc->buf = (uint8_t *) malloc(enc->alloc_len);
+		if (!enc->buf)
+			enc->error = true;
+	}
+}
+
+static
+void encoder_fini(struct intern_encoder *enc)
+{
+	free(enc->buf);
+}
+
+static
+void encode_bytes(struct intern_encoder *enc, const void *src, size_t len, bool hashed)
+{
+	const uint8_t *p = (const uint8_t *) src;
+	size_t i;
+
+	if (enc->error)
+		return;
+	if (hashed) {
+		for (i = 0; i < len; i++)
+			enc->hash = (enc->hash ^ p[i]) * 0x100000001b3ULL;
+	}
+	if (!enc->alloc_len)
+		return;
+	if (enc->len + len > enc->alloc_len) {
+		size_t alloc_len = enc->alloc_len;
+		uint8_t *buf;
+
+		while (enc->len + len > alloc_len)
+			alloc_len <<= 1;
+		buf = (uint8_t *) realloc(enc->buf, alloc_len);
+		if (!buf) {
+			enc->error = true;
+			return;
+		}
+		enc->buf = buf;
+		enc->alloc_len = alloc_len;
+	}
+	memcpy(enc->buf + enc->len, p, len);
+	enc->len += len;
+}
+
+static
+void encode_uint(struct intern_encoder *enc, uint64_t v, size_t size)
+{
+	uint8_t bytes[sizeof(uint64_t)];
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		bytes[i] = (uint8_t) (v >> (8 * i));
+	encode_bytes(enc, bytes, size, true);
+}
+
+static
+void encode_u8(struct intern_encoder *enc, uint8_t v)
+{
+	encode_uint(enc, v, sizeof(v));
+}
+
+static
+void encode_u16(struct intern_encoder *enc, uint16_t v)
+{
+	encode_uint(enc, v, sizeof(v));
+}
+
+static
+void encode_u32(struct intern_encoder *enc, uint32_t v)
+{
+	encode_uint(enc, v, sizeof(v));
+}
+
+static
+void encode_u64(struct intern_encoder *enc, uint64_t v)
+{
+	encode_uint(enc, v, sizeof(v));
+}
+
+static
+void encode_cstr(struct intern_encoder *enc, const char *str)
+{
+	if (!str)
+		str = "";
+	encode_bytes(enc, str, strlen(str) + 1, true);
+}
+
+/* Not hashed: function addresses differ between processes. */
+static
+void encode_func(struct intern_encoder *enc, uintptr_t func)
+{
+	encode_bytes(enc, &func, sizeof(func), false);
+}
+
+static
+void encode_raw_string(struct intern_encoder *enc, struct side_type_raw_string str)
+{
+	const void *p = side_ptr_get(str.p);
+	size_t len;
+
+	encode_u8(enc, str.unit_size);
+	encode_u8(enc, side_enum_get(str.byte_order));
+	if (str.unit_size != 1 && str.unit_size != 2 && str.unit_size != 4) {
+		enc->error = true;
+		return;
+	}
+	if (!p) {
+		encode_u32(enc, 0);
+		return;
+	}
+	len = side_utf_strlen(p, str.unit_size);
+	encode_u32(enc, len);
+	encode_bytes(enc, p, len * str.unit_size, true);
+}
+
+static
+void encode_attr_value(struct intern_encoder *enc, const struct side_attr_value *value)
+{
+	uint32_t type = side_enum_get(value->type);
+
+	encode_u32(enc, type);
+	switch (type) {
+	case SIDE_ATTR_TYPE_NULL:
+		break;
+	case SIDE_ATTR_TYPE_BOOL:
+		encode_u8(enc, value->u.bool_value);
+		break;
+	case SIDE_ATTR_TYPE_U8:
+		encode_u8(enc, value->u.integer_value.side_u8);
+		break;
+	case SIDE_ATTR_TYPE_S8:
+		encode_u8(enc, (uint8_t) value->u.integer_value.side_s8);
+		break;
+	case SIDE_ATTR_TYPE_U16:
+		encode_u16(enc, value->u.integer_value.side_u16);
+		break;
+	case SIDE_ATTR_TYPE_S16:
+		encode_u16(enc, (uint16_t) value->u.integer_value.side_s16);
+		break;
+	case SIDE_ATTR_TYPE_U32:
+		encode_u32(enc, value->u.integer_value.side_u32);
+		break;
+	case SIDE_ATTR_TYPE_S32:
+		encode_u32(enc, (uint32_t) value->u.integer_value.side_s32);
+		break;
+	case SIDE_ATTR_TYPE_U64:
+		encode_u64(enc, value->u.integer_value.side_u64);
+		break;
+	case SIDE_ATTR_TYPE_S64:
+		encode_u64(enc, (uint64_t) value->u.integer_value.side_s64);
+		break;
+	case SIDE_ATTR_TYPE_U128:
+	case SIDE_ATTR_TYPE_S128:
+		encode_u64(enc, value->u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_LOW]);
+		encode_u64(enc, value->u.integer_value.side_u128_split[SIDE_INTEGER128_SPLIT_HIGH]);
+		break;
+	/* Floats are encoded in host byte order. */
+	case SIDE_ATTR_TYPE_FLOAT_BINARY16:
+		encode_bytes(enc, &value->u.float_value, 2, true);
+		break;
+	case SIDE_ATTR_TYPE_FLOAT_BINARY32:
+		encode_bytes(enc, &value->u.float_value, 4, true);
+		break;
+	case SIDE_ATTR_TYPE_FLOAT_BINARY64:
+		encode_bytes(enc, &value->u.float_value, 8, true);
+		break;
+	case SIDE_ATTR_TYPE_FLOAT_BINARY128:
+		encode_bytes(enc, &value->u.float_value, 16, true);
+		break;
+	case SIDE_ATTR_TYPE_STRING:
+		encode_raw_string(enc, value->u.string_value);
+		break;
+	default:
+		enc->error = true;
+		break;
+	}
+}
+
+static
+void encode_attrs(struct intern_encoder *enc, const struct side_attr *attrs, uint32_t nr_attrs)
+{
+	uint32_t i;
+
+	encode_u32(enc, nr_attrs);
+	for (i = 0; i < nr_attrs; i++) {
+		struct side_attr_value value = attrs[i].value;
+
+		encode_raw_string(enc, attrs[i].key);
+		encode_attr_value(enc, &value);
+	}
+}
+
+#define encode_attr_list(_enc, _array) \
+	encode_attrs(_enc, side_array_elements(_array), side_array_length(_array))
+
+static
+void encode_bool_params(struct intern_encoder *enc, const struct side_type_bool *type)
+{
+	encode_attr_list(enc, &type->attributes);
+	encode_u16(enc, type->bool_size);
+	encode_u16(enc, type->len_bits);
+	encode_u8(enc, side_enum_get(type->byte_order));
+}
+
+static
+void encode_integer_params(struct intern_encoder *enc, const struct side_type_integer *type)
+{
+	encode_attr_list(enc, &type->attributes);
+	encode_u16(enc, type->integer_size);
+	encode_u16(enc, type->len_bits);
+	encode_u8(enc, type->signedness);
+	encode_u8(enc, side_enum_get(type->byte_order));
+}
+
+static
+void encode_float_params(struct intern_encoder *enc, const struct side_type_float *type)
+{
+	encode_attr_list(enc, &type->attributes);
+	encode_u16(enc, type->float_size);
+	encode_u8(enc, side_enum_get(type->byte_order));
+}
+
+static
+void encode_string_params(struct intern_encoder *enc, const struct side_type_string *type)
+{
+	encode_attr_list(enc, &type->attributes);
+	encode_u8(enc, type->unit_size);
+	encode_u8(enc, side_enum_get(type->byte_order));
+}
+
+static
+void encode_enum_mappings(struct intern_encoder *enc, const struct side_enum_mappings *mappings)
+{
+	const struct side_enum_mapping *mapping;
+
+	encode_attr_list(enc, &mappings->attributes);
+	encode_u32(enc, side_array_length(&mappings->mappings));
+	side_for_each_element_in_array(mapping, &mappings->mappings) {
+		encode_u64(enc, (uint64_t) mapping->range_begin);
+		encode_u64(enc, (uint64_t) mapping->range_end);
+		encode_raw_string(enc, mapping->label);
+	}
+}
+
+static
+void encode_enum_bitmap_mappings(struct intern_encoder *enc, const struct side_enum_bitmap_mappings *mappings)
+{
+	const struct side_enum_bitmap_mapping *mapping;
+
+	encode_attr_list(enc, &mappings->attributes);
+	encode_u32(enc, side_array_length(&mappings->mappings));
+	side_for_each_element_in_array(mapping, &mappings->mappings) {
+		encode_u64(enc, mapping->range_begin);
+		encode_u64(enc, mapping->range_end);
+		encode_raw_string(enc, mapping->label);
+	}
+}
+
+static
+void encode_type(struct intern_encoder *enc, const struct side_type *type);
+
+static
+void encode_fields(struct intern_encoder *enc, const struct side_event_field *fields, uint32_t nr_fields)
+{
+	uint32_t i;
+
+	encode_u32(enc, nr_fields);
+	for (i = 0; i < nr_fields; i++) {
+		encode_cstr(enc, side_ptr_get(fields[i].field_name));
+		encode_type(enc, &fields[i].side_type);
+	}
+}
+
+static
+void encode_struct(struct intern_encoder *enc, const struct side_type_struct *side_struct)
+{
+	encode_fields(enc, side_array_elements(&side_struct->fields),
+		side_array_length(&side_struct->fields));
+	encode_attr_list(enc, &side_struct->attributes);
+}
+
+static
+void encode_array(struct intern_encoder *enc, const struct side_type_array *side_array)
+{
+	encode_type(enc, side_ptr_get(side_array->elem_type));
+	encode_u32(enc, side_array->length);
+	encode_attr_list(enc, &side_array->attributes);
+}
+
+static
+void encode_vla(struct intern_encoder *enc, const struct side_type_vla *side_vla)
+{
+	encode_type(enc, side_ptr_get(side_vla->elem_type));
+	encode_type(enc, side_ptr_get(side_vla->length_type));
+	encode_attr_list(enc, &side_vla->attributes);
+}
+
+static
+void encode_gather_header(struct intern_encoder *enc, uint64_t offset,
+		uint8_t access_mode)
+{
+	encode_u64(enc, offset);
+	encode_u8(enc, access_mode);
+}
+
+static
+void encode_gather(struct intern_encoder *enc, uint16_t label, const struct side_type_gather *gather)
+{
+	switch (label) {
+	case SIDE_TYPE_GATHER_BOOL:
+		encode_gather_header(enc, gather->u.side_bool.offset,
+			side_enum_get(gather->u.side_bool.access_mode));
+		encode_u16(enc, gather->u.side_bool.offset_bits);
+		encode_bool_params(enc, &gather->u.side_bool.type);
+		break;
+	case SIDE_TYPE_GATHER_BYTE:
+		encode_gather_header(enc, gather->u.side_byte.offset,
+			side_enum_get(gather->u.side_byte.access_mode));
+		encode_attr_list(enc, &gather->u.side_byte.type.attributes);
+		break;
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+		encode_gather_header(enc, gather->u.side_integer.offset,
+			side_enum_get(gather->u.side_integer.access_mode));
+		encode_u16(enc, gather->u.side_integer.offset_bits);
+		encode_integer_params(enc, &gather->u.side_integer.type);
+		break;
+	case SIDE_TYPE_GATHER_FLOAT:
+		encode_gather_header(enc, gather->u.side_float.offset,
+			side_enum_get(gather->u.side_float.access_mode));
+		encode_float_params(enc, &gather->u.side_float.type);
+		break;
+	case SIDE_TYPE_GATHER_STRING:
+		encode_gather_header(enc, gather->u.side_string.offset,
+			side_enum_get(gather->u.side_string.access_mode));
+		encode_string_params(enc, &gather->u.side_string.type);
+		break;
+	case SIDE_TYPE_GATHER_ENUM:
+		encode_enum_mappings(enc, side_ptr_get(gather->u.side_enum.mappings));
+		encode_type(enc, side_ptr_get(gather->u.side_enum.elem_type));
+		break;
+	case SIDE_TYPE_GATHER_STRUCT:
+		encode_gather_header(enc, gather->u.side_struct.offset,
+			side_enum_get(gather->u.side_struct.access_mode));
+		encode_u32(enc, gather->u.side_struct.size);
+		encode_struct(enc, side_ptr_get(gather->u.side_struct.type));
+		break;
+	case SIDE_TYPE_GATHER_ARRAY:
+		encode_gather_header(enc, gather->u.side_array.offset,
+			side_enum_get(gather->u.side_array.access_mode));
+		encode_array(enc, &gather->u.side_array.type);
+		break;
+	case SIDE_TYPE_GATHER_VLA:
+		encode_gather_header(enc, gather->u.side_vla.offset,
+			side_enum_get(gather->u.side_vla.access_mode));
+		encode_vla(enc, &gather->u.side_vla.type);
+		break;
+	}
+}
+
+static
+void encode_type(struct intern_encoder *enc, const struct side_type *type)
+{
+	uint16_t label = side_enum_get(type->type);
+
+	encode_u16(enc, label);
+	switch (label) {
+	case SIDE_TYPE_NULL:
+		encode_attr_list(enc, &type->u.side_null.attributes);
+		break;
+	case SIDE_TYPE_BOOL:
+		encode_bool_params(enc, &type->u.side_bool);
+		break;
+	case SIDE_TYPE_BYTE:
+		encode_attr_list(enc, &type->u.side_byte.attributes);
+		break;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_U128:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_S128:
+	case SIDE_TYPE_POINTER:
+		encode_integer_params(enc, &type->u.side_integer);
+		break;
+	case SIDE_TYPE_FLOAT_BINARY16:
+	case SIDE_TYPE_FLOAT_BINARY32:
+	case SIDE_TYPE_FLOAT_BINARY64:
+	case SIDE_TYPE_FLOAT_BINARY128:
+		encode_float_params(enc, &type->u.side_float);
+		break;
+	case SIDE_TYPE_STRING_UTF8:
+	case SIDE_TYPE_STRING_UTF16:
+	case SIDE_TYPE_STRING_UTF32:
+		encode_string_params(enc, &type->u.side_string);
+		break;
+	case SIDE_TYPE_STRUCT:
+		encode_struct(enc, side_ptr_get(type->u.side_struct));
+		break;
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_type_variant *variant = side_ptr_get(type->u.side_variant);
+		const struct side_variant_option *option;
+
+		encode_type(enc, &variant->selector);
+		encode_u32(enc, side_array_length(&variant->options));
+		side_for_each_element_in_array(option, &variant->options) {
+			encode_u64(enc, (uint64_t) option->range_begin);
+			encode_u64(enc, (uint64_t) option->range_end);
+			encode_type(enc, &option->side_type);
+		}
+		encode_attr_list(enc, &variant->attributes);
+		break;
+	}
+	case SIDE_TYPE_OPTIONAL:
+	{
+		const struct side_type_optional *optional = side_ptr_get(type->u.side_optional);
+
+		encode_type(enc, side_ptr_get(optional->elem_type));
+		encode_attr_list(enc, &optional->attributes);
+		break;
+	}
+	case SIDE_TYPE_ARRAY:
+		encode_array(enc, side_ptr_get(type->u.side_array));
+		break;
+	case SIDE_TYPE_VLA:
+		encode_vla(enc, side_ptr_get(type->u.side_vla));
+		break;
+	case SIDE_TYPE_VLA_VISITOR:
+	{
+		const struct side_type_vla_visitor *vla_visitor = side_ptr_get(type->u.side_vla_visitor);
+
+		encode_type(enc, side_ptr_get(vla_visitor->elem_type));
+		encode_type(enc, side_ptr_get(vla_visitor->length_type));
+		encode_func(enc, (uintptr_t) side_ptr_get(vla_visitor->visitor));
+		encode_attr_list(enc, &vla_visitor->attributes);
+		break;
+	}
+	case SIDE_TYPE_LAZY:
+	{
+		const struct side_type_lazy *lazy = side_ptr_get(type->u.side_lazy);
+
+		encode_type(enc, side_ptr_get(lazy->value_type));
+		encode_func(enc, (uintptr_t) side_ptr_get(lazy->func));
+		encode_attr_list(enc, &lazy->attributes);
+		break;
+	}
+	case SIDE_TYPE_ENUM:
+		encode_enum_mappings(enc, side_ptr_get(type->u.side_enum.mappings));
+		encode_type(enc, side_ptr_get(type->u.side_enum.elem_type));
+		break;
+	case SIDE_TYPE_ENUM_BITMAP:
+		encode_enum_bitmap_mappings(enc, side_ptr_get(type->u.side_enum_bitmap.mappings));
+		encode_type(enc, side_ptr_get(type->u.side_enum_bitmap.elem_type));
+		break;
+	case SIDE_TYPE_GATHER_BOOL:
+	case SIDE_TYPE_GATHER_BYTE:
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+	case SIDE_TYPE_GATHER_FLOAT:
+	case SIDE_TYPE_GATHER_STRING:
+	case SIDE_TYPE_GATHER_ENUM:
+	case SIDE_TYPE_GATHER_STRUCT:
+	case SIDE_TYPE_GATHER_ARRAY:
+	case SIDE_TYPE_GATHER_VLA:
+		encode_gather(enc, label, &type->u.side_gather);
+		break;
+	default:
+		/* Dynamic types: the label describes them. */
+		break;
+	}
+}
+
+/* Flags and static fields. Variadic fields are not described. */
+static
+void encode_event_fields(struct intern_encoder *enc, const struct side_event_description *desc)
+{
+	encode_u64(enc, desc->flags);
+	encode_fields(enc, side_array_elements(&desc->fields), side_array_length(&desc->fields));
+}
+
+uint64_t side_type_hash(const struct side_type *type)
+{
+	struct intern_encoder enc;
+
+	encoder_init(&enc, true);
+	encode_type(&enc, type);
+	return enc.hash;
+}
+
+uint64_t side_event_fields_hash(const struct side_event_description *desc)
+{
+	struct intern_encoder enc;
+
+	encoder_init(&enc, true);
+	encode_event_fields(&enc, desc);
+	return enc.hash;
+}
+
+static
+bool type_is_interned(const struct side_type *type)
+{
+	switch (side_enum_get(type->type)) {
+	case SIDE_TYPE_STRUCT:
+	case SIDE_TYPE_VARIANT:
+	case SIDE_TYPE_OPTIONAL:
+	case SIDE_TYPE_ARRAY:
+	case SIDE_TYPE_VLA:
+	case SIDE_TYPE_VLA_VISITOR:
+	case SIDE_TYPE_LAZY:
+	case SIDE_TYPE_ENUM:
+	case SIDE_TYPE_ENUM_BITMAP:
+	case SIDE_TYPE_GATHER_ENUM:
+	case SIDE_TYPE_GATHER_STRUCT:
+	case SIDE_TYPE_GATHER_ARRAY:
+	case SIDE_TYPE_GATHER_VLA:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Grow the table to hold at least nr entries. */
+static
+int table_reserve(struct intern_table *table, size_t nr)
+{
+	struct intern_entry **buckets;
+	size_t nr_buckets = table->nr_buckets, i;
+
+	if (nr_buckets >= nr && nr_buckets)
+		return SIDE_ERROR_OK;
+	if (!nr_buckets)
+		nr_buckets = SIDE_TYPE_INTERN_MIN_BUCKETS;
+	while (nr_buckets < nr)
+		nr_buckets <<= 1;
+	buckets = (struct intern_entry **) calloc(nr_buckets, sizeof(struct intern_entry *));
+	if (!buckets)
+		return SIDE_ERROR_NOMEM;
+	for (i = 0; i < table->nr_buckets; i++) {
+		struct intern_entry *entry, *next;
+
+		for (entry = table->buckets[i]; entry; entry = next) {
+			size_t bucket = entry->hash & (nr_buckets - 1);
+
+			next = entry->next;
+			entry->next = buckets[bucket];
+			buckets[bucket] = entry;
+		}
+	}
+	free(table->buckets);
+	table->buckets = buckets;
+	table->nr_buckets = nr_buckets;
+	return SIDE_ERROR_OK;
+}
+
+static
+int entry_add_instance(struct intern_entry *entry, const void *instance)
+{
+	if (entry->nr_instances == entry->max_instances) {
+		uint32_t max_instances = entry->max_instances ? 2 * entry->max_instances : 1;
+		const void **instances;
+
+		instances = (const void **) realloc(entry->instances, max_instances * sizeof(const void *));
+		if (!instances)
+			return SIDE_ERROR_NOMEM;
+		entry->instances = instances;
+		entry->max_instances = max_instances;
+	}
+	entry->instances[entry->nr_instances++] = instance;
+	return SIDE_ERROR_OK;
+}
+
+/* Returns false if instance is not an instance of entry. */
+static
+bool entry_remove_instance(struct intern_entry *entry, const void *instance)
+{
+	uint32_t i;
+
+	for (i = 0; i < entry->nr_instances; i++) {
+		if (entry->instances[i] != instance)
+			continue;
+		/* Keep the oldest instance in use canonical. */
+		memmove(&entry->instances[i], &entry->instances[i + 1],
+			(entry->nr_instances - i - 1) * sizeof(const void *));
+		entry->nr_instances--;
+		return true;
+	}
+	return false;
+}
+
+static
+void table_unlink(struct intern_table *table, struct intern_entry *entry)
+{
+	struct intern_entry **pos;
+
+	for (pos = &table->buckets[entry->hash & (table->nr_buckets - 1)]; *pos; pos = &(*pos)->next) {
+		if (*pos == entry) {
+			*pos = entry->next;
+			table->nr_entries--;
+			return;
+		}
+	}
+}
+
+typedef void (*intern_encode_func)(struct intern_encoder *enc, const void *instance);
+
+static
+void encode_type_instance(struct intern_encoder *enc, const void *instance)
+{
+	encode_type(enc, (const struct side_type *) instance);
+}
+
+static
+void encode_layout_instance(struct intern_encoder *enc, const void *instance)
+{
+	encode_event_fields(enc, (const struct side_event_description *) instance);
+}
+
+/*
+ * Find the entry structurally identical to the encoded instance.
+ * Returns NULL if there is none or on allocation failure.
+ */
+static
+struct intern_entry *table_find(const struct intern_table *table, const struct intern_encoder *enc,
+		intern_encode_func encode)
+{
+	struct intern_entry *entry;
+
+	if (!table->nr_buckets)
+		return NULL;
+	for (entry = table->buckets[enc->hash & (table->nr_buckets - 1)]; entry; entry = entry->next) {
+		struct intern_encoder canonical;
+		bool match;
+
+		if (entry->hash != enc->hash)
+			continue;
+		encoder_init(&canonical, false);
+		encode(&canonical, entry->instances[0]);
+		match = !canonical.error && canonical.len == enc->len &&
+			!memcmp(canonical.buf, enc->buf, enc->len);
+		encoder_fini(&canonical);
+		if (match)
+			return entry;
+	}
+	return NULL;
+}
+
+/* Find the entry holding instance, from its content hash. */
+static
+struct intern_entry *table_find_instance(const struct intern_table *table, uint64_t hash,
+		const void *instance)
+{
+	struct intern_entry *entry;
+
+	if (!table->nr_buckets)
+		return NULL;
+	for (entry = table->buckets[hash & (table->nr_buckets - 1)]; entry; entry = entry->next) {
+		uint32_t i;
+
+		if (entry->hash != hash)
+			continue;
+		for (i = 0; i < entry->nr_instances; i++) {
+			if (entry->instances[i] == instance)
+				return entry;
+		}
+	}
+	return NULL;
+}
+
+static
+void table_insert(struct intern_table *table, struct intern_entry *entry)
+{
+	size_t bucket = entry->hash & (table->nr_buckets - 1);
+
+	entry->next = table->buckets[bucket];
+	table->buckets[bucket] = entry;
+	table->nr_entries++;
+}
+
+static
+void intern_type(const struct side_type *type)
+{
+	struct intern_encoder enc;
+	struct intern_entry *entry;
+
+	side_range_index_add(type);
+	encoder_init(&enc, false);
+	encode_type(&enc, type);
+	if (enc.error)
+		goto end;
+	entry = table_find(&type_table, &enc, encode_type_instance);
+	if (entry) {
+		(void) entry_add_instance(entry, type);
+		goto end;
+	}
+	if (table_reserve(&type_table, type_table.nr_entries + 1))
+		goto end;
+	entry = (struct intern_entry *) calloc(1, sizeof(struct intern_entry));
+	if (!entry)
+		goto end;
+	entry->hash = enc.hash;
+	if (entry_add_instance(entry, type)) {
+		free(entry);
+		goto end;
+	}
+	table_insert(&type_table, entry);
+end:
+	encoder_fini(&enc);
+}
+
+static
+void release_type(const struct side_type *type)
+{
+	struct intern_entry *entry;
+
+	side_range_index_remove(type);
+	entry = table_find_instance(&type_table, side_type_hash(type), type);
+	if (!entry)
+		return;
+	(void) entry_remove_instance(entry, type);
+	if (entry->nr_instances)
+		return;
+	table_unlink(&type_table, entry);
+	free(entry->instances);
+	free(entry);
+}
+
+static
+void walk_type(const struct side_type *type, void (*func)(const struct side_type *type));
+
+static
+void walk_fields(const struct side_event_field *fields, uint32_t nr_fields,
+		void (*func)(const struct side_type *type))
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_fields; i++)
+		walk_type(&fields[i].side_type, func);
+}
+
+static
+void walk_struct(const struct side_type_struct *side_struct, void (*func)(const struct side_type *type))
+{
+	walk_fields(side_array_elements(&side_struct->fields), side_array_length(&side_struct->fields), func);
+}
+
+/* Apply func to each interned type of the tree, children first. */
+static
+void walk_type(const struct side_type *type, void (*func)(const struct side_type *type))
+{
+	switch (side_enum_get(type->type)) {
+	case SIDE_TYPE_STRUCT:
+		walk_struct(side_ptr_get(type->u.side_struct), func);
+		break;
+	case SIDE_TYPE_VARIANT:
+	{
+		const struct side_type_variant *variant = side_ptr_get(type->u.side_variant);
+		const struct side_variant_option *option;
+
+		side_for_each_element_in_array(option, &variant->options)
+			walk_type(&option->side_type, func);
+		break;
+	}
+	case SIDE_TYPE_OPTIONAL:
+		walk_type(side_ptr_get(side_ptr_get(type->u.side_optional)->elem_type), func);
+		break;
+	case SIDE_TYPE_ARRAY:
+		walk_type(side_ptr_get(side_ptr_get(type->u.side_array)->elem_type), func);
+		break;
+	case SIDE_TYPE_VLA:
+		walk_type(side_ptr_get(side_ptr_get(type->u.side_vla)->elem_type), func);
+		break;
+	case SIDE_TYPE_VLA_VISITOR:
+		walk_type(side_ptr_get(side_ptr_get(type->u.side_vla_visitor)->elem_type), func);
+		break;
+	case SIDE_TYPE_LAZY:
+		walk_type(side_ptr_get(side_ptr_get(type->u.side_lazy)->value_type), func);
+		break;
+	case SIDE_TYPE_GATHER_STRUCT:
+		walk_struct(side_ptr_get(type->u.side_gather.u.side_struct.type), func);
+		break;
+	case SIDE_TYPE_GATHER_ARRAY:
+		walk_type(side_ptr_get(type->u.side_gather.u.side_array.type.elem_type), func);
+		break;
+	case SIDE_TYPE_GATHER_VLA:
+		walk_type(side_ptr_get(type->u.side_gather.u.side_vla.type.elem_type), func);
+		break;
+	default:
+		break;
+	}
+	if (type_is_interned(type))
+		func(type);
+}
+
+struct side_type_intern_layout *side_type_intern_event(const struct side_event_description *desc)
+{
+	struct side_type_intern_layout *layout = NULL;
+	struct intern_encoder enc;
+	struct intern_entry *entry;
+
+	walk_fields(side_array_elements(&desc->fields), side_array_length(&desc->fields), intern_type);
+
+	encoder_init(&enc, false);
+	encode_event_fields(&enc, desc);
+	if (enc.error)
+		goto end;
+	entry = table_find(&layout_table, &enc, encode_layout_instance);
+	if (entry) {
+		if (!entry_add_instance(entry, desc))
+			layout = side_container_of(entry, struct side_type_intern_layout, entry);
+		goto end;
+	}
+	if (table_reserve(&layout_table, layout_table.nr_entries + 1))
+		goto end;
+	layout = (struct side_type_intern_layout *) calloc(1, sizeof(struct side_type_intern_layout));
+	if (!layout)
+		goto end;
+	layout->entry.hash = enc.hash;
+	if (entry_add_instance(&layout->entry, desc)) {
+		free(layout);
+		layout = NULL;
+		goto end;
+	}
+	layout->plan = side_serialize_plan_compile(desc);
+	table_insert(&layout_table, &layout->entry);
+end:
+	encoder_fini(&enc);
+	return layout;
+}
+
+void side_type_intern_event_release(const struct side_event_description *desc,
+		struct side_type_intern_layout *layout)
+{
+	walk_fields(side_array_elements(&desc->fields), side_array_length(&desc->fields), release_type);
+	if (!layout)
+		return;
+	(void) entry_remove_instance(&layout->entry, desc);
+	if (layout->entry.nr_instances)
+		return;
+	table_unlink(&layout_table, &layout->entry);
+	side_serialize_plan_destroy(layout->plan);
+	free(layout->entry.instances);
+	free(layout);
+}
+
+const struct side_serialize_plan *side_type_intern_layout_plan(const struct side_type_intern_layout *layout)
+{
+	return layout ? layout->plan : NULL;
+}
+
+const struct side_type *side_type_intern_lookup(const struct side_type *type)
+{
+	const struct side_type *canonical = NULL;
+	struct intern_encoder enc;
+	struct intern_entry *entry;
+
+	if (!type_is_interned(type))
+		return NULL;
+	encoder_init(&enc, false);
+	encode_type(&enc, type);
+	if (!enc.error) {
+		entry = table_find(&type_table, &enc, encode_type_instance);
+		if (entry)
+			canonical = (const struct side_type *) entry->instances[0];
+	}
+	encoder_fini(&enc);
+	return canonical;
+}
+
+static
+void table_free(struct intern_table *table, bool layouts)
+{
+	size_t i;
+
+	for (i = 0; i < table->nr_buckets; i++) {
+		struct intern_entry *entry, *next;
+
+		for (entry = table->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry->instances);
+			if (layouts) {
+				struct side_type_intern_layout *layout =
+					side_container_of(entry, struct side_type_intern_layout, entry);
+
+				side_serialize_plan_destroy(layout->plan);
+				free(layout);
+			} else {
+				free(entry);
+			}
+		}
+	}
+	free(table->buckets);
+	memset(table, 0, sizeof(*table));
+}
+
+void side_type_intern_exit(void)
+{
+	table_free(&type_table, false);
+	table_free(&layout_table, true);
+	side_range_index_exit();
+}
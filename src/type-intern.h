@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_TYPE_INTERN_H
+#define _SIDE_TYPE_INTERN_H
+
+#include <stdint.h>
+#include <side/trace.h>
+
+#include "serialize-plan.h"
+
+/*
+ * Interned type descriptions. The compound types (structures,
+ * variants, optionals, arrays, variable-length arrays, lazy types,
+ * enumerations and their gather counterparts) of registered events are
+ * indexed by content hash, and structurally identical types share a
+ * canonical instance: the first registered one still in use. The field
+ * lists of events are interned the same way, as layouts, and events
+ * with the same layout share its serialization plan. Variants and
+ * enumerations also get their range lookup index (range-index.h).
+ *
+ * All functions must be called with the event lock held. The public
+ * content hashes, side_type_hash() and side_event_fields_hash(), are
+ * also implemented in type-intern.c and need no lock.
+ */
+
+struct side_type_intern_layout;
+
+/*
+ * Intern the layout and the compound types of an event. Returns NULL
+ * on allocation failure, in which case the event has no layout and
+ * its types are only interned if memory allows.
+ */
+struct side_type_intern_layout *side_type_intern_event(const struct side_event_description *desc)
+	__attribute__((visibility("hidden")));
+/* Release what side_type_intern_event() interned. layout may be NULL. */
+void side_type_intern_event_release(const struct side_event_description *desc,
+		struct side_type_intern_layout *layout)
+	__attribute__((visibility("hidden")));
+/* NULL unless the layout is fixed. */
+const struct side_serialize_plan *side_type_intern_layout_plan(const struct side_type_intern_layout *layout)
+	__attribute__((visibility("hidden")));
+/* Canonical instance of a type structurally identical to type, or NULL. */
+const struct side_type *side_type_intern_lookup(const struct side_type *type)
+	__attribute__((visibility("hidden")));
+void side_type_intern_exit(void)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_TYPE_INTERN_H */
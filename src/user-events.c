@@ -0,0 +1,547 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include "user-events.h"
+
+/* From <linux/user_events.h>, which older kernel headers lack. */
+struct side_user_reg {
+	uint32_t size;
+	uint8_t enable_bit;
+	uint8_t enable_size;
+	uint16_t flags;
+	uint64_t enable_addr;
+	uint64_t name_args;
+	uint32_t write_index;
+} __attribute__((packed));
+
+struct side_user_unreg {
+	uint32_t size;
+	uint8_t disable_bit;
+	uint8_t reserved;
+	uint16_t reserved2;
+	uint64_t disable_addr;
+} __attribute__((packed));
+
+#define SIDE_DIAG_IOC_MAGIC		'*'
+#define SIDE_DIAG_IOCSREG		_IOWR(SIDE_DIAG_IOC_MAGIC, 0, struct side_user_reg *)
+#define SIDE_DIAG_IOCSUNREG		_IOW(SIDE_DIAG_IOC_MAGIC, 2, struct side_user_unreg *)
+
+/* Enabled state bit set by the kernel (shared user event bit). */
+#define SIDE_USER_EVENT_ENABLE_BIT	(SIDE_BITS_PER_LONG - 1)
+
+#define SIDE_USER_EVENT_MAX_FIELDS	32
+
+/* __rel_loc offsets and lengths are 16-bit. */
+#define SIDE_USER_EVENT_MAX_PAYLOAD	0xFFFF
+
+enum side_user_event_field_kind {
+	SIDE_USER_EVENT_FIELD_INLINE,		/* Value stored in the argument. */
+	SIDE_USER_EVENT_FIELD_STRING,		/* String pointed to by the argument. */
+	SIDE_USER_EVENT_FIELD_GATHER,		/* Value at the gather offset. */
+	SIDE_USER_EVENT_FIELD_GATHER_STRING,	/* String at the gather offset. */
+};
+
+struct side_user_event_field {
+	uint64_t offset;	/* Gather offset, bytes. */
+	uint16_t label;		/* Expected argument type. */
+	uint8_t kind;		/* enum side_user_event_field_kind */
+	uint8_t access_mode;	/* enum side_type_gather_access_mode */
+	uint32_t size;		/* Size within the fixed part of the payload, bytes. */
+};
+
+struct side_user_event {
+	const struct side_event_state_0 *es0;
+	uint32_t write_index;
+	uint32_t fixed_len;	/* Size of the fixed part of the payload, bytes. */
+	uint32_t nr_fields;
+	bool removed;		/* Protected by the event lock. */
+	struct side_user_event_field fields[];
+};
+
+/* Registered events, sorted by event state address. */
+struct side_user_event_table {
+	uint32_t nr_events;
+	struct side_user_event *events[];
+};
+
+static const char *user_events_paths[] = {
+	"/sys/kernel/tracing/user_events_data",
+	"/sys/kernel/debug/tracing/user_events_data",
+};
+
+static struct side_rcu_gp_state *user_events_rcu_gp;
+static struct side_user_event_table *user_event_table;
+static int user_events_fd = -1;
+static bool user_events_unavailable;
+
+/* Open the tracefs file on first use. Called with the event lock held. */
+static
+bool side_user_events_open(void)
+{
+	size_t i;
+
+	if (user_events_fd >= 0)
+		return true;
+	if (user_events_unavailable)
+		return false;
+	for (i = 0; i < SIDE_ARRAY_SIZE(user_events_paths); i++) {
+		user_events_fd = open(user_events_paths[i], O_RDWR | O_CLOEXEC);
+		if (user_events_fd >= 0)
+			return true;
+	}
+	user_events_unavailable = true;
+	return false;
+}
+
+/* User event names and field names are C identifiers. */
+static
+void side_user_event_print_name(FILE *f, const char *name)
+{
+	for (; *name; name++) {
+		char c = *name;
+
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		      (c >= '0' && c <= '9') || c == '_'))
+			c = '_';
+		fputc(c, f);
+	}
+}
+
+static
+const char *side_user_event_integer_type(uint16_t size, bool signedness)
+{
+	switch (size) {
+	case 1:
+		return signedness ? "s8" : "u8";
+	case 2:
+		return signedness ? "s16" : "u16";
+	case 4:
+		return signedness ? "s32" : "u32";
+	case 8:
+		return signedness ? "s64" : "u64";
+	default:
+		return NULL;
+	}
+}
+
+/* The kernel only knows about whole host byte order integers. */
+static
+const char *side_user_event_integer_type_desc(const struct side_type_integer *type)
+{
+	if (type->len_bits && type->len_bits != type->integer_size * CHAR_BIT)
+		return NULL;
+	if (type->integer_size > 1 && side_enum_get(type->byte_order) != SIDE_TYPE_BYTE_ORDER_HOST)
+		return NULL;
+	return side_user_event_integer_type(type->integer_size, type->signedness);
+}
+
+/*
+ * Describe a field to the kernel and prepare its payload layout.
+ * Returns false if the field type is not supported.
+ */
+static
+bool side_user_event_field_init(const struct side_event_field *field,
+		struct side_user_event_field *uf, FILE *f)
+{
+	const struct side_type *type = &field->side_type;
+	const char *type_name;
+
+	uf->label = side_enum_get(type->type);
+	switch (uf->label) {
+	case SIDE_TYPE_BOOL:
+		if (type->u.side_bool.len_bits && type->u.side_bool.len_bits != type->u.side_bool.bool_size * CHAR_BIT)
+			return false;
+		if (type->u.side_bool.bool_size > 1 &&
+		    side_enum_get(type->u.side_bool.byte_order) != SIDE_TYPE_BYTE_ORDER_HOST)
+			return false;
+		type_name = side_user_event_integer_type(type->u.side_bool.bool_size, false);
+		uf->kind = SIDE_USER_EVENT_FIELD_INLINE;
+		uf->size = type->u.side_bool.bool_size;
+		break;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_POINTER:
+		type_name = side_user_event_integer_type_desc(&type->u.side_integer);
+		uf->kind = SIDE_USER_EVENT_FIELD_INLINE;
+		uf->size = type->u.side_integer.integer_size;
+		break;
+	case SIDE_TYPE_BYTE:
+		type_name = "u8";
+		uf->kind = SIDE_USER_EVENT_FIELD_INLINE;
+		uf->size = 1;
+		break;
+	case SIDE_TYPE_STRING_UTF8:
+		if (type->u.side_string.unit_size != 1)
+			return false;
+		type_name = "__rel_loc char[]";
+		uf->kind = SIDE_USER_EVENT_FIELD_STRING;
+		uf->size = sizeof(uint32_t);
+		break;
+	case SIDE_TYPE_GATHER_BYTE:
+		type_name = "u8";
+		uf->kind = SIDE_USER_EVENT_FIELD_GATHER;
+		uf->offset = type->u.side_gather.u.side_byte.offset;
+		uf->access_mode = side_enum_get(type->u.side_gather.u.side_byte.access_mode);
+		uf->size = 1;
+		break;
+	case SIDE_TYPE_GATHER_INTEGER:
+	case SIDE_TYPE_GATHER_POINTER:
+		if (type->u.side_gather.u.side_integer.offset_bits)
+			return false;
+		type_name = side_user_event_integer_type_desc(&type->u.side_gather.u.side_integer.type);
+		uf->kind = SIDE_USER_EVENT_FIELD_GATHER;
+		uf->offset = type->u.side_gather.u.side_integer.offset;
+		uf->access_mode = side_enum_get(type->u.side_gather.u.side_integer.access_mode);
+		uf->size = type->u.side_gather.u.side_integer.type.integer_size;
+		break;
+	case SIDE_TYPE_GATHER_STRING:
+		if (type->u.side_gather.u.side_string.type.unit_size != 1)
+			return false;
+		type_name = "__rel_loc char[]";
+		uf->kind = SIDE_USER_EVENT_FIELD_GATHER_STRING;
+		uf->offset = type->u.side_gather.u.side_string.offset;
+		uf->access_mode = side_enum_get(type->u.side_gather.u.side_string.access_mode);
+		uf->size = sizeof(uint32_t);
+		break;
+	default:
+		return false;
+	}
+	if (!type_name)
+		return false;
+	fputs(type_name, f);
+	fputc(' ', f);
+	side_user_event_print_name(f, side_ptr_get(field->field_name));
+	return true;
+}
+
+/* Register an event with the kernel. Returns NULL if not registered. */
+static
+struct side_user_event *side_user_event_create(struct side_event_description *desc)
+{
+	struct side_event_state *event_state = side_ptr_get(desc->state);
+	uint32_t i, nr_fields = side_array_length(&desc->fields);
+	struct side_user_event *ev;
+	struct side_user_reg reg;
+	char *name_args = NULL;
+	size_t name_args_len;
+	bool supported = true;
+	FILE *f;
+
+	if (desc->flags & SIDE_EVENT_FLAG_VARIADIC)
+		return NULL;
+	if (event_state->version != 0 || nr_fields > SIDE_USER_EVENT_MAX_FIELDS)
+		return NULL;
+	ev = (struct side_user_event *) calloc(1, sizeof(struct side_user_event) +
+			nr_fields * sizeof(struct side_user_event_field));
+	if (!ev)
+		return NULL;
+	ev->es0 = side_container_of(event_state, struct side_event_state_0, parent);
+	ev->nr_fields = nr_fields;
+	f = open_memstream(&name_args, &name_args_len);
+	if (!f)
+		goto error;
+	side_user_event_print_name(f, side_ptr_get(desc->provider_name));
+	fputc('_', f);
+	side_user_event_print_name(f, side_ptr_get(desc->event_name));
+	for (i = 0; i < nr_fields && supported; i++) {
+		fputs(i ? "; " : " ", f);
+		supported = side_user_event_field_init(side_array_at(&desc->fields, i), &ev->fields[i], f);
+		ev->fixed_len += ev->fields[i].size;
+	}
+	if (fclose(f) || !supported)
+		goto error;
+	memset(&reg, 0, sizeof(reg));
+	reg.size = sizeof(reg);
+	reg.enable_bit = SIDE_USER_EVENT_ENABLE_BIT;
+	reg.enable_size = sizeof(uintptr_t);
+	reg.enable_addr = (uint64_t) (uintptr_t) &ev->es0->enabled;
+	reg.name_args = (uint64_t) (uintptr_t) name_args;
+	if (ioctl(user_events_fd, SIDE_DIAG_IOCSREG, &reg) < 0)
+		goto error;
+	ev->write_index = reg.write_index;
+	free(name_args);
+	return ev;
+
+error:
+	free(name_args);
+	free(ev);
+	return NULL;
+}
+
+static
+void side_user_event_destroy(struct side_event_state_0 *es0)
+{
+	struct side_user_unreg unreg;
+
+	memset(&unreg, 0, sizeof(unreg));
+	unreg.size = sizeof(unreg);
+	unreg.disable_bit = SIDE_USER_EVENT_ENABLE_BIT;
+	unreg.disable_addr = (uint64_t) (uintptr_t) &es0->enabled;
+	(void) ioctl(user_events_fd, SIDE_DIAG_IOCSUNREG, &unreg);
+	/* The kernel does not update the enabled state anymore. */
+	(void) __atomic_and_fetch(&es0->enabled, ~(1UL << SIDE_USER_EVENT_ENABLE_BIT), __ATOMIC_RELAXED);
+}
+
+static
+int side_user_event_cmp(const void *a, const void *b)
+{
+	uintptr_t es0_a = (uintptr_t) (*(const struct side_user_event * const *) a)->es0;
+	uintptr_t es0_b = (uintptr_t) (*(const struct side_user_event * const *) b)->es0;
+
+	if (es0_a < es0_b)
+		return -1;
+	if (es0_a > es0_b)
+		return 1;
+	return 0;
+}
+
+static
+struct side_user_event *side_user_event_lookup(const struct side_user_event_table *table,
+		const struct side_event_state_0 *es0)
+{
+	uint32_t low = 0, high = table->nr_events;
+
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		struct side_user_event *ev = table->events[mid];
+
+		if (ev->es0 == es0)
+			return ev;
+		if ((uintptr_t) ev->es0 < (uintptr_t) es0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return NULL;
+}
+
+/* Publish a new table and free the old one after a grace period. */
+static
+void side_user_event_table_publish(struct side_user_event_table *table)
+{
+	struct side_user_event_table *old_table = user_event_table;
+
+	side_rcu_assign_pointer(user_event_table, table);
+	if (old_table)
+		side_rcu_call(user_events_rcu_gp, free, old_table);
+}
+
+void side_user_events_register(struct side_event_description **events, uint32_t nr_events)
+{
+	struct side_user_event_table *old_table = user_event_table, *table;
+	uint32_t i, nr_old = old_table ? old_table->nr_events : 0, nr = nr_old;
+
+	if (!nr_events || !side_user_events_open())
+		return;
+	table = (struct side_user_event_table *) malloc(sizeof(struct side_user_event_table) +
+			(nr_old + nr_events) * sizeof(struct side_user_event *));
+	if (!table)
+		return;
+	if (nr_old)
+		memcpy(table->events, old_table->events, nr_old * sizeof(struct side_user_event *));
+	for (i = 0; i < nr_events; i++) {
+		struct side_user_event *ev;
+
+		/* Skip NULL pointers */
+		if (!events[i])
+			continue;
+		ev = side_user_event_create(events[i]);
+		if (ev)
+			table->events[nr++] = ev;
+	}
+	if (nr == nr_old) {
+		free(table);
+		return;
+	}
+	table->nr_events = nr;
+	qsort(table->events, nr, sizeof(struct side_user_event *), side_user_event_cmp);
+	side_user_event_table_publish(table);
+}
+
+void side_user_events_unregister(struct side_event_description **events, uint32_t nr_events)
+{
+	struct side_user_event_table *old_table = user_event_table, *table;
+	uint32_t i, j, nr_removed = 0;
+
+	if (!old_table)
+		return;
+	for (i = 0; i < nr_events; i++) {
+		struct side_event_state_0 *es0;
+		struct side_user_event *ev;
+
+		/* Skip NULL pointers */
+		if (!events[i])
+			continue;
+		es0 = side_container_of(side_ptr_get(events[i]->state), struct side_event_state_0, parent);
+		ev = side_user_event_lookup(old_table, es0);
+		if (!ev)
+			continue;
+		side_user_event_destroy(es0);
+		ev->removed = true;
+		nr_removed++;
+	}
+	if (!nr_removed)
+		return;
+	table = (struct side_user_event_table *) malloc(sizeof(struct side_user_event_table) +
+			old_table->nr_events * sizeof(struct side_user_event *));
+	if (!table) {
+		/* Compact the table in place once readers are done with it. */
+		side_rcu_assign_pointer(user_event_table, NULL);
+		side_rcu_wait_grace_period(user_events_rcu_gp);
+		table = old_table;
+	}
+	for (i = 0, j = 0; i < old_table->nr_events; i++) {
+		struct side_user_event *ev = old_table->events[i];
+
+		if (!ev->removed)
+			table->events[j++] = ev;
+		else if (table == old_table)
+			free(ev);
+		else
+			side_rcu_call(user_events_rcu_gp, free, ev);
+	}
+	table->nr_events = j;
+	if (table == old_table) {
+		if (j) {
+			side_rcu_assign_pointer(user_event_table, table);
+		} else {
+			free(table);
+		}
+		return;
+	}
+	if (!j) {
+		free(table);
+		table = NULL;
+	}
+	side_user_event_table_publish(table);
+}
+
+bool side_user_event_registered(const struct side_event_state_0 *es0)
+{
+	return user_event_table && side_user_event_lookup(user_event_table, es0);
+}
+
+static
+const char *side_user_event_gather_access(const struct side_user_event_field *field, const char *ptr)
+{
+	ptr += field->offset;
+	if (field->access_mode == SIDE_TYPE_GATHER_ACCESS_POINTER)
+		memcpy(&ptr, ptr, sizeof(const char *));
+	return ptr;
+}
+
+/*
+ * The payload is the write index followed by the fixed part of the
+ * fields, then the string data referenced by __rel_loc fields. Each
+ * iovec points to the argument storage, so only the __rel_loc
+ * descriptors are built on the stack.
+ */
+void side_user_event_write(const struct side_event_state_0 *es0, const struct side_arg_vec *side_arg_vec)
+{
+	struct iovec iov[1 + 2 * SIDE_USER_EVENT_MAX_FIELDS];
+	uint32_t rel_loc[SIDE_USER_EVENT_MAX_FIELDS];
+	const struct side_user_event_table *table;
+	struct side_rcu_read_state rcu_read_state;
+	uint32_t i, nr_iov, fixed_left, data_len = 0;
+	const struct side_user_event *ev;
+	const struct side_arg *sav;
+
+	side_rcu_read_begin(user_events_rcu_gp, &rcu_read_state);
+	table = side_rcu_dereference(user_event_table);
+	if (side_unlikely(!table))
+		goto end;
+	ev = side_user_event_lookup(table, es0);
+	if (side_unlikely(!ev || side_arg_vec->len != ev->nr_fields))
+		goto end;
+	sav = side_ptr_get(side_arg_vec->sav);
+	iov[0].iov_base = (void *) &ev->write_index;
+	iov[0].iov_len = sizeof(ev->write_index);
+	nr_iov = 1 + ev->nr_fields;
+	fixed_left = ev->fixed_len;
+	for (i = 0; i < ev->nr_fields; i++) {
+		const struct side_user_event_field *field = &ev->fields[i];
+		const struct side_arg *arg = &sav[i];
+		const char *ptr;
+		size_t len;
+
+		if (side_unlikely(side_enum_get(arg->type) != field->label))
+			goto end;
+		fixed_left -= field->size;
+		switch (field->kind) {
+		case SIDE_USER_EVENT_FIELD_INLINE:
+			/* Values are stored at the start of the argument union. */
+			ptr = (const char *) &arg->u.side_static;
+			break;
+		case SIDE_USER_EVENT_FIELD_STRING:
+			ptr = (const char *) side_ptr_get(arg->u.side_static.string_value);
+			break;
+		case SIDE_USER_EVENT_FIELD_GATHER:
+			ptr = side_user_event_gather_access(field,
+					(const char *) side_ptr_get(arg->u.side_static.side_integer_gather_ptr));
+			break;
+		case SIDE_USER_EVENT_FIELD_GATHER_STRING:
+			ptr = side_user_event_gather_access(field,
+					(const char *) side_ptr_get(arg->u.side_static.side_string_gather_ptr));
+			break;
+		default:
+			abort();
+		}
+		if (field->kind == SIDE_USER_EVENT_FIELD_STRING ||
+		    field->kind == SIDE_USER_EVENT_FIELD_GATHER_STRING) {
+			len = strlen(ptr) + 1;
+			if (side_unlikely(len > SIDE_USER_EVENT_MAX_PAYLOAD - ev->fixed_len - data_len))
+				goto end;
+			/* Data offset is relative to the end of the field. */
+			rel_loc[i] = ((uint32_t) len << 16) | (fixed_left + data_len);
+			iov[nr_iov].iov_base = (void *) ptr;
+			iov[nr_iov].iov_len = len;
+			nr_iov++;
+			data_len += len;
+			ptr = (const char *) &rel_loc[i];
+		}
+		iov[1 + i].iov_base = (void *) ptr;
+		iov[1 + i].iov_len = field->size;
+	}
+	/* Writes fail when the kernel disables the event concurrently. */
+	(void) writev(user_events_fd, iov, nr_iov);
+end:
+	side_rcu_read_end(user_events_rcu_gp, &rcu_read_state);
+}
+
+void side_user_events_init(struct side_rcu_gp_state *rcu_gp)
+{
+	const char *env = getenv("LIBSIDE_USER_EVENTS");
+
+	user_events_rcu_gp = rcu_gp;
+	/* Events are not registered with the kernel with LIBSIDE_USER_EVENTS=0. */
+	if (env && !strcmp(env, "0"))
+		user_events_unavailable = true;
+}
+
+/* Called once all events are unregistered. */
+void side_user_events_exit(void)
+{
+	free(user_event_table);
+	user_event_table = NULL;
+	if (user_events_fd >= 0) {
+		(void) close(user_events_fd);
+		user_events_fd = -1;
+	}
+}
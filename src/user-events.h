@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_USER_EVENTS_H
+#define _SIDE_USER_EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+#include "rcu.h"
+
+/*
+ * Linux user_events integration. Events are registered with the kernel
+ * through the tracefs user_events_data file, and the kernel sets the
+ * user event bit of their enabled state while a kernel tracer (perf,
+ * ftrace) has them enabled. Variadic events and events with a field
+ * type which cannot be described to the kernel are not registered.
+ *
+ * Registration functions must be called with the event lock held.
+ */
+
+void side_user_events_init(struct side_rcu_gp_state *rcu_gp) __attribute__((visibility("hidden")));
+void side_user_events_exit(void) __attribute__((visibility("hidden")));
+void side_user_events_register(struct side_event_description **events, uint32_t nr_events)
+	__attribute__((visibility("hidden")));
+void side_user_events_unregister(struct side_event_description **events, uint32_t nr_events)
+	__attribute__((visibility("hidden")));
+/* Returns true if the event is registered with the kernel. */
+bool side_user_event_registered(const struct side_event_state_0 *es0)
+	__attribute__((visibility("hidden")));
+/* Emit the event payload to the kernel. */
+void side_user_event_write(const struct side_event_state_0 *es0, const struct side_arg_vec *side_arg_vec)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_USER_EVENTS_H */
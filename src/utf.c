@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <side/trace.h>
+
+#include "utf.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define UTF_REPLACEMENT_CHAR	0xFFFD
+
+static
+uint32_t load_unit(const char *p, uint8_t unit_size, bool swap)
+{
+	if (unit_size == 2) {
+		uint16_t v;
+
+		memcpy(&v, p, 2);
+		return swap ? side_bswap_16(v) : v;
+	} else {
+		uint32_t v;
+
+		memcpy(&v, p, 4);
+		return swap ? side_bswap_32(v) : v;
+	}
+}
+
+static
+size_t strlen_scalar(const char *p, uint8_t unit_size)
+{
+	const char *s;
+
+	for (s = p; load_unit(s, unit_size, false); s += unit_size)
+		;
+	return (s - p) / unit_size;
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+/*
+ * Scan aligned 16-byte vectors once the scan pointer is aligned. An
+ * aligned load never crosses a page boundary, so reading past the
+ * terminator within its vector is safe. AddressSanitizer does not know
+ * about page bounds and reports that read as an overflow, so the
+ * function is not instrumented.
+ */
+static __attribute__((no_sanitize_address))
+size_t strlen_vec(const char *p, uint8_t unit_size)
+{
+	const char *s = p;
+
+	while ((uintptr_t) s & 15) {
+		if (!load_unit(s, unit_size, false))
+			return (s - p) / unit_size;
+		s += unit_size;
+	}
+	for (;; s += 16) {
+		unsigned int pos;
+#if defined(__x86_64__)
+		__m128i v = _mm_load_si128((const __m128i *) s), cmp;
+		int mask;
+
+		if (unit_size == 2)
+			cmp = _mm_cmpeq_epi16(v, _mm_setzero_si128());
+		else
+			cmp = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+		mask = _mm_movemask_epi8(cmp);
+		if (!mask)
+			continue;
+		pos = __builtin_ctz(mask);
+#else
+		uint8x16_t v = vld1q_u8((const uint8_t *) s), cmp;
+		uint64_t mask;
+
+		if (unit_size == 2)
+			cmp = vreinterpretq_u8_u16(vceqzq_u16(vreinterpretq_u16_u8(v)));
+		else
+			cmp = vreinterpretq_u8_u32(vceqzq_u32(vreinterpretq_u32_u8(v)));
+		/* Narrow to 4 bits per byte. */
+		mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+		if (!mask)
+			continue;
+		pos = __builtin_ctzll(mask) / 4;
+#endif
+		return (s - p + pos) / unit_size;
+	}
+}
+#endif
+
+size_t side_utf_strlen(const void *p, uint8_t unit_size)
+{
+	switch (unit_size) {
+	case 1:
+		return strlen(p);
+	case 2:
+	case 4:
+		break;
+	default:
+		abort();
+	}
+#if defined(__x86_64__) || defined(__aarch64__)
+	/* Vector lanes must line up with the code units. */
+	if (!((uintptr_t) p & (unit_size - 1)))
+		return strlen_vec(p, unit_size);
+#endif
+	return strlen_scalar(p, unit_size);
+}
+
+static
+char *put_utf8(char *dst, uint32_t c)
+{
+	if (c < 0x80) {
+		*dst++ = c;
+	} else if (c < 0x800) {
+		*dst++ = 0xC0 | (c >> 6);
+		*dst++ = 0x80 | (c & 0x3F);
+	} else if (c < 0x10000) {
+		*dst++ = 0xE0 | (c >> 12);
+		*dst++ = 0x80 | ((c >> 6) & 0x3F);
+		*dst++ = 0x80 | (c & 0x3F);
+	} else {
+		*dst++ = 0xF0 | (c >> 18);
+		*dst++ = 0x80 | ((c >> 12) & 0x3F);
+		*dst++ = 0x80 | ((c >> 6) & 0x3F);
+		*dst++ = 0x80 | (c & 0x3F);
+	}
+	return dst;
+}
+
+/*
+ * Transcode the leading ASCII code units of src, 8 at a time. Returns
+ * the number of code units done.
+ */
+static
+size_t ascii_vec(char *dst, const char *src, size_t nr_units, uint8_t unit_size, bool swap)
+{
+	size_t i = 0;
+
+#if defined(__x86_64__)
+	if (unit_size == 2) {
+		for (; i + 8 <= nr_units; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i * 2));
+
+			if (swap)
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((int16_t) 0xFF80)),
+					_mm_setzero_si128())) != 0xFFFF)
+				break;
+			_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(v, v));
+		}
+	} else {
+		/* Only the low byte is kept: test the byte holding it. */
+		__m128i high = swap ? _mm_set1_epi32((int32_t) 0x80FFFFFF) : _mm_set1_epi32((int32_t) 0xFFFFFF80);
+
+		for (; i + 8 <= nr_units; i += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (src + i * 4));
+			__m128i b = _mm_loadu_si128((const __m128i *) (src + i * 4 + 16));
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(a, b), high),
+					_mm_setzero_si128())) != 0xFFFF)
+				break;
+			if (swap) {
+				a = _mm_srli_epi32(a, 24);
+				b = _mm_srli_epi32(b, 24);
+			}
+			a = _mm_packs_epi32(a, b);
+			_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(a, a));
+		}
+	}
+#elif defined(__aarch64__)
+	if (unit_size == 2) {
+		for (; i + 8 <= nr_units; i += 8) {
+			uint8x16_t b = vld1q_u8((const uint8_t *) (src + i * 2));
+			uint16x8_t v;
+
+			if (swap)
+				b = vrev16q_u8(b);
+			v = vreinterpretq_u16_u8(b);
+			if (vmaxvq_u16(v) >= 0x80)
+				break;
+			vst1_u8((uint8_t *) (dst + i), vmovn_u16(v));
+		}
+	} else {
+		for (; i + 8 <= nr_units; i += 8) {
+			uint8x16_t ba = vld1q_u8((const uint8_t *) (src + i * 4));
+			uint8x16_t bb = vld1q_u8((const uint8_t *) (src + i * 4 + 16));
+			uint32x4_t a, b;
+
+			if (swap) {
+				ba = vrev32q_u8(ba);
+				bb = vrev32q_u8(bb);
+			}
+			a = vreinterpretq_u32_u8(ba);
+			b = vreinterpretq_u32_u8(bb);
+			if (vmaxvq_u32(vorrq_u32(a, b)) >= 0x80)
+				break;
+			vst1_u8((uint8_t *) (dst + i), vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))));
+		}
+	}
+#else
+	(void) dst;
+	(void) src;
+	(void) nr_units;
+	(void) unit_size;
+	(void) swap;
+#endif
+	return i;
+}
+
+size_t side_utf_to_utf8(char *dst, const void *src, size_t nr_units, uint8_t unit_size,
+		enum side_type_label_byte_order byte_order)
+{
+	bool swap = byte_order != SIDE_TYPE_BYTE_ORDER_HOST;
+	const char *s = src;
+	char *d = dst;
+	size_t i = 0;
+
+	if (unit_size != 2 && unit_size != 4)
+		abort();
+	while (i < nr_units) {
+		size_t nr_ascii;
+		uint32_t c;
+
+		nr_ascii = ascii_vec(d, s + i * unit_size, nr_units - i, unit_size, swap);
+		i += nr_ascii;
+		d += nr_ascii;
+		if (i == nr_units)
+			break;
+		/*
+		 * Transcode code units one at a time until the next vector
+		 * boundary, then retry the ASCII fast path.
+		 */
+		do {
+			c = load_unit(s + i * unit_size, unit_size, swap);
+			i++;
+			if (unit_size == 2 && c >= 0xD800 && c <= 0xDFFF) {
+				uint32_t low;
+
+				if (c <= 0xDBFF && i < nr_units
+						&& (low = load_unit(s + i * 2, 2, swap)) >= 0xDC00
+						&& low <= 0xDFFF) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					i++;
+				} else {
+					c = UTF_REPLACEMENT_CHAR;
+				}
+			} else if (unit_size == 4 && (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))) {
+				c = UTF_REPLACEMENT_CHAR;
+			}
+			d = put_utf8(d, c);
+		} while (i < nr_units && (i & 7));
+	}
+	return d - dst;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+#ifndef _SIDE_UTF_H
+#define _SIDE_UTF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <side/trace.h>
+
+/*
+ * String scanning and transcoding to UTF-8, processing 16 bytes at a
+ * time with SSE2 on x86-64 and NEON on aarch64 (both part of the base
+ * instruction sets).
+ */
+
+/* Worst case UTF-8 size of nr_units code units, without terminator. */
+#define SIDE_UTF8_MAX_SIZE(nr_units, unit_size)	((nr_units) * ((unit_size) == 2 ? 3 : (unit_size)))
+
+/* Number of code units of size 1, 2 or 4 before the null terminator. */
+size_t side_utf_strlen(const void *p, uint8_t unit_size)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Transcode nr_units UTF-16 or UTF-32 code units to UTF-8 into dst,
+ * which holds at least SIDE_UTF8_MAX_SIZE(nr_units, unit_size) bytes.
+ * Invalid code units are replaced by U+FFFD. Returns the number of
+ * bytes written, without null terminator.
+ */
+size_t side_utf_to_utf8(char *dst, const void *src, size_t nr_units, uint8_t unit_size,
+		enum side_type_label_byte_order byte_order)
+	__attribute__((visibility("hidden")));
+
+#endif /* _SIDE_UTF_H */
@@ -3,10 +3,17 @@
  * Copyright 2022-2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "range-index.h"
+#include "utf.h"
 #include "visit-arg-vec.h"
 
+/* Power of two. */
+#define CALLSITE_CACHE_SIZE	4096
+#define CALLSITE_CACHE_PROBES	16
+
 union int_value {
 	uint64_t u[NR_SIDE_INTEGER128_SPLIT];
 	int64_t s[NR_SIDE_INTEGER128_SPLIT];
@@ -20,8 +27,17 @@ enum context_type {
 	CONTEXT_OPTIONAL,
 };
 
+/* State of a visit checking argument types. */
+struct visit_check {
+	/* Argument types may vary between visits from the same call site. */
+	bool variable;
+};
+
 struct visit_context {
 	const struct visit_context *parent;
+	struct visit_check *check;	/* NULL if argument types are trusted. */
+	/* Members of a structure field visited in this context, NULL for all. */
+	const struct side_field_projection *projection;
 	union {
 		struct {
 			const char *provider_name;
@@ -45,6 +61,10 @@ uint32_t visit_gather_type(const struct side_type_visitor *type_visitor, const s
 static
 uint32_t visit_gather_elem(const struct side_type_visitor *type_visitor, const struct side_type *type_desc, const void *ptr, void *priv);
 
+static
+uint32_t visit_gather_elems(const struct side_type_visitor *type_visitor, const struct side_type *elem_type,
+		const void *_ptr, uint32_t length, void *priv);
+
 static
 void side_visit_type(const struct side_type_visitor *type_visitor, const struct visit_context *ctx, const struct side_type *type_desc, const struct side_arg *item, void *priv);
 
@@ -55,7 +75,8 @@ static
 uint32_t type_visitor_gather_enum(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr, void *priv);
 
 static
-uint32_t type_visitor_gather_struct(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr, void *priv);
+uint32_t type_visitor_gather_struct(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr,
+		const struct side_field_projection *projection, void *priv);
 
 static
 uint32_t type_visitor_gather_array(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr, void *priv);
@@ -210,31 +231,12 @@ void side_check_value_u64(union int_value v)
 static
 size_t type_visitor_strlen(const void *p, uint8_t unit_size)
 {
-	size_t inbytesleft = 0;
-
 	switch (unit_size) {
 	case 1:
-	{
-		const char *str = p;
-
-		return strlen(str) + 1;
-	}
 	case 2:
-	{
-		const uint16_t *p16 = p;
-
-		for (; *p16; p16++)
-			inbytesleft += 2;
-		return inbytesleft + 2;		/* Include 2-byte null terminator. */
-	}
 	case 4:
-	{
-		const uint32_t *p32 = p;
-
-		for (; *p32; p32++)
-			inbytesleft += 4;
-		return inbytesleft + 4;		/* Include 4-byte null terminator. */
-	}
+		/* Include the null terminator. */
+		return (side_utf_strlen(p, unit_size) + 1) * unit_size;
 	default:
 		fprintf(stderr, "Unknown string unit size %" PRIu8 "\n", unit_size);
 		abort();
@@ -252,14 +254,28 @@ void side_visit_elem(const struct side_type_visitor *type_visitor, const struct
 		type_visitor->after_elem_func(type_desc, priv);
 }
 
+/*
+ * Fields skipped by a projection are not checked, so the call site is
+ * not trusted after this visit.
+ */
+static
+void side_visit_skip_field(const struct visit_context *ctx)
+{
+	if (ctx->check)
+		ctx->check->variable = true;
+}
+
 static
 void side_visit_field(const struct side_type_visitor *type_visitor, const struct visit_context *ctx,
-		const struct side_event_field *item_desc, const struct side_arg *item, void *priv)
+		const struct side_event_field *item_desc, const struct side_arg *item,
+		const struct side_field_projection *members, void *priv)
 {
 	struct visit_context new_ctx = {
 		.type = CONTEXT_FIELD,
 		.field_name = side_ptr_get(item_desc->field_name),
 		.parent = ctx,
+		.check = ctx->check,
+		.projection = members,
 	};
 	if (type_visitor->before_field_func)
 		type_visitor->before_field_func(item_desc, priv);
@@ -284,11 +300,21 @@ void type_visitor_struct(const struct side_type_visitor *type_visitor, const str
 		type_visitor->before_struct_type_func(side_struct, side_arg_vec, priv);
 
 	for (i = 0; i < side_sav_len; i++) {
+		const struct side_field_projection *members = NULL;
 		struct visit_context new_ctx = {
 			.type = CONTEXT_STRUCT,
-			.parent = ctx
+			.parent = ctx,
+			.check = ctx->check,
 		};
-		side_visit_field(type_visitor, &new_ctx, side_array_at(&side_struct->fields, i), &sav[i], priv);
+
+		if (ctx->projection) {
+			if (!ctx->projection->fields[i].selected) {
+				side_visit_skip_field(ctx);
+				continue;
+			}
+			members = ctx->projection->fields[i].members;
+		}
+		side_visit_field(type_visitor, &new_ctx, side_array_at(&side_struct->fields, i), &sav[i], members, priv);
 	}
 	if (type_visitor->after_struct_type_func)
 		type_visitor->after_struct_type_func(side_struct, side_arg_vec, priv);
@@ -300,9 +326,13 @@ void type_visitor_variant(const struct side_type_visitor *type_visitor, const st
 {
 	const struct side_type_variant *side_type_variant = side_ptr_get(type_desc->u.side_variant);
 	const struct side_type *selector_type = &side_type_variant->selector;
+	const struct side_range_index *index;
 	const struct side_variant_option *option;
 	union int_value v;
 
+	/* The option type depends on the selector value. */
+	if (ctx->check)
+		ctx->check->variable = true;
 	if (side_enum_get(selector_type->type) != side_enum_get(side_arg_variant->selector.type)) {
 		fprintf(stderr, "ERROR: Unexpected variant selector type\n");
 		abort();
@@ -326,12 +356,23 @@ void type_visitor_variant(const struct side_type_visitor *type_visitor, const st
 	v = tracer_load_integer_value(&selector_type->u.side_integer,
 			&side_arg_variant->selector.u.side_static.integer_value, 0, NULL);
 	side_check_value_u64(v);
+	if (side_array_length(&side_type_variant->options) >= SIDE_RANGE_INDEX_MIN_RANGES
+			&& (index = side_range_index_find(side_type_variant))) {
+		const uint32_t *pos;
+
+		if (!side_range_index_lookup(index, v.s[SIDE_INTEGER128_SPLIT_LOW], &pos))
+			goto unknown;
+		option = side_array_at(&side_type_variant->options, pos[0]);
+		side_visit_type(type_visitor, ctx, &option->side_type, &side_arg_variant->option, priv);
+		return;
+	}
 	side_for_each_element_in_array(option, &side_type_variant->options) {
 		if (v.s[SIDE_INTEGER128_SPLIT_LOW] >= option->range_begin && v.s[SIDE_INTEGER128_SPLIT_LOW] <= option->range_end) {
 			side_visit_type(type_visitor, ctx, &option->side_type, &side_arg_variant->option, priv);
 			return;
 		}
 	}
+unknown:
 	fprintf(stderr, "ERROR: Variant selector value unknown %" PRId64 "\n", v.s[SIDE_INTEGER128_SPLIT_LOW]);
 	abort();
 }
@@ -345,8 +386,12 @@ void type_visitor_optional(const struct side_type_visitor *type_visitor, const s
 	struct visit_context new_ctx = {
 		.type = CONTEXT_OPTIONAL,
 		.parent = ctx,
+		.check = ctx->check,
 	};
 
+	/* The value is only visited when enabled. */
+	if (ctx->check)
+		ctx->check->variable = true;
 	if (side_arg_optional->selector == SIDE_OPTIONAL_DISABLED)
 		return;
 
@@ -356,6 +401,25 @@ void type_visitor_optional(const struct side_type_visitor *type_visitor, const s
 	side_visit_type(type_visitor, &new_ctx, type, arg, priv);
 }
 
+static
+void type_visitor_lazy(const struct side_type_visitor *type_visitor, const struct visit_context *ctx,
+			const struct side_type *type_desc, const struct side_arg *item, void *priv)
+{
+	const struct side_arg *value;
+
+	/* The value is provided by the application lazy function. */
+	if (ctx->check)
+		ctx->check->variable = true;
+	value = side_arg_lazy_value(type_desc, item);
+	if (!value) {
+		fprintf(stderr, "ERROR: Lazy evaluation error\n");
+		abort();
+	}
+	side_visit_type(type_visitor, ctx,
+			side_ptr_get(side_ptr_get(type_desc->u.side_lazy)->value_type),
+			value, priv);
+}
+
 static
 void type_visitor_array(const struct side_type_visitor *type_visitor, const struct visit_context *ctx,
 			const struct side_type *type_desc, const struct side_arg_vec *side_arg_vec, void *priv)
@@ -373,7 +437,8 @@ void type_visitor_array(const struct side_type_visitor *type_visitor, const stru
 		struct visit_context new_ctx = {
 			.type = CONTEXT_ARRAY,
 			.array_index = i,
-			.parent = ctx
+			.parent = ctx,
+			.check = ctx->check,
 		};
 		side_visit_elem(type_visitor, &new_ctx, side_ptr_get(side_ptr_get(type_desc->u.side_array)->elem_type), &sav[i], priv);
 	}
@@ -394,7 +459,8 @@ void type_visitor_vla(const struct side_type_visitor *type_visitor, const struct
 		struct visit_context new_ctx = {
 			.type = CONTEXT_ARRAY,
 			.array_index = i,
-			.parent = ctx
+			.parent = ctx,
+			.check = ctx->check,
 		};
 		side_visit_elem(type_visitor, &new_ctx, side_ptr_get(side_ptr_get(type_desc->u.side_vla)->elem_type), &sav[i], priv);
 	}
@@ -420,6 +486,40 @@ enum side_visitor_status tracer_write_elem_cb(const struct side_tracer_visitor_c
 	return SIDE_VISITOR_STATUS_OK;
 }
 
+static
+enum side_visitor_status tracer_write_elems_cb(const struct side_tracer_visitor_ctx *tracer_ctx,
+					const struct side_arg *elems, uint32_t nr_elems)
+{
+	struct tracer_visitor_priv *tracer_priv = (struct tracer_visitor_priv *) tracer_ctx->priv;
+	uint32_t i;
+
+	for (i = 0; i < nr_elems; i++)
+		side_visit_elem(tracer_priv->type_visitor, tracer_priv->ctx, tracer_priv->elem_type, &elems[i], tracer_priv->priv);
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status tracer_write_scalars_cb(const struct side_tracer_visitor_ctx *tracer_ctx,
+					const struct side_arg *proto, const void *base, size_t stride,
+					uint32_t nr_elems)
+{
+	struct tracer_visitor_priv *tracer_priv = (struct tracer_visitor_priv *) tracer_ctx->priv;
+	struct side_arg elem = *proto;
+	const char *p = base;
+	size_t size;
+	void *value;
+	uint32_t i;
+
+	size = side_arg_scalar_value(&elem, tracer_priv->elem_type, &value);
+	if (!size)
+		return SIDE_VISITOR_STATUS_ERROR;
+	for (i = 0; i < nr_elems; i++, p += stride) {
+		memcpy(value, p, size);
+		side_visit_elem(tracer_priv->type_visitor, tracer_priv->ctx, tracer_priv->elem_type, &elem, tracer_priv->priv);
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
 static
 void type_visitor_vla_visitor(const struct side_type_visitor *type_visitor, const struct visit_context *ctx,
 			const struct side_type *type_desc, struct side_arg_vla_visitor *vla_visitor, void *priv)
@@ -434,6 +534,8 @@ void type_visitor_vla_visitor(const struct side_type_visitor *type_visitor, cons
 	const struct side_tracer_visitor_ctx tracer_ctx = {
 		.write_elem = tracer_write_elem_cb,
 		.priv = &tracer_priv,
+		.write_elems = tracer_write_elems_cb,
+		.write_scalars = tracer_write_scalars_cb,
 	};
 	enum side_visitor_status status;
 	side_visitor_func func;
@@ -441,6 +543,9 @@ void type_visitor_vla_visitor(const struct side_type_visitor *type_visitor, cons
 
 	if (!vla_visitor)
 		abort();
+	/* Elements are provided by the application visitor. */
+	if (ctx->check)
+		ctx->check->variable = true;
 	if (type_visitor->before_vla_visitor_type_func)
 		type_visitor->before_vla_visitor_type_func(side_ptr_get(type_desc->u.side_vla_visitor), vla_visitor, priv);
 	app_ctx = side_ptr_get(vla_visitor->app_ctx);
@@ -501,17 +606,23 @@ union int_value tracer_load_gather_integer_value(const struct side_type_gather_i
 }
 
 static
-void visit_gather_field(const struct side_type_visitor *type_visitor, const struct side_event_field *field, const void *ptr, void *priv)
+void visit_gather_field(const struct side_type_visitor *type_visitor, const struct side_event_field *field, const void *ptr,
+		const struct side_field_projection *members, void *priv)
 {
 	if (type_visitor->before_field_func)
 		type_visitor->before_field_func(field, priv);
-	(void) visit_gather_type(type_visitor, &field->side_type, ptr, priv);
+	/* Only gather structure fields have members. */
+	if (members)
+		(void) type_visitor_gather_struct(type_visitor, &field->side_type.u.side_gather, ptr, members, priv);
+	else
+		(void) visit_gather_type(type_visitor, &field->side_type, ptr, priv);
 	if (type_visitor->after_field_func)
 		type_visitor->after_field_func(field, priv);
 }
 
 static
-uint32_t type_visitor_gather_struct(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr, void *priv)
+uint32_t type_visitor_gather_struct(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr,
+		const struct side_field_projection *projection, void *priv)
 {
 	enum side_type_gather_access_mode access_mode = side_enum_get(type_gather->u.side_struct.access_mode);
 	const struct side_type_struct *side_struct = side_ptr_get(type_gather->u.side_struct.type);
@@ -521,8 +632,16 @@ uint32_t type_visitor_gather_struct(const struct side_type_visitor *type_visitor
 	if (type_visitor->before_gather_struct_type_func)
 		type_visitor->before_gather_struct_type_func(side_struct, priv);
 	ptr = tracer_gather_access(access_mode, ptr + type_gather->u.side_struct.offset);
-	for (i = 0; i < side_array_length(&side_struct->fields); i++)
-		visit_gather_field(type_visitor, side_array_at(&side_struct->fields, i), ptr, priv);
+	for (i = 0; i < side_array_length(&side_struct->fields); i++) {
+		const struct side_field_projection *members = NULL;
+
+		if (projection) {
+			if (!projection->fields[i].selected)
+				continue;
+			members = projection->fields[i].members;
+		}
+		visit_gather_field(type_visitor, side_array_at(&side_struct->fields, i), ptr, members, priv);
+	}
 	if (type_visitor->after_gather_struct_type_func)
 		type_visitor->after_gather_struct_type_func(side_struct, priv);
 	return tracer_gather_size(access_mode, type_gather->u.side_struct.size);
@@ -534,24 +653,12 @@ uint32_t type_visitor_gather_array(const struct side_type_visitor *type_visitor,
 	enum side_type_gather_access_mode access_mode = side_enum_get(type_gather->u.side_array.access_mode);
 	const struct side_type_array *side_array = &type_gather->u.side_array.type;
 	const char *ptr = (const char *) _ptr, *orig_ptr;
-	uint32_t i;
 
 	if (type_visitor->before_gather_array_type_func)
 		type_visitor->before_gather_array_type_func(side_array, priv);
 	ptr = tracer_gather_access(access_mode, ptr + type_gather->u.side_array.offset);
 	orig_ptr = ptr;
-	for (i = 0; i < side_array->length; i++) {
-		const struct side_type *elem_type = side_ptr_get(side_array->elem_type);
-
-		switch (side_enum_get(elem_type->type)) {
-		case SIDE_TYPE_GATHER_VLA:
-			fprintf(stderr, "<gather VLA only supported within gather structures>\n");
-			abort();
-		default:
-			break;
-		}
-		ptr += visit_gather_elem(type_visitor, elem_type, ptr, priv);
-	}
+	ptr += visit_gather_elems(type_visitor, side_ptr_get(side_array->elem_type), ptr, side_array->length, priv);
 	if (type_visitor->after_gather_array_type_func)
 		type_visitor->after_gather_array_type_func(side_array, priv);
 	return tracer_gather_size(access_mode, ptr - orig_ptr);
@@ -566,7 +673,7 @@ uint32_t type_visitor_gather_vla(const struct side_type_visitor *type_visitor, c
 	const char *ptr = (const char *) _ptr, *orig_ptr;
 	const char *length_ptr = (const char *) _length_ptr;
 	union int_value v = {};
-	uint32_t i, length;
+	uint32_t length;
 
 	/* Access length */
 	switch (side_enum_get(length_type->type)) {
@@ -587,18 +694,7 @@ uint32_t type_visitor_gather_vla(const struct side_type_visitor *type_visitor, c
 		type_visitor->before_gather_vla_type_func(side_vla, length, priv);
 	ptr = tracer_gather_access(access_mode, ptr + type_gather->u.side_vla.offset);
 	orig_ptr = ptr;
-	for (i = 0; i < length; i++) {
-		const struct side_type *elem_type = side_ptr_get(side_vla->elem_type);
-
-		switch (side_enum_get(elem_type->type)) {
-		case SIDE_TYPE_GATHER_VLA:
-			fprintf(stderr, "<gather VLA only supported within gather structures>\n");
-			abort();
-		default:
-			break;
-		}
-		ptr += visit_gather_elem(type_visitor, elem_type, ptr, priv);
-	}
+	ptr += visit_gather_elems(type_visitor, side_ptr_get(side_vla->elem_type), ptr, length, priv);
 	if (type_visitor->after_gather_vla_type_func)
 		type_visitor->after_gather_vla_type_func(side_vla, length, priv);
 	return tracer_gather_size(access_mode, ptr - orig_ptr);
@@ -755,7 +851,7 @@ uint32_t visit_gather_type(const struct side_type_visitor *type_visitor, const s
 
 		/* Gather compound types */
 	case SIDE_TYPE_GATHER_STRUCT:
-		len = type_visitor_gather_struct(type_visitor, &type_desc->u.side_gather, ptr, priv);
+		len = type_visitor_gather_struct(type_visitor, &type_desc->u.side_gather, ptr, NULL, priv);
 		break;
 	case SIDE_TYPE_GATHER_ARRAY:
 		len = type_visitor_gather_array(type_visitor, &type_desc->u.side_gather, ptr, priv);
@@ -783,6 +879,48 @@ uint32_t visit_gather_elem(const struct side_type_visitor *type_visitor, const s
 	return len;
 }
 
+/* Visit the elements of a gather array or VLA. Returns their size. */
+static
+uint32_t visit_gather_elems(const struct side_type_visitor *type_visitor, const struct side_type *elem_type,
+		const void *_ptr, uint32_t length, void *priv)
+{
+	const char *ptr = (const char *) _ptr, *orig_ptr = ptr;
+	uint32_t i;
+
+	switch (side_enum_get(elem_type->type)) {
+	case SIDE_TYPE_GATHER_VLA:
+		fprintf(stderr, "<gather VLA only supported within gather structures>\n");
+		abort();
+	case SIDE_TYPE_GATHER_INTEGER:
+	{
+		const struct side_type_gather_integer *type = &elem_type->u.side_gather.u.side_integer;
+
+		if (type_visitor->gather_integer_array_type_func &&
+		    side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT && !type->offset) {
+			type_visitor->gather_integer_array_type_func(type, ptr, length, priv);
+			return length * type->type.integer_size;
+		}
+		break;
+	}
+	case SIDE_TYPE_GATHER_FLOAT:
+	{
+		const struct side_type_gather_float *type = &elem_type->u.side_gather.u.side_float;
+
+		if (type_visitor->gather_float_array_type_func &&
+		    side_enum_get(type->access_mode) == SIDE_TYPE_GATHER_ACCESS_DIRECT && !type->offset) {
+			type_visitor->gather_float_array_type_func(type, ptr, length, priv);
+			return length * type->type.float_size;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	for (i = 0; i < length; i++)
+		ptr += visit_gather_elem(type_visitor, elem_type, ptr, priv);
+	return ptr - orig_ptr;
+}
+
 static
 uint32_t type_visitor_gather_enum(const struct side_type_visitor *type_visitor, const struct side_type_gather *type_gather, const void *_ptr, void *priv)
 {
@@ -918,6 +1056,44 @@ enum side_visitor_status tracer_dynamic_vla_write_elem_cb(
 	return SIDE_VISITOR_STATUS_OK;
 }
 
+static
+enum side_visitor_status tracer_dynamic_vla_write_elems_cb(
+			const struct side_tracer_visitor_ctx *tracer_ctx,
+			const struct side_arg *elems, uint32_t nr_elems)
+{
+	struct tracer_dynamic_vla_visitor_priv *tracer_priv =
+		(struct tracer_dynamic_vla_visitor_priv *) tracer_ctx->priv;
+	uint32_t i;
+
+	for (i = 0; i < nr_elems; i++)
+		visit_dynamic_elem(tracer_priv->type_visitor, &elems[i], tracer_priv->priv);
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status tracer_dynamic_vla_write_scalars_cb(
+			const struct side_tracer_visitor_ctx *tracer_ctx,
+			const struct side_arg *proto, const void *base, size_t stride,
+			uint32_t nr_elems)
+{
+	struct tracer_dynamic_vla_visitor_priv *tracer_priv =
+		(struct tracer_dynamic_vla_visitor_priv *) tracer_ctx->priv;
+	struct side_arg elem = *proto;
+	const char *p = base;
+	size_t size;
+	void *value;
+	uint32_t i;
+
+	size = side_arg_scalar_value(&elem, NULL, &value);
+	if (!size)
+		return SIDE_VISITOR_STATUS_ERROR;
+	for (i = 0; i < nr_elems; i++, p += stride) {
+		memcpy(value, p, size);
+		visit_dynamic_elem(tracer_priv->type_visitor, &elem, tracer_priv->priv);
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
 static
 void type_visitor_dynamic_vla_visitor(const struct side_type_visitor *type_visitor, const struct side_arg *item, void *priv)
 {
@@ -930,6 +1106,8 @@ void type_visitor_dynamic_vla_visitor(const struct side_type_visitor *type_visit
 	const struct side_tracer_visitor_ctx tracer_ctx = {
 		.write_elem = tracer_dynamic_vla_write_elem_cb,
 		.priv = &tracer_priv,
+		.write_elems = tracer_dynamic_vla_write_elems_cb,
+		.write_scalars = tracer_dynamic_vla_write_scalars_cb,
 	};
 	enum side_visitor_status status;
 	void *app_ctx;
@@ -1109,6 +1287,7 @@ const char *side_type_label_to_string(enum side_type_label label)
 	case SIDE_TYPE_DYNAMIC_STRUCT_VISITOR: return "SIDE_TYPE_DYNAMIC_STRUCT_VISITOR";
 	case SIDE_TYPE_DYNAMIC_VLA: return "SIDE_TYPE_DYNAMIC_VLA";
 	case SIDE_TYPE_DYNAMIC_VLA_VISITOR: return "SIDE_TYPE_DYNAMIC_VLA_VISITOR";
+	case SIDE_TYPE_LAZY: return "SIDE_TYPE_LAZY";
 	default:
 		return "<UNKNOWN>";
 	}
@@ -1224,7 +1403,8 @@ void side_visit_type(const struct side_type_visitor *type_visitor,
 {
 	enum side_type_label type;
 
-	ensure_types_compatible(ctx, type_desc, item);
+	if (ctx->check)
+		ensure_types_compatible(ctx, type_desc, item);
 
 	if (side_enum_get(type_desc->type) == SIDE_TYPE_ENUM || side_enum_get(type_desc->type) == SIDE_TYPE_ENUM_BITMAP || side_enum_get(type_desc->type) == SIDE_TYPE_GATHER_ENUM)
 		type = side_enum_get(type_desc->type);
@@ -1323,7 +1503,8 @@ void side_visit_type(const struct side_type_visitor *type_visitor,
 
 		/* Gather compound type */
 	case SIDE_TYPE_GATHER_STRUCT:
-		(void) type_visitor_gather_struct(type_visitor, &type_desc->u.side_gather, side_ptr_get(item->u.side_static.side_struct_gather_ptr), priv);
+		(void) type_visitor_gather_struct(type_visitor, &type_desc->u.side_gather, side_ptr_get(item->u.side_static.side_struct_gather_ptr),
+				ctx->projection, priv);
 		break;
 	case SIDE_TYPE_GATHER_ARRAY:
 		(void) type_visitor_gather_array(type_visitor, &type_desc->u.side_gather, side_ptr_get(item->u.side_static.side_array_gather_ptr), priv);
@@ -1361,26 +1542,222 @@ void side_visit_type(const struct side_type_visitor *type_visitor,
 				priv);
 		break;
 
+	case SIDE_TYPE_LAZY:
+		type_visitor_lazy(type_visitor, ctx, type_desc, item, priv);
+		break;
+
 	default:
 		fprintf(stderr, "<UNKNOWN TYPE>\n");
 		abort();
 	}
 }
 
+/*
+ * Call sites whose arguments were checked against the description of
+ * their event. Slots are claimed by setting their caller address, and
+ * are never reused once their event is forgotten.
+ */
+struct callsite_slot {
+	void *caller_addr;
+	const struct side_event_description *desc;
+};
+
+static struct callsite_slot callsite_cache[CALLSITE_CACHE_SIZE];
+static bool full_type_check;
+
+static
+size_t callsite_hash(const struct side_event_description *desc, void *caller_addr)
+{
+	uint64_t v = (uint64_t) (uintptr_t) caller_addr ^ ((uint64_t) (uintptr_t) desc << 1);
+
+	return (size_t) ((v * 0x9E3779B97F4A7C15ULL) >> 32) & (CALLSITE_CACHE_SIZE - 1);
+}
+
+static
+bool callsite_trusted(const struct side_event_description *desc, void *caller_addr)
+{
+	size_t i, hash = callsite_hash(desc, caller_addr);
+
+	for (i = 0; i < CALLSITE_CACHE_PROBES; i++) {
+		struct callsite_slot *slot = &callsite_cache[(hash + i) & (CALLSITE_CACHE_SIZE - 1)];
+		void *addr = __atomic_load_n(&slot->caller_addr, __ATOMIC_RELAXED);
+
+		if (!addr)
+			return false;
+		if (addr == caller_addr && __atomic_load_n(&slot->desc, __ATOMIC_RELAXED) == desc)
+			return true;
+	}
+	return false;
+}
+
+static
+void callsite_trust(const struct side_event_description *desc, void *caller_addr)
+{
+	size_t i, hash = callsite_hash(desc, caller_addr);
+
+	for (i = 0; i < CALLSITE_CACHE_PROBES; i++) {
+		struct callsite_slot *slot = &callsite_cache[(hash + i) & (CALLSITE_CACHE_SIZE - 1)];
+		void *addr = NULL;
+
+		if (__atomic_compare_exchange_n(&slot->caller_addr, &addr, caller_addr,
+				false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&slot->desc, desc, __ATOMIC_RELAXED);
+			return;
+		}
+		if (addr == caller_addr && __atomic_load_n(&slot->desc, __ATOMIC_RELAXED) == desc)
+			return;
+	}
+	/* Cache full: keep checking this call site. */
+}
+
+void type_visitor_init(void)
+{
+	const char *env = getenv("LIBSIDE_TYPE_CHECK");
+
+	full_type_check = env && !strcmp(env, "full");
+}
+
+void type_visitor_forget_event(const struct side_event_description *desc)
+{
+	size_t i;
+
+	for (i = 0; i < CALLSITE_CACHE_SIZE; i++) {
+		struct callsite_slot *slot = &callsite_cache[i];
+
+		if (__atomic_load_n(&slot->desc, __ATOMIC_RELAXED) == desc)
+			__atomic_store_n(&slot->desc, NULL, __ATOMIC_RELAXED);
+	}
+}
+
+static
+struct side_field_projection *projection_alloc(uint32_t nr_fields)
+{
+	struct side_field_projection *projection;
+
+	projection = (struct side_field_projection *) calloc(1, sizeof(struct side_field_projection)
+			+ nr_fields * sizeof(struct side_field_projection_entry));
+	if (projection)
+		projection->nr_fields = nr_fields;
+	return projection;
+}
+
+static
+const struct side_type_struct *projection_field_struct(const struct side_event_field *field)
+{
+	switch (side_enum_get(field->side_type.type)) {
+	case SIDE_TYPE_STRUCT:
+		return side_ptr_get(field->side_type.u.side_struct);
+	case SIDE_TYPE_GATHER_STRUCT:
+		return side_ptr_get(field->side_type.u.side_gather.u.side_struct.type);
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Select the field path of length len within projection, a projection
+ * of fields. Returns false on allocation failure.
+ */
+static
+bool projection_select(struct side_field_projection *projection, const struct side_event_field *fields,
+		const char *path, size_t len)
+{
+	const char *dot = memchr(path, '.', len);
+	size_t name_len = dot ? (size_t) (dot - path) : len;
+	uint32_t i, j;
+
+	for (i = 0; i < projection->nr_fields; i++) {
+		struct side_field_projection_entry *entry = &projection->fields[i];
+		const char *field_name = side_ptr_get(fields[i].field_name);
+		const struct side_type_struct *side_struct;
+
+		if (strncmp(field_name, path, name_len) || field_name[name_len] != '\0')
+			continue;
+		if (!dot) {
+			/* Whole field. */
+			entry->selected = true;
+			side_field_projection_destroy(entry->members);
+			entry->members = NULL;
+			return true;
+		}
+		side_struct = projection_field_struct(&fields[i]);
+		/* Members are already selected by the whole field. */
+		if (!side_struct || (entry->selected && !entry->members))
+			return true;
+		if (!entry->members) {
+			entry->members = projection_alloc(side_array_length(&side_struct->fields));
+			if (!entry->members)
+				return false;
+		}
+		if (!projection_select(entry->members, side_array_elements(&side_struct->fields),
+				dot + 1, len - name_len - 1))
+			return false;
+		/* The structure is visited if any of its members is. */
+		for (j = 0; j < entry->members->nr_fields; j++) {
+			if (entry->members->fields[j].selected) {
+				entry->selected = true;
+				break;
+			}
+		}
+		return true;
+	}
+	return true;
+}
+
+struct side_field_projection *side_field_projection_compile(const struct side_event_description *desc,
+		const char *paths)
+{
+	struct side_field_projection *projection;
+	const char *p = paths;
+
+	projection = projection_alloc(side_array_length(&desc->fields));
+	if (!projection)
+		return NULL;
+	while (*p) {
+		size_t len = strcspn(p, ",");
+
+		if (!projection_select(projection, side_array_elements(&desc->fields), p, len)) {
+			side_field_projection_destroy(projection);
+			return NULL;
+		}
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+	return projection;
+}
+
+void side_field_projection_destroy(struct side_field_projection *projection)
+{
+	uint32_t i;
+
+	if (!projection)
+		return;
+	for (i = 0; i < projection->nr_fields; i++)
+		side_field_projection_destroy(projection->fields[i].members);
+	free(projection);
+}
+
 void type_visitor_event(const struct side_type_visitor *type_visitor,
 		const struct side_event_description *desc,
 		const struct side_arg_vec *side_arg_vec,
 		const struct side_arg_dynamic_struct *var_struct,
+		const struct side_field_projection *projection,
 		void *caller_addr, void *priv)
 {
 	const struct side_arg *sav = side_ptr_get(side_arg_vec->sav);
 	uint32_t i, side_sav_len = side_arg_vec->len;
+	struct visit_check check = {
+		.variable = false,
+	};
+	bool trusted = !full_type_check && caller_addr && callsite_trusted(desc, caller_addr);
 	const struct visit_context ctx = {
 		.type = CONTEXT_NAMESPACE,
 		.namespace = {
 			.provider_name = side_ptr_get(desc->provider_name),
 			.event_name = side_ptr_get(desc->event_name),
 		},
+		.check = trusted ? NULL : &check,
 	};
 
 	if (side_array_length(&desc->fields) != side_sav_len) {
@@ -1392,8 +1769,18 @@ void type_visitor_event(const struct side_type_visitor *type_visitor,
 	if (side_sav_len) {
 		if (type_visitor->before_static_fields_func)
 			type_visitor->before_static_fields_func(side_arg_vec, priv);
-		for (i = 0; i < side_sav_len; i++)
-			side_visit_field(type_visitor, &ctx, side_array_at(&desc->fields, i), &sav[i], priv);
+		for (i = 0; i < side_sav_len; i++) {
+			const struct side_field_projection *members = NULL;
+
+			if (projection) {
+				if (!projection->fields[i].selected) {
+					side_visit_skip_field(&ctx);
+					continue;
+				}
+				members = projection->fields[i].members;
+			}
+			side_visit_field(type_visitor, &ctx, side_array_at(&desc->fields, i), &sav[i], members, priv);
+		}
 		if (type_visitor->after_static_fields_func)
 			type_visitor->after_static_fields_func(side_arg_vec, priv);
 	}
@@ -1409,4 +1796,61 @@ void type_visitor_event(const struct side_type_visitor *type_visitor,
 	}
 	if (type_visitor->after_event_func)
 		type_visitor->after_event_func(desc, side_arg_vec, var_struct, caller_addr, priv);
+	/* A mismatch aborts: the call site arguments are compatible. */
+	if (!trusted && !full_type_check && caller_addr && !check.variable)
+		callsite_trust(desc, caller_addr);
+}
+
+size_t side_arg_scalar_value(struct side_arg *arg, const struct side_type *type_desc, void **value)
+{
+	enum side_type_label label = side_enum_get(arg->type);
+
+	switch (label) {
+	case SIDE_TYPE_DYNAMIC_BOOL:
+		*value = &arg->u.side_dynamic.side_bool.value;
+		return arg->u.side_dynamic.side_bool.type.bool_size;
+	case SIDE_TYPE_DYNAMIC_BYTE:
+		*value = &arg->u.side_dynamic.side_byte.value;
+		return 1;
+	case SIDE_TYPE_DYNAMIC_INTEGER:
+	case SIDE_TYPE_DYNAMIC_POINTER:
+		*value = &arg->u.side_dynamic.side_integer.value;
+		return arg->u.side_dynamic.side_integer.type.integer_size;
+	case SIDE_TYPE_DYNAMIC_FLOAT:
+		*value = &arg->u.side_dynamic.side_float.value;
+		return arg->u.side_dynamic.side_float.type.float_size;
+	default:
+		break;
+	}
+	if (!type_desc || side_enum_get(type_desc->type) != label)
+		return 0;
+	switch (label) {
+	case SIDE_TYPE_BOOL:
+		*value = &arg->u.side_static.bool_value;
+		return type_desc->u.side_bool.bool_size;
+	case SIDE_TYPE_BYTE:
+		*value = &arg->u.side_static.byte_value;
+		return 1;
+	case SIDE_TYPE_U8:
+	case SIDE_TYPE_U16:
+	case SIDE_TYPE_U32:
+	case SIDE_TYPE_U64:
+	case SIDE_TYPE_U128:
+	case SIDE_TYPE_S8:
+	case SIDE_TYPE_S16:
+	case SIDE_TYPE_S32:
+	case SIDE_TYPE_S64:
+	case SIDE_TYPE_S128:
+	case SIDE_TYPE_POINTER:
+		*value = &arg->u.side_static.integer_value;
+		return type_desc->u.side_integer.integer_size;
+	case SIDE_TYPE_FLOAT_BINARY16:
+	case SIDE_TYPE_FLOAT_BINARY32:
+	case SIDE_TYPE_FLOAT_BINARY64:
+	case SIDE_TYPE_FLOAT_BINARY128:
+		*value = &arg->u.side_static.float_value;
+		return type_desc->u.side_float.float_size;
+	default:
+		return 0;
+	}
 }
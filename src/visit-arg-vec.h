@@ -61,6 +61,15 @@ struct side_type_visitor {
 	void (*gather_string_type_func)(const struct side_type_gather_string *type, const void *p, uint8_t unit_size,
 				enum side_type_label_byte_order byte_order, size_t strlen_with_null, void *priv);
 
+	/*
+	 * Gather arrays and VLAs of integers or floats accessed directly at
+	 * offset 0: the length elements are stored back to back at ptr.
+	 * When set, called once per array instead of the per-element
+	 * before_elem_func, gather_*_type_func and after_elem_func.
+	 */
+	void (*gather_integer_array_type_func)(const struct side_type_gather_integer *type, const void *ptr, uint32_t length, void *priv);
+	void (*gather_float_array_type_func)(const struct side_type_gather_float *type, const void *ptr, uint32_t length, void *priv);
+
 	/* Gather compound types. */
 	void (*before_gather_struct_type_func)(const struct side_type_struct *type, void *priv);
 	void (*after_gather_struct_type_func)(const struct side_type_struct *type, void *priv);
@@ -97,10 +106,60 @@ struct side_type_visitor {
 	void (*after_dynamic_vla_visitor_func)(const struct side_arg *item, void *priv);
 };
 
+/*
+ * Argument types are checked against the event description on the
+ * first visit from each call site, and trusted on later visits from
+ * that call site, unless their types can vary between visits
+ * (variants, optionals, visitors). LIBSIDE_TYPE_CHECK=full checks
+ * every visit.
+ */
+void type_visitor_init(void);
+/* Forget the checked call sites of an event being unregistered. */
+void type_visitor_forget_event(const struct side_event_description *desc);
+
+/*
+ * Field projection: the fields of an event, or of a structure, visited
+ * by type_visitor_event(). The arguments of other fields are skipped
+ * entirely, without dereferencing gather pointers nor invoking
+ * application visitors. Variadic fields are always visited.
+ */
+struct side_field_projection;
+
+struct side_field_projection_entry {
+	bool selected;
+	/* Members of a structure field, NULL to visit the whole field. */
+	struct side_field_projection *members;
+};
+
+struct side_field_projection {
+	uint32_t nr_fields;
+	struct side_field_projection_entry fields[];
+};
+
+/*
+ * Compile the projection of the comma-separated field paths, e.g.
+ * "fd,hdr.len", where '.' selects a member of a structure or gather
+ * structure field. Paths which do not name a field of the event are
+ * ignored. Returns NULL on allocation failure.
+ */
+struct side_field_projection *side_field_projection_compile(const struct side_event_description *desc,
+		const char *paths);
+void side_field_projection_destroy(struct side_field_projection *projection);
+
+/* A NULL projection visits all fields. */
 void type_visitor_event(const struct side_type_visitor *type_visitor,
 		const struct side_event_description *desc,
 		const struct side_arg_vec *side_arg_vec,
 		const struct side_arg_dynamic_struct *var_struct,
+		const struct side_field_projection *projection,
 		void *caller_addr, void *priv);
 
+/*
+ * Location of the value of a bool, byte, integer, pointer or float
+ * argument, stored in *value. Returns the value size, or 0 for other
+ * arguments. The size of stack-copy arguments comes from their type
+ * description type_desc, which may be NULL for dynamic arguments.
+ */
+size_t side_arg_scalar_value(struct side_arg *arg, const struct side_type *type_desc, void **value);
+
 #endif /* _VISIT_ARG_VEC_H */
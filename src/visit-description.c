@@ -135,6 +135,17 @@ void description_visitor_optional(const struct side_description_visitor *descrip
 		description_visitor->after_optional_type_func(type_desc, priv);
 }
 
+static
+void description_visitor_lazy(const struct side_description_visitor *description_visitor,
+				const struct side_type_lazy *side_lazy, void *priv)
+{
+	if (description_visitor->before_lazy_type_func)
+		description_visitor->before_lazy_type_func(side_lazy, priv);
+	side_visit_type(description_visitor, side_ptr_get(side_lazy->value_type), priv);
+	if (description_visitor->after_lazy_type_func)
+		description_visitor->after_lazy_type_func(side_lazy, priv);
+}
+
 static
 void description_visitor_array(const struct side_description_visitor *description_visitor, const struct side_type *type_desc, void *priv)
 {
@@ -485,6 +496,10 @@ void side_visit_type(const struct side_description_visitor *description_visitor,
 		description_visitor_optional(description_visitor, side_ptr_get(type_desc->u.side_optional), priv);
 		break;
 
+	case SIDE_TYPE_LAZY:
+		description_visitor_lazy(description_visitor, side_ptr_get(type_desc->u.side_lazy), priv);
+		break;
+
 	default:
 		fprintf(stderr, "<UNKNOWN TYPE>\n");
 		abort();
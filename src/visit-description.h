@@ -46,6 +46,8 @@ struct side_description_visitor {
 	void (*after_element_vla_visitor_type_func)(const struct side_type_vla_visitor *side_vla_visitor, void *priv);
 	void (*before_optional_type_func)(const struct side_type *optional, void *priv);
 	void (*after_optional_type_func)(const struct side_type *optional, void *priv);
+	void (*before_lazy_type_func)(const struct side_type_lazy *side_lazy, void *priv);
+	void (*after_lazy_type_func)(const struct side_type_lazy *side_lazy, void *priv);
 
 	/* Stack-copy enumeration types. */
 	void (*before_enum_type_func)(const struct side_type *type_desc, void *priv);
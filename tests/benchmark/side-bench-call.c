@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Measure the cost of the instrumentation fast path: a disabled
+ * side_event(), and an enabled event calling 1, 4 or 16 empty
+ * callbacks, for static and variadic events. Each case runs the same
+ * number of events on every thread, and prints one key=value line.
+ *
+ * The callbacks are registered with a key of their own, and the
+ * process-wide loglevel threshold is raised so the built-in text
+ * tracer is not called. Its event descriptions are still written to
+ * LIBSIDE_TRACER_FD (see run.sh).
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <side/trace.h>
+
+#define MAX_CALLBACKS	16
+
+static int nr_threads = 1;
+static long nr_iterations = 10000000;
+
+static pthread_barrier_t start_barrier;
+static uint64_t bench_key;
+static int cb_priv[MAX_CALLBACKS];
+
+side_static_event(bench_event_disabled, "bench", "disabled", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("a"), side_field_u64("b"))
+);
+
+side_static_event(bench_event_static, "bench", "static", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("a"), side_field_u64("b"))
+);
+
+side_static_event_variadic(bench_event_variadic, "bench", "variadic", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("a"), side_field_u64("b"))
+);
+
+enum bench_case {
+	BENCH_CASE_DISABLED,
+	BENCH_CASE_STATIC,
+	BENCH_CASE_VARIADIC,
+};
+
+struct thread_ctx {
+	pthread_t thread_id;
+	enum bench_case bench_case;
+	uint64_t elapsed_ns;
+};
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void bench_callback(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		void *priv __attribute__((unused)),
+		void *caller_addr __attribute__((unused)))
+{
+	__asm__ __volatile__ ("" : : : "memory");
+}
+
+static
+void bench_callback_variadic(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		const struct side_arg_dynamic_struct *var_struct __attribute__((unused)),
+		void *priv __attribute__((unused)),
+		void *caller_addr __attribute__((unused)))
+{
+	__asm__ __volatile__ ("" : : : "memory");
+}
+
+static
+void *bench_thread(void *arg)
+{
+	struct thread_ctx *thread_ctx = (struct thread_ctx *) arg;
+	uint64_t begin;
+	long i;
+
+	pthread_barrier_wait(&start_barrier);
+	begin = now_ns();
+	switch (thread_ctx->bench_case) {
+	case BENCH_CASE_DISABLED:
+		for (i = 0; i < nr_iterations; i++)
+			side_event(bench_event_disabled,
+				side_arg_list(side_arg_u32((uint32_t) i), side_arg_u64(42)));
+		break;
+	case BENCH_CASE_STATIC:
+		for (i = 0; i < nr_iterations; i++)
+			side_event(bench_event_static,
+				side_arg_list(side_arg_u32((uint32_t) i), side_arg_u64(42)));
+		break;
+	case BENCH_CASE_VARIADIC:
+		for (i = 0; i < nr_iterations; i++)
+			side_event_variadic(bench_event_variadic,
+				side_arg_list(side_arg_u32((uint32_t) i), side_arg_u64(42)),
+				side_arg_list(
+					side_arg_dynamic_field("c", side_arg_dynamic_u32(55)),
+					side_arg_dynamic_field("d", side_arg_dynamic_s8(-4)),
+				)
+			);
+		break;
+	}
+	thread_ctx->elapsed_ns = now_ns() - begin;
+	return NULL;
+}
+
+static
+void run_case(const char *name, enum bench_case bench_case, int nr_callbacks)
+{
+	struct thread_ctx *thread_ctx;
+	uint64_t max_ns = 0, tot_ns = 0;
+	int i, ret;
+
+	thread_ctx = calloc(nr_threads, sizeof(struct thread_ctx));
+	if (!thread_ctx)
+		abort();
+	if (pthread_barrier_init(&start_barrier, NULL, nr_threads))
+		abort();
+	for (i = 0; i < nr_threads; i++) {
+		thread_ctx[i].bench_case = bench_case;
+		ret = pthread_create(&thread_ctx[i].thread_id, NULL, bench_thread, &thread_ctx[i]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			abort();
+		}
+	}
+	for (i = 0; i < nr_threads; i++) {
+		ret = pthread_join(thread_ctx[i].thread_id, NULL);
+		if (ret) {
+			errno = ret;
+			perror("pthread_join");
+			abort();
+		}
+		tot_ns += thread_ctx[i].elapsed_ns;
+		if (thread_ctx[i].elapsed_ns > max_ns)
+			max_ns = thread_ctx[i].elapsed_ns;
+	}
+	(void) pthread_barrier_destroy(&start_barrier);
+	/* Latency is averaged over threads, throughput uses the slowest one. */
+	printf("benchmark=%s callbacks=%d threads=%d iterations=%ld ns_per_op=%.2f ops_per_sec=%.0f\n",
+		name, nr_callbacks, nr_threads, nr_iterations,
+		(double) tot_ns / ((double) nr_iterations * nr_threads),
+		max_ns ? (double) nr_iterations * nr_threads * 1e9 / (double) max_ns : 0);
+	fflush(stdout);
+	free(thread_ctx);
+}
+
+static
+void set_nr_callbacks(enum bench_case bench_case, int *nr_callbacks, int target)
+{
+	for (; *nr_callbacks < target; (*nr_callbacks)++) {
+		int ret;
+
+		if (bench_case == BENCH_CASE_VARIADIC)
+			ret = side_tracer_callback_variadic_register(&bench_event_variadic,
+				bench_callback_variadic, &cb_priv[*nr_callbacks], bench_key);
+		else
+			ret = side_tracer_callback_register(&bench_event_static,
+				bench_callback, &cb_priv[*nr_callbacks], bench_key);
+		if (ret != SIDE_ERROR_OK)
+			abort();
+	}
+}
+
+static
+void clear_callbacks(enum bench_case bench_case, int nr_callbacks)
+{
+	int i;
+
+	for (i = 0; i < nr_callbacks; i++) {
+		int ret;
+
+		if (bench_case == BENCH_CASE_VARIADIC)
+			ret = side_tracer_callback_variadic_unregister(&bench_event_variadic,
+				bench_callback_variadic, &cb_priv[i], bench_key);
+		else
+			ret = side_tracer_callback_unregister(&bench_event_static,
+				bench_callback, &cb_priv[i], bench_key);
+		if (ret != SIDE_ERROR_OK)
+			abort();
+	}
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-n <iterations> (number of events per thread and case)\n");
+	printf("	-t <nr_threads> (number of threads calling the events)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'n':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_iterations = atol(argv[i + 1]);
+				i++;
+				break;
+			case 't':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_threads = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	if (nr_threads < 1 || nr_iterations < 1) {
+		fprintf(stderr, "The number of threads and iterations must be positive\n");
+		return -1;
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	static const int nr_callbacks_cases[] = { 1, 4, 16 };
+	int ret, nr_callbacks = 0;
+	size_t i;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	if (side_tracer_request_key(&bench_key))
+		abort();
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	if (side_tracer_key_loglevel_threshold_set(bench_key, SIDE_LOGLEVEL_DEBUG))
+		abort();
+
+	run_case("event_disabled", BENCH_CASE_DISABLED, 0);
+
+	for (i = 0; i < sizeof(nr_callbacks_cases) / sizeof(nr_callbacks_cases[0]); i++) {
+		set_nr_callbacks(BENCH_CASE_STATIC, &nr_callbacks, nr_callbacks_cases[i]);
+		run_case("event_static", BENCH_CASE_STATIC, nr_callbacks);
+	}
+	clear_callbacks(BENCH_CASE_STATIC, nr_callbacks);
+
+	nr_callbacks = 0;
+	for (i = 0; i < sizeof(nr_callbacks_cases) / sizeof(nr_callbacks_cases[0]); i++) {
+		set_nr_callbacks(BENCH_CASE_VARIADIC, &nr_callbacks, nr_callbacks_cases[i]);
+		run_case("event_variadic", BENCH_CASE_VARIADIC, nr_callbacks);
+	}
+	clear_callbacks(BENCH_CASE_VARIADIC, nr_callbacks);
+	return 0;
+}
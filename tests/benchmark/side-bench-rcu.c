@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Measure the RCU read-side critical section cost, with the rseq
+ * per-CPU counters and with the atomic fallback, and the grace period
+ * latency under read-side load. Reader threads are pinned round-robin
+ * over the first <nr_cpus> CPUs allowed for the process. Each
+ * measurement prints one key=value line.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../src/rcu.h"
+
+static int nr_threads = 1;
+static int nr_cpus;
+static long nr_iterations = 10000000;
+static int nr_grace_periods = 10000;
+
+static pthread_barrier_t start_barrier;
+static volatile int stop_test;
+
+struct thread_ctx {
+	pthread_t thread_id;
+	int cpu;
+	uint64_t count;
+	uint64_t elapsed_ns;
+};
+
+static struct side_rcu_gp_state bench_rcu_gp;
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void pin_thread(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	(void) sched_setaffinity(0, sizeof(set), &set);
+}
+
+static
+void *bench_read_thread(void *arg)
+{
+	struct thread_ctx *thread_ctx = (struct thread_ctx *) arg;
+	uint64_t begin;
+	long i;
+
+	pin_thread(thread_ctx->cpu);
+	pthread_barrier_wait(&start_barrier);
+	begin = now_ns();
+	for (i = 0; i < nr_iterations; i++) {
+		struct side_rcu_read_state rcu_read_state;
+
+		side_rcu_read_begin(&bench_rcu_gp, &rcu_read_state);
+		side_rcu_read_end(&bench_rcu_gp, &rcu_read_state);
+	}
+	thread_ctx->elapsed_ns = now_ns() - begin;
+	return NULL;
+}
+
+static
+void *bench_load_thread(void *arg)
+{
+	struct thread_ctx *thread_ctx = (struct thread_ctx *) arg;
+	uint64_t count = 0;
+
+	pin_thread(thread_ctx->cpu);
+	pthread_barrier_wait(&start_barrier);
+	while (!__atomic_load_n(&stop_test, __ATOMIC_RELAXED)) {
+		struct side_rcu_read_state rcu_read_state;
+
+		side_rcu_read_begin(&bench_rcu_gp, &rcu_read_state);
+		side_rcu_read_end(&bench_rcu_gp, &rcu_read_state);
+		count++;
+	}
+	thread_ctx->count = count;
+	return NULL;
+}
+
+/* Assign the threads round-robin to the first nr_cpus allowed CPUs. */
+static
+int assign_cpus(struct thread_ctx *thread_ctx, int nr)
+{
+	int allowed_cpus[CPU_SETSIZE];
+	int i, nr_allowed = 0;
+	cpu_set_t allowed;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		CPU_ZERO(&allowed);
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &allowed))
+			allowed_cpus[nr_allowed++] = i;
+	}
+	if (nr_cpus > 0 && nr_cpus < nr_allowed)
+		nr_allowed = nr_cpus;
+	for (i = 0; i < nr; i++)
+		thread_ctx[i].cpu = nr_allowed ? allowed_cpus[i % nr_allowed] : -1;
+	return nr < nr_allowed ? nr : nr_allowed;
+}
+
+static
+struct thread_ctx *start_threads(int nr, void *(*func)(void *), int *used_cpus)
+{
+	struct thread_ctx *thread_ctx;
+	int i, ret;
+
+	thread_ctx = calloc(nr ? nr : 1, sizeof(struct thread_ctx));
+	if (!thread_ctx)
+		abort();
+	*used_cpus = assign_cpus(thread_ctx, nr);
+	/* The calling thread joins the barrier to start the measurement. */
+	if (pthread_barrier_init(&start_barrier, NULL, nr + 1))
+		abort();
+	for (i = 0; i < nr; i++) {
+		ret = pthread_create(&thread_ctx[i].thread_id, NULL, func, &thread_ctx[i]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			abort();
+		}
+	}
+	return thread_ctx;
+}
+
+static
+void join_threads(struct thread_ctx *thread_ctx, int nr)
+{
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = pthread_join(thread_ctx[i].thread_id, NULL);
+		if (ret) {
+			errno = ret;
+			perror("pthread_join");
+			abort();
+		}
+	}
+	(void) pthread_barrier_destroy(&start_barrier);
+}
+
+static
+void bench_read(const char *mode)
+{
+	struct thread_ctx *thread_ctx;
+	uint64_t max_ns = 0, tot_ns = 0;
+	int i, used_cpus;
+
+	thread_ctx = start_threads(nr_threads, bench_read_thread, &used_cpus);
+	pthread_barrier_wait(&start_barrier);
+	join_threads(thread_ctx, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		tot_ns += thread_ctx[i].elapsed_ns;
+		if (thread_ctx[i].elapsed_ns > max_ns)
+			max_ns = thread_ctx[i].elapsed_ns;
+	}
+	printf("benchmark=rcu_read mode=%s threads=%d cpus=%d iterations=%ld ns_per_op=%.2f ops_per_sec=%.0f\n",
+		mode, nr_threads, used_cpus, nr_iterations,
+		(double) tot_ns / ((double) nr_iterations * nr_threads),
+		max_ns ? (double) nr_iterations * nr_threads * 1e9 / (double) max_ns : 0);
+	fflush(stdout);
+	free(thread_ctx);
+}
+
+static
+void bench_grace_period(void)
+{
+	uint64_t reads = 0, gp_tot_ns = 0, gp_max_ns = 0;
+	struct thread_ctx *thread_ctx;
+	int i, used_cpus;
+
+	stop_test = 0;
+	thread_ctx = start_threads(nr_threads, bench_load_thread, &used_cpus);
+	pthread_barrier_wait(&start_barrier);
+	for (i = 0; i < nr_grace_periods; i++) {
+		uint64_t begin, delta;
+
+		begin = now_ns();
+		side_rcu_wait_grace_period(&bench_rcu_gp);
+		delta = now_ns() - begin;
+		gp_tot_ns += delta;
+		if (delta > gp_max_ns)
+			gp_max_ns = delta;
+	}
+	__atomic_store_n(&stop_test, 1, __ATOMIC_RELAXED);
+	join_threads(thread_ctx, nr_threads);
+	for (i = 0; i < nr_threads; i++)
+		reads += thread_ctx[i].count;
+	printf("benchmark=rcu_grace_period readers=%d cpus=%d possible_cpus=%d grace_periods=%d avg_ns=%" PRIu64 " max_ns=%" PRIu64 " reads=%" PRIu64 "\n",
+		nr_threads, used_cpus, bench_rcu_gp.nr_cpus, nr_grace_periods,
+		nr_grace_periods ? gp_tot_ns / nr_grace_periods : 0, gp_max_ns, reads);
+	fflush(stdout);
+	free(thread_ctx);
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-n <iterations> (number of read-side critical sections per thread)\n");
+	printf("	-g <grace_periods> (number of grace periods measured)\n");
+	printf("	-t <nr_threads> (number of reader threads)\n");
+	printf("	-c <nr_cpus> (number of CPUs the readers are pinned to, default: all allowed)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'n':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_iterations = atol(argv[i + 1]);
+				i++;
+				break;
+			case 'g':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_grace_periods = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 't':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_threads = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'c':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_cpus = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	if (nr_threads < 0 || nr_iterations < 1 || nr_grace_periods < 0 || nr_cpus < 0) {
+		fprintf(stderr, "Invalid number of threads, CPUs or iterations\n");
+		return -1;
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	unsigned int rseq_membarrier_available;
+	int ret;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	side_rcu_gp_init(&bench_rcu_gp);
+	rseq_membarrier_available = side_rcu_rseq_membarrier_available;
+	if (nr_threads) {
+		if (rseq_membarrier_available)
+			bench_read("rseq");
+		/*
+		 * Readers use the atomic fallback when rseq is unavailable.
+		 * The grace period observes both counter kinds.
+		 */
+		side_rcu_rseq_membarrier_available = 0;
+		bench_read("fallback");
+		side_rcu_rseq_membarrier_available = rseq_membarrier_available;
+	}
+	bench_grace_period();
+	side_rcu_gp_exit(&bench_rcu_gp);
+	return 0;
+}
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Measure the cost of registering and unregistering a large number of
+ * events at once, as done when a library is loaded and unloaded. The
+ * event descriptions are copies of a template event, each with its own
+ * state and event name. Each round prints one key=value line.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <side/trace.h>
+
+static int nr_events = 10000;
+static int nr_rounds = 10;
+
+side_static_event(bench_event_template, "bench", "template", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("a"), side_field_u64("b"), side_field_string("c"))
+);
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-e <nr_events> (number of events registered at once)\n");
+	printf("	-n <rounds> (number of register/unregister rounds)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'e':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_events = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'n':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_rounds = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	if (nr_events < 1 || nr_rounds < 1) {
+		fprintf(stderr, "The number of events and rounds must be positive\n");
+		return -1;
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	struct side_event_description *descs, **events;
+	struct side_event_state_0 *states;
+	char (*names)[32];
+	int i, ret;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	/* Keep the built-in text tracer callbacks out of the measurement. */
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+
+	descs = calloc(nr_events, sizeof(*descs));
+	states = calloc(nr_events, sizeof(*states));
+	events = calloc(nr_events, sizeof(*events));
+	names = calloc(nr_events, sizeof(*names));
+	if (!descs || !states || !events || !names)
+		abort();
+	for (i = 0; i < nr_events; i++) {
+		states[i].parent.version = SIDE_EVENT_STATE_ABI_VERSION;
+		states[i].callbacks = (const struct side_callback *) &side_empty_callback[0];
+		states[i].desc = &descs[i];
+		descs[i] = bench_event_template;
+		side_ptr_set(descs[i].state, &states[i].parent);
+		snprintf(names[i], sizeof(names[i]), "event_%d", i);
+		side_ptr_set(descs[i].event_name, names[i]);
+		events[i] = &descs[i];
+	}
+
+	for (i = 0; i < nr_rounds; i++) {
+		struct side_events_register_handle *handle;
+		uint64_t begin, register_ns, unregister_ns;
+
+		begin = now_ns();
+		handle = side_events_register(events, nr_events);
+		register_ns = now_ns() - begin;
+		if (!handle)
+			abort();
+		begin = now_ns();
+		side_events_unregister(handle);
+		unregister_ns = now_ns() - begin;
+		printf("benchmark=events_register events=%d round=%d register_ns=%" PRIu64 " unregister_ns=%" PRIu64 " register_ns_per_event=%.1f unregister_ns_per_event=%.1f\n",
+			nr_events, i, register_ns, unregister_ns,
+			(double) register_ns / nr_events, (double) unregister_ns / nr_events);
+		fflush(stdout);
+	}
+	free(names);
+	free(events);
+	free(states);
+	free(descs);
+	return 0;
+}
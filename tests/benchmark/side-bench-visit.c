@@ -0,0 +1,1169 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Measure the argument and description visitors over a corpus of
+ * events, one per type label, modelled after the events of
+ * tests/unit/test.c. Each event of the corpus is called with:
+ *
+ *  - an empty callback ("none"), measuring the call dispatch,
+ *  - a callback visiting the arguments with type_visitor_event() and
+ *    a visitor without callbacks ("null"),
+ *  - the built-in text tracer ("tracer"), whose output is written to
+ *    LIBSIDE_TRACER_FD (see run-benchmarks).
+ *
+ * The visit cost excludes the dispatch measured with the empty callback.
+ * The bytes of an event are the size of its arguments serialized as a
+ * payload (side_tracer_callback_payload_register()), or 0 when the
+ * arguments cannot be serialized. The description visitor is run
+ * directly with description_visitor_event() and a null visitor. Each
+ * measurement prints one key=value line.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <side/trace.h>
+
+#include "../../src/visit-arg-vec.h"
+#include "../../src/visit-description.h"
+
+static long nr_iterations = 100000;
+static const char *label_filter;
+
+static uint64_t bench_key;
+static size_t payload_len;
+
+static const struct side_type_visitor null_type_visitor;
+static const struct side_description_visitor null_description_visitor;
+
+/* Basic types. */
+
+side_static_event(bench_null, "bench", "null", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_null("a"), side_field_null("b"), side_field_null("c"), side_field_null("d"))
+);
+
+static
+void emit_null(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_null,
+			side_arg_list(side_arg_null(), side_arg_null(), side_arg_null(), side_arg_null()));
+}
+
+side_static_event(bench_bool, "bench", "bool", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_bool("a"), side_field_bool("b"), side_field_bool("c"), side_field_bool("d"))
+);
+
+static
+void emit_bool(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_bool,
+			side_arg_list(side_arg_bool(true), side_arg_bool(false), side_arg_bool(i & 1), side_arg_bool(true)));
+}
+
+side_static_event(bench_integer, "bench", "integer", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_u8("u8"),
+		side_field_u16("u16"),
+		side_field_u32("u32"),
+		side_field_u64("u64"),
+		side_field_s32("s32"),
+		side_field_s64("s64"),
+	)
+);
+
+static
+void emit_integer(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_integer,
+			side_arg_list(
+				side_arg_u8(200),
+				side_arg_u16(60000),
+				side_arg_u32((uint32_t) i),
+				side_arg_u64(0x123456789ULL),
+				side_arg_s32(-500),
+				side_arg_s64(-5000000000LL),
+			)
+		);
+}
+
+side_static_event(bench_byte, "bench", "byte", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_byte("a"), side_field_byte("b"), side_field_byte("c"), side_field_byte("d"))
+);
+
+static
+void emit_byte(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_byte,
+			side_arg_list(side_arg_byte(0x1), side_arg_byte(0x2), side_arg_byte(0x3), side_arg_byte(0x4)));
+}
+
+side_static_event(bench_pointer, "bench", "pointer", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_pointer("a"), side_field_pointer("b"))
+);
+
+static
+void emit_pointer(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_pointer,
+			side_arg_list(side_arg_pointer((void *) 0x1), side_arg_pointer(&nr_iterations)));
+}
+
+side_static_event(bench_float, "bench", "float", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+#if __HAVE_FLOAT32
+		side_field_float_binary32("binary32"),
+#endif
+#if __HAVE_FLOAT64
+		side_field_float_binary64("binary64"),
+#endif
+	)
+);
+
+static
+void emit_float(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_float,
+			side_arg_list(
+#if __HAVE_FLOAT32
+				side_arg_float_binary32(2.2f),
+#endif
+#if __HAVE_FLOAT64
+				side_arg_float_binary64(3.3),
+#endif
+			)
+		);
+}
+
+side_static_event(bench_string_utf8, "bench", "string_utf8", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_string("a"), side_field_string("b"))
+);
+
+static
+void emit_string_utf8(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_string_utf8,
+			side_arg_list(side_arg_string("short"), side_arg_string("a somewhat longer string argument")));
+}
+
+side_static_event(bench_string_utf16, "bench", "string_utf16", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_string16("a"))
+);
+
+static
+void emit_string_utf16(long n)
+{
+	static const uint16_t str16[] = { 0x00ae, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 0 };
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_string_utf16, side_arg_list(side_arg_string16(str16)));
+}
+
+side_static_event(bench_string_utf32, "bench", "string_utf32", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_string32("a"))
+);
+
+static
+void emit_string_utf32(long n)
+{
+	static const uint32_t str32[] = { 0x000000ae, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 0 };
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_string_utf32, side_arg_list(side_arg_string32(str32)));
+}
+
+/* Compound types. */
+
+static side_define_struct(bench_struct_def,
+	side_field_list(
+		side_field_u32("x"),
+		side_field_s64("y"),
+		side_field_string("z"),
+	)
+);
+
+side_static_event(bench_struct, "bench", "struct", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_struct("struct", bench_struct_def))
+);
+
+static
+void emit_struct(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_struct(mystruct,
+			side_arg_list(side_arg_u32(21), side_arg_s64(22), side_arg_string("abc")));
+		side_event(bench_struct, side_arg_list(side_arg_struct(mystruct)));
+	}
+}
+
+static side_define_array(bench_array_def,
+	side_elem(side_type_u32()),
+	8
+);
+
+side_static_event(bench_array, "bench", "array", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_array("array", bench_array_def))
+);
+
+static
+void emit_array(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_array(myarray,
+			side_arg_list(side_arg_u32(1), side_arg_u32(2), side_arg_u32(3), side_arg_u32(4),
+				side_arg_u32(5), side_arg_u32(6), side_arg_u32(7), side_arg_u32(8)));
+		side_event(bench_array, side_arg_list(side_arg_array(myarray)));
+	}
+}
+
+static side_define_vla(bench_vla_def,
+	side_elem(side_type_u32()),
+	side_elem(side_type_u32())
+);
+
+side_static_event(bench_vla, "bench", "vla", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_vla("vla", bench_vla_def))
+);
+
+static
+void emit_vla(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_vla(myvla,
+			side_arg_list(side_arg_u32(1), side_arg_u32(2), side_arg_u32(3), side_arg_u32(4),
+				side_arg_u32(5), side_arg_u32(6), side_arg_u32(7), side_arg_u32(8)));
+		side_event(bench_vla, side_arg_list(side_arg_vla(myvla)));
+	}
+}
+
+static uint32_t bench_visitor_array[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+struct bench_visitor_ctx {
+	const uint32_t *ptr;
+	uint32_t length;
+};
+
+static
+enum side_visitor_status bench_vla_visitor(const struct side_tracer_visitor_ctx *tracer_ctx, struct bench_visitor_ctx *ctx)
+{
+	uint32_t length = ctx->length, i;
+
+	for (i = 0; i < length; i++) {
+		const struct side_arg elem = side_visit_dynamic_arg(side_arg_u32, ctx->ptr[i]);
+
+		if (tracer_ctx->write_elem(tracer_ctx, &elem) != SIDE_VISITOR_STATUS_OK)
+			return SIDE_VISITOR_STATUS_ERROR;
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+side_define_static_vla_visitor(bench_vla_visitor_def,
+			side_elem(side_type_u32()), side_elem(side_type_u32()),
+			bench_vla_visitor, struct bench_visitor_ctx);
+
+side_static_event(bench_vla_visitor_event, "bench", "vla_visitor", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_vla_visitor("vlavisit", bench_vla_visitor_def))
+);
+
+static
+void emit_vla_visitor(long n)
+{
+	struct bench_visitor_ctx ctx = {
+		.ptr = bench_visitor_array,
+		.length = SIDE_ARRAY_SIZE(bench_visitor_array),
+	};
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_vla_visitor(side_visitor, &ctx);
+		side_event(bench_vla_visitor_event, side_arg_list(side_arg_vla_visitor(side_visitor)));
+	}
+}
+
+static side_define_variant(bench_variant_def,
+	side_type_u32(),
+	side_option_list(
+		side_option_range(1, 3, side_type_u16()),
+		side_option(5, side_type_string()),
+	)
+);
+
+side_static_event(bench_variant, "bench", "variant", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_variant("a", bench_variant_def), side_field_variant("b", bench_variant_def))
+);
+
+static
+void emit_variant(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_variant(myvariant1, side_arg_u32(2), side_arg_u16(4));
+		side_arg_define_variant(myvariant2, side_arg_u32(5), side_arg_string("abc"));
+		side_event(bench_variant,
+			side_arg_list(side_arg_variant(myvariant1), side_arg_variant(myvariant2)));
+	}
+}
+
+static side_define_optional(bench_optional_def, side_elem(side_type_string()));
+
+side_static_event(bench_optional, "bench", "optional", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_optional("a", bench_optional_def), side_field_optional("b", bench_optional_def))
+);
+
+static
+void emit_optional(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_define_optional(present, side_arg_string("present"), SIDE_OPTIONAL_ENABLED);
+		side_arg_define_optional(absent, side_arg_string("absent"), SIDE_OPTIONAL_DISABLED);
+		side_event(bench_optional, side_arg_list(side_arg_optional(present), side_arg_optional(absent)));
+	}
+}
+
+/* Enumeration types. */
+
+static side_define_enum(bench_enum_def,
+	side_enum_mapping_list(
+		side_enum_mapping_range("one-ten", 1, 10),
+		side_enum_mapping_range("100-200", 100, 200),
+		side_enum_mapping_value("200", 200),
+		side_enum_mapping_value("300", 300),
+	)
+);
+
+side_static_event(bench_enum, "bench", "enum", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_enum("a", &bench_enum_def, side_elem(side_type_u32())),
+		side_field_enum("b", &bench_enum_def, side_elem(side_type_u64())),
+		side_field_enum("c", &bench_enum_def, side_elem(side_type_u8())),
+		side_field_enum("d", &bench_enum_def, side_elem(side_type_s8())),
+	)
+);
+
+static
+void emit_enum(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_enum,
+			side_arg_list(side_arg_u32(5), side_arg_u64(400), side_arg_u8(200), side_arg_s8(-100)));
+}
+
+static side_define_enum_bitmap(bench_enum_bitmap_def,
+	side_enum_bitmap_mapping_list(
+		side_enum_bitmap_mapping_value("0", 0),
+		side_enum_bitmap_mapping_range("1-2", 1, 2),
+		side_enum_bitmap_mapping_range("2-4", 2, 4),
+		side_enum_bitmap_mapping_value("3", 3),
+		side_enum_bitmap_mapping_value("30", 30),
+		side_enum_bitmap_mapping_value("63", 63),
+	)
+);
+
+side_static_event(bench_enum_bitmap, "bench", "enum_bitmap", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_enum_bitmap("a", &bench_enum_bitmap_def, side_elem(side_type_u32())),
+		side_field_enum_bitmap("b", &bench_enum_bitmap_def, side_elem(side_type_u8())),
+		side_field_enum_bitmap("c", &bench_enum_bitmap_def, side_elem(side_type_u64())),
+		side_field_enum_bitmap("d", &bench_enum_bitmap_def, side_elem(side_type_byte())),
+	)
+);
+
+static
+void emit_enum_bitmap(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_enum_bitmap,
+			side_arg_list(
+				side_arg_u32((1U << 1) | (1U << 30)),
+				side_arg_u8(1U << 3),
+				side_arg_u64((1ULL << 1) | (1ULL << 63)),
+				side_arg_byte(1U << 2),
+			)
+		);
+}
+
+/* Gather basic types. */
+
+side_static_event(bench_gather_bool, "bench", "gather_bool", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_bool("a", 0, sizeof(bool), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_bool("b", 0, sizeof(bool), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_bool("c", 0, sizeof(uint16_t), 1, 1, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_bool("d", 0, sizeof(uint16_t), 1, 1, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_bool(long n)
+{
+	bool v1 = true, v2 = false;
+	uint16_t v3 = 1U << 1, v4 = 1U << 2;
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_bool,
+			side_arg_list(
+				side_arg_gather_bool(&v1),
+				side_arg_gather_bool(&v2),
+				side_arg_gather_bool(&v3),
+				side_arg_gather_bool(&v4),
+			)
+		);
+}
+
+side_static_event(bench_gather_byte, "bench", "gather_byte", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_byte("a", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_byte("b", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_byte(long n)
+{
+	uint8_t v1 = 0x44, v2 = 0x55;
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_byte,
+			side_arg_list(side_arg_gather_byte(&v1), side_arg_gather_byte(&v2)));
+}
+
+side_static_event(bench_gather_integer, "bench", "gather_integer", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_unsigned_integer("u32", 0, sizeof(uint32_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("u64", 0, sizeof(uint64_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_signed_integer("s16", 0, sizeof(int16_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_signed_integer("s64_bits", 0, sizeof(int64_t), 1, 31, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_integer(long n)
+{
+	uint32_t v1 = 5;
+	uint64_t v2 = 400;
+	int16_t v3 = -100;
+	int64_t v4 = -1;
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_integer,
+			side_arg_list(
+				side_arg_gather_integer(&v1),
+				side_arg_gather_integer(&v2),
+				side_arg_gather_integer(&v3),
+				side_arg_gather_integer(&v4),
+			)
+		);
+}
+
+side_static_event(bench_gather_pointer, "bench", "gather_pointer", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_pointer("a", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_pointer("b", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_pointer(long n)
+{
+	void *v1 = (void *) 0x44, *v2 = &nr_iterations;
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_pointer,
+			side_arg_list(side_arg_gather_pointer(&v1), side_arg_gather_pointer(&v2)));
+}
+
+side_static_event(bench_gather_float, "bench", "gather_float", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+#if __HAVE_FLOAT32
+		side_field_gather_float("f32", 0, sizeof(_Float32), SIDE_TYPE_GATHER_ACCESS_DIRECT),
+#endif
+#if __HAVE_FLOAT64
+		side_field_gather_float("f64", 0, sizeof(_Float64), SIDE_TYPE_GATHER_ACCESS_DIRECT),
+#endif
+	)
+);
+
+static
+void emit_gather_float(long n)
+{
+#if __HAVE_FLOAT32
+	_Float32 f32 = 2.2f;
+#endif
+#if __HAVE_FLOAT64
+	_Float64 f64 = 3.3;
+#endif
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_float,
+			side_arg_list(
+#if __HAVE_FLOAT32
+				side_arg_gather_float(&f32),
+#endif
+#if __HAVE_FLOAT64
+				side_arg_gather_float(&f64),
+#endif
+			)
+		);
+}
+
+side_static_event(bench_gather_string, "bench", "gather_string", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_string("a", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_string("b", 0, SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_string(long n)
+{
+	const char *str1 = "short", *str2 = "a somewhat longer string argument";
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_string,
+			side_arg_list(side_arg_gather_string(str1), side_arg_gather_string(str2)));
+}
+
+/* Gather compound types. */
+
+struct bench_gather {
+	uint32_t a;
+	uint64_t b;
+	uint8_t c;
+	int32_t d;
+	uint16_t e;
+	int64_t f;
+};
+
+static side_define_struct(bench_gather_struct_def,
+	side_field_list(
+		side_field_gather_unsigned_integer("a", offsetof(struct bench_gather, a),
+			side_struct_field_sizeof(struct bench_gather, a), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("b", offsetof(struct bench_gather, b),
+			side_struct_field_sizeof(struct bench_gather, b), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("c", offsetof(struct bench_gather, c),
+			side_struct_field_sizeof(struct bench_gather, c), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_signed_integer("d", offsetof(struct bench_gather, d),
+			side_struct_field_sizeof(struct bench_gather, d), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("e", offsetof(struct bench_gather, e),
+			side_struct_field_sizeof(struct bench_gather, e), 8, 4,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_signed_integer("f", offsetof(struct bench_gather, f),
+			side_struct_field_sizeof(struct bench_gather, f), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+side_static_event(bench_gather_struct, "bench", "gather_struct", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_struct("struct", bench_gather_struct_def, 0, sizeof(struct bench_gather),
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void emit_gather_struct(long n)
+{
+	struct bench_gather mystruct = {
+		.a = 55,
+		.b = 123,
+		.c = 2,
+		.d = -55,
+		.e = 0xABCD,
+		.f = -1,
+	};
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_struct, side_arg_list(side_arg_gather_struct(&mystruct)));
+}
+
+static uint32_t bench_gather_array_values[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+side_static_event(bench_gather_array, "bench", "gather_array", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_array("array",
+			side_elem(side_type_gather_unsigned_integer(0, sizeof(uint32_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT)),
+			SIDE_ARRAY_SIZE(bench_gather_array_values), 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT
+		),
+	)
+);
+
+static
+void emit_gather_array(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_array, side_arg_list(side_arg_gather_array(bench_gather_array_values)));
+}
+
+side_static_event(bench_gather_vla, "bench", "gather_vla", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_vla("vla",
+			side_elem(side_type_gather_unsigned_integer(0, sizeof(uint32_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT)),
+			0, SIDE_TYPE_GATHER_ACCESS_DIRECT,
+			side_length(side_type_gather_unsigned_integer(0, sizeof(uint16_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT))
+		),
+	)
+);
+
+static
+void emit_gather_vla(long n)
+{
+	uint16_t len = SIDE_ARRAY_SIZE(bench_gather_array_values);
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_vla, side_arg_list(side_arg_gather_vla(bench_gather_array_values, &len)));
+}
+
+/* Gather enumeration types. */
+
+side_static_event(bench_gather_enum, "bench", "gather_enum", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_enum("a", bench_enum_def,
+			side_elem(side_type_gather_unsigned_integer(0, sizeof(uint32_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT))),
+		side_field_gather_enum("b", bench_enum_def,
+			side_elem(side_type_gather_unsigned_integer(0, sizeof(uint64_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT))),
+		side_field_gather_enum("c", bench_enum_def,
+			side_elem(side_type_gather_unsigned_integer(0, sizeof(uint8_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT))),
+		side_field_gather_enum("d", bench_enum_def,
+			side_elem(side_type_gather_signed_integer(0, sizeof(int8_t), 0, 0, SIDE_TYPE_GATHER_ACCESS_DIRECT))),
+	)
+);
+
+static
+void emit_gather_enum(long n)
+{
+	uint32_t v1 = 5;
+	uint64_t v2 = 400;
+	uint8_t v3 = 200;
+	int8_t v4 = -100;
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_gather_enum,
+			side_arg_list(
+				side_arg_gather_integer(&v1),
+				side_arg_gather_integer(&v2),
+				side_arg_gather_integer(&v3),
+				side_arg_gather_integer(&v4),
+			)
+		);
+}
+
+/* Dynamic types. */
+
+side_static_event(bench_dynamic_basic, "bench", "dynamic_basic", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_dynamic("a"),
+		side_field_dynamic("b"),
+		side_field_dynamic("c"),
+		side_field_dynamic("d"),
+	)
+);
+
+static
+void emit_dynamic_basic(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event(bench_dynamic_basic,
+			side_arg_list(
+				side_arg_dynamic_u32((uint32_t) i),
+				side_arg_dynamic_s64(-5000000000LL),
+				side_arg_dynamic_bool(true),
+				side_arg_dynamic_string("zzz"),
+			)
+		);
+}
+
+side_static_event(bench_dynamic_struct, "bench", "dynamic_struct", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_dynamic("dynamic"))
+);
+
+static
+void emit_dynamic_struct(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_dynamic_define_struct(mystruct,
+			side_arg_list(
+				side_arg_dynamic_field("a", side_arg_dynamic_u32(43)),
+				side_arg_dynamic_field("b", side_arg_dynamic_string("zzz")),
+				side_arg_dynamic_field("c", side_arg_dynamic_null()),
+			)
+		);
+		side_event(bench_dynamic_struct, side_arg_list(side_arg_dynamic_struct(&mystruct)));
+	}
+}
+
+side_static_event(bench_dynamic_vla, "bench", "dynamic_vla", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_dynamic("dynamic"))
+);
+
+static
+void emit_dynamic_vla(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_dynamic_define_vec(myvla,
+			side_arg_list(
+				side_arg_dynamic_u32(1),
+				side_arg_dynamic_u32(2),
+				side_arg_dynamic_u32(3),
+				side_arg_dynamic_u32(4),
+			)
+		);
+		side_event(bench_dynamic_vla, side_arg_list(side_arg_dynamic_vla(&myvla)));
+	}
+}
+
+side_static_event(bench_dynamic_vla_visitor, "bench", "dynamic_vla_visitor", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_dynamic("dynamic"))
+);
+
+static
+enum side_visitor_status bench_dynamic_vla_visitor_func(const struct side_tracer_visitor_ctx *tracer_ctx, void *_ctx)
+{
+	struct bench_visitor_ctx *ctx = (struct bench_visitor_ctx *) _ctx;
+	uint32_t length = ctx->length, i;
+
+	for (i = 0; i < length; i++) {
+		const struct side_arg elem = side_visit_dynamic_arg(side_arg_dynamic_u32, ctx->ptr[i]);
+
+		if (tracer_ctx->write_elem(tracer_ctx, &elem) != SIDE_VISITOR_STATUS_OK)
+			return SIDE_VISITOR_STATUS_ERROR;
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+void emit_dynamic_vla_visitor(long n)
+{
+	struct bench_visitor_ctx ctx = {
+		.ptr = bench_visitor_array,
+		.length = SIDE_ARRAY_SIZE(bench_visitor_array),
+	};
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_dynamic_define_vla_visitor(myvlavisitor, bench_dynamic_vla_visitor_func, &ctx);
+		side_event(bench_dynamic_vla_visitor,
+			side_arg_list(side_arg_dynamic_vla_visitor(myvlavisitor)));
+	}
+}
+
+side_static_event(bench_dynamic_struct_visitor, "bench", "dynamic_struct_visitor", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_dynamic("dynamic"))
+);
+
+static const char *bench_struct_visitor_names[] = { "a", "b", "c", "d" };
+
+static
+enum side_visitor_status bench_dynamic_struct_visitor_func(const struct side_tracer_dynamic_struct_visitor_ctx *tracer_ctx, void *_ctx)
+{
+	struct bench_visitor_ctx *ctx = (struct bench_visitor_ctx *) _ctx;
+	uint32_t i;
+
+	for (i = 0; i < SIDE_ARRAY_SIZE(bench_struct_visitor_names); i++) {
+		struct side_arg_dynamic_field dynamic_field =
+			side_visit_dynamic_field(side_arg_dynamic_u32, bench_struct_visitor_names[i], ctx->ptr[i]);
+
+		if (tracer_ctx->write_field(tracer_ctx, &dynamic_field) != SIDE_VISITOR_STATUS_OK)
+			return SIDE_VISITOR_STATUS_ERROR;
+	}
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+void emit_dynamic_struct_visitor(long n)
+{
+	struct bench_visitor_ctx ctx = {
+		.ptr = bench_visitor_array,
+		.length = SIDE_ARRAY_SIZE(bench_struct_visitor_names),
+	};
+	long i;
+
+	for (i = 0; i < n; i++) {
+		side_arg_dynamic_define_struct_visitor(mystructvisitor, bench_dynamic_struct_visitor_func, &ctx);
+		side_event(bench_dynamic_struct_visitor,
+			side_arg_list(side_arg_dynamic_struct_visitor(&mystructvisitor)));
+	}
+}
+
+side_static_event_variadic(bench_variadic, "bench", "variadic", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("a"))
+);
+
+static
+void emit_variadic(long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		side_event_variadic(bench_variadic,
+			side_arg_list(side_arg_u32((uint32_t) i)),
+			side_arg_list(
+				side_arg_dynamic_field("b", side_arg_dynamic_u32(55)),
+				side_arg_dynamic_field("c", side_arg_dynamic_s8(-4)),
+			)
+		);
+}
+
+struct corpus_entry {
+	const char *label;
+	struct side_event_description *desc;
+	void (*emit)(long n);
+};
+
+static const struct corpus_entry corpus[] = {
+	{ "null", &bench_null, emit_null },
+	{ "bool", &bench_bool, emit_bool },
+	{ "integer", &bench_integer, emit_integer },
+	{ "byte", &bench_byte, emit_byte },
+	{ "pointer", &bench_pointer, emit_pointer },
+	{ "float", &bench_float, emit_float },
+	{ "string_utf8", &bench_string_utf8, emit_string_utf8 },
+	{ "string_utf16", &bench_string_utf16, emit_string_utf16 },
+	{ "string_utf32", &bench_string_utf32, emit_string_utf32 },
+	{ "struct", &bench_struct, emit_struct },
+	{ "array", &bench_array, emit_array },
+	{ "vla", &bench_vla, emit_vla },
+	{ "vla_visitor", &bench_vla_visitor_event, emit_vla_visitor },
+	{ "variant", &bench_variant, emit_variant },
+	{ "optional", &bench_optional, emit_optional },
+	{ "enum", &bench_enum, emit_enum },
+	{ "enum_bitmap", &bench_enum_bitmap, emit_enum_bitmap },
+	{ "gather_bool", &bench_gather_bool, emit_gather_bool },
+	{ "gather_byte", &bench_gather_byte, emit_gather_byte },
+	{ "gather_integer", &bench_gather_integer, emit_gather_integer },
+	{ "gather_pointer", &bench_gather_pointer, emit_gather_pointer },
+	{ "gather_float", &bench_gather_float, emit_gather_float },
+	{ "gather_string", &bench_gather_string, emit_gather_string },
+	{ "gather_struct", &bench_gather_struct, emit_gather_struct },
+	{ "gather_array", &bench_gather_array, emit_gather_array },
+	{ "gather_vla", &bench_gather_vla, emit_gather_vla },
+	{ "gather_enum", &bench_gather_enum, emit_gather_enum },
+	{ "dynamic_basic", &bench_dynamic_basic, emit_dynamic_basic },
+	{ "dynamic_struct", &bench_dynamic_struct, emit_dynamic_struct },
+	{ "dynamic_vla", &bench_dynamic_vla, emit_dynamic_vla },
+	{ "dynamic_vla_visitor", &bench_dynamic_vla_visitor, emit_dynamic_vla_visitor },
+	{ "dynamic_struct_visitor", &bench_dynamic_struct_visitor, emit_dynamic_struct_visitor },
+	{ "variadic", &bench_variadic, emit_variadic },
+};
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void callback_none(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		void *priv __attribute__((unused)),
+		void *caller_addr __attribute__((unused)))
+{
+	__asm__ __volatile__ ("" : : : "memory");
+}
+
+static
+void callback_variadic_none(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		const struct side_arg_dynamic_struct *var_struct __attribute__((unused)),
+		void *priv __attribute__((unused)),
+		void *caller_addr __attribute__((unused)))
+{
+	__asm__ __volatile__ ("" : : : "memory");
+}
+
+static
+void callback_null(const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		void *priv __attribute__((unused)), void *caller_addr)
+{
+	type_visitor_event(&null_type_visitor, desc, side_arg_vec, NULL, NULL, caller_addr, NULL);
+}
+
+static
+void callback_variadic_null(const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec,
+		const struct side_arg_dynamic_struct *var_struct,
+		void *priv __attribute__((unused)), void *caller_addr)
+{
+	type_visitor_event(&null_type_visitor, desc, side_arg_vec, var_struct, NULL, caller_addr, NULL);
+}
+
+static
+void callback_payload(const struct side_event_description *desc __attribute__((unused)),
+		const void *payload __attribute__((unused)), size_t len,
+		void *priv __attribute__((unused)), void *caller_addr __attribute__((unused)))
+{
+	payload_len = len;
+}
+
+static
+bool entry_is_variadic(const struct corpus_entry *entry)
+{
+	return entry->desc->flags & SIDE_EVENT_FLAG_VARIADIC;
+}
+
+static
+void register_callback(const struct corpus_entry *entry, side_tracer_callback_func call,
+		side_tracer_callback_variadic_func call_variadic, bool unregister)
+{
+	int ret;
+
+	if (entry_is_variadic(entry)) {
+		if (unregister)
+			ret = side_tracer_callback_variadic_unregister(entry->desc, call_variadic, NULL, bench_key);
+		else
+			ret = side_tracer_callback_variadic_register(entry->desc, call_variadic, NULL, bench_key);
+	} else {
+		if (unregister)
+			ret = side_tracer_callback_unregister(entry->desc, call, NULL, bench_key);
+		else
+			ret = side_tracer_callback_register(entry->desc, call, NULL, bench_key);
+	}
+	if (ret != SIDE_ERROR_OK)
+		abort();
+}
+
+/* Returns the average time of an event, in ns. */
+static
+double time_emit(const struct corpus_entry *entry)
+{
+	uint64_t begin;
+
+	/* The first event from the call site checks the argument types. */
+	entry->emit(1);
+	begin = now_ns();
+	entry->emit(nr_iterations);
+	return (double) (now_ns() - begin) / nr_iterations;
+}
+
+static
+double time_callback(const struct corpus_entry *entry, side_tracer_callback_func call,
+		side_tracer_callback_variadic_func call_variadic)
+{
+	double ns;
+
+	register_callback(entry, call, call_variadic, false);
+	ns = time_emit(entry);
+	register_callback(entry, call, call_variadic, true);
+	return ns;
+}
+
+static
+double time_tracer(const struct corpus_entry *entry)
+{
+	double ns;
+
+	/* The text tracer callbacks follow the process-wide threshold. */
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_DEBUG))
+		abort();
+	ns = time_emit(entry);
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	return ns;
+}
+
+static
+size_t payload_size(const struct corpus_entry *entry)
+{
+	payload_len = 0;
+	if (side_tracer_callback_payload_register(entry->desc, callback_payload, NULL, bench_key) != SIDE_ERROR_OK)
+		abort();
+	entry->emit(1);
+	if (side_tracer_callback_payload_unregister(entry->desc, callback_payload, NULL, bench_key) != SIDE_ERROR_OK)
+		abort();
+	return payload_len;
+}
+
+static
+void print_visit(const char *label, const char *visitor, double ns, double dispatch_ns, size_t bytes)
+{
+	double visit_ns = ns - dispatch_ns;
+
+	if (visit_ns < 0)
+		visit_ns = 0;
+	printf("benchmark=visit label=%s visitor=%s iterations=%ld ns_per_event=%.2f visit_ns_per_event=%.2f bytes_per_event=%zu bytes_per_sec=%.0f\n",
+		label, visitor, nr_iterations, ns, visit_ns, bytes,
+		visit_ns > 0 ? (double) bytes * 1e9 / visit_ns : 0);
+}
+
+static
+void bench_entry(const struct corpus_entry *entry)
+{
+	double none_ns, null_ns, tracer_ns, describe_ns;
+	uint64_t begin;
+	size_t bytes;
+	long i;
+
+	bytes = payload_size(entry);
+	none_ns = time_callback(entry, callback_none, callback_variadic_none);
+	null_ns = time_callback(entry, callback_null, callback_variadic_null);
+	tracer_ns = time_tracer(entry);
+
+	begin = now_ns();
+	for (i = 0; i < nr_iterations; i++)
+		description_visitor_event(&null_description_visitor, entry->desc, NULL);
+	describe_ns = (double) (now_ns() - begin) / nr_iterations;
+
+	printf("benchmark=visit label=%s visitor=none iterations=%ld ns_per_event=%.2f\n",
+		entry->label, nr_iterations, none_ns);
+	print_visit(entry->label, "null", null_ns, none_ns, bytes);
+	print_visit(entry->label, "tracer", tracer_ns, none_ns, bytes);
+	printf("benchmark=describe label=%s visitor=null iterations=%ld ns_per_event=%.2f\n",
+		entry->label, nr_iterations, describe_ns);
+	fflush(stdout);
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-n <iterations> (number of events per label and visitor)\n");
+	printf("	-l <label> (only measure the events of this type label)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'n':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_iterations = atol(argv[i + 1]);
+				i++;
+				break;
+			case 'l':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				label_filter = argv[i + 1];
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	if (nr_iterations < 1) {
+		fprintf(stderr, "The number of iterations must be positive\n");
+		return -1;
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	size_t i;
+	int ret;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	if (side_tracer_request_key(&bench_key))
+		abort();
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	if (side_tracer_key_loglevel_threshold_set(bench_key, SIDE_LOGLEVEL_DEBUG))
+		abort();
+
+	for (i = 0; i < SIDE_ARRAY_SIZE(corpus); i++) {
+		if (label_filter && strcmp(label_filter, corpus[i].label))
+			continue;
+		bench_entry(&corpus[i]);
+	}
+	return 0;
+}
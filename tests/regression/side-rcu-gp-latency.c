@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2022 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Measure RCU grace period latency as a function of the number of CPUs
+ * used by readers. Each reader thread is pinned to a distinct CPU
+ * (round-robin over the CPUs allowed for the process).
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "../../src/rcu.h"
+
+static int nr_reader_threads = 2;
+static int nr_iterations = 10000;
+
+static volatile int start_test, stop_test;
+
+struct thread_ctx {
+	pthread_t thread_id;
+	int cpu;
+	uint64_t count;
+};
+
+static struct side_rcu_gp_state test_rcu_gp;
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		abort();
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static
+void *test_reader_thread(void *arg)
+{
+	struct thread_ctx *thread_ctx = (struct thread_ctx *) arg;
+	uint64_t count = 0;
+
+	if (thread_ctx->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(thread_ctx->cpu, &set);
+		(void) sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	while (!start_test) { }
+
+	while (!stop_test) {
+		struct side_rcu_read_state rcu_read_state;
+
+		side_rcu_read_begin(&test_rcu_gp, &rcu_read_state);
+		side_rcu_read_end(&test_rcu_gp, &rcu_read_state);
+		count++;
+	}
+	thread_ctx->count = count;
+	return NULL;
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-n <iterations> (number of grace periods measured)\n");
+	printf("	-r <nr_readers> (number of reader threads, one per CPU)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'n':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_iterations = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'r':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_reader_threads = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	uint64_t read_tot = 0, gp_tot_ns = 0, gp_max_ns = 0;
+	struct thread_ctx *reader_ctx;
+	cpu_set_t allowed;
+	int i, ret, cpu = -1;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	side_rcu_gp_init(&test_rcu_gp);
+	reader_ctx = calloc(nr_reader_threads, sizeof(struct thread_ctx));
+	if (!reader_ctx)
+		abort();
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		CPU_ZERO(&allowed);
+
+	for (i = 0; i < nr_reader_threads; i++) {
+		int j;
+
+		/* Pick the next allowed CPU, round-robin. */
+		reader_ctx[i].cpu = -1;
+		for (j = 0; j < CPU_SETSIZE; j++) {
+			cpu = (cpu + 1) % CPU_SETSIZE;
+			if (CPU_ISSET(cpu, &allowed)) {
+				reader_ctx[i].cpu = cpu;
+				break;
+			}
+		}
+		ret = pthread_create(&reader_ctx[i].thread_id, NULL, test_reader_thread, &reader_ctx[i]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			abort();
+		}
+	}
+
+	start_test = 1;
+
+	for (i = 0; i < nr_iterations; i++) {
+		uint64_t begin, delta;
+
+		begin = now_ns();
+		side_rcu_wait_grace_period(&test_rcu_gp);
+		delta = now_ns() - begin;
+		gp_tot_ns += delta;
+		if (delta > gp_max_ns)
+			gp_max_ns = delta;
+	}
+
+	stop_test = 1;
+
+	for (i = 0; i < nr_reader_threads; i++) {
+		void *res;
+
+		ret = pthread_join(reader_ctx[i].thread_id, &res);
+		if (ret) {
+			errno = ret;
+			perror("pthread_join");
+			abort();
+		}
+		read_tot += reader_ctx[i].count;
+	}
+	printf("Summary: nr_possible_cpus: %d, nr_reader_threads: %d, grace periods: %d, avg latency: %" PRIu64 " ns, max latency: %" PRIu64 " ns, reads: %" PRIu64 "\n",
+		test_rcu_gp.nr_cpus, nr_reader_threads, nr_iterations,
+		nr_iterations ? gp_tot_ns / nr_iterations : 0, gp_max_ns, read_tot);
+	free(reader_ctx);
+	side_rcu_gp_exit(&test_rcu_gp);
+	return 0;
+}
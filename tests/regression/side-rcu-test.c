@@ -10,6 +10,7 @@
 static int nr_reader_threads = 2;
 static int nr_writer_threads = 2;
 static int duration_s = 10;
+static int use_call_rcu;
 
 static volatile int start_test, stop_test;
 
@@ -26,12 +27,24 @@ static struct side_rcu_gp_state test_rcu_gp;
 
 #define POISON_VALUE	55
 
+/* Bound the number of callbacks queued by each writer. */
+#define CALL_RCU_BARRIER_PERIOD	1024
+
 struct test_data {
 	int v;
 };
 
 static struct test_data *rcu_p;
 
+static
+void test_data_free(void *ptr)
+{
+	struct test_data *data = (struct test_data *) ptr;
+
+	data->v = POISON_VALUE;
+	free(data);
+}
+
 static
 void *test_reader_thread(void *arg)
 {
@@ -83,11 +96,15 @@ void *test_writer_thread(void *arg)
 		side_rcu_assign_pointer(rcu_p, new_data);
 		pthread_mutex_unlock(&lock);
 
-		side_rcu_wait_grace_period(&test_rcu_gp);
-
-		if (old_data) {
-			old_data->v = POISON_VALUE;
-			free(old_data);
+		if (use_call_rcu) {
+			if (old_data)
+				side_rcu_call(&test_rcu_gp, test_data_free, old_data);
+			if (!(count % CALL_RCU_BARRIER_PERIOD))
+				side_rcu_barrier(&test_rcu_gp);
+		} else {
+			side_rcu_wait_grace_period(&test_rcu_gp);
+			if (old_data)
+				test_data_free(old_data);
 		}
 		count++;
 	}
@@ -102,6 +119,7 @@ void print_help(void)
 	printf("	-d <seconds> (test duration in seconds)\n");
 	printf("	-r <nr_readers> (number of reader threads)\n");
 	printf("	-w <nr_writers> (number of writers threads)\n");
+	printf("	-c (use deferred reclamation with side_rcu_call)\n");
 }
 
 static
@@ -136,6 +154,9 @@ int parse_cmd_line(int argc, const char **argv)
 				nr_writer_threads = atoi(argv[i + 1]);
 				i++;
 				break;
+			case 'c':
+				use_call_rcu = 1;
+				break;
 			case 'h':
 				print_help();
 				ret = 1;
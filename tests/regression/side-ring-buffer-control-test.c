@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Act as a session daemon for a child process tracing into a ring
+ * buffer with its events initially disabled: enable and disable events
+ * through the control region between bursts of events, and check that
+ * the ring buffer only holds the records of the enabled bursts.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <side/trace.h>
+
+#include "../../src/ring-buffer.h"
+#include "../../src/ring-buffer-control.h"
+
+#define NR_EVENTS_PER_BURST	10
+
+side_static_event(control_event_a, "control_test", "event_a", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("burst"))
+);
+
+side_static_event(control_event_b, "control_test", "event_b", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("burst"))
+);
+
+static int to_child = -1, from_child = -1;
+
+/* Emit a burst of each event per command byte read. */
+static
+int child_main(void)
+{
+	uint32_t burst = 0;
+	char c;
+
+	if (write(1, "r", 1) != 1)
+		return 1;
+	while (read(0, &c, 1) == 1 && c == 'e') {
+		int i;
+
+		for (i = 0; i < NR_EVENTS_PER_BURST; i++) {
+			side_event(control_event_a, side_arg_list(side_arg_u32(burst)));
+			side_event(control_event_b, side_arg_list(side_arg_u32(burst)));
+		}
+		burst++;
+		if (write(1, "d", 1) != 1)
+			return 1;
+	}
+	return 0;
+}
+
+static
+pid_t spawn_child(const char *path)
+{
+	int in[2], out[2];
+	pid_t pid;
+
+	if (pipe(in) || pipe(out))
+		abort();
+	pid = fork();
+	if (pid < 0)
+		abort();
+	if (!pid) {
+		int null_fd = open("/dev/null", O_WRONLY);
+
+		if (null_fd < 0 || dup2(in[0], 0) < 0 || dup2(out[1], 1) < 0 || dup2(null_fd, 3) < 0)
+			_exit(1);
+		/* The child sees the end of the commands once the parent closes its pipe. */
+		(void) close(in[1]);
+		(void) close(out[0]);
+		setenv("LIBSIDE_RING_BUFFER", path, 1);
+		setenv("LIBSIDE_RING_BUFFER_CONTROL", "disabled", 1);
+		/* Keep the text tracer output away from the command pipe. */
+		setenv("LIBSIDE_TRACER_FD", "3", 1);
+		execl("/proc/self/exe", "side-ring-buffer-control-test", "child", (char *) NULL);
+		_exit(1);
+	}
+	(void) close(in[0]);
+	(void) close(out[1]);
+	to_child = in[1];
+	from_child = out[0];
+	return pid;
+}
+
+static
+void expect_from_child(char expected)
+{
+	char c;
+
+	if (read(from_child, &c, 1) != 1 || c != expected) {
+		fprintf(stderr, "Unexpected child reply\n");
+		abort();
+	}
+}
+
+static
+void run_burst(void)
+{
+	if (write(to_child, "e", 1) != 1)
+		abort();
+	expect_from_child('d');
+}
+
+static
+void *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	void *addr;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0 || fstat(fd, &st))
+		abort();
+	addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+		abort();
+	(void) close(fd);
+	*len = st.st_size;
+	return addr;
+}
+
+static
+uint32_t lookup_event(const struct side_ring_buffer_control_header *control, const char *name)
+{
+	uint32_t id, limit = __atomic_load_n(&control->id_limit, __ATOMIC_ACQUIRE);
+
+	for (id = 0; id < limit; id++) {
+		struct side_ring_buffer_control_event event;
+
+		while (!side_ring_buffer_control_read_event(control, id, &event)) { }
+		if (event.registered && !strcmp(event.provider_name, "control_test") &&
+		    !strcmp(event.event_name, name)) {
+			if (event.enabled || event.requested) {
+				fprintf(stderr, "Event %s is not initially disabled\n", name);
+				abort();
+			}
+			return id;
+		}
+	}
+	fprintf(stderr, "Event %s is not published\n", name);
+	abort();
+}
+
+static
+void request(struct side_ring_buffer_control_header *control, uint32_t id, bool enable)
+{
+	struct side_ring_buffer_control_event event;
+	struct timespec timeout = { .tv_sec = 10 };
+
+	if (!side_ring_buffer_control_wait(control, side_ring_buffer_control_request(control, id, enable),
+			&timeout)) {
+		fprintf(stderr, "Request timed out\n");
+		abort();
+	}
+	while (!side_ring_buffer_control_read_event(control, id, &event)) { }
+	if (event.enabled != enable) {
+		fprintf(stderr, "Request not applied\n");
+		abort();
+	}
+}
+
+/* Count the records of each ID in complete sub-buffers. */
+static
+void count_records(const struct side_ring_buffer_header *header, uint32_t id_a, uint32_t id_b,
+		uint64_t *nr_a, uint64_t *nr_b, uint64_t *nr_other)
+{
+	uint32_t cpu;
+
+	for (cpu = 0; cpu < header->nr_cpus; cpu++) {
+		struct side_ring_buffer_cpu *cpu_buf = side_ring_buffer_get_cpu(header, cpu);
+		uintptr_t pos = 0;
+
+		while (side_ring_buffer_subbuf_complete(header, cpu_buf, pos)) {
+			const char *data = side_ring_buffer_subbuf_data(header, cpu_buf, pos);
+			uint64_t offset = 0;
+
+			while (offset < header->subbuf_size) {
+				struct side_ring_buffer_record_header record;
+
+				memcpy(&record, data + offset, sizeof(record));
+				if (!record.size || offset + record.size > header->subbuf_size)
+					abort();
+				if (record.id == id_a)
+					(*nr_a)++;
+				else if (record.id == id_b)
+					(*nr_b)++;
+				else if (record.id != SIDE_RING_BUFFER_ID_PADDING)
+					(*nr_other)++;
+				offset += record.size;
+			}
+			pos += header->subbuf_size;
+		}
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	struct side_ring_buffer_control_header *control;
+	uint64_t nr_a = 0, nr_b = 0, nr_other = 0;
+	char dir[] = "/tmp/side-control-XXXXXX";
+	char path[sizeof(dir) + 8], control_path[sizeof(dir) + 16];
+	size_t control_len, rb_len;
+	uint32_t id_a, id_b;
+	void *rb;
+	int status;
+	pid_t pid;
+
+	if (argc > 1 && !strcmp(argv[1], "child"))
+		return child_main();
+
+	if (!mkdtemp(dir))
+		abort();
+	snprintf(path, sizeof(path), "%s/rb", dir);
+	snprintf(control_path, sizeof(control_path), "%s.ctl", path);
+	pid = spawn_child(path);
+	expect_from_child('r');
+	control = (struct side_ring_buffer_control_header *) map_file(control_path, &control_len);
+	if (memcmp(control->magic, SIDE_RING_BUFFER_CONTROL_MAGIC, sizeof(control->magic)) ||
+	    control->version != SIDE_RING_BUFFER_CONTROL_VERSION || control->pid != (uint32_t) pid)
+		abort();
+	id_a = lookup_event(control, "event_a");
+	id_b = lookup_event(control, "event_b");
+
+	run_burst();			/* Not recorded. */
+	request(control, id_a, true);
+	run_burst();			/* Records event_a. */
+	request(control, id_b, true);
+	run_burst();			/* Records both events. */
+	request(control, id_a, false);
+	request(control, id_b, false);
+	run_burst();			/* Not recorded. */
+
+	/* The child flushes the ring buffer on exit. */
+	(void) close(to_child);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+		abort();
+	rb = map_file(path, &rb_len);
+	count_records((const struct side_ring_buffer_header *) rb, id_a, id_b, &nr_a, &nr_b, &nr_other);
+	printf("Summary: event_a records: %" PRIu64 ", event_b records: %" PRIu64 ", other records: %" PRIu64 "\n",
+		nr_a, nr_b, nr_other);
+	if (nr_a != 2 * NR_EVENTS_PER_BURST || nr_b != NR_EVENTS_PER_BURST || nr_other)
+		abort();
+	(void) munmap(rb, rb_len);
+	(void) munmap(control, control_len);
+	(void) unlink(path);
+	(void) unlink(control_path);
+	snprintf(control_path, sizeof(control_path), "%s.meta", path);
+	(void) unlink(control_path);
+	snprintf(control_path, sizeof(control_path), "%s.ctf2", path);
+	(void) unlink(control_path);
+	(void) rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Concurrent writers record per-thread sequence numbers in per-CPU
+ * ring buffers while a reader consumes complete sub-buffers in discard
+ * mode. Checks that records are well-formed, that each thread's
+ * records are read in order, and that every record is either read or
+ * accounted as lost.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../../src/ring-buffer.h"
+
+static int nr_writer_threads = 4;
+static int duration_s = 2;
+
+static volatile int start_test, stop_test;
+
+struct thread_ctx {
+	pthread_t thread_id;
+	uint32_t id;
+	uint64_t count;
+};
+
+struct test_record {
+	struct side_ring_buffer_record_header header;
+	uint64_t seq;
+};
+
+static struct side_ring_buffer *rb;
+static uint64_t *last_seq;
+static uint64_t nr_read;
+
+static
+void *test_writer_thread(void *arg)
+{
+	struct thread_ctx *thread_ctx = (struct thread_ctx *) arg;
+	uint64_t count = 0;
+
+	while (!start_test) { }
+
+	while (!stop_test) {
+		struct side_ring_buffer_ctx ctx;
+		uint64_t seq = count + 1;
+
+		if (side_ring_buffer_reserve(rb, &ctx, sizeof(struct test_record), thread_ctx->id)) {
+			memcpy(ctx.data + sizeof(struct side_ring_buffer_record_header), &seq, sizeof(seq));
+			side_ring_buffer_commit(rb, &ctx);
+		}
+		count++;
+	}
+	thread_ctx->count = count;
+	return NULL;
+}
+
+static
+void check_subbuf(const struct side_ring_buffer_header *header, const char *data)
+{
+	uint64_t offset = 0;
+
+	while (offset < header->subbuf_size) {
+		struct test_record record;
+
+		memcpy(&record.header, data + offset, sizeof(record.header));
+		if (!record.header.size || record.header.size % SIDE_RING_BUFFER_ALIGN ||
+		    offset + record.header.size > header->subbuf_size) {
+			fprintf(stderr, "Unexpected record size: %" PRIu32 "\n", record.header.size);
+			abort();
+		}
+		if (record.header.id != SIDE_RING_BUFFER_ID_PADDING) {
+			if (record.header.id >= (uint32_t) nr_writer_threads ||
+			    record.header.size != sizeof(struct test_record)) {
+				fprintf(stderr, "Unexpected record id: %" PRIu32 "\n", record.header.id);
+				abort();
+			}
+			memcpy(&record.seq, data + offset + sizeof(record.header), sizeof(record.seq));
+			if (record.seq <= last_seq[record.header.id]) {
+				fprintf(stderr, "Unexpected sequence number: %" PRIu64 "\n", record.seq);
+				abort();
+			}
+			last_seq[record.header.id] = record.seq;
+			nr_read++;
+		}
+		offset += record.header.size;
+	}
+}
+
+/* Consume all complete sub-buffers. Returns the number consumed. */
+static
+int consume(const struct side_ring_buffer_header *header)
+{
+	uint32_t cpu;
+	int nr = 0;
+
+	for (cpu = 0; cpu < header->nr_cpus; cpu++) {
+		struct side_ring_buffer_cpu *cpu_buf = side_ring_buffer_get_cpu(header, cpu);
+		uintptr_t pos = __atomic_load_n(&cpu_buf->read_pos, __ATOMIC_RELAXED);
+
+		while (side_ring_buffer_subbuf_complete(header, cpu_buf, pos)) {
+			check_subbuf(header, side_ring_buffer_subbuf_data(header, cpu_buf, pos));
+			side_ring_buffer_subbuf_release(header, cpu_buf, pos);
+			pos += header->subbuf_size;
+			nr++;
+		}
+	}
+	return nr;
+}
+
+static
+void print_help(void)
+{
+	printf("Invoke with command line arguments:\n");
+	printf("	-d <seconds> (test duration in seconds)\n");
+	printf("	-w <nr_writers> (number of writers threads)\n");
+}
+
+static
+int parse_cmd_line(int argc, const char **argv)
+{
+	const char *arg = NULL;
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+
+		switch (arg[0]) {
+		case '-':
+			switch (arg[1]) {
+			case '\0':
+				goto error;
+			case 'd':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				duration_s = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'w':
+				if (i == argc - 1)
+					goto error_extra_arg;
+				nr_writer_threads = atoi(argv[i + 1]);
+				i++;
+				break;
+			case 'h':
+				print_help();
+				ret = 1;
+				break;
+			}
+			break;
+		default:
+			goto error;
+		}
+
+	}
+	return ret;
+
+error:
+	fprintf(stderr, "Unknown command line option '%s'\n", arg);
+	return -1;
+error_extra_arg:
+	fprintf(stderr, "Command line option '%s' requires an extra argument\n", arg);
+	return -1;
+}
+
+int main(int argc, const char **argv)
+{
+	struct side_ring_buffer_config config = {
+		.mode = SIDE_RING_BUFFER_MODE_DISCARD,
+		.nr_subbufs = 4,
+		.subbuf_size = 4096,
+		.path = NULL,
+	};
+	const struct side_ring_buffer_header *header;
+	uint64_t write_tot = 0, lost_tot = 0;
+	struct thread_ctx *writer_ctx;
+	uint32_t cpu;
+	int i, ret;
+
+	ret = parse_cmd_line(argc, argv);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		return 0;
+
+	rb = side_ring_buffer_create(&config);
+	if (!rb)
+		abort();
+	header = side_ring_buffer_get_header(rb);
+	writer_ctx = calloc(nr_writer_threads, sizeof(struct thread_ctx));
+	if (!writer_ctx)
+		abort();
+	last_seq = calloc(nr_writer_threads, sizeof(uint64_t));
+	if (!last_seq)
+		abort();
+
+	for (i = 0; i < nr_writer_threads; i++) {
+		writer_ctx[i].id = i;
+		ret = pthread_create(&writer_ctx[i].thread_id, NULL, test_writer_thread, &writer_ctx[i]);
+		if (ret) {
+			errno = ret;
+			perror("pthread_create");
+			abort();
+		}
+	}
+
+	start_test = 1;
+
+	for (i = 0; i < duration_s * 1000; i++) {
+		if (!consume(header))
+			(void) usleep(1000);
+	}
+
+	stop_test = 1;
+
+	for (i = 0; i < nr_writer_threads; i++) {
+		void *res;
+
+		ret = pthread_join(writer_ctx[i].thread_id, &res);
+		if (ret) {
+			errno = ret;
+			perror("pthread_join");
+			abort();
+		}
+		write_tot += writer_ctx[i].count;
+	}
+	side_ring_buffer_flush(rb);
+	(void) consume(header);
+	for (cpu = 0; cpu < header->nr_cpus; cpu++)
+		lost_tot += side_ring_buffer_get_cpu(header, cpu)->lost;
+	printf("Summary: duration: %d s, nr_writer_threads: %d, writes: %" PRIu64 ", reads: %" PRIu64 ", lost: %" PRIu64 "\n",
+		duration_s, nr_writer_threads, write_tot, nr_read, lost_tot);
+	if (nr_read + lost_tot != write_tot) {
+		fprintf(stderr, "Records missing\n");
+		abort();
+	}
+	free(last_seq);
+	free(writer_ctx);
+	side_ring_buffer_destroy(rb);
+	return 0;
+}
@@ -0,0 +1,47 @@
+// SPDX-FileCopyrightText: 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+//
+// SPDX-License-Identifier: MIT
+
+#if __cplusplus >= 201703L
+
+#include <stdint.h>
+#include <side/instrumentation-cxx-api.h>
+
+enum class my_state : uint8_t {
+	IDLE,
+	RUNNING,
+};
+
+side_cxx_static_event(my_provider_event, "myprovider", "myevent", SIDE_LOGLEVEL_DEBUG,
+	libside::field<uint32_t>("id"),
+	libside::field<int64_t>("delta"),
+	libside::field<bool>("flag"),
+	libside::field<my_state>("state"),
+	libside::field<double>("ratio"),
+	libside::field<const char *>("name"),
+	libside::field<void *>("ptr"));
+
+side_cxx_static_event(my_provider_event_nofield, "myprovider", "myevent_nofield",
+	SIDE_LOGLEVEL_DEBUG);
+
+static_assert(side_cxx_fields__my_provider_event.nr_fields == 7,
+	"Unexpected number of fields");
+
+int main()
+{
+	int v = 0;
+
+	side_cxx_event(my_provider_event, 42, -3, true, my_state::RUNNING, 0.5,
+		"hello", &v);
+	side_cxx_event(my_provider_event_nofield);
+	return 0;
+}
+
+#else
+
+int main()
+{
+	return 0;
+}
+
+#endif
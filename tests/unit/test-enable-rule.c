@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Enablement rules only unregister the callbacks they registered, and
+ * leave the registrations of the same callback tuple made explicitly
+ * before the rule.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <side/trace.h>
+
+#include "tap.h"
+
+#define NR_TESTS	7
+
+side_static_event(manual_event, "enable_rule", "manual", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("value"))
+);
+
+side_static_event(rule_event, "enable_rule", "rule", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("value"))
+);
+
+static uint64_t key;
+static uint32_t nr_manual_calls, nr_rule_calls;
+
+static
+void test_call(const struct side_event_description *desc,
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		void *priv __attribute__((unused)), void *caller_addr __attribute__((unused)))
+{
+	if (desc == &manual_event)
+		nr_manual_calls++;
+	else
+		nr_rule_calls++;
+}
+
+static
+void emit_events(void)
+{
+	side_event(manual_event, side_arg_list(side_arg_u32(0)));
+	side_event(rule_event, side_arg_list(side_arg_u32(0)));
+}
+
+int main(void)
+{
+	struct side_tracer_enable_rule rule = {
+		.provider_pattern = "enable_rule",
+		.event_pattern = "*",
+		.loglevel = SIDE_LOGLEVEL_DEBUG,
+		.call = test_call,
+	};
+	struct side_tracer_enable_rule_handle *rule_handle;
+
+	plan_tests(NR_TESTS);
+	/* Keep the built-in text tracer callbacks from enabling the events. */
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	if (side_tracer_request_key(&key) ||
+	    side_tracer_key_loglevel_threshold_set(key, SIDE_LOGLEVEL_DEBUG))
+		abort();
+	rule.key = key;
+
+	if (side_tracer_callback_register(&manual_event, test_call, NULL, key))
+		abort();
+	rule_handle = side_tracer_enable_rule_register(&rule);
+	ok(rule_handle != NULL, "rule registers over an explicit registration");
+	ok(side_event_enabled(rule_event), "rule enables the matching event");
+	emit_events();
+	ok(nr_manual_calls == 1 && nr_rule_calls == 1, "callback called once per event");
+
+	side_tracer_enable_rule_unregister(rule_handle);
+	ok(!side_event_enabled(rule_event), "rule unregistration disables the event it enabled");
+	ok(side_event_enabled(manual_event), "explicit registration survives the rule");
+	emit_events();
+	ok(nr_manual_calls == 2 && nr_rule_calls == 1, "explicit callback still called");
+	ok(side_tracer_callback_unregister(&manual_event, test_call, NULL, key) == SIDE_ERROR_OK,
+		"explicit registration unregisters");
+	return exit_status();
+}
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Callback filters: precedence and short-circuit jumps of the compiled
+ * operations, integer, bitfield and string comparisons of stack-copy
+ * and gather fields, and rejected expressions.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <side/trace.h>
+
+#include "../../src/filter.h"
+#include "tap.h"
+
+#define NR_TESTS	55
+
+struct gather {
+	uint32_t value;
+	uint16_t bits;
+	const char *name;
+};
+
+static side_define_struct(gather_struct,
+	side_field_list(
+		side_field_gather_unsigned_integer("value", offsetof(struct gather, value),
+			side_struct_field_sizeof(struct gather, value), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+side_static_event(filter_event, "filter", "event", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_u32("a"),
+		side_field_u32("b"),
+		side_field_u32("c"),
+		side_field_s32("s"),
+		side_field_u64("u"),
+		side_field_string("name"),
+		side_field_gather_unsigned_integer("gvalue", offsetof(struct gather, value),
+			side_struct_field_sizeof(struct gather, value), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		/* Signed 4-bit field in bits 4 to 7. */
+		side_field_gather_signed_integer("gbits", offsetof(struct gather, bits),
+			side_struct_field_sizeof(struct gather, bits), 4, 4,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_string("gname", offsetof(struct gather, name),
+			SIDE_TYPE_GATHER_ACCESS_POINTER),
+		side_field_gather_struct("gstruct", gather_struct, 0, sizeof(struct gather),
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+struct values {
+	uint32_t a, b, c;
+	int32_t s;
+	uint64_t u;
+	const char *name;
+	struct gather gather;
+};
+
+static uint64_t key;
+static int nr_calls;
+
+static
+void test_call(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		void *priv __attribute__((unused)), void *caller_addr __attribute__((unused)))
+{
+	nr_calls++;
+}
+
+static
+void emit(const struct values *v)
+{
+	side_event(filter_event,
+		side_arg_list(
+			side_arg_u32(v->a),
+			side_arg_u32(v->b),
+			side_arg_u32(v->c),
+			side_arg_s32(v->s),
+			side_arg_u64(v->u),
+			side_arg_string(v->name),
+			side_arg_gather_integer(&v->gather),
+			side_arg_gather_integer(&v->gather),
+			side_arg_gather_string(&v->gather),
+			side_arg_gather_struct(&v->gather),
+		)
+	);
+}
+
+/* Returns 1 if the event matches the filter, 0 if not, -1 on error. */
+static
+int match(const char *expr, const struct values *v)
+{
+	struct side_filter *filter;
+
+	if (side_filter_compile(&filter_event, expr, &filter))
+		return -1;
+	if (side_tracer_callback_filter_register(&filter_event, test_call, NULL, key, filter))
+		abort();
+	nr_calls = 0;
+	emit(v);
+	if (side_tracer_callback_unregister(&filter_event, test_call, NULL, key))
+		abort();
+	side_filter_destroy(filter);
+	return nr_calls;
+}
+
+static
+bool rejected(const char *expr)
+{
+	struct side_filter *filter = NULL;
+
+	if (side_filter_compile(&filter_event, expr, &filter) == SIDE_ERROR_INVAL)
+		return filter == NULL;
+	side_filter_destroy(filter);
+	return false;
+}
+
+/* Parenthesize the comparison nesting times. */
+static
+char *nested(int nesting)
+{
+	char *expr = (char *) malloc(2 * nesting + 7);
+	int i;
+
+	if (!expr)
+		abort();
+	for (i = 0; i < nesting; i++)
+		expr[i] = '(';
+	strcpy(expr + nesting, "a == 1");
+	for (i = 0; i < nesting; i++)
+		strcat(expr, ")");
+	return expr;
+}
+
+static
+void test_precedence(void)
+{
+	struct values v = { .name = "", .gather = { .name = "" } };
+	struct side_filter *filter;
+
+	/* && binds tighter than ||. */
+	v.a = 0; v.b = 1; v.c = 1;
+	ok(match("a && b || c", &v) == 1, "a && b || c is (a && b) || c");
+	v.a = 1; v.b = 0; v.c = 0;
+	ok(match("a || b && c", &v) == 1, "a || b && c is a || (b && c)");
+	ok(match("(a || b) && c", &v) == 0, "parentheses override precedence");
+	v.a = 1; v.b = 1;
+	ok(match("!(a && b)", &v) == 0, "negation of a parenthesized expression");
+	v.b = 0;
+	ok(match("!(a && b)", &v) == 1, "negation of a false expression");
+	ok(match("!a || !!a", &v) == 1, "repeated negation");
+	ok(match("!(a == 1) && c", &v) == 0, "negation binds tighter than &&");
+
+	ok(!side_filter_compile(&filter_event, "a && b || c", &filter), "a && b || c compiles");
+	ok(filter->nr_ops == 5 &&
+		filter->ops[1].opcode == SIDE_FILTER_OP_JUMP_FALSE && filter->ops[1].arg_index == 3 &&
+		filter->ops[3].opcode == SIDE_FILTER_OP_JUMP_TRUE && filter->ops[3].arg_index == 5,
+		"&& jumps to the || operator, || jumps to the end");
+	side_filter_destroy(filter);
+	ok(!side_filter_compile(&filter_event, "a || b && c", &filter), "a || b && c compiles");
+	ok(filter->nr_ops == 5 &&
+		filter->ops[1].opcode == SIDE_FILTER_OP_JUMP_TRUE && filter->ops[1].arg_index == 5 &&
+		filter->ops[3].opcode == SIDE_FILTER_OP_JUMP_FALSE && filter->ops[3].arg_index == 5,
+		"|| and && jump to the end");
+	side_filter_destroy(filter);
+
+	/* The left operand decides the result. */
+	v.a = 0; v.b = 1;
+	ok(match("a && b", &v) == 0, "&& short-circuits on false");
+	v.a = 1; v.b = 0;
+	ok(match("a || b", &v) == 1, "|| short-circuits on true");
+	v.a = 0; v.b = 0; v.c = 1;
+	ok(match("a && b || a && b || c", &v) == 1, "chained || reaches its last operand");
+}
+
+static
+void test_integers(void)
+{
+	struct values v = { .name = "", .gather = { .name = "" } };
+
+	v.a = 11;
+	ok(match("a == 11 && a != 10 && a > 10 && a >= 11 && a < 12 && a <= 11", &v) == 1,
+		"unsigned comparisons");
+	ok(match("10 < a && 11 >= a", &v) == 1, "literal on the left of the comparison");
+	ok(match("a == 0xb && a == 013", &v) == 1, "hexadecimal and octal literals");
+	v.s = -5;
+	ok(match("s < 0 && s > -10 && s == -5 && s >= -5", &v) == 1, "signed comparisons");
+	ok(match("s < -10 || s > 0", &v) == 0, "signed comparisons are not unsigned");
+	v.s = INT32_MIN;
+	ok(match("s == -2147483648", &v) == 1, "signed minimum");
+	v.u = UINT64_MAX;
+	ok(match("u == 18446744073709551615 && u > 0", &v) == 1, "unsigned maximum");
+	v.a = 0;
+	ok(match("a", &v) == 0, "zero field alone is false");
+	v.a = 2;
+	ok(match("a", &v) == 1, "non-zero field alone is true");
+	ok(match("a == true", &v) == 0 && match("a != false", &v) == 1, "boolean keywords");
+
+	v.gather.value = 4096;
+	ok(match("gvalue == 4096 && gvalue > 4095", &v) == 1, "gather integer");
+	v.gather.bits = 0xF0;
+	ok(match("gbits == -1 && gbits < 0", &v) == 1, "negative signed bitfield");
+	v.gather.bits = 0x7F;
+	ok(match("gbits == 7", &v) == 1, "bitfield ignores the surrounding bits");
+	v.gather.bits = 0x80;
+	ok(match("gbits == -8", &v) == 1, "bitfield sign bit");
+}
+
+static
+void test_strings(void)
+{
+	struct values v = { .name = "foo", .gather = { .name = "bar" } };
+
+	ok(match("name == \"foo\" && name != \"fo\"", &v) == 1, "string == and !=");
+	ok(match("name == \"foobar\"", &v) == 0, "string literal longer than the field");
+	ok(match("\"foo\" == name", &v) == 1, "string literal on the left");
+	ok(match("gname == \"bar\" && gname != \"foo\"", &v) == 1, "gather string");
+	v.name = "a\"b";
+	ok(match("name == \"a\\\"b\"", &v) == 1, "escaped string literal");
+	v.name = "";
+	ok(match("name == \"\" && !(name != \"\")", &v) == 1, "empty string");
+}
+
+static
+void test_rejected(void)
+{
+	char *expr;
+
+	ok(rejected("nosuch == 1"), "unknown field");
+	ok(rejected("a == nosuch"), "unknown field as literal");
+	ok(rejected("a == 12abc"), "malformed integer literal");
+	ok(rejected("a == 0x"), "integer literal without digits");
+	ok(rejected("a == -"), "lone minus sign");
+	ok(rejected("a == 18446744073709551616"), "integer literal overflow");
+	ok(rejected("a == -1"), "negative literal for an unsigned field");
+	ok(rejected("s == 9223372036854775808"), "signed literal overflow");
+	ok(rejected("name == \"foo"), "unterminated string literal");
+	ok(rejected("name < \"foo\""), "string ordering");
+	ok(rejected("name == 1"), "string field compared to an integer");
+	ok(rejected("a == \"foo\""), "integer field compared to a string");
+	ok(rejected("a == b"), "comparison of two fields");
+	ok(rejected("1 == 1"), "comparison of two literals");
+	ok(rejected("gstruct == 1"), "struct field");
+	ok(rejected("(a == 1"), "unbalanced parenthesis");
+	ok(rejected("a == 1)"), "trailing characters");
+	ok(rejected("a &&"), "missing operand");
+	ok(rejected(""), "empty expression");
+	expr = nested(31);
+	ok(!rejected(expr), "nesting at the limit");
+	free(expr);
+	expr = nested(32);
+	ok(rejected(expr), "nesting over the limit");
+	free(expr);
+}
+
+int main(void)
+{
+	plan_tests(NR_TESTS);
+	/* Keep the built-in text tracer callbacks from enabling the event. */
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	if (side_tracer_request_key(&key) ||
+	    side_tracer_key_loglevel_threshold_set(key, SIDE_LOGLEVEL_DEBUG))
+		abort();
+	test_precedence();
+	test_integers();
+	test_strings();
+	test_rejected();
+	return exit_status();
+}
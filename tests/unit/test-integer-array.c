@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Compare the output of each vector kernel of the integer array batch
+ * operations supported by the CPU, completed by the scalar code for
+ * the elements it leaves, with the scalar code alone: for every element
+ * size, counts covering the vector tails, signed and unsigned
+ * bitfields, and in-place conversion.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/integer-array.c"
+#include "tap.h"
+
+#define MAX_COUNT	67		/* Over two AVX2 vectors of bytes. */
+#define BUF_LEN		(MAX_COUNT * 8 + 1)
+
+struct bswap_impl {
+	const char *name;
+	bswap_kernel kernel;		/* NULL for the dispatch. */
+	bool supported;
+};
+
+struct extract_bits_impl {
+	const char *name;
+	extract_bits_kernel kernel;	/* NULL for the dispatch. */
+	bool supported;
+};
+
+/* Bitfields as (offset_bits, len_bits) within each element size. */
+struct bitfield {
+	unsigned int offset_bits;
+	unsigned int len_bits;
+};
+
+static const unsigned int sizes[] = { 1, 2, 4, 8 };
+
+static const struct bitfield bitfields[] = {
+	{ 0, 1 }, { 0, 3 }, { 1, 1 }, { 2, 5 }, { 3, 4 }, { 0, 7 }, { 1, 7 }, { 0, 8 },
+	{ 4, 9 }, { 0, 15 }, { 0, 16 }, { 7, 17 }, { 1, 31 }, { 0, 32 }, { 5, 23 },
+	{ 33, 20 }, { 0, 63 }, { 1, 63 }, { 63, 1 }, { 0, 64 },
+};
+
+static char src_buf[BUF_LEN], expected[BUF_LEN], result[BUF_LEN];
+
+/* Deterministic bytes with both values of every bit. */
+static
+void fill(char *buf, size_t len, unsigned int seed)
+{
+	uint32_t x = 2463534242U + seed;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = (char) x;
+	}
+}
+
+static
+void run_bswap(const struct bswap_impl *impl, char *dst, const char *src, size_t count,
+		unsigned int size)
+{
+	size_t done;
+
+	if (!impl->kernel) {
+		side_integer_array_bswap(dst, src, count, size);
+		return;
+	}
+	done = impl->kernel(dst, src, count, size);
+	if (done > count)
+		abort();
+	bswap_scalar(dst + done * size, src + done * size, count - done, size);
+}
+
+static
+void run_extract_bits(const struct extract_bits_impl *impl, char *dst, const char *src,
+		size_t count, unsigned int size, const struct bitfield *bitfield, bool is_signed)
+{
+	uint64_t mask = bits_mask(bitfield->len_bits), sign = 0;
+	size_t done;
+
+	if (!impl->kernel) {
+		side_integer_array_extract_bits(dst, src, count, size,
+				bitfield->offset_bits, bitfield->len_bits, is_signed);
+		return;
+	}
+	if (is_signed)
+		sign = 1ULL << (bitfield->len_bits - 1);
+	done = impl->kernel(dst, src, count, size, bitfield->offset_bits, mask, sign);
+	if (done > count)
+		abort();
+	extract_bits_scalar(dst + done * size, src + done * size, count - done, size,
+		bitfield->offset_bits, mask, sign);
+}
+
+/*
+ * Returns the number of mismatches. The source starts at an odd address
+ * to exercise unaligned loads, and bytes past the count must be left
+ * untouched.
+ */
+static
+unsigned int check_bswap(const struct bswap_impl *impl, bool in_place)
+{
+	unsigned int nr_errors = 0, i;
+	size_t count;
+
+	for (i = 0; i < SIDE_ARRAY_SIZE(sizes); i++) {
+		unsigned int size = sizes[i];
+
+		for (count = 0; count <= MAX_COUNT; count++) {
+			const char *src = src_buf + 1;
+
+			fill(src_buf, BUF_LEN, size + count);
+			memcpy(expected, src_buf, BUF_LEN);
+			bswap_scalar(expected + 1, src, count, size);
+			memcpy(result, src_buf, BUF_LEN);
+			if (in_place)
+				run_bswap(impl, result + 1, result + 1, count, size);
+			else
+				run_bswap(impl, result + 1, src, count, size);
+			if (memcmp(expected, result, BUF_LEN)) {
+				diag("%s: size %u, count %zu", impl->name, size, count);
+				nr_errors++;
+			}
+		}
+	}
+	return nr_errors;
+}
+
+static
+unsigned int check_extract_bits(const struct extract_bits_impl *impl, bool in_place)
+{
+	unsigned int nr_errors = 0, i, j;
+	size_t count;
+
+	for (i = 0; i < SIDE_ARRAY_SIZE(sizes); i++) {
+		unsigned int size = sizes[i];
+
+		for (j = 0; j < SIDE_ARRAY_SIZE(bitfields); j++) {
+			const struct bitfield *bitfield = &bitfields[j];
+			uint64_t mask = bits_mask(bitfield->len_bits);
+			int is_signed;
+
+			if (bitfield->offset_bits + bitfield->len_bits > size * 8)
+				continue;
+			for (is_signed = 0; is_signed < 2; is_signed++) {
+				for (count = 0; count <= MAX_COUNT; count++) {
+					const char *src = src_buf + 1;
+
+					fill(src_buf, BUF_LEN, size + j + count);
+					memcpy(expected, src_buf, BUF_LEN);
+					extract_bits_scalar(expected + 1, src, count, size,
+						bitfield->offset_bits, mask,
+						is_signed ? 1ULL << (bitfield->len_bits - 1) : 0);
+					memcpy(result, src_buf, BUF_LEN);
+					if (in_place)
+						run_extract_bits(impl, result + 1, result + 1, count, size,
+							bitfield, is_signed);
+					else
+						run_extract_bits(impl, result + 1, src, count, size,
+							bitfield, is_signed);
+					if (memcmp(expected, result, BUF_LEN)) {
+						diag("%s: size %u, bits %u:%u, %s, count %zu", impl->name,
+							size, bitfield->offset_bits, bitfield->len_bits,
+							is_signed ? "signed" : "unsigned", count);
+						nr_errors++;
+					}
+				}
+			}
+		}
+	}
+	return nr_errors;
+}
+
+int main(void)
+{
+	struct bswap_impl bswap_impls[] = {
+		{ "bswap dispatch", NULL, true },
+#if defined(__x86_64__)
+		{ "bswap_ssse3", bswap_ssse3, __builtin_cpu_supports("ssse3") },
+		{ "bswap_avx2", bswap_avx2, __builtin_cpu_supports("avx2") },
+#elif defined(__aarch64__)
+		{ "bswap_neon", bswap_neon, true },
+#endif
+	};
+	struct extract_bits_impl extract_bits_impls[] = {
+		{ "extract_bits dispatch", NULL, true },
+#if defined(__x86_64__)
+		{ "extract_bits_sse2", extract_bits_sse2, true },
+		{ "extract_bits_avx2", extract_bits_avx2, __builtin_cpu_supports("avx2") },
+#elif defined(__aarch64__)
+		{ "extract_bits_neon", extract_bits_neon, true },
+#endif
+	};
+	unsigned int i;
+
+	plan_tests(2 * (SIDE_ARRAY_SIZE(bswap_impls) + SIDE_ARRAY_SIZE(extract_bits_impls)));
+	for (i = 0; i < SIDE_ARRAY_SIZE(bswap_impls); i++) {
+		const struct bswap_impl *impl = &bswap_impls[i];
+
+		skip_start(!impl->supported, 2, "%s not supported by the CPU", impl->name);
+		ok(!check_bswap(impl, false), "%s matches the scalar code", impl->name);
+		ok(!check_bswap(impl, true), "%s in place matches the scalar code", impl->name);
+		skip_end();
+	}
+	for (i = 0; i < SIDE_ARRAY_SIZE(extract_bits_impls); i++) {
+		const struct extract_bits_impl *impl = &extract_bits_impls[i];
+
+		skip_start(!impl->supported, 2, "%s not supported by the CPU", impl->name);
+		ok(!check_extract_bits(impl, false), "%s matches the scalar code", impl->name);
+		ok(!check_extract_bits(impl, true), "%s in place matches the scalar code", impl->name);
+		skip_end();
+	}
+	return exit_status();
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * Static key sites follow the enabled state of their event while
+ * threads execute them, and sites patched into NOPs do not observe the
+ * enabled state bits set from outside of libside (ptrace). Traps which
+ * are not caused by patching reach the previous SIGTRAP action.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <side/trace.h>
+
+#include "tap.h"
+
+#define NR_TESTS		9
+#define NR_THREADS		2
+#define NR_TOGGLES		200
+
+#define JUMP_OPCODE		0xe9
+#define NOP_OPCODE		0x0f
+
+/* Set by debuggers in the enabled state, see side.c. */
+#define ENABLED_PTRACE_MASK	((uintptr_t) 1 << (SIDE_BITS_PER_LONG - 2))
+
+side_static_event(jump_label_event, "jump_label", "event", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(side_field_u32("value"))
+);
+
+static uint64_t key;
+static uint64_t nr_calls;
+static volatile int stop_test;
+static volatile sig_atomic_t nr_traps;
+
+static
+void test_call(const struct side_event_description *desc __attribute__((unused)),
+		const struct side_arg_vec *side_arg_vec __attribute__((unused)),
+		void *priv __attribute__((unused)), void *caller_addr __attribute__((unused)))
+{
+	__atomic_add_fetch(&nr_calls, 1, __ATOMIC_RELAXED);
+}
+
+static
+void *test_thread(void *arg __attribute__((unused)))
+{
+	uint32_t i = 0;
+
+	while (!__atomic_load_n(&stop_test, __ATOMIC_RELAXED))
+		side_event(jump_label_event, side_arg_list(side_arg_u32(i++)));
+	return NULL;
+}
+
+/* Returns the first opcode byte of the event site, or 0 if not found. */
+static
+uint8_t site_opcode(void)
+{
+	struct side_jump_entry *entry;
+
+	for (entry = __start_side_jump_entry; entry < __stop_side_jump_entry; entry++) {
+		struct side_event_state **key_ref = (struct side_event_state **) (uintptr_t) entry->key_ref;
+
+		if (*key_ref == &side_event_state__jump_label_event.parent)
+			return *(volatile uint8_t *) (uintptr_t) entry->code;
+	}
+	return 0;
+}
+
+static
+bool event_enabled(void)
+{
+	return side_event_enabled(jump_label_event);
+}
+
+static
+void test_sigtrap(int sig __attribute__((unused)))
+{
+	nr_traps++;
+}
+
+/* A raised SIGTRAP terminates a process with the default action. */
+static
+bool raise_terminates(void)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		abort();
+	if (!pid) {
+		(void) raise(SIGTRAP);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid)
+		abort();
+	return WIFSIGNALED(status) && WTERMSIG(status) == SIGTRAP;
+}
+
+int main(void)
+{
+	pthread_t threads[NR_THREADS];
+	bool patched, enabled;
+	int i;
+
+	plan_tests(NR_TESTS);
+	/* Keep the built-in text tracer callbacks from enabling the event. */
+	if (side_loglevel_threshold_set(SIDE_LOGLEVEL_EMERG))
+		abort();
+	if (side_tracer_request_key(&key) ||
+	    side_tracer_key_loglevel_threshold_set(key, SIDE_LOGLEVEL_DEBUG))
+		abort();
+
+	patched = site_opcode() == NOP_OPCODE;
+	ok(patched || site_opcode() == JUMP_OPCODE, "disabled event site is a NOP or an unpatched jump");
+	if (!patched)
+		diag("static key patching unavailable, sites are left as jumps");
+
+	/* Documented limitation: patched sites miss the ptrace bit. */
+	__atomic_or_fetch(&side_event_state__jump_label_event.enabled, ENABLED_PTRACE_MASK,
+			__ATOMIC_RELAXED);
+	enabled = event_enabled();
+	__atomic_and_fetch(&side_event_state__jump_label_event.enabled, ~ENABLED_PTRACE_MASK,
+			__ATOMIC_RELAXED);
+	ok(enabled == !patched, "ptrace bit is only observed by unpatched sites");
+
+	ok(raise_terminates(), "raised SIGTRAP keeps the default action");
+	{
+		struct sigaction sa;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = test_sigtrap;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGTRAP, &sa, NULL))
+			abort();
+	}
+	/* Patching installs the libside handler back over the application one. */
+	if (side_tracer_callback_register(&jump_label_event, test_call, NULL, key) ||
+	    side_tracer_callback_unregister(&jump_label_event, test_call, NULL, key))
+		abort();
+	(void) raise(SIGTRAP);
+	(void) raise(SIGTRAP);
+	ok(nr_traps == 2, "raised SIGTRAP reaches the application handler");
+
+	for (i = 0; i < NR_THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, test_thread, NULL))
+			abort();
+	}
+	for (i = 0; i < NR_TOGGLES; i++) {
+		if (side_tracer_callback_register(&jump_label_event, test_call, NULL, key))
+			abort();
+		if (side_tracer_callback_unregister(&jump_label_event, test_call, NULL, key))
+			abort();
+	}
+	ok(site_opcode() == (patched ? NOP_OPCODE : JUMP_OPCODE), "site is restored after toggling under load");
+	ok(nr_traps == 2, "patching traps do not reach the application handler");
+
+	if (side_tracer_callback_register(&jump_label_event, test_call, NULL, key))
+		abort();
+	ok(site_opcode() == JUMP_OPCODE, "enabled event site is a jump");
+	__atomic_store_n(&nr_calls, 0, __ATOMIC_RELAXED);
+	while (!__atomic_load_n(&nr_calls, __ATOMIC_RELAXED))
+		sched_yield();
+	pass("enabled event reaches the callback");
+	__atomic_store_n(&stop_test, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < NR_THREADS; i++) {
+		if (pthread_join(threads[i], NULL))
+			abort();
+	}
+	if (side_tracer_callback_unregister(&jump_label_event, test_call, NULL, key))
+		abort();
+	ok(event_enabled() == false, "disabled event is not enabled");
+	return exit_status();
+}
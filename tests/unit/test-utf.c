@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright 2024 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ */
+
+/*
+ * UTF-16 and UTF-32 string scanning and transcoding to UTF-8: strings
+ * at every alignment and ending at a page boundary, both byte orders,
+ * surrogate pairs, invalid code units, and non-ASCII code units around
+ * the boundaries where transcoding returns to the vector path. The
+ * test includes utf.c to reach the hidden functions.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../../src/utf.c"
+#include "tap.h"
+
+#define NR_TESTS	26
+
+#define MAX_UNITS	40
+#define MAX_OFFSET	32
+
+static const uint8_t unit_sizes[] = { 2, 4 };
+
+static
+void store_unit(char *p, uint32_t c, uint8_t unit_size, bool swap)
+{
+	if (unit_size == 2) {
+		uint16_t v = swap ? side_bswap_16((uint16_t) c) : (uint16_t) c;
+
+		memcpy(p, &v, 2);
+	} else {
+		uint32_t v = swap ? side_bswap_32(c) : c;
+
+		memcpy(p, &v, 4);
+	}
+}
+
+static
+enum side_type_label_byte_order byte_order(bool swap)
+{
+	if (!swap)
+		return SIDE_TYPE_BYTE_ORDER_HOST;
+	return SIDE_TYPE_BYTE_ORDER_HOST == SIDE_TYPE_BYTE_ORDER_LE ?
+		SIDE_TYPE_BYTE_ORDER_BE : SIDE_TYPE_BYTE_ORDER_LE;
+}
+
+/* Reference transcoder, one code unit at a time. */
+static
+size_t ref_to_utf8(char *dst, const uint32_t *units, size_t nr_units, uint8_t unit_size)
+{
+	char *d = dst;
+	size_t i = 0;
+
+	while (i < nr_units) {
+		uint32_t c = units[i++];
+
+		if (unit_size == 2 && c >= 0xD800 && c <= 0xDBFF && i < nr_units &&
+		    units[i] >= 0xDC00 && units[i] <= 0xDFFF)
+			c = 0x10000 + ((c - 0xD800) << 10) + (units[i++] - 0xDC00);
+		else if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+			c = 0xFFFD;
+		d = put_utf8(d, c);
+	}
+	return d - dst;
+}
+
+/* Transcode units stored at an odd or even address in the byte order. */
+static
+bool check_transcode(const uint32_t *units, size_t nr_units, uint8_t unit_size, bool swap,
+		size_t offset)
+{
+	char src[(MAX_UNITS + 1) * 4 + MAX_OFFSET], expected[MAX_UNITS * 4], result[MAX_UNITS * 4 + 1];
+	size_t expected_len, len, i;
+
+	for (i = 0; i < nr_units; i++)
+		store_unit(src + offset + i * unit_size, units[i], unit_size, swap);
+	expected_len = ref_to_utf8(expected, units, nr_units, unit_size);
+	memset(result, 0x55, sizeof(result));
+	len = side_utf_to_utf8(result, src + offset, nr_units, unit_size, byte_order(swap));
+	if (len > SIDE_UTF8_MAX_SIZE(nr_units, unit_size) || result[len] != 0x55)
+		return false;
+	return len == expected_len && !memcmp(result, expected, len);
+}
+
+/* Expected UTF-8 of a few code units, in both byte orders. */
+static
+bool check_utf8(const uint32_t *units, size_t nr_units, uint8_t unit_size, const char *utf8)
+{
+	char result[MAX_UNITS * 4], src[MAX_UNITS * 4];
+	int swap;
+
+	for (swap = 0; swap < 2; swap++) {
+		size_t i, len;
+
+		for (i = 0; i < nr_units; i++)
+			store_unit(src + i * unit_size, units[i], unit_size, swap);
+		len = side_utf_to_utf8(result, src, nr_units, unit_size, byte_order(swap));
+		if (len != strlen(utf8) || memcmp(result, utf8, len))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Transcode ASCII strings with a code unit (or pair) placed at every
+ * position, in both byte orders and at both alignments.
+ */
+static
+bool check_positions(uint8_t unit_size, const uint32_t *insert, size_t nr_insert)
+{
+	uint32_t units[MAX_UNITS];
+	size_t nr_units, pos, i;
+	int swap;
+
+	for (nr_units = nr_insert; nr_units <= MAX_UNITS; nr_units++) {
+		for (pos = 0; pos + nr_insert <= nr_units; pos++) {
+			for (i = 0; i < nr_units; i++)
+				units[i] = 'a' + i % 26;
+			memcpy(&units[pos], insert, nr_insert * sizeof(uint32_t));
+			for (swap = 0; swap < 2; swap++) {
+				if (!check_transcode(units, nr_units, unit_size, swap, 0) ||
+				    !check_transcode(units, nr_units, unit_size, swap, 1)) {
+					diag("unit size %u, %zu units, position %zu, %s", unit_size,
+						nr_units, pos, swap ? "swapped" : "host");
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/* Strings of every length at every offset, aligned or not to the unit. */
+static
+bool check_strlen_offsets(uint8_t unit_size)
+{
+	char buf[(MAX_UNITS + 1) * 4 + MAX_OFFSET];
+	size_t offset, len, i;
+
+	for (offset = 0; offset < MAX_OFFSET; offset++) {
+		for (len = 0; len <= MAX_UNITS; len++) {
+			memset(buf, 0xFF, sizeof(buf));
+			for (i = 0; i < len; i++)
+				store_unit(buf + offset + i * unit_size, 0x100 + i, unit_size, false);
+			store_unit(buf + offset + len * unit_size, 0, unit_size, false);
+			if (side_utf_strlen(buf + offset, unit_size) != len) {
+				diag("unit size %u, offset %zu, length %zu", unit_size, offset, len);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Strings ending at the end of a page followed by an inaccessible
+ * page: the scan must not read past the page holding the terminator.
+ */
+static
+bool check_strlen_page_end(uint8_t unit_size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	bool success = true;
+	size_t len, offset;
+	char *map;
+
+	map = (char *) mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		abort();
+	if (mprotect(map + page_size, page_size, PROT_NONE))
+		abort();
+	memset(map, 0xFF, page_size);
+	for (len = 0; len <= MAX_UNITS && success; len++) {
+		/* Unit-aligned and unaligned ends of the terminator. */
+		for (offset = 0; offset < unit_size && success; offset += unit_size - 1) {
+			char *end = map + page_size - offset;
+			char *p = end - (len + 1) * unit_size;
+			size_t i;
+
+			for (i = 0; i < len; i++)
+				store_unit(p + i * unit_size, 'a', unit_size, false);
+			store_unit(p + len * unit_size, 0, unit_size, false);
+			if (side_utf_strlen(p, unit_size) != len) {
+				diag("unit size %u, length %zu, end offset %zu", unit_size, len, offset);
+				success = false;
+			}
+		}
+	}
+	(void) munmap(map, 2 * page_size);
+	return success;
+}
+
+int main(void)
+{
+	static const uint32_t pair[] = { 0xD83D, 0xDE00 };	/* U+1F600 */
+	static const uint32_t lone_high[] = { 0xD83D };
+	static const uint32_t lone_low[] = { 0xDE00 };
+	static const uint32_t reversed_pair[] = { 0xDE00, 0xD83D };
+	static const uint32_t two_byte[] = { 0xE9 };
+	static const uint32_t three_byte[] = { 0x20AC };
+	static const uint32_t astral[] = { 0x1F600 };
+	static const uint32_t out_of_range[] = { 0x110000 };
+	static const uint32_t surrogate_value[] = { 0xD800 };
+	unsigned int i;
+
+	plan_tests(NR_TESTS);
+	for (i = 0; i < SIDE_ARRAY_SIZE(unit_sizes); i++) {
+		uint8_t unit_size = unit_sizes[i];
+
+		ok(check_strlen_offsets(unit_size), "UTF-%u strlen at every offset", unit_size * 8);
+		ok(check_strlen_page_end(unit_size), "UTF-%u strlen ending at a page boundary",
+			unit_size * 8);
+		ok(check_positions(unit_size, two_byte, 1),
+			"UTF-%u two-byte code point at every position", unit_size * 8);
+		ok(check_positions(unit_size, three_byte, 1),
+			"UTF-%u three-byte code point at every position", unit_size * 8);
+	}
+
+	ok(check_utf8(pair, 2, 2, "\xF0\x9F\x98\x80"), "UTF-16 surrogate pair");
+	ok(check_utf8(lone_high, 1, 2, "\xEF\xBF\xBD"), "UTF-16 lone high surrogate at the end");
+	ok(check_utf8((const uint32_t []) { 0xD83D, 'a' }, 2, 2, "\xEF\xBF\xBD" "a"),
+		"UTF-16 high surrogate followed by a non-surrogate");
+	ok(check_utf8(lone_low, 1, 2, "\xEF\xBF\xBD"), "UTF-16 lone low surrogate");
+	ok(check_utf8(reversed_pair, 2, 2, "\xEF\xBF\xBD\xEF\xBF\xBD"), "UTF-16 reversed surrogate pair");
+	ok(check_positions(2, pair, 2), "UTF-16 surrogate pair at every position");
+	ok(check_positions(2, lone_high, 1), "UTF-16 lone high surrogate at every position");
+	ok(check_positions(2, lone_low, 1), "UTF-16 lone low surrogate at every position");
+	ok(check_positions(2, reversed_pair, 2), "UTF-16 reversed surrogate pair at every position");
+
+	ok(check_utf8(astral, 1, 4, "\xF0\x9F\x98\x80"), "UTF-32 supplementary code point");
+	ok(check_utf8((const uint32_t []) { 0x10FFFF }, 1, 4, "\xF4\x8F\xBF\xBF"), "UTF-32 maximum code point");
+	ok(check_utf8(out_of_range, 1, 4, "\xEF\xBF\xBD"), "UTF-32 code point above U+10FFFF");
+	ok(check_utf8((const uint32_t []) { 0x80000000 }, 1, 4, "\xEF\xBF\xBD"),
+		"UTF-32 code unit with the top bit set");
+	ok(check_utf8(surrogate_value, 1, 4, "\xEF\xBF\xBD"), "UTF-32 surrogate code point");
+	ok(check_positions(4, astral, 1), "UTF-32 supplementary code point at every position");
+	ok(check_positions(4, out_of_range, 1), "UTF-32 code point above U+10FFFF at every position");
+	ok(check_positions(4, surrogate_value, 1), "UTF-32 surrogate code point at every position");
+	ok(check_positions(4, (const uint32_t []) { 0x100 }, 1),
+		"UTF-32 code unit with a non-zero second byte at every position");
+	return exit_status();
+}
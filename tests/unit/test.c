@@ -181,6 +181,46 @@ void test_vla_visitor(void)
 	}
 }
 
+/* 1D array visitor writing elements in batches */
+static
+enum side_visitor_status test_batch_visitor(const struct side_tracer_visitor_ctx *tracer_ctx, struct app_visitor_ctx *ctx)
+{
+	const struct side_arg elems[] = {
+		side_visit_dynamic_arg(side_arg_u32, ctx->ptr[0]),
+		side_visit_dynamic_arg(side_arg_u32, ctx->ptr[1]),
+	};
+	const struct side_arg proto = side_visit_dynamic_arg(side_arg_u32, 0);
+
+	if (tracer_ctx->write_elems(tracer_ctx, elems, SIDE_ARRAY_SIZE(elems)) != SIDE_VISITOR_STATUS_OK)
+		return SIDE_VISITOR_STATUS_ERROR;
+	return tracer_ctx->write_scalars(tracer_ctx, &proto, &ctx->ptr[2],
+		sizeof(ctx->ptr[0]), ctx->length - 2);
+}
+
+side_define_static_vla_visitor(my_vla_visitor_batch,
+			side_elem(side_type_u32()), side_elem(side_type_u32()),
+			test_batch_visitor, struct app_visitor_ctx);
+
+side_static_event(my_provider_event_vla_visitor_batch, "myprovider", "myvlavisitbatch", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_vla_visitor("vlavisit", my_vla_visitor_batch),
+	)
+);
+
+static
+void test_vla_visitor_batch(void)
+{
+	if (side_event_enabled(my_provider_event_vla_visitor_batch)) {
+		struct app_visitor_ctx ctx = {
+			.ptr = testarray,
+			.length = SIDE_ARRAY_SIZE(testarray),
+		};
+		side_arg_define_vla_visitor(side_visitor, &ctx);
+		side_event_call(my_provider_event_vla_visitor_batch,
+			side_arg_list(side_arg_vla_visitor(side_visitor)));
+	}
+}
+
 /* 2D array visitor */
 
 struct app_visitor_2d_inner_ctx {
@@ -601,6 +641,34 @@ void test_dynamic_vla_with_visitor(void)
 	}
 }
 
+static
+enum side_visitor_status test_dynamic_vla_batch_visitor(const struct side_tracer_visitor_ctx *tracer_ctx, void *_ctx)
+{
+	struct app_dynamic_vla_visitor_ctx *ctx = (struct app_dynamic_vla_visitor_ctx *) _ctx;
+	const struct side_arg proto = side_visit_dynamic_arg(side_arg_dynamic_u32, 0);
+
+	/* Every other element. */
+	return tracer_ctx->write_scalars(tracer_ctx, &proto, ctx->ptr,
+		2 * sizeof(ctx->ptr[0]), ctx->length / 2);
+}
+
+static
+void test_dynamic_vla_with_batch_visitor(void)
+{
+	if (side_event_enabled(my_provider_event_dynamic_vla_visitor)) {
+		struct app_dynamic_vla_visitor_ctx ctx = {
+			.ptr = testarray_dynamic_vla,
+			.length = SIDE_ARRAY_SIZE(testarray_dynamic_vla),
+		};
+		side_arg_dynamic_define_vla_visitor(myvlavisitor, test_dynamic_vla_batch_visitor, &ctx);
+		side_event_call(my_provider_event_dynamic_vla_visitor,
+			side_arg_list(
+				side_arg_dynamic_vla_visitor(myvlavisitor)
+			)
+		);
+	}
+}
+
 side_static_event(my_provider_event_dynamic_struct_visitor,
 	"myprovider", "mydynamicstructvisitor", SIDE_LOGLEVEL_DEBUG,
 	side_field_list(
@@ -1472,6 +1540,63 @@ void test_struct_gather(void)
 	}
 }
 
+/* Whole event payload passed as a native structure. */
+struct testrecord {
+	uint64_t timestamp;
+	uint32_t cpu;
+	int32_t status;
+	uint16_t flags;
+	uint8_t kind;
+	uint8_t level;
+};
+
+static side_define_struct(mystructrecord,
+	side_field_list(
+		side_field_gather_unsigned_integer("timestamp", offsetof(struct testrecord, timestamp),
+			side_struct_field_sizeof(struct testrecord, timestamp), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("cpu", offsetof(struct testrecord, cpu),
+			side_struct_field_sizeof(struct testrecord, cpu), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_signed_integer("status", offsetof(struct testrecord, status),
+			side_struct_field_sizeof(struct testrecord, status), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("flags", offsetof(struct testrecord, flags),
+			side_struct_field_sizeof(struct testrecord, flags), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("kind", offsetof(struct testrecord, kind),
+			side_struct_field_sizeof(struct testrecord, kind), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+		side_field_gather_unsigned_integer("level", offsetof(struct testrecord, level),
+			side_struct_field_sizeof(struct testrecord, level), 0, 0,
+			SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+side_static_event(my_provider_event_record, "myprovider", "myeventrecord", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_gather_struct("record", mystructrecord, 0, sizeof(struct testrecord),
+				SIDE_TYPE_GATHER_ACCESS_DIRECT),
+	)
+);
+
+static
+void test_struct_gather_record(void)
+{
+	if (side_event_enabled(my_provider_event_record)) {
+		struct testrecord record = {
+			.timestamp = 1234567890,
+			.cpu = 3,
+			.status = -2,
+			.flags = 0x10,
+			.kind = 7,
+			.level = 1,
+		};
+
+		side_event_call(my_provider_event_record, side_arg_list(side_arg_gather_struct(&record)));
+	}
+}
+
 struct testnest2 {
 	uint8_t c;
 };
@@ -2362,6 +2487,59 @@ static void test_vla_of_struct(void)
 	}
 }
 
+/* Lazily evaluated fields */
+struct app_lazy_ctx {
+	const uint32_t *ptr;
+	uint32_t length;
+	char name[16];
+};
+
+static
+enum side_visitor_status test_lazy_sum(struct app_lazy_ctx *ctx, struct side_arg *value)
+{
+	uint32_t sum = 0, i;
+
+	for (i = 0; i < ctx->length; i++)
+		sum += ctx->ptr[i];
+	*value = (struct side_arg) side_visit_dynamic_arg(side_arg_u32, sum);
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+static
+enum side_visitor_status test_lazy_name(struct app_lazy_ctx *ctx, struct side_arg *value)
+{
+	snprintf(ctx->name, sizeof(ctx->name), "len-%u", ctx->length);
+	*value = (struct side_arg) side_visit_dynamic_arg(side_arg_string, ctx->name);
+	return SIDE_VISITOR_STATUS_OK;
+}
+
+side_define_static_lazy(my_lazy_sum, side_elem(side_type_u32()), test_lazy_sum, struct app_lazy_ctx);
+side_define_static_lazy(my_lazy_name, side_elem(side_type_string()), test_lazy_name, struct app_lazy_ctx);
+
+side_static_event(my_provider_event_lazy, "myprovider", "mylazy", SIDE_LOGLEVEL_DEBUG,
+	side_field_list(
+		side_field_lazy("sum", my_lazy_sum),
+		side_field_lazy("name", my_lazy_name),
+		side_field_s64("v"),
+	)
+);
+
+static
+void test_lazy(void)
+{
+	if (side_event_enabled(my_provider_event_lazy)) {
+		struct app_lazy_ctx ctx = {
+			.ptr = testarray,
+			.length = SIDE_ARRAY_SIZE(testarray),
+			.name = { 0 },
+		};
+		side_arg_define_lazy(sum, &ctx);
+		side_arg_define_lazy(name, &ctx);
+		side_event_call(my_provider_event_lazy,
+			side_arg_list(side_arg_lazy(sum), side_arg_lazy(name), side_arg_s64(42)));
+	}
+}
+
 int main()
 {
 	test_fields();
@@ -2371,6 +2549,7 @@ int main()
 	test_array();
 	test_vla();
 	test_vla_visitor();
+	test_vla_visitor_batch();
 	test_vla_visitor_2d();
 	test_dynamic_basic_type();
 	test_dynamic_vla();
@@ -2385,6 +2564,7 @@ int main()
 	test_bool();
 	test_dynamic_bool();
 	test_dynamic_vla_with_visitor();
+	test_dynamic_vla_with_batch_visitor();
 	test_dynamic_struct_with_visitor();
 	test_event_user_attribute();
 	test_field_user_attribute();
@@ -2400,6 +2580,7 @@ int main()
 	test_endian();
 	test_base();
 	test_struct_gather();
+	test_struct_gather_record();
 	test_struct_gather_nest_ptr();
 	test_struct_gather_float();
 	test_array_gather();
@@ -2418,5 +2599,6 @@ int main()
 	test_optional();
 	test_nested_struct();
 	test_vla_of_struct();
+	test_lazy();
 	return 0;
 }